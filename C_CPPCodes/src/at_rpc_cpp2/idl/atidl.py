@@ -0,0 +1,462 @@
+# atidl.py
+"""Code generator for .atidl schemas: typed AT methods (see include/typed_call.h).
+
+A schema names a service and its methods, one per line:
+
+    service calculator;
+    method add(a: f64, b: f64) -> f64;
+    method scale(values: list<f64>, factor: f64) -> list<f64>;
+
+Types: bool, i32, u32, i64, u64, f64, string, bytes and list<T> of any of them
+but bool. Lines starting with // are comments.
+
+For C++ it writes <service>.atidl.h: an <Method>Args struct per method with its
+binary encode / decode, a Service interface to implement, register_service()
+to hook it into a TypedRegistry and a blocking Client over RPCConnection.
+For Python it writes <service>_atidl.py with an encode_<method>() and
+decode_<method>_result() per method and a Client over atproto.Client.
+"""
+import argparse
+import keyword
+import os
+import re
+import sys
+
+SCALARS = {
+    # name: (C++ type, struct code, size)
+    "bool": ("bool", "?", 1),
+    "i32": ("int32_t", "i", 4),
+    "u32": ("uint32_t", "I", 4),
+    "i64": ("int64_t", "q", 8),
+    "u64": ("uint64_t", "Q", 8),
+    "f64": ("double", "d", 8),
+}
+BLOBS = {"string", "bytes"}
+
+IDENT = r"[A-Za-z_][A-Za-z0-9_]*"
+SERVICE_RE = re.compile(rf"^service\s+({IDENT})\s*;$")
+METHOD_RE = re.compile(rf"^method\s+({IDENT})\s*\((.*)\)\s*->\s*(.+?)\s*;$")
+ARG_RE = re.compile(rf"^({IDENT})\s*:\s*(.+)$")
+LIST_RE = re.compile(r"^list\s*<\s*(\w+)\s*>$")
+
+CPP_KEYWORDS = {
+    "auto", "bool", "break", "case", "char", "class", "const", "default", "delete", "do", "double", "else", "enum",
+    "explicit", "false", "float", "for", "if", "int", "long", "namespace", "new", "operator", "private", "public",
+    "return", "short", "signed", "sizeof", "static", "struct", "switch", "template", "this", "true", "typedef",
+    "union", "unsigned", "using", "virtual", "void", "while", "args", "in", "out", "result",
+}
+
+
+class SchemaError(Exception):
+    pass
+
+
+class Type:
+    def __init__(self, kind, element=None):
+        self.kind = kind        # a SCALARS key, "string", "bytes" or "list"
+        self.element = element  # element kind of a list
+
+    @staticmethod
+    def parse(text, where):
+        text = text.strip()
+        match = LIST_RE.match(text)
+        if match:
+            element = match.group(1)
+            if element == "bool":
+                raise SchemaError(f"{where}: list<bool> is not supported")
+            if element not in SCALARS and element not in BLOBS:
+                raise SchemaError(f"{where}: unknown list element type '{element}'")
+            return Type("list", element)
+        if text in SCALARS or text in BLOBS:
+            return Type(text)
+        raise SchemaError(f"{where}: unknown type '{text}'")
+
+    def spelling(self):
+        return f"list<{self.element}>" if self.kind == "list" else self.kind
+
+    # --- C++ ---
+    @staticmethod
+    def _cpp_of(kind):
+        return "std::string" if kind in BLOBS else SCALARS[kind][0]
+
+    def cpp(self):
+        if self.kind == "list":
+            return f"std::vector<{self._cpp_of(self.element)}>"
+        return self._cpp_of(self.kind)
+
+    def cpp_param(self):
+        return self.cpp() if self.kind in SCALARS else f"const {self.cpp()}&"
+
+    def cpp_suffix(self):
+        return "list" if self.kind == "list" else self.kind
+
+    def cpp_init(self):
+        return "{}" if self.kind in SCALARS else ""
+
+
+class Method:
+    def __init__(self, name, args, result, line):
+        self.name = name
+        self.args = args      # [(name, Type)]
+        self.result = result  # Type
+        self.line = line
+        self.method_id = method_id(name)
+
+    @property
+    def camel(self):
+        return "".join(part[:1].upper() + part[1:] for part in self.name.split("_"))
+
+    def signature(self):
+        args = ", ".join(f"{name}: {t.spelling()}" for name, t in self.args)
+        return f"{self.name}({args}) -> {self.result.spelling()}"
+
+
+def method_id(name):
+    """32-bit FNV-1a, the same as typed_method_id() in typed_call.h"""
+    value = 2166136261
+    for byte in name.encode():
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def parse_schema(text, path):
+    service = None
+    methods = []
+    for number, raw in enumerate(text.splitlines(), 1):
+        line = raw.split("//", 1)[0].strip()
+        if not line:
+            continue
+        where = f"{path}:{number}"
+        match = SERVICE_RE.match(line)
+        if match:
+            if service:
+                raise SchemaError(f"{where}: a schema declares one service")
+            service = match.group(1)
+            continue
+        match = METHOD_RE.match(line)
+        if not match:
+            raise SchemaError(f"{where}: expected 'service <name>;' or 'method <name>(<args>) -> <type>;'")
+        name, arg_text, result_text = match.groups()
+        args = []
+        for piece in filter(None, (p.strip() for p in arg_text.split(","))):
+            arg = ARG_RE.match(piece)
+            if not arg:
+                raise SchemaError(f"{where}: expected '<name>: <type>', got '{piece}'")
+            arg_name = arg.group(1)
+            if arg_name in CPP_KEYWORDS or keyword.iskeyword(arg_name):
+                raise SchemaError(f"{where}: '{arg_name}' cannot be an argument name")
+            if any(arg_name == other for other, _ in args):
+                raise SchemaError(f"{where}: duplicate argument '{arg_name}'")
+            args.append((arg_name, Type.parse(arg.group(2), where)))
+        methods.append(Method(name, args, Type.parse(result_text, where), number))
+
+    if not service:
+        raise SchemaError(f"{path}: missing 'service <name>;'")
+    seen = {}
+    for method in methods:
+        if method.name in CPP_KEYWORDS or keyword.iskeyword(method.name):
+            raise SchemaError(f"{path}:{method.line}: '{method.name}' cannot be a method name")
+        if method.camel in {m.camel for m in seen.values()}:
+            raise SchemaError(f"{path}:{method.line}: method '{method.name}' declared twice")
+        other = seen.get(method.method_id)
+        if other:
+            raise SchemaError(f"{path}:{method.line}: '{method.name}' and '{other.name}' hash to the same method id")
+        seen[method.method_id] = method
+    return service, methods
+
+
+# --- C++ ---
+
+def cpp_write(t, expr):
+    return f"out.write_{t.cpp_suffix()}({expr});"
+
+
+def cpp_read(t, target):
+    return f"in.read_{t.cpp_suffix()}({target})"
+
+
+def generate_cpp(service, methods, schema_name):
+    out = [
+        f"// {service}.atidl.h",
+        f"// Generated by idl/atidl.py from {schema_name}; do not edit.",
+        "#pragma once",
+        '#include "rpc_connection.h"',
+        '#include "typed_call.h"',
+        "#include <cstdint>",
+        "#include <stdexcept>",
+        "#include <string>",
+        "#include <vector>",
+        "",
+        f"namespace {service} {{",
+        "",
+    ]
+    for m in methods:
+        out.append(f"// {m.signature()}")
+        out.append(f"struct {m.camel}Args {{")
+        out.append(f'    static constexpr const char* NAME = "{m.name}";')
+        out.append(f'    static constexpr uint32_t METHOD_ID = typed_method_id("{m.name}");')
+        for name, t in m.args:
+            out.append(f"    {t.cpp()} {name}{t.cpp_init()};")
+        out.append("")
+        if m.args:
+            out.append("    void encode(TypedWriter& out) const {")
+            out.extend(f"        {cpp_write(t, name)}" for name, t in m.args)
+            out.append("    }")
+            reads = " && ".join(cpp_read(t, name) for name, t in m.args)
+            out.append("    bool decode(TypedReader& in) {")
+            out.append(f"        return {reads};")
+            out.append("    }")
+        else:
+            out.append("    void encode(TypedWriter&) const {}")
+            out.append("    bool decode(TypedReader&) { return true; }")
+        out.append("};")
+        out.append(f"using {m.camel}Result = {m.result.cpp()};")
+        out.append("")
+
+    out.append("// Implement to serve the schema; a method may throw to answer with an error")
+    out.append("class Service {")
+    out.append("public:")
+    out.append("    virtual ~Service() = default;")
+    for m in methods:
+        out.append(f"    virtual {m.camel}Result {m.name}(const {m.camel}Args& args) = 0;")
+    out.append("};")
+    out.append("")
+
+    out.append("// Route every method of the schema to `service`, which must outlive the registry")
+    out.append("inline void register_service(TypedRegistry& registry, Service& service) {")
+    for m in methods:
+        out.append(f"    registry.add({m.camel}Args::METHOD_ID, {m.camel}Args::NAME, [&service](TypedReader& in, TypedWriter& out) {{")
+        out.append(f"        {m.camel}Args args;")
+        out.append("        if (!args.decode(in) || !in.done()) {")
+        out.append("            return false;")
+        out.append("        }")
+        out.append(f"        {cpp_write(m.result, f'service.{m.name}(args)')}")
+        out.append("        return true;")
+        out.append("    });")
+    out.append("}")
+    out.append("")
+
+    out.append("// Blocking calls over an RPCConnection; remote errors and timeouts throw as")
+    out.append("// RPCConnection::call() does")
+    out.append("class Client {")
+    out.append("public:")
+    out.append("    explicit Client(RPCConnection& connection, int timeout_ms = 10000)")
+    out.append("        : connection_(connection), timeout_ms_(timeout_ms) {}")
+    for m in methods:
+        params = ", ".join(f"{t.cpp_param()} {name}" for name, t in m.args)
+        out.append("")
+        out.append(f"    {m.camel}Result {m.name}({params}) {{")
+        out.append(f"        {m.camel}Args args;")
+        out.extend(f"        args.{name} = {name};" for name, _ in m.args)
+        out.append("        std::vector<uint8_t> body = connection_.call_typed(encode_typed_call(args), timeout_ms_);")
+        out.append("        TypedReader in(body.data(), body.size());")
+        out.append(f"        {m.camel}Result result{m.result.cpp_init()};")
+        out.append(f"        if (!{cpp_read(m.result, 'result')} || !in.done()) {{")
+        out.append(f"            throw std::runtime_error(\"Invalid typed response for '{m.name}'\");")
+        out.append("        }")
+        out.append("        return result;")
+        out.append("    }")
+    out.append("")
+    out.append("private:")
+    out.append("    RPCConnection& connection_;")
+    out.append("    int timeout_ms_;")
+    out.append("};")
+    out.append("")
+    out.append(f"}} // namespace {service}")
+    return "\n".join(out) + "\n"
+
+
+# --- Python ---
+
+PY_PRELUDE = '''
+import struct
+
+FLAG_TYPED = 0x0040
+_COUNT = struct.Struct("<I")
+
+
+def _pack_blob(data):
+    return _COUNT.pack(len(data)) + data
+
+
+def _pack_list(code, values):
+    return struct.pack(f"<I{len(values)}{code}", len(values), *values)
+
+
+def _pack_blob_list(values):
+    return _COUNT.pack(len(values)) + b"".join(_pack_blob(v) for v in values)
+
+
+def _unpack_scalar(layout, body, offset):
+    return layout.unpack_from(body, offset)[0], offset + layout.size
+
+
+def _unpack_blob(body, offset):
+    (size,) = _COUNT.unpack_from(body, offset)
+    offset += 4
+    if offset + size > len(body):
+        raise ValueError("truncated typed response")
+    return bytes(body[offset:offset + size]), offset + size
+
+
+def _unpack_list(code, body, offset):
+    (count,) = _COUNT.unpack_from(body, offset)
+    layout = struct.Struct(f"<{count}{code}")
+    return list(layout.unpack_from(body, offset + 4)), offset + 4 + layout.size
+
+
+def _unpack_blob_list(body, offset):
+    (count,) = _COUNT.unpack_from(body, offset)
+    offset += 4
+    values = []
+    for _ in range(count):
+        value, offset = _unpack_blob(body, offset)
+        values.append(value)
+    return values, offset
+
+
+def _finish(value, offset, body):
+    if offset != len(body):
+        raise ValueError("trailing bytes in typed response")
+    return value
+'''
+
+
+def py_blob(t, expr):
+    return f"{expr}.encode()" if t == "string" else f"bytes({expr})"
+
+
+def py_encode_body(m):
+    """Statements building the request body: consecutive scalars (the header
+    included) are packed by one precompiled struct"""
+    parts = []
+    layouts = []
+    codes, values = "II", [f"{m.name.upper()}_ID", "0"]
+
+    def flush():
+        nonlocal codes, values
+        if codes:
+            layout = f"_{m.name.upper()}_{len(layouts)}"
+            layouts.append(f'{layout} = struct.Struct("<{codes}")')
+            parts.append(f"{layout}.pack({', '.join(values)})")
+        codes, values = "", []
+
+    for name, t in m.args:
+        if t.kind in SCALARS:
+            codes += SCALARS[t.kind][1]
+            values.append(name)
+            continue
+        flush()
+        if t.kind in BLOBS:
+            parts.append(f"_pack_blob({py_blob(t.kind, name)})")
+        elif t.element in BLOBS:
+            parts.append(f"_pack_blob_list([{py_blob(t.element, 'v')} for v in {name}])")
+        else:
+            parts.append(f'_pack_list("{SCALARS[t.element][1]}", {name})')
+    flush()
+    body = parts[0] if len(parts) == 1 else 'b"".join((' + ", ".join(parts) + "))"
+    return layouts, body
+
+
+def py_decode(m):
+    """(layout definitions, decoding call, post-processing) of a result"""
+    t = m.result
+    if t.kind in SCALARS:
+        layout = f"_{m.name.upper()}_RESULT"
+        return [f'{layout} = struct.Struct("<{SCALARS[t.kind][1]}")'], f"_unpack_scalar({layout}, body, 0)", None
+    return [], *py_decode_variable(t)
+
+
+def py_decode_variable(t):
+    if t.kind in BLOBS:
+        return "_unpack_blob(body, 0)", ".decode()" if t.kind == "string" else None
+    if t.element in BLOBS:
+        return "_unpack_blob_list(body, 0)", "string_list" if t.element == "string" else None
+    return f'_unpack_list("{SCALARS[t.element][1]}", body, 0)', None
+
+
+def generate_python(service, methods, schema_name):
+    out = [
+        f"# {service}_atidl.py",
+        f'"""Generated by idl/atidl.py from {schema_name}; do not edit.',
+        "",
+        f"Typed calls of the '{service}' service: encode_<method>() builds a request",
+        "body for an AT frame with FLAG_TYPED, decode_<method>_result() reads the",
+        'response body. Client wraps an atproto.Client (anything with call_raw()). """',
+    ]
+    out.extend(PY_PRELUDE.splitlines())
+    out.append("")
+    out.append("")
+    for m in methods:
+        out.append(f"{m.name.upper()}_ID = 0x{m.method_id:08X}")
+    for m in methods:
+        layouts, body = py_encode_body(m)
+        result_layouts, call, post = py_decode(m)
+        layouts += result_layouts
+        params = ", ".join(name for name, _ in m.args)
+        out.append("")
+        out.append("")
+        out.extend(layouts)
+        out.append("")
+        out.append("")
+        out.append(f"def encode_{m.name}({params}):")
+        out.append(f'    """{m.signature()}"""')
+        out.append(f"    return {body}")
+        out.append("")
+        out.append("")
+        out.append(f"def decode_{m.name}_result(body):")
+        out.append(f"    value, offset = {call}")
+        if post == ".decode()":
+            out.append("    value = value.decode()")
+        elif post == "string_list":
+            out.append("    value = [v.decode() for v in value]")
+        out.append("    return _finish(value, offset, body)")
+    out.append("")
+    out.append("")
+    out.append("class Client:")
+    out.append(f'    """Blocking typed calls of \'{service}\' over a transport with call_raw(flags, body)"""')
+    out.append("")
+    out.append("    def __init__(self, transport):")
+    out.append("        self.transport = transport")
+    for m in methods:
+        params = "".join(f", {name}" for name, _ in m.args)
+        out.append("")
+        out.append(f"    def {m.name}(self{params}):")
+        out.append(f"        _, body = self.transport.call_raw(FLAG_TYPED, encode_{m.name}({params[2:]}))")
+        out.append(f"        return decode_{m.name}_result(body)")
+    return "\n".join(out) + "\n"
+
+
+def write_output(path, text):
+    with open(path, "w", encoding="utf-8", newline="\n") as f:
+        f.write(text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate C++ / Python code for typed AT methods")
+    parser.add_argument("schema", help=".atidl file")
+    parser.add_argument("--cpp-out", help="directory for <service>.atidl.h")
+    parser.add_argument("--py-out", help="directory for <service>_atidl.py")
+    options = parser.parse_args()
+
+    with open(options.schema, encoding="utf-8") as f:
+        text = f.read()
+    schema_name = os.path.basename(options.schema)
+    try:
+        service, methods = parse_schema(text, schema_name)
+    except SchemaError as e:
+        print(f"atidl: {e}", file=sys.stderr)
+        return 1
+    if options.cpp_out:
+        os.makedirs(options.cpp_out, exist_ok=True)
+        write_output(os.path.join(options.cpp_out, f"{service}.atidl.h"), generate_cpp(service, methods, schema_name))
+    if options.py_out:
+        os.makedirs(options.py_out, exist_ok=True)
+        write_output(os.path.join(options.py_out, f"{service}_atidl.py"), generate_python(service, methods, schema_name))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
+
+# run: python idl/atidl.py idl/calculator.atidl --cpp-out idl/idl_out --py-out python
@@ -0,0 +1,308 @@
+// calculator.atidl.h
+// Generated by idl/atidl.py from calculator.atidl; do not edit.
+#pragma once
+#include "rpc_connection.h"
+#include "typed_call.h"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace calculator {
+
+// add(a: f64, b: f64) -> f64
+struct AddArgs {
+    static constexpr const char* NAME = "add";
+    static constexpr uint32_t METHOD_ID = typed_method_id("add");
+    double a{};
+    double b{};
+
+    void encode(TypedWriter& out) const {
+        out.write_f64(a);
+        out.write_f64(b);
+    }
+    bool decode(TypedReader& in) {
+        return in.read_f64(a) && in.read_f64(b);
+    }
+};
+using AddResult = double;
+
+// sub(a: f64, b: f64) -> f64
+struct SubArgs {
+    static constexpr const char* NAME = "sub";
+    static constexpr uint32_t METHOD_ID = typed_method_id("sub");
+    double a{};
+    double b{};
+
+    void encode(TypedWriter& out) const {
+        out.write_f64(a);
+        out.write_f64(b);
+    }
+    bool decode(TypedReader& in) {
+        return in.read_f64(a) && in.read_f64(b);
+    }
+};
+using SubResult = double;
+
+// mul(a: f64, b: f64) -> f64
+struct MulArgs {
+    static constexpr const char* NAME = "mul";
+    static constexpr uint32_t METHOD_ID = typed_method_id("mul");
+    double a{};
+    double b{};
+
+    void encode(TypedWriter& out) const {
+        out.write_f64(a);
+        out.write_f64(b);
+    }
+    bool decode(TypedReader& in) {
+        return in.read_f64(a) && in.read_f64(b);
+    }
+};
+using MulResult = double;
+
+// div(a: f64, b: f64) -> f64
+struct DivArgs {
+    static constexpr const char* NAME = "div";
+    static constexpr uint32_t METHOD_ID = typed_method_id("div");
+    double a{};
+    double b{};
+
+    void encode(TypedWriter& out) const {
+        out.write_f64(a);
+        out.write_f64(b);
+    }
+    bool decode(TypedReader& in) {
+        return in.read_f64(a) && in.read_f64(b);
+    }
+};
+using DivResult = double;
+
+// sum(values: list<f64>) -> f64
+struct SumArgs {
+    static constexpr const char* NAME = "sum";
+    static constexpr uint32_t METHOD_ID = typed_method_id("sum");
+    std::vector<double> values;
+
+    void encode(TypedWriter& out) const {
+        out.write_list(values);
+    }
+    bool decode(TypedReader& in) {
+        return in.read_list(values);
+    }
+};
+using SumResult = double;
+
+// scale(values: list<f64>, factor: f64) -> list<f64>
+struct ScaleArgs {
+    static constexpr const char* NAME = "scale";
+    static constexpr uint32_t METHOD_ID = typed_method_id("scale");
+    std::vector<double> values;
+    double factor{};
+
+    void encode(TypedWriter& out) const {
+        out.write_list(values);
+        out.write_f64(factor);
+    }
+    bool decode(TypedReader& in) {
+        return in.read_list(values) && in.read_f64(factor);
+    }
+};
+using ScaleResult = std::vector<double>;
+
+// label(name: string, value: f64, precision: i32) -> string
+struct LabelArgs {
+    static constexpr const char* NAME = "label";
+    static constexpr uint32_t METHOD_ID = typed_method_id("label");
+    std::string name;
+    double value{};
+    int32_t precision{};
+
+    void encode(TypedWriter& out) const {
+        out.write_string(name);
+        out.write_f64(value);
+        out.write_i32(precision);
+    }
+    bool decode(TypedReader& in) {
+        return in.read_string(name) && in.read_f64(value) && in.read_i32(precision);
+    }
+};
+using LabelResult = std::string;
+
+// Implement to serve the schema; a method may throw to answer with an error
+class Service {
+public:
+    virtual ~Service() = default;
+    virtual AddResult add(const AddArgs& args) = 0;
+    virtual SubResult sub(const SubArgs& args) = 0;
+    virtual MulResult mul(const MulArgs& args) = 0;
+    virtual DivResult div(const DivArgs& args) = 0;
+    virtual SumResult sum(const SumArgs& args) = 0;
+    virtual ScaleResult scale(const ScaleArgs& args) = 0;
+    virtual LabelResult label(const LabelArgs& args) = 0;
+};
+
+// Route every method of the schema to `service`, which must outlive the registry
+inline void register_service(TypedRegistry& registry, Service& service) {
+    registry.add(AddArgs::METHOD_ID, AddArgs::NAME, [&service](TypedReader& in, TypedWriter& out) {
+        AddArgs args;
+        if (!args.decode(in) || !in.done()) {
+            return false;
+        }
+        out.write_f64(service.add(args));
+        return true;
+    });
+    registry.add(SubArgs::METHOD_ID, SubArgs::NAME, [&service](TypedReader& in, TypedWriter& out) {
+        SubArgs args;
+        if (!args.decode(in) || !in.done()) {
+            return false;
+        }
+        out.write_f64(service.sub(args));
+        return true;
+    });
+    registry.add(MulArgs::METHOD_ID, MulArgs::NAME, [&service](TypedReader& in, TypedWriter& out) {
+        MulArgs args;
+        if (!args.decode(in) || !in.done()) {
+            return false;
+        }
+        out.write_f64(service.mul(args));
+        return true;
+    });
+    registry.add(DivArgs::METHOD_ID, DivArgs::NAME, [&service](TypedReader& in, TypedWriter& out) {
+        DivArgs args;
+        if (!args.decode(in) || !in.done()) {
+            return false;
+        }
+        out.write_f64(service.div(args));
+        return true;
+    });
+    registry.add(SumArgs::METHOD_ID, SumArgs::NAME, [&service](TypedReader& in, TypedWriter& out) {
+        SumArgs args;
+        if (!args.decode(in) || !in.done()) {
+            return false;
+        }
+        out.write_f64(service.sum(args));
+        return true;
+    });
+    registry.add(ScaleArgs::METHOD_ID, ScaleArgs::NAME, [&service](TypedReader& in, TypedWriter& out) {
+        ScaleArgs args;
+        if (!args.decode(in) || !in.done()) {
+            return false;
+        }
+        out.write_list(service.scale(args));
+        return true;
+    });
+    registry.add(LabelArgs::METHOD_ID, LabelArgs::NAME, [&service](TypedReader& in, TypedWriter& out) {
+        LabelArgs args;
+        if (!args.decode(in) || !in.done()) {
+            return false;
+        }
+        out.write_string(service.label(args));
+        return true;
+    });
+}
+
+// Blocking calls over an RPCConnection; remote errors and timeouts throw as
+// RPCConnection::call() does
+class Client {
+public:
+    explicit Client(RPCConnection& connection, int timeout_ms = 10000)
+        : connection_(connection), timeout_ms_(timeout_ms) {}
+
+    AddResult add(double a, double b) {
+        AddArgs args;
+        args.a = a;
+        args.b = b;
+        std::vector<uint8_t> body = connection_.call_typed(encode_typed_call(args), timeout_ms_);
+        TypedReader in(body.data(), body.size());
+        AddResult result{};
+        if (!in.read_f64(result) || !in.done()) {
+            throw std::runtime_error("Invalid typed response for 'add'");
+        }
+        return result;
+    }
+
+    SubResult sub(double a, double b) {
+        SubArgs args;
+        args.a = a;
+        args.b = b;
+        std::vector<uint8_t> body = connection_.call_typed(encode_typed_call(args), timeout_ms_);
+        TypedReader in(body.data(), body.size());
+        SubResult result{};
+        if (!in.read_f64(result) || !in.done()) {
+            throw std::runtime_error("Invalid typed response for 'sub'");
+        }
+        return result;
+    }
+
+    MulResult mul(double a, double b) {
+        MulArgs args;
+        args.a = a;
+        args.b = b;
+        std::vector<uint8_t> body = connection_.call_typed(encode_typed_call(args), timeout_ms_);
+        TypedReader in(body.data(), body.size());
+        MulResult result{};
+        if (!in.read_f64(result) || !in.done()) {
+            throw std::runtime_error("Invalid typed response for 'mul'");
+        }
+        return result;
+    }
+
+    DivResult div(double a, double b) {
+        DivArgs args;
+        args.a = a;
+        args.b = b;
+        std::vector<uint8_t> body = connection_.call_typed(encode_typed_call(args), timeout_ms_);
+        TypedReader in(body.data(), body.size());
+        DivResult result{};
+        if (!in.read_f64(result) || !in.done()) {
+            throw std::runtime_error("Invalid typed response for 'div'");
+        }
+        return result;
+    }
+
+    SumResult sum(const std::vector<double>& values) {
+        SumArgs args;
+        args.values = values;
+        std::vector<uint8_t> body = connection_.call_typed(encode_typed_call(args), timeout_ms_);
+        TypedReader in(body.data(), body.size());
+        SumResult result{};
+        if (!in.read_f64(result) || !in.done()) {
+            throw std::runtime_error("Invalid typed response for 'sum'");
+        }
+        return result;
+    }
+
+    ScaleResult scale(const std::vector<double>& values, double factor) {
+        ScaleArgs args;
+        args.values = values;
+        args.factor = factor;
+        std::vector<uint8_t> body = connection_.call_typed(encode_typed_call(args), timeout_ms_);
+        TypedReader in(body.data(), body.size());
+        ScaleResult result;
+        if (!in.read_list(result) || !in.done()) {
+            throw std::runtime_error("Invalid typed response for 'scale'");
+        }
+        return result;
+    }
+
+    LabelResult label(const std::string& name, double value, int32_t precision) {
+        LabelArgs args;
+        args.name = name;
+        args.value = value;
+        args.precision = precision;
+        std::vector<uint8_t> body = connection_.call_typed(encode_typed_call(args), timeout_ms_);
+        TypedReader in(body.data(), body.size());
+        LabelResult result;
+        if (!in.read_string(result) || !in.done()) {
+            throw std::runtime_error("Invalid typed response for 'label'");
+        }
+        return result;
+    }
+
+private:
+    RPCConnection& connection_;
+    int timeout_ms_;
+};
+
+} // namespace calculator
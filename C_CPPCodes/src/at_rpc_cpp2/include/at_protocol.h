@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <mutex>
 #include <stdexcept>
 
@@ -32,6 +33,8 @@ struct ATHeader {
     // 大小端设置
     static const ByteOrder byte_order = ByteOrder::BigEndian;
     std::vector<uint8_t> pack() const;
+    // 直接写入调用方的缓冲区（至少 sizeof(ATHeader) 字节）
+    void pack_into(uint8_t* out) const;
     void unpack(const uint8_t* data, size_t size);
 };
 // #pragma pack(pop) // 从堆栈中恢复之前保存的对齐设置
@@ -42,6 +45,14 @@ public:
     static constexpr uint16_t FLAG_REQUEST = 0x0001;
     static constexpr uint16_t FLAG_RESPONSE = 0x0002;
     static constexpr uint16_t FLAG_ERROR = 0x0004;
+    static constexpr uint16_t FLAG_BINARY = 0x0008; // 正文为二进制批量运算数据（见 bulk_ops.h），不是 JSON
+    static constexpr uint16_t FLAG_PUSH = 0x0010;   // 服务端主动推送的订阅消息（见 pubsub.h），不对应任何请求
+    static constexpr uint16_t FLAG_MSGPACK = 0x0020; // 正文为 MessagePack 编码的同一份 JSON 文档，响应以同样编码返回
+    static constexpr uint16_t FLAG_TYPED = 0x0040;   // 正文为 .atidl 声明的类型化调用（见 typed_call.h），由生成代码编解码
+    static constexpr uint16_t FLAG_SEALED = 0x0080;  // 正文经 AES-256-GCM 加密，末尾的 GCM 标签代替 CRC（见 frame_cipher.h）
+    static constexpr uint16_t FLAG_COMPRESSED = 0x0100; // 正文经 LZ 压缩，前 4 字节为原始长度（见 lz_codec.h）；CRC 覆盖压缩后的正文
+    static constexpr uint16_t FLAG_ACCEPTS_COMPRESSED = 0x0200; // 请求：客户端能解压响应，服务端可压缩较大的响应正文
+    static constexpr size_t SEAL_TAG_SIZE = 16;      // FLAG_SEALED 帧正文末尾的 GCM 标签
     static constexpr size_t HEADER_SIZE = sizeof(ATHeader); // 16 bytes
 
     ATProtocol();
@@ -49,9 +60,16 @@ public:
 
     // 打包数据
     std::vector<uint8_t> pack(uint16_t flags, const std::string& body, uint32_t sequence = 0);
+    std::vector<uint8_t> pack(uint16_t flags, const uint8_t* body, size_t body_size, uint32_t sequence = 0);
+    // 同上，写入调用方的缓冲区（如 BufferPool 回收的），已有容量足够时不分配内存
+    void pack_into(std::vector<uint8_t>& packet, uint16_t flags, const uint8_t* body, size_t body_size, uint32_t sequence = 0);
 
     // 解包数据
     bool unpack(const std::vector<uint8_t>& data, uint16_t& flags, uint32_t& sequence, std::string& body);
+    // 直接解析缓冲区中的一帧（无需先拷贝成 vector）
+    bool unpack(const uint8_t* data, size_t size, uint16_t& flags, uint32_t& sequence, std::string& body);
+    // 同上，但 body 直接指向 data 中的正文，不拷贝
+    bool unpack(const uint8_t* data, size_t size, uint16_t& flags, uint32_t& sequence, std::string_view& body);
     uint32_t get_next_sequence();
 
 private:
@@ -0,0 +1,123 @@
+// atproto.h
+// C ABI of the AT codec (libatproto), for peers in other languages (python/atproto.py).
+// Nothing here allocates on the caller's behalf: every function reads and
+// writes buffers the caller owns, so bindings can pass bytearray / memoryview
+// memory straight through. Functions return ATPROTO_OK or a negative
+// atproto_status; sizes come back through out-parameters.
+//
+// Stable within one ATPROTO_ABI_VERSION: new functions may be added, existing
+// signatures and struct layouts do not change.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(ATPROTO_BUILD)
+#    define ATPROTO_API __declspec(dllexport)
+#  else
+#    define ATPROTO_API __declspec(dllimport)
+#  endif
+#else
+#  define ATPROTO_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ATPROTO_ABI_VERSION 1
+
+// Wire constants, the same as ATProtocol's
+#define ATPROTO_HEADER_SIZE 16
+#define ATPROTO_ID 0x4154
+#define ATPROTO_FLAG_REQUEST 0x0001
+#define ATPROTO_FLAG_RESPONSE 0x0002
+#define ATPROTO_FLAG_ERROR 0x0004
+#define ATPROTO_FLAG_BINARY 0x0008
+#define ATPROTO_FLAG_PUSH 0x0010
+#define ATPROTO_FLAG_MSGPACK 0x0020
+#define ATPROTO_FLAG_TYPED 0x0040
+#define ATPROTO_FLAG_SEALED 0x0080 // AES-GCM encrypted body; no CRC, and not decrypted by this library
+#define ATPROTO_FLAG_COMPRESSED 0x0100 // LZ-compressed body (lz_codec.h); not decompressed by this library
+#define ATPROTO_FLAG_ACCEPTS_COMPRESSED 0x0200 // request: the client takes compressed responses
+
+typedef enum atproto_status {
+    ATPROTO_OK = 0,
+    ATPROTO_ERR_ARGUMENT = -1,  // NULL pointer or out-of-range value
+    ATPROTO_ERR_BUFFER = -2,    // output buffer too small; *written holds the size needed
+    ATPROTO_ERR_PROTOCOL = -3,  // not an AT header
+    ATPROTO_ERR_TOO_LARGE = -4, // body longer than the caller's max_body
+    ATPROTO_ERR_CHECKSUM = -5,  // body does not match the header's CRC32
+    ATPROTO_ERR_ENCODING = -6   // invalid JSON / MessagePack, or an unsupported value
+} atproto_status;
+
+// Decoded 16-byte header (host byte order)
+typedef struct atproto_header {
+    uint16_t protocol_id;
+    uint16_t flags;
+    uint32_t sequence;
+    uint32_t body_length;
+    uint32_t hash_value;
+} atproto_header;
+
+// A complete frame found inside a receive buffer; the body is not copied
+typedef struct atproto_frame {
+    uint16_t flags;
+    uint16_t reserved;
+    uint32_t sequence;
+    uint64_t body_offset; // from the start of the scanned buffer
+    uint64_t body_length;
+} atproto_frame;
+
+ATPROTO_API uint32_t atproto_abi_version(void);
+
+// CRC32 (IEEE, as in zlib) of a byte range, the header's hash_value
+ATPROTO_API uint32_t atproto_crc32(const uint8_t* data, size_t size);
+
+// Write the header of a frame carrying `body` into out[0..16)
+ATPROTO_API int atproto_pack_header(uint8_t* out, size_t out_size, uint16_t flags, uint32_t sequence,
+                                    const uint8_t* body, size_t body_size);
+
+// Header plus a copy of the body; *written = 16 + body_size. With a short (or
+// NULL) `out`, returns ATPROTO_ERR_BUFFER and the size needed.
+ATPROTO_API int atproto_pack_frame(uint8_t* out, size_t out_size, uint16_t flags, uint32_t sequence,
+                                   const uint8_t* body, size_t body_size, size_t* written);
+
+// Decode the first 16 bytes of `data`. Checks the protocol id only.
+ATPROTO_API int atproto_parse_header(const uint8_t* data, size_t size, atproto_header* header);
+
+// Incremental decode: find the complete frames at the start of data[0..size),
+// at most max_frames of them, verifying each body's CRC when verify_crc is set
+// (except for sealed frames, which have none; bodies longer than max_body are
+// refused; 0 = no limit). *count is how many
+// were found and *consumed how many bytes they span; keep the rest and call
+// again once more bytes arrived. *needed is the whole size of the next,
+// incomplete frame (16 while even its header is), so a caller can grow its
+// buffer once instead of repeatedly; 0 when max_frames ended the scan.
+// Errors refer to the frame at *consumed; frames before it are still valid.
+ATPROTO_API int atproto_scan_frames(const uint8_t* data, size_t size, uint32_t max_body, int verify_crc,
+                                    atproto_frame* frames, size_t max_frames, size_t* count, size_t* consumed,
+                                    size_t* needed);
+
+// MessagePack bodies (ATPROTO_FLAG_MSGPACK) carry the same documents as JSON
+// ones. Both helpers return ATPROTO_ERR_BUFFER with *written = size needed
+// when `out` is too small.
+ATPROTO_API int atproto_json_to_msgpack(const char* json_text, size_t json_size, uint8_t* out, size_t out_size,
+                                        size_t* written);
+ATPROTO_API int atproto_msgpack_to_json(const uint8_t* data, size_t size, char* out, size_t out_size,
+                                        size_t* written);
+
+// A whole request frame {"func": func, "args": [args...]} with a MessagePack
+// body, encoded straight into `out` (flags = REQUEST | MSGPACK)
+ATPROTO_API int atproto_pack_call_msgpack(uint8_t* out, size_t out_size, uint32_t sequence, const char* func,
+                                          size_t func_size, const double* args, size_t arg_count, size_t* written);
+
+// The "result" of a MessagePack response body when it is a number; otherwise
+// ATPROTO_ERR_ENCODING. For {"status": "error"} bodies, copies the message
+// (truncated, NUL-terminated) into `error` and returns ATPROTO_ERR_ENCODING too.
+ATPROTO_API int atproto_msgpack_result(const uint8_t* data, size_t size, double* result, char* error,
+                                       size_t error_size);
+
+#ifdef __cplusplus
+}
+#endif
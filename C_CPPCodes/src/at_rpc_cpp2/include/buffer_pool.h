@@ -0,0 +1,107 @@
+// buffer_pool.h
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "at_protocol.h" // json
+
+// Recycled packet buffers for the codec and socket paths, so a connection in
+// steady state allocates nothing per frame. Buffers stay std::vector<uint8_t>
+// (send_all, ResponseWriter, FrameCipher all take one); the pool only keeps
+// their capacity alive between frames.
+//
+// Capacities come in power-of-two classes from 256 B to 16 MiB, the largest
+// frame. Each thread caches up to THREAD_CACHE_BUFFERS buffers of every class
+// up to 64 KiB and trades them with a shared depot in batches, so the common
+// acquire / release is a vector push / pop without a lock. Larger classes go
+// straight to the depot, whose idle bytes are capped (set_depot_limit);
+// anything beyond is freed. A thread's cache returns to the depot when the
+// thread exits.
+//
+// Buffers of 4 MiB and more can be advised into transparent huge pages
+// (set_hugepages, Linux): one TLB entry per 2 MiB for the bulk bodies that
+// fill them, no hugetlbfs reservation needed. Only whole aligned 2 MiB pages
+// inside a buffer qualify, hence not the 2 MiB class.
+class BufferPool {
+public:
+    static constexpr unsigned MIN_CLASS_SHIFT = 8;  // 256 B
+    static constexpr unsigned MAX_CLASS_SHIFT = 24; // 16 MiB: header + 10 MiB body fits
+    static constexpr size_t CLASSES = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+    static constexpr unsigned THREAD_CACHE_MAX_SHIFT = 16; // 64 KiB
+    static constexpr size_t THREAD_CACHE_BUFFERS = 16;     // per class and thread
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    static BufferPool& instance();
+
+    // An empty buffer with capacity for at least `size` bytes. Sizes above the
+    // largest class are allocated as asked and freed on release.
+    std::vector<uint8_t> acquire(size_t size);
+    // Hand a buffer back for reuse (any vector will do; it is filed under the
+    // largest class its capacity covers)
+    void release(std::vector<uint8_t>&& buffer);
+
+    // Idle bytes the depot may hold, default 64 MiB; 0 frees larger buffers at once
+    void set_depot_limit(size_t bytes);
+    // madvise(MADV_HUGEPAGE) new buffers of 2 * HUGE_PAGE_SIZE and up. No-op off Linux.
+    void set_hugepages(bool enabled);
+
+    // {"allocated", "reused", "dropped", "oversize", "depot_bytes"}: buffers
+    // newly allocated, taken from the depot again, freed on release and too
+    // large to pool. "allocated" standing still is the steady state.
+    // (Thread-cache hits are not counted, to keep them free of shared writes.)
+    json stats() const;
+
+private:
+    friend struct BufferCache;
+
+    BufferPool() = default;
+    std::vector<uint8_t> allocate(unsigned shift);
+    // Move up to `count` buffers of a class between the depot and a thread cache
+    size_t take_from_depot(size_t cls, std::vector<std::vector<uint8_t>>& out, size_t count);
+    bool take_from_depot(size_t cls, std::vector<uint8_t>& out);
+    void give_to_depot(size_t cls, std::vector<uint8_t>&& buffer);
+
+    mutable std::mutex depot_mutex_;
+    std::vector<std::vector<uint8_t>> depot_[CLASSES];
+    size_t depot_bytes_ = 0;
+    size_t depot_limit_ = 64 * 1024 * 1024;
+    std::atomic<bool> hugepages_{false};
+
+    std::atomic<uint64_t> allocated_{0};
+    std::atomic<uint64_t> reused_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> oversize_{0};
+};
+
+// A pooled buffer that goes back to BufferPool::instance() when the handle
+// goes out of scope, early returns and exceptions included
+class PooledBuffer {
+public:
+    PooledBuffer() = default; // holds nothing until assigned
+    explicit PooledBuffer(size_t capacity) : buffer_(BufferPool::instance().acquire(capacity)) {}
+    ~PooledBuffer() { BufferPool::instance().release(std::move(buffer_)); }
+
+    PooledBuffer(PooledBuffer&& other) noexcept : buffer_(std::move(other.buffer_)) {}
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept {
+        buffer_.swap(other.buffer_);
+        return *this;
+    }
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    std::vector<uint8_t>& operator*() { return buffer_; }
+    std::vector<uint8_t>* operator->() { return &buffer_; }
+    uint8_t* data() { return buffer_.data(); }
+    size_t size() const { return buffer_.size(); }
+
+    // Keep the buffer beyond the handle (e.g. a response frame handed on);
+    // whoever ends up with it may give it back with BufferPool::release
+    std::vector<uint8_t> take() { return std::move(buffer_); }
+
+private:
+    std::vector<uint8_t> buffer_;
+};
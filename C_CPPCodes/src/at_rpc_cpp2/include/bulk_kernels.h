@@ -0,0 +1,53 @@
+// bulk_kernels.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Kernel table behind execute_bulk(), one per instruction set. Array pointers
+// point into received frames and may be unaligned: kernels only use unaligned
+// vector loads and load_unaligned() for scalar elements. Output arrays may be
+// unaligned too. min/max require n > 0.
+struct BulkKernels {
+    const char* isa;
+
+    void (*add_f64)(const double* a, const double* b, double* out, size_t n);
+    void (*sub_f64)(const double* a, const double* b, double* out, size_t n);
+    void (*mul_f64)(const double* a, const double* b, double* out, size_t n);
+    void (*div_f64)(const double* a, const double* b, double* out, size_t n);
+    void (*axpy_f64)(double alpha, const double* x, const double* y, double* out, size_t n);
+    double (*dot_f64)(const double* a, const double* b, size_t n);
+    double (*sum_f64)(const double* a, size_t n);
+    double (*min_f64)(const double* a, size_t n);
+    double (*max_f64)(const double* a, size_t n);
+
+    void (*add_i32)(const int32_t* a, const int32_t* b, int32_t* out, size_t n);
+    void (*sub_i32)(const int32_t* a, const int32_t* b, int32_t* out, size_t n);
+    void (*mul_i32)(const int32_t* a, const int32_t* b, int32_t* out, size_t n);
+    int64_t (*dot_i32)(const int32_t* a, const int32_t* b, size_t n);
+    int64_t (*sum_i32)(const int32_t* a, size_t n);
+    int32_t (*min_i32)(const int32_t* a, size_t n);
+    int32_t (*max_i32)(const int32_t* a, size_t n);
+};
+
+template <typename T>
+inline T load_unaligned(const T* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template <typename T>
+inline void store_unaligned(T* p, T value) {
+    std::memcpy(p, &value, sizeof(T));
+}
+
+const BulkKernels& bulk_kernels_scalar();
+#if defined(__SSE2__) || defined(_M_X64)
+const BulkKernels& bulk_kernels_sse2();
+#endif
+#ifdef AT_BULK_AVX2
+// Built from bulk_kernels_avx2.cpp with AVX2 + FMA code generation; only call
+// after checking the CPU
+const BulkKernels& bulk_kernels_avx2();
+#endif
@@ -0,0 +1,96 @@
+// bulk_ops.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ResponseWriter;
+
+// Array-valued calculator methods. A request with ATProtocol::FLAG_BINARY set
+// carries a binary body instead of JSON (little-endian; hosts are assumed to be
+// little-endian too, as every x86 / ARM target of this project is):
+//
+//   BulkRequestHeader (16 bytes), then a[count], then b[count] for two-input ops
+//
+// A successful response has FLAG_RESPONSE | FLAG_BINARY and the body
+//
+//   BulkResponseHeader (8 bytes), then count result elements
+//
+// Errors are ordinary FLAG_ERROR responses with the JSON error body.
+//
+//   op          inputs     result
+//   add/sub/mul a, b       array, same dtype (int32 wraps around)
+//   div         a, b       array; float64 follows IEEE (x/0 = inf), int32 rejects 0
+//   dot         a, b       scalar: float64, or int64 for int32 (wraps around)
+//   sum         a          scalar: float64, or int64 for int32
+//   min/max     a          scalar, same dtype; empty arrays are rejected,
+//                          NaN inputs give an unspecified result
+//   axpy        a, b       array alpha * a + b; float64 only
+//
+// Reductions run in SIMD lanes (and axpy / dot use FMA on AVX2), so float64
+// results may differ from a sequential loop in the last bits.
+enum class BulkOp : uint8_t {
+    Add = 1,
+    Sub = 2,
+    Mul = 3,
+    Div = 4,
+    Dot = 5,
+    Sum = 6,
+    Min = 7,
+    Max = 8,
+    Axpy = 9,
+};
+
+enum class BulkDType : uint8_t {
+    Float64 = 1,
+    Int32 = 2,
+    Int64 = 3, // results only
+};
+
+struct BulkRequestHeader {
+    uint8_t op;       // BulkOp
+    uint8_t dtype;    // BulkDType of both inputs
+    uint16_t reserved;
+    uint32_t count;   // elements per input array
+    double alpha;     // axpy scale, ignored by the other ops
+};
+static_assert(sizeof(BulkRequestHeader) == 16, "BulkRequestHeader layout is part of the wire format");
+
+struct BulkResponseHeader {
+    uint8_t dtype;    // BulkDType of the result
+    uint8_t reserved[3];
+    uint32_t count;
+};
+static_assert(sizeof(BulkResponseHeader) == 8, "BulkResponseHeader layout is part of the wire format");
+
+// Decoded bulk response: values land in f64 or ints depending on dtype
+struct BulkResult {
+    BulkDType dtype = BulkDType::Float64;
+    std::vector<double> f64;
+    std::vector<int64_t> ints;  // int32 and int64 results
+
+    size_t size() const { return dtype == BulkDType::Float64 ? f64.size() : ints.size(); }
+};
+
+const char* bulk_op_name(BulkOp op);                     // "add", ...; "invalid" if unknown
+bool parse_bulk_op(const std::string& name, BulkOp& op);
+bool bulk_op_takes_two(BulkOp op);                      // needs b[] as well as a[]
+
+// Client side: request bodies (b is ignored by one-input ops) and responses
+std::vector<uint8_t> encode_bulk_request(BulkOp op, const std::vector<double>& a,
+                                         const std::vector<double>& b = {}, double alpha = 0.0);
+std::vector<uint8_t> encode_bulk_request(BulkOp op, const std::vector<int32_t>& a,
+                                         const std::vector<int32_t>& b = {});
+bool decode_bulk_response(const uint8_t* body, size_t size, BulkResult& result);
+
+// Server side: metrics name of a request body ("bulk.add", "bulk.invalid")
+std::string bulk_method_name(const uint8_t* body, size_t size);
+
+// Validate and run one request, writing the binary result into `response`.
+// Returns false with `error` set (and nothing written) for a bad request.
+bool execute_bulk(const uint8_t* body, size_t size, ResponseWriter& response, std::string& error);
+
+// Instruction set the kernels were picked for at startup: "avx2", "sse2" or
+// "scalar". AT_BULK_ISA=scalar|sse2|avx2 in the environment caps the choice.
+const char* bulk_kernel_isa();
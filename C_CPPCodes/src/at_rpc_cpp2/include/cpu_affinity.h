@@ -0,0 +1,44 @@
+// cpu_affinity.h
+#pragma once
+#include <string>
+#include <vector>
+
+// CPUs this process may run on, grouped by NUMA node. On Linux the nodes come
+// from /sys/devices/system/node, restricted to the process's affinity mask;
+// elsewhere (or without sysfs) every CPU is reported as node 0.
+class CpuTopology {
+public:
+    struct Node {
+        int id;
+        std::vector<int> cpus;
+    };
+
+    static CpuTopology detect();
+
+    const std::vector<Node>& nodes() const { return nodes_; }
+    std::vector<int> cpus() const;   // node by node, ascending within a node
+    int node_of(int cpu) const;      // -1 if the CPU is not available
+    bool contains(int cpu) const { return node_of(cpu) >= 0; }
+
+    // "2 NUMA nodes: node0 cpus 0-15, node1 cpus 16-31"
+    std::string describe() const;
+
+private:
+    std::vector<Node> nodes_;
+};
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}; throws std::invalid_argument
+std::vector<int> parse_cpu_list(const std::string& text);
+// Inverse of parse_cpu_list for sorted lists: {0, 1, 2, 3, 8} -> "0-3,8"
+std::string format_cpu_list(const std::vector<int>& cpus);
+
+// The CPUs a server spreads its threads over: "auto" means every CPU of the
+// topology, anything else is a parse_cpu_list() list that must be a subset
+// of it. Throws std::invalid_argument.
+std::vector<int> select_cpus(const CpuTopology& topology, const std::string& spec);
+
+// Pin the calling thread to `cpu`. With numa_node >= 0 the thread's future page
+// allocations also prefer that node (Linux), so buffers it creates stay
+// node-local; pass -1 on single-node machines. Returns false if pinning failed or is
+// unsupported on this platform.
+bool pin_current_thread(int cpu, int numa_node = -1);
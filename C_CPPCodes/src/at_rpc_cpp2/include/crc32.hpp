@@ -1,9 +1,10 @@
-#pragma one
+#pragma once
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
 namespace crc32 {
-    uint32_t reflect(uint32_t data, size_t num){
+    inline uint32_t reflect(uint32_t data, size_t num){
         uint32_t reflection = 0;
         for (size_t bit = 0; bit < num; ++bit) {
             if (data & 0x01) {
@@ -14,7 +15,10 @@ namespace crc32 {
         return reflection;
     }
 
-    uint32_t crc_table[256];
+    // crc_tables[0] is the classic byte table; crc_tables[k] advances a byte
+    // through k more zero bytes, so calculate() can fold 8 bytes per step
+    // (slicing-by-8) instead of one
+    inline uint32_t crc_tables[8][256];
 
     struct CRC32Initializer {
         CRC32Initializer() {
@@ -28,19 +32,38 @@ namespace crc32 {
                         crc <<= 1;
                     }
                 }
-                crc_table[i] = reflect(crc, 32);
+                crc_tables[0][i] = reflect(crc, 32);
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (size_t k = 1; k < 8; ++k) {
+                    uint32_t prev = crc_tables[k - 1][i];
+                    crc_tables[k][i] = (prev >> 8) ^ crc_tables[0][prev & 0xFF];
+                }
             }
         }
-    } crc32_init;
+    };
+    inline CRC32Initializer crc32_init;
 
-    int32_t calculate_hash(const std::string &data) {
+    // CRC of a byte range, e.g. a body already sitting in a frame buffer
+    inline uint32_t calculate(const uint8_t* data, size_t size) {
         uint32_t crc = 0xFFFFFFFF;
-        for (size_t i = 0; i < data.length(); ++i) {
-            uint8_t byte = static_cast<uint8_t>(data[i]);
-            uint8_t index = (crc ^ byte) & 0xFF;
-            crc = (crc >> 8) ^ crc_table[index];
+        for (; size >= 8; data += 8, size -= 8) {
+            uint32_t one = (data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24)) ^ crc;
+            uint32_t two = data[4] | (data[5] << 8) | (data[6] << 16) | (static_cast<uint32_t>(data[7]) << 24);
+            crc = crc_tables[7][one & 0xFF] ^ crc_tables[6][(one >> 8) & 0xFF] ^
+                  crc_tables[5][(one >> 16) & 0xFF] ^ crc_tables[4][one >> 24] ^
+                  crc_tables[3][two & 0xFF] ^ crc_tables[2][(two >> 8) & 0xFF] ^
+                  crc_tables[1][(two >> 16) & 0xFF] ^ crc_tables[0][two >> 24];
+        }
+        for (size_t i = 0; i < size; ++i) {
+            uint8_t index = (crc ^ data[i]) & 0xFF;
+            crc = (crc >> 8) ^ crc_tables[0][index];
         }
         // return ~crc;
-        return static_cast<int32_t>(crc ^ 0xFFFFFFFF);
+        return crc ^ 0xFFFFFFFF;
+    }
+
+    inline int32_t calculate_hash(const std::string &data) {
+        return static_cast<int32_t>(calculate(reinterpret_cast<const uint8_t*>(data.data()), data.size()));
     }
-};
\ No newline at end of file
+};
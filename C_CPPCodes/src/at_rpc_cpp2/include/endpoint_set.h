@@ -0,0 +1,115 @@
+// endpoint_set.h
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "rpc_connection.h"
+
+struct Endpoint {
+    std::string host;
+    int port;
+
+    std::string to_string() const { return host + ":" + std::to_string(port); }
+};
+
+// Parse "host1:port1,host2:port2"; throws std::invalid_argument on bad entries
+std::vector<Endpoint> parse_endpoints(const std::string& spec);
+
+enum class LoadBalancePolicy {
+    PowerOfTwoChoices, // pick two healthy endpoints at random, use the one with fewer outstanding calls
+    RoundRobin
+};
+
+struct EndpointSetOptions {
+    LoadBalancePolicy policy = LoadBalancePolicy::PowerOfTwoChoices;
+    int call_timeout_ms = 5000;
+    int failure_threshold = 3;                               // consecutive transport failures before ejection
+    std::chrono::milliseconds base_ejection{1000};           // doubled on each failed probe
+    std::chrono::milliseconds max_ejection{30000};
+
+    // Hedged requests, only for the methods listed here (they must be idempotent):
+    // when a call is slower than the observed hedge_percentile latency, a copy is
+    // sent to another endpoint (or a second connection) and the first answer wins.
+    std::vector<std::string> hedged_methods;
+    double hedge_percentile = 0.95;
+    std::chrono::microseconds min_hedge_delay{200};
+    double max_hedge_ratio = 0.05;                           // hedges per call, at most
+};
+
+// Client that spreads calls over several AT servers with passive health
+// tracking: an endpoint that fails failure_threshold calls in a row is ejected;
+// after the ejection time a single probe call is let through, and its outcome
+// either restores the endpoint or ejects it again for twice as long.
+// Optional hedging (see EndpointSetOptions::hedged_methods) trims tail latency
+// caused by occasional slow servers; the losing copy is cancelled client-side.
+class EndpointSetClient {
+public:
+    explicit EndpointSetClient(std::vector<Endpoint> endpoints, EndpointSetOptions options = {});
+    ~EndpointSetClient();
+
+    EndpointSetClient(const EndpointSetClient&) = delete;
+    EndpointSetClient& operator=(const EndpointSetClient&) = delete;
+
+    // Throws RPCTransportError when the chosen endpoint fails, std::runtime_error
+    // for remote application errors
+    json call(const std::string& func, const std::vector<double>& args);
+
+    size_t size() const { return endpoints_.size(); }
+    size_t healthy_count() const;
+    // Per-endpoint health plus hedging counters
+    json status() const;
+
+private:
+    struct EndpointState {
+        Endpoint endpoint;
+        std::mutex conn_mutex;
+        std::shared_ptr<RPCConnection> conn;
+        std::shared_ptr<RPCConnection> hedge_conn;  // second connection for hedging within one endpoint
+        std::atomic<int> consecutive_failures{0};
+        std::atomic<int64_t> ejected_until_ns{0};  // 0: healthy
+        std::atomic<int> ejections{0};             // consecutive ejections, drives backoff
+        std::atomic<bool> probing{false};
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> failures{0};
+    };
+
+    // Pick an endpoint according to the policy; `exclude` is skipped when possible.
+    // Sets `probe` when the pick is a probe of an ejected endpoint.
+    EndpointState* pick(const EndpointState* exclude, bool& probe);
+    std::shared_ptr<RPCConnection> connection(EndpointState& state, bool secondary = false);
+    void on_success(EndpointState& state, bool probe);
+    void on_failure(EndpointState& state, bool probe);
+    size_t outstanding(EndpointState& state);
+
+    bool is_hedged(const std::string& func) const;
+    json call_hedged(const std::string& func, const std::vector<double>& args);
+    void record_latency(uint64_t ns);
+    int64_t hedge_delay_ns() const { return hedge_delay_ns_.load(std::memory_order_relaxed); }
+    bool take_hedge_token();
+
+    EndpointSetOptions options_;
+    std::vector<std::unique_ptr<EndpointState>> endpoints_;
+    std::atomic<uint64_t> rr_counter_{0};
+    std::mutex rng_mutex_;
+    std::mt19937 rng_;
+
+    // Recent call latencies, the source of the hedge delay percentile
+    static constexpr size_t LATENCY_WINDOW = 1024;
+    static constexpr size_t LATENCY_REFRESH = 64;
+    std::mutex latency_mutex_;
+    std::vector<uint64_t> latency_window_;
+    size_t latency_samples_ = 0;
+    std::atomic<int64_t> hedge_delay_ns_{0};     // 0 until enough samples were seen
+
+    // Token bucket in thousandths of a hedge: every call adds max_hedge_ratio
+    std::atomic<int64_t> hedge_budget_milli_{0};
+    std::atomic<uint64_t> calls_total_{0};
+    std::atomic<uint64_t> hedges_sent_{0};
+    std::atomic<uint64_t> hedge_wins_{0};
+};
@@ -0,0 +1,116 @@
+// expr_eval.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "at_protocol.h" // json
+#include "request_arena.h"
+
+class ResponseWriter;
+
+enum class ExprSyntax : uint8_t {
+    Infix,   // (a+b)*c/d, sqrt(x), min(a, b), a^2
+    Postfix, // a b + c * d /   (neg = unary minus, functions take their operands from the stack)
+};
+
+enum class ExprOp : uint8_t {
+    PushConst,
+    PushVar,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Pow,
+    Min,
+    Max,
+    Neg,
+    Abs,
+    Sqrt,
+    Exp,
+    Log,
+};
+
+struct ExprInstr {
+    ExprOp op;
+    uint32_t var;   // PushVar: index into variables()
+    double value;   // PushConst
+};
+
+// A formula compiled into a postfix program over a value stack. Plans are
+// immutable, so one compiled plan can be evaluated by any number of threads.
+class ExprPlan {
+public:
+    static constexpr size_t MAX_TEXT_LENGTH = 4096;
+    static constexpr size_t MAX_STACK = 256;
+    static constexpr size_t MAX_VARIABLES = 256;
+
+    // Compile `text`. Variables bind in the order of `variables`; when that is
+    // empty, in order of first appearance. Constant subexpressions are folded.
+    // Throws std::invalid_argument naming the offending position.
+    static std::shared_ptr<const ExprPlan> compile(std::string_view text, ExprSyntax syntax,
+                                                   const std::vector<std::string>& variables = {});
+
+    const std::vector<std::string>& variables() const { return variables_; }
+    const std::vector<ExprInstr>& code() const { return code_; }
+
+    // Evaluate `count` bindings of variables().size() values each (row-major)
+    // into out[count]. Runs column-wise over chunks of rows, one instruction at
+    // a time. Throws std::domain_error on division by zero; other non-finite
+    // results (sqrt(-1), overflow) are returned as they are.
+    void evaluate(const double* bindings, size_t count, double* out) const;
+    double evaluate(const double* binding) const;
+
+private:
+    std::vector<std::string> variables_;
+    std::vector<ExprInstr> code_;
+    size_t max_stack_ = 0;
+};
+
+// LRU cache of compiled plans keyed by a 64-bit hash of (syntax, text,
+// variables); the full key is kept to tell hash collisions apart. Thread-safe.
+class ExprPlanCache {
+public:
+    explicit ExprPlanCache(size_t capacity = 1024) : capacity_(capacity) {}
+
+    ExprPlanCache(const ExprPlanCache&) = delete;
+    ExprPlanCache& operator=(const ExprPlanCache&) = delete;
+
+    // The plan for the expression, compiled on a miss (compile errors propagate).
+    // `hit` tells whether it was cached.
+    std::shared_ptr<const ExprPlan> get(std::string_view text, ExprSyntax syntax,
+                                        const std::vector<std::string>& variables, bool& hit);
+
+    size_t size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    struct Entry {
+        uint64_t hash;
+        std::string key;
+        std::shared_ptr<const ExprPlan> plan;
+    };
+
+    size_t capacity_;
+    mutable std::mutex mutex_;
+    std::list<Entry> lru_; // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+// The "eval" method:
+//   {"func": "eval", "expr": "(a+b)*c/d", "vars": ["a","b","c","d"], "args": [1,2,3,4]}
+//   {"func": "eval", "program": "a b + c * d /", "batch": [[1,2,3,4], [5,6,7,8]]}
+// "vars" is optional (first-appearance order). "args" gives one binding and
+// yields a number, "batch" many bindings and yields an array. Writes the
+// response; returns false when it is an error. Scratch space comes from the
+// request arena (see request_arena.h).
+bool handle_eval_request(const arena_json& request, ExprPlanCache& cache, ResponseWriter& response);
@@ -0,0 +1,53 @@
+// fast_request.h
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Argument list with inline room for the usual handful of numbers; only longer
+// lists spill to the heap
+class InlineArgs {
+public:
+    static constexpr size_t INLINE_CAPACITY = 8;
+
+    void push_back(double value) {
+        if (size_ < INLINE_CAPACITY) {
+            inline_[size_] = value;
+        } else {
+            if (size_ == INLINE_CAPACITY) {
+                heap_.assign(inline_, inline_ + INLINE_CAPACITY);
+            }
+            heap_.push_back(value);
+        }
+        ++size_;
+    }
+    void clear() {
+        size_ = 0;
+        heap_.clear();
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const double* data() const { return size_ <= INLINE_CAPACITY ? inline_ : heap_.data(); }
+    double operator[](size_t i) const { return data()[i]; }
+    const double* begin() const { return data(); }
+    const double* end() const { return data() + size_; }
+
+private:
+    double inline_[INLINE_CAPACITY];
+    size_t size_ = 0;
+    std::vector<double> heap_;
+};
+
+// A request body of the shape {"func": "<name>", "args": [<numbers>...]}
+struct FastRequest {
+    std::string_view func; // points into the parsed body
+    InlineArgs args;
+};
+
+// Single-pass parser for exactly that shape (keys in either order, any JSON
+// whitespace), with no DOM and no allocation for up to INLINE_CAPACITY args.
+// Returns false for anything else: other or repeated keys, escapes or non-ASCII
+// in the name, non-numeric args, trailing data... Callers then fall back to
+// nlohmann::json, so the fast path only changes speed, never results.
+bool parse_fast_request(std::string_view body, FastRequest& out);
@@ -0,0 +1,85 @@
+// frame_cipher.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "at_protocol.h"
+
+// Sealed frames: AES-256-GCM (Crypto++, AES-NI and PCLMUL when the CPU has
+// them) instead of the CRC, for links that leave the data centre. Both ends
+// share a 32-byte key; a connection that uses it starts with a handshake
+//
+//   client -> server  FLAG_SEALED, sequence 0, body = client salt (16 bytes)
+//   server -> client  FLAG_SEALED | FLAG_RESPONSE, body = server salt, GCM tag
+//
+// and every later frame in either direction is sealed:
+//
+//   header  flags | FLAG_SEALED, hash_value 0, body_length includes the tag
+//   body    ciphertext, then the 16-byte GCM tag
+//
+// The connection key is HKDF-SHA256(shared key, client salt || server salt), so
+// a recorded session cannot be replayed into a new connection. Nonces are
+// never sent: 4 bytes naming the direction and a 64-bit count of the frames
+// sent that way so far, which TCP delivers in order. The header is the
+// additional authenticated data, so flags and sequence cannot be altered
+// either. A frame that fails to open ends the connection.
+//
+// One cipher per connection. seal() and open() keep separate counters, so the
+// writer and the reader may run on different threads, but frames must be
+// sealed in the order they go out: callers seal under their send lock.
+class FrameCipher {
+public:
+    static constexpr size_t KEY_SIZE = 32;
+    static constexpr size_t SALT_SIZE = 16;
+    static constexpr size_t TAG_SIZE = ATProtocol::SEAL_TAG_SIZE;
+
+    enum class Role {
+        Client,
+        Server,
+    };
+
+    // False when built without Crypto++ (CMake option AT_RPC_CRYPTOPP)
+    static bool available();
+
+    // The key as 64 hex digits in a file (surrounding whitespace ignored);
+    // std::runtime_error when the file is missing or holds anything else
+    static std::vector<uint8_t> load_key(const std::string& path);
+
+    // std::invalid_argument for a key that is not KEY_SIZE bytes,
+    // std::runtime_error when built without Crypto++
+    FrameCipher(const std::vector<uint8_t>& key, Role role);
+    ~FrameCipher();
+
+    FrameCipher(const FrameCipher&) = delete;
+    FrameCipher& operator=(const FrameCipher&) = delete;
+
+    // Client, first frame of the connection: picks the client salt
+    std::vector<uint8_t> client_hello();
+    // Server: takes the client's hello and builds the reply to send back.
+    // False when the frame is not a hello.
+    bool accept_hello(const uint8_t* frame, size_t size, std::vector<uint8_t>& reply);
+    // Client: checks the server's reply. False when it is not one or the
+    // server holds a different key.
+    bool finish_hello(const uint8_t* frame, size_t size);
+    bool established() const;
+
+    // Encrypt a complete frame in place: sets FLAG_SEALED, zeroes hash_value,
+    // appends the tag and patches body_length. A frame built with FLAG_SEALED
+    // already set skipped the CRC (see ATProtocol::pack, ResponseWriter::finish).
+    void seal(std::vector<uint8_t>& frame);
+    // seal() on a copy, for frames shared between connections (push frames)
+    std::vector<uint8_t> seal_copy(const std::vector<uint8_t>& frame);
+
+    // Decrypt a received frame in place. On success `size` shrinks by TAG_SIZE
+    // and the header's body_length with it, so the frame unpacks as usual;
+    // FLAG_SEALED stays set and tells unpack() there is no CRC to check.
+    // False when the frame is not sealed or does not authenticate.
+    bool open(uint8_t* frame, size_t& size);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,45 @@
+// lz_codec.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// In-tree LZ77 codec for large frame bodies, in the LZ4 block format: greedy
+// matching on a 4-byte hash, no entropy stage, so compressing runs at several
+// hundred MB/s and decompressing at around 1 GB/s on one core. Blocks are
+// self-contained (no dictionary, no state between frames).
+//
+// A body sent with ATProtocol::FLAG_COMPRESSED is
+//
+//   uncompressed length (4 bytes, big-endian like the header), then one block
+//
+// and the header's body_length and CRC cover that compressed form. Compression
+// comes before sealing and decompression after opening (see frame_cipher.h).
+// Responses are only compressed for requests carrying
+// FLAG_ACCEPTS_COMPRESSED, so older clients never see such a body.
+
+static constexpr size_t LZ_BODY_PREFIX = 4;
+// Bodies that do not shrink by at least 1/LZ_MIN_SAVING are sent as they are
+static constexpr size_t LZ_MIN_SAVING = 8;
+
+// Largest block lz_compress() can produce for `size` input bytes
+size_t lz_compress_bound(size_t size);
+
+// Compress `size` bytes into dst. Returns the block size, or 0 when it would
+// not fit in `capacity` (compression stops as soon as it runs out of room, so
+// a capacity below the input size doubles as an early exit for poor ratios).
+size_t lz_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+
+// Decompress a block that must expand to exactly raw_size bytes. False for a
+// malformed block; never reads or writes out of bounds.
+bool lz_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t raw_size);
+
+// Append the FLAG_COMPRESSED form of `body` to `out`. False, `out` unchanged,
+// when it would not save at least 1/LZ_MIN_SAVING of the body.
+bool lz_compress_body(const uint8_t* body, size_t size, std::vector<uint8_t>& out);
+
+// Decode a FLAG_COMPRESSED body into `out`. False when it is malformed or
+// would expand beyond max_size (the receiver's frame limit), so a small frame
+// cannot make the receiver allocate more than a plain frame could.
+bool lz_decompress_body(const uint8_t* body, size_t size, size_t max_size, std::string& out);
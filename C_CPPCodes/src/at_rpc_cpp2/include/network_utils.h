@@ -10,6 +10,8 @@
     // #define SOCKET_ERROR SOCKET_ERROR
 #else
     #include <sys/socket.h>
+    #include <sys/uio.h>     // For iovec (gathered sends)
+    #include <poll.h>
     #include <netinet/in.h>
     #include <arpa/inet.h>
     #include <unistd.h>
@@ -31,8 +33,33 @@ socket_t create_socket();
 bool bind_socket(socket_t sock, const std::string& host, int port);
 bool connect_socket(socket_t sock, const std::string& host, int port);
 void close_socket(socket_t sock);
+// Shut both directions down without closing: a thread blocked in recv on the
+// socket wakes up and sees the connection end
+void shutdown_socket(socket_t sock);
 int get_last_error();
 std::string get_error_message(int err);
 
 size_t send_all(socket_t sockfd, const std::vector<uint8_t>& data);
-size_t recv_all(socket_t sockfd, std::vector<uint8_t>& data, size_t len);
\ No newline at end of file
+size_t recv_all(socket_t sockfd, std::vector<uint8_t>& data, size_t len);
+// Same, into caller memory (e.g. straight behind a header already in the buffer)
+size_t recv_all(socket_t sockfd, uint8_t* data, size_t len);
+
+// Single recv call (EINTR retried): >0 bytes read, 0 peer closed, SOCKET_ERROR on error
+int recv_some(socket_t sockfd, uint8_t* buf, size_t len);
+
+// Wait until the socket has data (or EOF) to read. timeout_ms = 0 only checks,
+// a negative timeout waits forever. Returns false on timeout or error.
+bool wait_readable(socket_t sockfd, int timeout_ms);
+
+// SO_RCVTIMEO: a blocking recv gives up after timeout_ms (0 = never)
+bool set_recv_timeout(socket_t sockfd, int timeout_ms);
+
+// One contiguous piece of a gathered write
+struct IoSlice {
+    const void* data;
+    size_t len;
+};
+
+// Gathered send (writev / WSASend): all slices leave in as few syscalls as the
+// kernel allows. Returns the number of bytes sent, short on error.
+size_t send_all_iov(socket_t sockfd, const std::vector<IoSlice>& slices);
\ No newline at end of file
@@ -0,0 +1,138 @@
+// pubsub.h
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "at_protocol.h" // json
+#include "request_arena.h"
+
+class ResponseWriter;
+
+// Topic fan-out over ordinary AT connections. A client subscribes with
+//   {"func": "subscribe", "topic": "prices", "policy": "conflate" | "drop"}
+// and from then on receives server-push frames (ATProtocol::FLAG_PUSH, header
+// sequence = the topic's message number) with the body
+//   {"data": <published value>, "seq": <n>, "topic": "prices"}
+// on the same connection, interleaved with its responses at frame boundaries.
+//
+// A message is encoded and checksummed once into an immutable frame shared by
+// every subscriber's queue. Subscribers that fall behind are handled by the
+// policy they subscribed with:
+//   conflate  a queued, unsent message of the topic is replaced by the newer
+//             one, so a slow client sees the latest value, not every value
+//   drop      the subscriber is disconnected once its queue is full
+using SharedFrame = std::shared_ptr<const std::vector<uint8_t>>;
+
+enum class SlowSubscriberPolicy : uint8_t {
+    Conflate,
+    Drop,
+};
+
+bool parse_slow_policy(const std::string& name, SlowSubscriberPolicy& policy);
+
+// The push side of one connection: a bounded queue of shared frames drained
+// by its own sender thread, so publishers never block on a slow socket.
+class PushSubscriber {
+public:
+    enum class Enqueued { Queued, Conflated, Dropped };
+
+    // writer sends one whole frame (blocking) and returns false when the
+    // connection is gone. on_drop runs once when the queue overflows under the
+    // drop policy, typically shutting the socket down.
+    using Writer = std::function<bool(const std::vector<uint8_t>& frame)>;
+    using OnDrop = std::function<void()>;
+
+    PushSubscriber(size_t max_queued, Writer writer, OnDrop on_drop);
+    ~PushSubscriber();
+
+    PushSubscriber(const PushSubscriber&) = delete;
+    PushSubscriber& operator=(const PushSubscriber&) = delete;
+
+    // Never blocks on the socket. Frames queued after close() or a drop are refused.
+    Enqueued enqueue(uint64_t topic_id, const SharedFrame& frame, SlowSubscriberPolicy policy);
+
+    // Stop the sender thread; unsent frames are discarded. After close()
+    // returns, neither writer nor on_drop runs again.
+    void close();
+
+    bool open() const;
+    uint64_t sent() const { return sent_.load(std::memory_order_relaxed); }
+
+private:
+    struct Item {
+        uint64_t topic_id;
+        SharedFrame frame;
+    };
+
+    void sender_loop();
+
+    const size_t max_queued_;
+    Writer writer_;
+    OnDrop on_drop_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Item> queue_;
+    bool closed_ = false;
+    std::atomic<uint64_t> sent_{0};
+    std::thread sender_;
+};
+
+// Topic registry. Holds subscribers weakly: a closed or dropped one is pruned
+// by the next publish to its topics.
+class PubSubHub {
+public:
+    void subscribe(const std::string& topic, const std::shared_ptr<PushSubscriber>& subscriber,
+                   SlowSubscriberPolicy policy);
+    bool unsubscribe(const std::string& topic, const PushSubscriber* subscriber);
+
+    // Encode `data` once and queue it for every subscriber of `topic`.
+    // Returns how many subscribers took it (conflated ones included).
+    size_t publish(const std::string& topic, const json& data);
+
+    json stats() const; // {"topics", "published", "deliveries", "conflated", "dropped"}
+
+private:
+    struct Subscription {
+        std::weak_ptr<PushSubscriber> subscriber;
+        const PushSubscriber* key;
+        SlowSubscriberPolicy policy;
+    };
+    struct Topic {
+        uint64_t id;
+        uint32_t next_seq = 1;
+        std::vector<Subscription> subscriptions;
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Topic> topics_;
+    uint64_t next_topic_id_ = 1;
+    uint64_t published_ = 0;
+    uint64_t deliveries_ = 0;
+    uint64_t conflated_ = 0;
+    uint64_t dropped_ = 0;
+};
+
+// subscribe / unsubscribe / publish
+bool is_pubsub_method(std::string_view func);
+
+// Handle one of those requests for a connection. `subscriber` returns the
+// connection's PushSubscriber, creating it on first use. Writes the response;
+// returns false when it is an error.
+//   subscribe    {"topic", "policy"?}  -> {"topic", "policy"}
+//   unsubscribe  {"topic"}             -> true / false
+//   publish      {"topic", "data"}     -> number of subscribers reached
+bool handle_pubsub_request(const std::string& func, const arena_json& request, PubSubHub& hub,
+                           const std::function<std::shared_ptr<PushSubscriber>()>& subscriber,
+                           ResponseWriter& response);
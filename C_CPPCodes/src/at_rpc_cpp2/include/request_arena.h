@@ -0,0 +1,148 @@
+// request_arena.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "at_protocol.h" // json
+
+// Request-lifetime memory for the handler path. A request's JSON DOM, its
+// strings and scratch vectors all die together when the response is written,
+// so instead of one malloc/free pair per node they are carved from a
+// monotonic arena and released with one pointer reset.
+//
+// Each thread has one arena (thread-local, so connection threads and
+// scheduler workers never share), active while a RequestArena::Scope is open.
+// ArenaAllocator draws from the active arena, or from the heap when none is,
+// so arena_* types stay usable anywhere; a value allocated inside a Scope must
+// not outlive it.
+//
+// The first chunk is CHUNK_SIZE bytes and later ones double. When a request
+// needed more than one chunk, reset() folds them into a single chunk of their
+// total size (up to RETAIN_LIMIT), so the next request of that size fits in
+// one and steady state allocates nothing.
+class RequestArena {
+public:
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+    static constexpr size_t RETAIN_LIMIT = 1024 * 1024;
+
+    RequestArena() = default;
+    ~RequestArena();
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    void* allocate(size_t size, size_t align);
+    bool owns(const void* p) const;
+    // Construct a T in the arena that is never destroyed: the reset takes its
+    // memory back. Only for types whose destructor just frees arena memory,
+    // e.g. arena_json, whose destructor otherwise walks the whole DOM (with a
+    // heap-allocated stack) to free nodes one by one.
+    template <typename T, typename... Args>
+    T& make(Args&&... args) {
+        return *new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+    // Forget everything allocated since the last reset
+    void reset();
+    size_t used() const { return used_; }
+
+    // The calling thread's active arena, nullptr outside a Scope
+    static RequestArena* current() { return current_; }
+
+    // {"chunks", "bytes"}: chunks allocated since start and bytes held by all
+    // arenas now. "chunks" standing still is the steady state.
+    static json stats();
+
+    // Activates the calling thread's arena; resets it on the way out. Nested
+    // scopes share the outer one's lifetime.
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        bool owner_;
+    };
+
+private:
+    struct Chunk {
+        uint8_t* data;
+        size_t size;
+    };
+    void* allocate_slow(size_t size, size_t align);
+    void add_chunk(size_t size);
+
+    std::vector<Chunk> chunks_; // the last one is being filled
+    uint8_t* cursor_ = nullptr;
+    uint8_t* limit_ = nullptr;
+    size_t used_ = 0;           // bytes handed out since the last reset, across chunks
+
+    static inline thread_local RequestArena* current_ = nullptr;
+};
+
+inline void* RequestArena::allocate(size_t size, size_t align) {
+    uintptr_t p = (reinterpret_cast<uintptr_t>(cursor_) + align - 1) & ~(uintptr_t(align) - 1);
+    if (cursor_ && p + size <= reinterpret_cast<uintptr_t>(limit_)) {
+        used_ += p + size - reinterpret_cast<uintptr_t>(cursor_);
+        cursor_ = reinterpret_cast<uint8_t*>(p + size);
+        return reinterpret_cast<void*>(p);
+    }
+    return allocate_slow(size, align);
+}
+
+// Stateless allocator over RequestArena::current(), as nlohmann::basic_json
+// default-constructs its AllocatorType wherever it allocates. Deallocation
+// inside the arena is a no-op; the memory comes back at reset().
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() noexcept = default;
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        if (RequestArena* arena = RequestArena::current()) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t) noexcept {
+        RequestArena* arena = RequestArena::current();
+        if (arena && arena->owns(p)) {
+            return;
+        }
+        ::operator delete(p);
+    }
+
+    friend bool operator==(const ArenaAllocator&, const ArenaAllocator&) { return true; }
+    friend bool operator!=(const ArenaAllocator&, const ArenaAllocator&) { return false; }
+};
+
+using arena_string = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+template <typename T>
+using arena_vector = std::vector<T, ArenaAllocator<T>>;
+
+// The request DOM. Converts to and from json (both ways copy), e.g. for data
+// that outlives the request such as a published message.
+using arena_json = nlohmann::basic_json<std::map, std::vector, arena_string, bool, std::int64_t, std::uint64_t, double,
+                                        ArenaAllocator>;
+
+// arena_json::at(key) does not compile for a custom string type in this
+// nlohmann version; the same lookup, throwing the same out_of_range
+inline const arena_json& arena_at(const arena_json& object, const char* key) {
+    auto it = object.find(key);
+    if (it == object.end()) {
+        throw arena_json::out_of_range::create(403, std::string("key '") + key + "' not found", object);
+    }
+    return *it;
+}
@@ -0,0 +1,63 @@
+// response_writer.h
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "at_protocol.h"
+#include "request_arena.h"
+
+// Builds one AT response frame in place: the header slot is reserved up front,
+// the JSON body is formatted directly behind it and finish() patches length and
+// CRC into the slot. No json DOM, no body string, no packet copy. The buffer
+// handed in is cleared but keeps its capacity, so a recycled (pooled) buffer
+// makes the whole response allocation-free.
+//
+// Bodies are the JSON nlohmann's dump() produces for {"status": ..., "result" /
+// "message": ...}, keys in the same order and non-finite numbers as null. The
+// only difference: numbers use the shortest round-trip digits, where dump()'s
+// grisu2 occasionally prints one digit more; both parse to the same double.
+class ResponseWriter {
+public:
+    explicit ResponseWriter(std::vector<uint8_t> buffer = {});
+
+    // {"status":"success","result":<number>}
+    void success(double result);
+    // {"status":"success","result":[<number>, ...]}
+    void success(const double* results, size_t count);
+    // {"status":"success","result":<value>}; for the rare structured results
+    void success(const json& result);
+    void success(const arena_json& result); // dumped into the request arena
+    // {"status":"error","message":"<message>"}
+    void error(std::string_view message);
+
+    // Raw body bytes for FLAG_BINARY responses: appends `size` bytes and returns
+    // where to fill them in (valid until the next write)
+    uint8_t* binary(size_t size);
+
+    // Body written so far; valid until finish()
+    std::string_view body() const;
+
+    // Re-encode the JSON body written so far as MessagePack, for answers to
+    // FLAG_MSGPACK requests (the slow path: it goes through the DOM)
+    void to_msgpack();
+
+    // Replace a body of at least `threshold` bytes by its FLAG_COMPRESSED form
+    // (see lz_codec.h), after to_msgpack(). False, body untouched, when it is
+    // shorter or does not compress well enough; on true the caller adds
+    // FLAG_COMPRESSED to finish()'s flags.
+    bool compress(size_t threshold);
+
+    // Fill in the header and hand out the finished frame (without CRC when
+    // flags has FLAG_SEALED: it is about to go through FrameCipher::seal)
+    std::vector<uint8_t> finish(uint16_t flags, uint32_t sequence);
+
+private:
+    void append(std::string_view text);
+    // Grow through the buffer pool rather than the vector's own reallocation
+    void reserve(size_t size);
+    void append_number(double value);
+    void append_string(std::string_view text);
+
+    std::vector<uint8_t> frame_;
+};
@@ -0,0 +1,83 @@
+// rpc_capture.h
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 抓包文件格式 (host byte order):
+//   file header (32 bytes): magic "ATCP", version, record alignment, reserved,
+//                           data_end (bytes used, set on close), start_ns
+//   records, each 8-byte aligned:
+//     uint64 ts_ns    arrival time relative to start_ns
+//     uint32 conn_id
+//     uint32 length   frame bytes that follow; written last, 0 marks the end
+//     uint8  frame[length]   header + body exactly as received
+struct CaptureFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t alignment;
+    uint32_t reserved;
+    uint64_t data_end;
+    uint64_t start_ns;
+};
+static_assert(sizeof(CaptureFileHeader) == 32, "CaptureFileHeader layout is part of the capture format");
+
+struct CaptureRecordHeader {
+    uint64_t ts_ns;
+    uint32_t conn_id;
+    uint32_t length;
+};
+static_assert(sizeof(CaptureRecordHeader) == 16, "CaptureRecordHeader layout is part of the capture format");
+
+// Append-only capture of incoming AT frames into a preallocated memory-mapped
+// file. append() is safe from any number of threads: it reserves space with one
+// atomic add and copies the frame, no locks and no syscalls. Frames that do not
+// fit once the file is full are counted in dropped() and not recorded.
+// A file from a crashed process is still readable: records are published by
+// writing their length last. POSIX only (mmap); open() fails on Windows.
+class CaptureWriter {
+public:
+    static constexpr uint32_t FILE_MAGIC = 0x50435441; // "ATCP"
+    static constexpr uint32_t FILE_VERSION = 1;
+    static constexpr size_t ALIGNMENT = 8;
+
+    CaptureWriter() = default;
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    // Create (truncate) path and map capacity bytes of it
+    bool open(const std::string& path, size_t capacity);
+    // Unmap and shrink the file to the bytes actually used
+    void close();
+    bool is_open() const { return base_.load(std::memory_order_acquire) != nullptr; }
+
+    void append(uint32_t conn_id, uint64_t arrival_ns, const uint8_t* frame, size_t length);
+
+    uint64_t frames() const { return frames_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+    std::atomic<uint8_t*> base_{nullptr};
+    std::atomic<int> writers_{0};   // appends in progress; close() waits for them
+    size_t capacity_ = 0;
+    uint64_t start_ns_ = 0;
+    int fd_ = -1;
+    std::atomic<size_t> offset_{0};
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+struct CapturedFrame {
+    uint64_t ts_ns; // relative to the start of the capture
+    uint32_t conn_id;
+    std::vector<uint8_t> bytes;
+};
+
+// Read every complete record of a capture file, ordered by arrival time.
+// Returns false when the file is missing or not a capture.
+bool read_capture(const std::string& path, std::vector<CapturedFrame>& frames);
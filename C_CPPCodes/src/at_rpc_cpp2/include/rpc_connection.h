@@ -0,0 +1,167 @@
+// rpc_connection.h
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "at_protocol.h"
+#include "buffer_pool.h"
+#include "bulk_ops.h"
+#include "network_utils.h"
+
+class FrameCipher;
+
+// Connection-level failure (connect, send, disconnect, timeout). Remote
+// application errors such as "Division by zero" are plain std::runtime_error,
+// so callers can tell a broken endpoint from a bad request.
+class RPCTransportError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Persistent, pipelined AT connection. Any number of threads may issue calls;
+// a reader thread matches responses to callers by sequence number.
+class RPCConnection {
+public:
+    static constexpr uint32_t MAX_BODY_LENGTH = 10 * 1024 * 1024;
+
+    struct PendingCall {
+        uint32_t sequence;
+        std::future<json> result;
+    };
+
+    // Completion callback: exactly one of response / error is meaningful. It runs
+    // on the reader thread (or the calling thread when the send fails), so it
+    // must not block.
+    using Completion = std::function<void(json&& response, std::exception_ptr error)>;
+
+    // Server push of a subscribed topic (see pubsub.h): topic, the topic's
+    // message number and the published value. Runs on the reader thread, so it
+    // must not block.
+    using PushHandler = std::function<void(const std::string& topic, uint32_t seq, json&& data)>;
+
+    RPCConnection(const std::string& host, int port);
+    ~RPCConnection();
+
+    RPCConnection(const RPCConnection&) = delete;
+    RPCConnection& operator=(const RPCConnection&) = delete;
+
+    // Seal every frame with AES-256-GCM under this 32-byte key (see
+    // frame_cipher.h); call before connect(). connect() then fails unless the
+    // server holds the same key. std::runtime_error when built without Crypto++.
+    void enable_encryption(const std::vector<uint8_t>& key);
+
+    // LZ-compress request bodies of at least `threshold` bytes (see
+    // lz_codec.h) and let the server compress large responses. Bodies that do
+    // not shrink by 1/8 go out as they are. Call before issuing calls;
+    // 0 turns it off again.
+    void enable_compression(size_t threshold);
+
+    bool connect();
+    void close();
+    bool is_connected() const { return connected_.load(std::memory_order_acquire); }
+
+    const std::string& host() const { return host_; }
+    int port() const { return port_; }
+
+    // Send a request without waiting; the future yields the response JSON or
+    // throws (RPCTransportError / std::runtime_error for remote errors).
+    PendingCall call_async(const std::string& func, const std::vector<double>& args);
+
+    // Callback flavour; returns the request sequence, usable with cancel()
+    uint32_t call_async(const std::string& func, const std::vector<double>& args, Completion on_done);
+
+    // Blocking call with timeout; a timed-out call is cancelled
+    json call(const std::string& func, const std::vector<double>& args, int timeout_ms = 10000);
+
+    // Arbitrary request body, for methods taking more than {"func", "args"}
+    // (e.g. {"func": "eval", "expr": ..., "batch": ...}, see expr_eval.h)
+    uint32_t request_async(const json& request, Completion on_done);
+    json request(const json& request, int timeout_ms = 10000);
+
+    // Where push frames go; without a handler they are dropped. Set it before
+    // subscribing ({"func": "subscribe", "topic": ..., "policy": ...} through request()).
+    void set_push_handler(PushHandler handler);
+
+    // Array-valued call (see bulk_ops.h); `body` comes from encode_bulk_request()
+    // and must fit in one frame (std::invalid_argument otherwise).
+    // The callback flavour receives the binary response body as json::binary.
+    uint32_t call_bulk_async(const std::vector<uint8_t>& body, Completion on_done);
+    BulkResult call_bulk(const std::vector<uint8_t>& body, int timeout_ms = 10000);
+
+    // Typed call (see typed_call.h); `body` comes from encode_typed_call(), and
+    // the generated <service>::Client wraps both ends. Returns the encoded result.
+    uint32_t call_typed_async(const std::vector<uint8_t>& body, Completion on_done);
+    std::vector<uint8_t> call_typed(const std::vector<uint8_t>& body, int timeout_ms = 10000);
+
+    // Forget a pending call; its response is dropped when it arrives. Returns
+    // false when the call had already completed (its callback ran or is running).
+    bool cancel(uint32_t sequence);
+
+    // Requests sent and not yet answered or cancelled
+    size_t outstanding() const;
+
+    // Opt-in micro-batching: calls issued within `window` of the first one, or up
+    // to max_calls of them, leave back-to-back in a single gathered write. The
+    // first caller of a batch waits up to `window` before flushing, so latency
+    // grows by at most `window` in exchange for far fewer syscalls and packets.
+    // Configure before issuing calls; max_calls <= 1 disables batching.
+    void enable_batching(std::chrono::microseconds window, size_t max_calls);
+
+    uint64_t frames_sent() const { return frames_sent_.load(std::memory_order_relaxed); }
+    uint64_t writes() const { return writes_.load(std::memory_order_relaxed); }
+
+private:
+    bool handshake();
+    void reader_loop();
+    void dispatch_push(uint32_t sequence, std::string_view body);
+    void fail_all(const std::string& reason);
+    void fail_call(uint32_t sequence, const std::string& reason);
+    uint32_t submit(uint16_t flags, const uint8_t* body, size_t body_size, Completion on_done);
+
+    struct BatchedFrame {
+        uint32_t sequence;
+        PooledBuffer packet; // back to the pool once the batch is sent
+    };
+    void enqueue_batched(uint32_t sequence, PooledBuffer&& packet);
+    void flush_batch(std::unique_lock<std::mutex>& lock);
+
+    std::string host_;
+    int port_;
+    socket_t sock_;
+    std::atomic<bool> connected_;
+    std::vector<uint8_t> key_;            // set by enable_encryption
+    std::unique_ptr<FrameCipher> cipher_; // per session; used under write_mutex_ and by the reader
+    size_t compress_threshold_ = 0;       // set by enable_compression; 0 = plain bodies only
+
+    ATProtocol protocol_; // sequence source; unpack only runs on the reader thread
+    std::mutex write_mutex_;
+
+    mutable std::mutex pending_mutex_;
+    std::unordered_map<uint32_t, Completion> pending_;
+
+    std::thread reader_;
+
+    std::mutex push_mutex_;
+    PushHandler on_push_;
+
+    std::chrono::microseconds batch_window_{0};
+    size_t batch_max_calls_ = 0;
+    std::mutex batch_mutex_;
+    std::condition_variable batch_cv_;
+    std::vector<BatchedFrame> batch_;
+    uint64_t batch_generation_ = 0; // bumped on every flush, wakes the waiting leader
+
+    std::atomic<uint64_t> frames_sent_{0};
+    std::atomic<uint64_t> writes_{0};
+};
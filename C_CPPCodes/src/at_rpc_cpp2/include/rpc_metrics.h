@@ -0,0 +1,132 @@
+// rpc_metrics.h
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "network_utils.h"
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+// 单调时钟纳秒时间戳，所有阶段耗时都基于它计算
+inline uint64_t metrics_now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Lock-free latency histogram with power-of-two nanosecond buckets.
+// Bucket i counts samples in [2^i, 2^(i+1)) ns; the last bucket is open-ended.
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKETS = 40; // 2^39 ns ~= 9 minutes
+
+    void record(uint64_t ns) noexcept {
+        size_t idx = bucket_index(ns);
+        buckets_[idx].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum_ns() const { return sum_ns_.load(std::memory_order_relaxed); }
+    uint64_t bucket_count(size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+
+    // Upper bound (exclusive) of bucket i in nanoseconds
+    static uint64_t bucket_upper_ns(size_t i) { return uint64_t(1) << (i + 1); }
+
+    // Approximate quantile (0..1), reported as the upper bound of the bucket holding it
+    uint64_t percentile_ns(double q) const;
+
+    static size_t bucket_index(uint64_t ns) noexcept {
+        if (ns == 0) return 0;
+#if defined(_MSC_VER)
+        unsigned long msb;
+        _BitScanReverse64(&msb, ns);
+        size_t idx = msb;
+#else
+        size_t idx = 63 - static_cast<size_t>(__builtin_clzll(ns));
+#endif
+        return idx < BUCKETS ? idx : BUCKETS - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+};
+
+// Per-method counters. Each slot sits on its own cache line so hot methods
+// recorded from different connection threads do not false-share.
+struct alignas(64) MethodMetrics {
+    std::string name;
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> bytes_in{0};
+    std::atomic<uint64_t> bytes_out{0};
+
+    LatencyHistogram queue_wait; // frame complete -> handler start
+    LatencyHistogram handler;    // handler start -> handler end
+    LatencyHistogram send;       // response encode -> send complete
+};
+
+class RPCMetrics {
+public:
+    static constexpr size_t MAX_METHODS = 64;
+    static constexpr const char* OVERFLOW_METHOD = "__other";
+
+    RPCMetrics() = default;
+    RPCMetrics(const RPCMetrics&) = delete;
+    RPCMetrics& operator=(const RPCMetrics&) = delete;
+
+    // Lock-free lookup of an already registered method; the first call for a new
+    // name takes a mutex to publish the slot. Once the table is full every new
+    // name is folded into OVERFLOW_METHOD so the table stays bounded.
+    MethodMetrics& method(const std::string& name);
+
+    // Gauges
+    std::atomic<int64_t> connections{0};      // currently open client connections
+    std::atomic<int64_t> queue_depth{0};      // requests received but not yet answered
+    std::atomic<uint64_t> connections_total{0};
+    // Write coalescing: responses / response_writes is the responses per send call
+    std::atomic<uint64_t> responses{0};
+    std::atomic<uint64_t> response_writes{0};
+    // Receive buffer memory committed across connections, and reads that paused on the quota
+    std::atomic<int64_t> rx_buffer_bytes{0};
+    std::atomic<uint64_t> rx_quota_stalls{0};
+
+    json to_json() const;
+    std::string to_prometheus() const;
+
+private:
+    MethodMetrics* find(const std::string& name, size_t count);
+
+    std::array<MethodMetrics, MAX_METHODS> methods_;
+    std::atomic<size_t> method_count_{0};
+    std::mutex register_mutex_;
+};
+
+// Minimal HTTP/1.0 endpoint serving RPCMetrics::to_prometheus() as plain text.
+// Intended for a local scrape port, e.g. 127.0.0.1:9100/metrics.
+class MetricsHttpExporter {
+public:
+    MetricsHttpExporter(const RPCMetrics& metrics, const std::string& host, int port);
+    ~MetricsHttpExporter();
+
+    bool start();
+    void stop();
+
+private:
+    void serve_loop();
+
+    const RPCMetrics& metrics_;
+    std::string host_;
+    int port_;
+    socket_t listen_socket_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
@@ -0,0 +1,97 @@
+// rpc_profiler.h
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "at_protocol.h" // json
+#include "fast_request.h" // InlineArgs
+
+class ResponseWriter;
+
+// In-process sampling profiler, for live servers where perf is not available
+// (perf_event_paranoid, containers without CAP_PERFMON). While running, a
+// process CPU-time timer (ITIMER_PROF) sends SIGPROF every 1/hz s of CPU the
+// process burns, to the thread that burned it; the handler unwinds that
+// thread's stack into its own lock-free ring, and a collector thread drains
+// the rings every COLLECT_INTERVAL_MS into per-stack counts. stop() names the
+// frames and writes them as collapsed stacks,
+//
+//   <thread name>;<outermost frame>;...;<innermost frame> <samples>
+//
+// one line per distinct stack, the input of flamegraph.pl or speedscope.
+//
+// Stacks are unwound with the toolchain's DWARF unwinder (_Unwind_Backtrace,
+// the .eh_frame tables every x86-64 / AArch64 Linux binary carries), so no
+// frame pointers are needed and libc frames (send, recv, poll) keep their
+// callers. On glibc 2.35+ with GCC 12+ its unwind-table lookup
+// (_dl_find_object) takes no lock, which keeps it safe in the handler. Frames
+// are named from each module's ELF symbol table (static functions and lambdas
+// included); inlined calls fold into their caller.
+//
+// Linux on x86-64 and AArch64 only; available() is false elsewhere.
+class RPCProfiler {
+public:
+    // Reserved methods, see handle_profile_request
+    static constexpr const char* START_METHOD = "__profile_start";
+    static constexpr const char* STOP_METHOD = "__profile_stop";
+
+    static constexpr unsigned DEFAULT_HZ = 99; // off the beat of 10 ms / 100 ms periodic work
+    static constexpr unsigned MAX_HZ = 1000; // the kernel tick (CONFIG_HZ) caps the real rate
+    static constexpr size_t MAX_DEPTH = 64;
+    static constexpr size_t MAX_THREADS = 256; // threads sampled per run; later ones count as dropped
+    static constexpr size_t RING_SAMPLES = 64; // per thread, drained every COLLECT_INTERVAL_MS
+    static constexpr unsigned COLLECT_INTERVAL_MS = 20;
+
+    static RPCProfiler& instance();
+    static bool available();
+
+    // Start sampling at `hz` samples per second of process CPU time. Throws
+    // std::invalid_argument for a bad rate and std::runtime_error when already
+    // running, unsupported, or SIGPROF belongs to someone else.
+    void start(unsigned hz = DEFAULT_HZ);
+    bool running() const { return running_.load(std::memory_order_relaxed); }
+
+    // Stop and write the collapsed stacks to `path`. Returns {"path",
+    // "samples", "dropped", "stacks", "threads", "seconds"}; throws
+    // std::runtime_error when not running or the file cannot be written (the
+    // samples are discarded either way).
+    json stop(const std::string& path);
+
+private:
+    RPCProfiler() = default;
+    void collect_loop();
+    void drain();
+
+    std::mutex mutex_; // serializes start / stop
+    std::atomic<bool> running_{false};
+    uint64_t started_ns_ = 0;
+
+    std::thread collector_;
+    std::mutex collect_mutex_;
+    std::condition_variable collect_cv_;
+    bool collect_stop_ = false;
+
+    // Filled by the collector: {thread name index, pcs innermost first} -> samples
+    std::map<std::vector<uintptr_t>, uint64_t> counts_;
+    std::vector<std::string> thread_names_;
+    std::vector<int> slot_names_; // per ring: index into thread_names_, -1 until seen
+    uint64_t samples_ = 0;
+};
+
+bool is_profile_method(std::string_view func);
+
+// Handle one of the reserved profiler methods. `output_path` is where stop
+// writes; empty means profiling is off for this server. Writes the response;
+// returns false when it is an error.
+//   __profile_start  [hz]?  -> {"hz"}
+//   __profile_stop          -> {"path", "samples", "dropped", "stacks", "threads", "seconds"}
+bool handle_profile_request(const std::string& func, const InlineArgs& args, const std::string& output_path,
+                            ResponseWriter& response);
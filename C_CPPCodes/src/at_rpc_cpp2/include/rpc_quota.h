@@ -0,0 +1,50 @@
+// rpc_quota.h
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Byte budget shared by all connections of a server (receive buffer memory).
+// acquire() blocks while the budget is exhausted; a connection waiting here
+// stops reading, so TCP flow control pushes back on its client.
+//
+// Readers paused on the budget may each hold part of a frame that cannot
+// complete until another one does. To rule out that deadlock, the oldest frame
+// in progress (see begin_frame) is always granted, so memory stays bounded by
+// limit + one connection's quota and some frame always makes progress.
+class ByteBudget {
+public:
+    explicit ByteBudget(size_t limit = 0) : limit_(limit) {}
+
+    ByteBudget(const ByteBudget&) = delete;
+    ByteBudget& operator=(const ByteBudget&) = delete;
+
+    // 0 = unlimited. Lowering the limit never revokes bytes already held.
+    void set_limit(size_t limit);
+
+    // Register a frame being received; returns its ticket (never 0)
+    uint64_t begin_frame();
+    void end_frame(uint64_t ticket);
+
+    // Reserve n bytes for the frame `ticket` (0: no frame, no priority), waiting
+    // up to `timeout` for other connections to release theirs. Returns false on
+    // timeout. `waited` reports whether the caller had to pause.
+    bool acquire(size_t n, uint64_t ticket, std::chrono::milliseconds timeout, bool* waited = nullptr);
+    void release(size_t n);
+
+    size_t used() const;
+    size_t limit() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    size_t limit_;
+    size_t used_ = 0;
+    uint64_t next_ticket_ = 1;
+    // Tickets in progress, oldest first: they are issued in increasing order, so
+    // a vector stays sorted and, once grown, costs no allocation per frame
+    std::vector<uint64_t> frames_;
+};
@@ -0,0 +1,90 @@
+// rpc_scheduler.h
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Shared execution queue with deficit round-robin across flows (one flow per
+// connection or per client identity). Each flow keeps its own FIFO; the
+// workers visit the flows with work in turn and a flow may start jobs worth up
+// to quantum * weight cost units per visit, carrying unused credit over while
+// it stays busy. A client pipelining thousands of requests therefore gets its
+// weighted share of the workers, not all of them.
+//
+// max_outstanding bounds a flow's jobs queued or running: submit() blocks
+// until one of them finishes, so a noisy client stalls on its own socket
+// (TCP flow control) instead of growing everyone's queue wait.
+class FairScheduler {
+public:
+    using Job = std::function<void()>;
+    // Runs first on each worker thread (e.g. to pin it to a CPU)
+    using WorkerInit = std::function<void(size_t worker_index)>;
+
+    FairScheduler(size_t workers, size_t quantum, size_t max_outstanding, WorkerInit init = {});
+    ~FairScheduler();
+
+    FairScheduler(const FairScheduler&) = delete;
+    FairScheduler& operator=(const FairScheduler&) = delete;
+
+    // Share of a flow relative to the default weight 1; applies to flows
+    // created after the call. Throws std::invalid_argument for weight 0.
+    void set_weight(const std::string& flow, uint32_t weight);
+
+    // Queue `job` on `flow`, blocking while the flow is at max_outstanding.
+    // `cost` is in the units of the quantum (the server uses frame bytes).
+    // Returns false, without running the job, once stop() has begun.
+    bool submit(const std::string& flow, size_t cost, Job job);
+
+    // Run what is queued, then join the workers
+    void stop();
+
+    size_t queued() const;             // jobs waiting for a worker
+    uint64_t throttled() const { return throttled_.load(std::memory_order_relaxed); } // submits that hit max_outstanding
+    size_t workers() const { return threads_.size(); }
+
+private:
+    struct Task {
+        size_t cost;
+        Job job;
+    };
+
+    struct Flow {
+        std::string name;
+        uint32_t weight = 1;
+        size_t deficit = 0;
+        bool granted = false;      // quantum already added for the current visit
+        bool active = false;       // in active_
+        size_t outstanding = 0;    // queued + running
+        size_t waiters = 0;        // submitters blocked on `space`
+        std::deque<Task> queue;
+        std::condition_variable space; // submitters waiting on max_outstanding
+    };
+
+    void worker_loop(size_t index);
+    void finish(Flow& flow);
+
+    WorkerInit init_;
+    const size_t quantum_;
+    const size_t max_outstanding_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_;
+    std::unordered_map<std::string, std::unique_ptr<Flow>> flows_;
+    std::unordered_map<std::string, uint32_t> weights_;
+    std::list<Flow*> active_;          // flows with queued jobs, in visiting order
+    size_t queued_ = 0;
+    bool stopping_ = false;
+    std::atomic<uint64_t> throttled_{0};
+    std::mutex join_mutex_;
+    std::vector<std::thread> threads_;
+};
@@ -0,0 +1,105 @@
+// rpc_trace.h
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rpc_metrics.h" // metrics_now_ns()
+
+// 请求生命周期中的各个时间点
+enum class TraceStage : uint8_t {
+    Accept = 0,     // connection accepted (sequence 0)
+    FirstByte,      // header bytes arrived
+    FrameComplete,  // header + body fully received
+    Decode,         // AT unpack + body parse done
+    Enqueue,        // request handed to execution
+    HandlerStart,
+    HandlerEnd,
+    Encode,         // response packed
+    SendComplete,
+    Count
+};
+
+const char* trace_stage_name(TraceStage stage);
+
+// Fixed 24-byte binary record, written as-is into the dump file
+struct TraceEvent {
+    uint64_t ts_ns;      // metrics_now_ns() clock
+    uint32_t conn_id;
+    uint32_t sequence;
+    uint32_t thread_id;
+    uint8_t stage;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(TraceEvent) == 24, "TraceEvent layout is part of the dump format");
+
+// Single-producer ring owned by one thread at a time. The writer never blocks;
+// when full it overwrites the oldest events. Readers detect overwritten slots
+// by re-reading head_ after copying.
+class TraceRing {
+public:
+    static constexpr size_t CAPACITY = 8192; // power of two, 192 KB per ring
+
+    TraceRing() : events_(new TraceEvent[CAPACITY]), head_(0) {}
+
+    void push(const TraceEvent& ev) noexcept {
+        uint64_t h = head_.load(std::memory_order_relaxed);
+        events_[h & (CAPACITY - 1)] = ev;
+        head_.store(h + 1, std::memory_order_release);
+    }
+
+    // Append the events currently held by the ring to out
+    void snapshot(std::vector<TraceEvent>& out) const;
+
+private:
+    std::unique_ptr<TraceEvent[]> events_;
+    std::atomic<uint64_t> head_;
+};
+
+// Process-wide tracer. Every recording thread lazily takes a ring; rings of
+// exited threads are recycled (their history is kept until overwritten), so
+// memory is bounded by the peak number of concurrent threads.
+class RPCTracer {
+public:
+    static constexpr uint32_t FILE_MAGIC = 0x41545452; // "ATTR"
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    static RPCTracer& instance();
+
+    void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    void record(TraceStage stage, uint32_t conn_id, uint32_t sequence, uint64_t ts_ns) {
+        if (!enabled()) return;
+        local_ring().push({ts_ns, conn_id, sequence, thread_id(), static_cast<uint8_t>(stage), {0, 0, 0}});
+    }
+    void record(TraceStage stage, uint32_t conn_id, uint32_t sequence) {
+        if (!enabled()) return;
+        record(stage, conn_id, sequence, metrics_now_ns());
+    }
+
+    // Write all buffered events to a binary dump file. Returns the number of
+    // events written, or -1 on I/O error.
+    long long dump(const std::string& path);
+
+private:
+    RPCTracer() = default;
+    TraceRing& local_ring();
+    void release_ring(TraceRing* ring);
+    static uint32_t thread_id();
+
+    friend struct TraceRingHandle;
+
+    std::atomic<bool> enabled_{false};
+    std::mutex rings_mutex_;
+    std::vector<std::unique_ptr<TraceRing>> rings_;
+    std::vector<TraceRing*> free_rings_;
+};
+
+// Convert a binary dump into Chrome trace JSON (chrome://tracing, Perfetto).
+// Each request becomes a row of complete ("X") events: recv, decode, enqueue,
+// queue, handler, encode, send.
+bool trace_dump_to_chrome(const std::string& dump_path, const std::string& json_path);
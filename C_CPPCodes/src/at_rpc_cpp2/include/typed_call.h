@@ -0,0 +1,192 @@
+// typed_call.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+class ResponseWriter;
+
+// Typed methods: declared in an .atidl schema (see idl/) and served through the
+// code idl/atidl.py generates from it, instead of hand-parsed JSON. A request
+// with ATProtocol::FLAG_TYPED set carries
+//
+//   TypedCallHeader (8 bytes), then the arguments in declaration order
+//
+// and a successful response has FLAG_RESPONSE | FLAG_TYPED with the encoded
+// result as its whole body. Errors are ordinary FLAG_ERROR JSON responses.
+//
+// Values are little-endian like bulk_ops.h, one after another with no padding:
+//
+//   bool            1 byte (0 / 1)
+//   i32 / u32       4 bytes
+//   i64 / u64 / f64 8 bytes
+//   string / bytes  u32 length, then the bytes (string is UTF-8)
+//   list<T>         u32 count, then the elements (T is any of the above but bool)
+struct TypedCallHeader {
+    uint32_t method_id; // typed_method_id() of the method name
+    uint32_t reserved;
+};
+static_assert(sizeof(TypedCallHeader) == 8, "TypedCallHeader layout is part of the wire format");
+
+// 32-bit FNV-1a of the method name; the generators compute the same value
+constexpr uint32_t typed_method_id(std::string_view name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+// Appends encoded values to a request body or to a response frame
+class TypedWriter {
+public:
+    explicit TypedWriter(std::vector<uint8_t>& out) : vector_(&out) {}
+    explicit TypedWriter(ResponseWriter& out) : response_(&out) {}
+
+    void write_bool(bool value) { *reserve(1) = value ? 1 : 0; }
+    void write_i32(int32_t value) { put(value); }
+    void write_u32(uint32_t value) { put(value); }
+    void write_i64(int64_t value) { put(value); }
+    void write_u64(uint64_t value) { put(value); }
+    void write_f64(double value) { put(value); }
+    void write_string(std::string_view text);
+    void write_bytes(std::string_view data) { write_string(data); }
+
+    template <typename T>
+    void write_list(const std::vector<T>& values) {
+        write_u32(static_cast<uint32_t>(values.size()));
+        if constexpr (std::is_same_v<T, std::string>) {
+            for (const auto& value : values) {
+                write_string(value);
+            }
+        } else {
+            static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "list<bool> is not a wire type");
+            if (!values.empty()) {
+                std::memcpy(reserve(values.size() * sizeof(T)), values.data(), values.size() * sizeof(T));
+            }
+        }
+    }
+
+private:
+    template <typename T>
+    void put(T value) { std::memcpy(reserve(sizeof(T)), &value, sizeof(T)); }
+    uint8_t* reserve(size_t size);
+
+    std::vector<uint8_t>* vector_ = nullptr;
+    ResponseWriter* response_ = nullptr;
+};
+
+// Bounds-checked decoding; every read returns false once the input runs short
+class TypedReader {
+public:
+    TypedReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    bool read_bool(bool& value);
+    bool read_i32(int32_t& value) { return get(value); }
+    bool read_u32(uint32_t& value) { return get(value); }
+    bool read_i64(int64_t& value) { return get(value); }
+    bool read_u64(uint64_t& value) { return get(value); }
+    bool read_f64(double& value) { return get(value); }
+    bool read_string(std::string& text);
+    bool read_bytes(std::string& data) { return read_string(data); }
+
+    template <typename T>
+    bool read_list(std::vector<T>& values) {
+        uint32_t count;
+        if (!read_u32(count)) {
+            return false;
+        }
+        if constexpr (std::is_same_v<T, std::string>) {
+            // Every element takes at least its length prefix: refuse counts the
+            // body cannot hold before allocating for them
+            if (count > remaining() / sizeof(uint32_t)) {
+                return false;
+            }
+            values.resize(count);
+            for (auto& value : values) {
+                if (!read_string(value)) {
+                    return false;
+                }
+            }
+            return true;
+        } else {
+            static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "list<bool> is not a wire type");
+            if (count > remaining() / sizeof(T)) {
+                return false;
+            }
+            values.resize(count);
+            if (count > 0) {
+                std::memcpy(values.data(), data_ + pos_, count * sizeof(T));
+            }
+            pos_ += count * sizeof(T);
+            return true;
+        }
+    }
+
+    size_t remaining() const { return size_ - pos_; }
+    bool done() const { return pos_ == size_; }
+
+private:
+    template <typename T>
+    bool get(T& value) {
+        if (remaining() < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+// Request body of a generated *Args struct
+template <typename Args>
+std::vector<uint8_t> encode_typed_call(const Args& args) {
+    std::vector<uint8_t> body(sizeof(TypedCallHeader));
+    TypedCallHeader header{Args::METHOD_ID, 0};
+    std::memcpy(body.data(), &header, sizeof(header));
+    TypedWriter writer(body);
+    args.encode(writer);
+    return body;
+}
+
+// Server-side method table, filled by the generated register_service(). Fill it
+// before serving: lookups take no lock.
+class TypedRegistry {
+public:
+    // Decode the arguments from `args` (false when they are malformed or leave
+    // bytes over) and write the result to `result`. Exceptions become error
+    // responses carrying their what().
+    using Handler = std::function<bool(TypedReader& args, TypedWriter& result)>;
+
+    // std::logic_error when another method already has this id
+    void add(uint32_t method_id, const std::string& name, Handler handler);
+
+    size_t size() const { return methods_.size(); }
+
+    // Metrics name of a request body ("typed.add", "typed.unknown")
+    const std::string& method_name(const uint8_t* body, size_t size) const;
+
+    // Run one request, writing the encoded result into `response`. Returns
+    // false with `error` set (and nothing written) for a bad request.
+    bool execute(const uint8_t* body, size_t size, ResponseWriter& response, std::string& error) const;
+
+private:
+    struct Method {
+        std::string name;
+        std::string metric_name;
+        Handler handler;
+    };
+    const Method* find(const uint8_t* body, size_t size) const;
+
+    std::unordered_map<uint32_t, Method> methods_;
+};
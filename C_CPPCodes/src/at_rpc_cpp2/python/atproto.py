@@ -0,0 +1,406 @@
+# atproto.py
+"""Python binding of libatproto (include/atproto.h), the AT codec's C ABI.
+
+Header packing, CRC32, frame scanning and MessagePack bodies run in C, on the
+caller's own memory: bytes, bytearray and writable memoryview arguments are
+passed by address, never copied (read-only memoryviews are copied once, as
+ctypes cannot take their address). FrameDecoder receives straight into its
+buffer and hands out memoryview bodies over it.
+
+The library is looked up in $ATPROTO_LIBRARY, then next to this file and in
+../build, then on the system path.
+"""
+import ctypes
+import ctypes.util
+import json
+import os
+import socket
+import struct
+from collections import namedtuple
+
+HEADER_SIZE = 16
+PROTOCOL_ID = 0x4154
+FLAG_REQUEST = 0x0001
+FLAG_RESPONSE = 0x0002
+FLAG_ERROR = 0x0004
+FLAG_BINARY = 0x0008
+FLAG_PUSH = 0x0010
+FLAG_MSGPACK = 0x0020
+FLAG_TYPED = 0x0040
+FLAG_SEALED = 0x0080  # AES-GCM frames of C++ peers; not supported by this client
+FLAG_COMPRESSED = 0x0100  # LZ-compressed bodies; this client never asks for them
+FLAG_ACCEPTS_COMPRESSED = 0x0200
+
+ABI_VERSION = 1
+
+OK = 0
+ERR_ARGUMENT = -1
+ERR_BUFFER = -2
+ERR_PROTOCOL = -3
+ERR_TOO_LARGE = -4
+ERR_CHECKSUM = -5
+ERR_ENCODING = -6
+
+_MESSAGES = {
+    ERR_ARGUMENT: "invalid argument",
+    ERR_BUFFER: "buffer too small",
+    ERR_PROTOCOL: "not an AT frame",
+    ERR_TOO_LARGE: "frame body too large",
+    ERR_CHECKSUM: "CRC32 mismatch",
+    ERR_ENCODING: "invalid JSON / MessagePack",
+}
+
+
+class ATProtoError(Exception):
+    def __init__(self, status, what=""):
+        super().__init__(f"{what}: {_MESSAGES.get(status, status)}" if what else _MESSAGES.get(status, str(status)))
+        self.status = status
+
+
+class RemoteError(Exception):
+    """{"status": "error"} answer from the server"""
+
+
+Header = namedtuple("Header", "protocol_id flags sequence body_length hash_value")
+Frame = namedtuple("Frame", "flags sequence body")  # body: memoryview into the decoder's buffer
+
+
+class _Header(ctypes.Structure):
+    _fields_ = [("protocol_id", ctypes.c_uint16), ("flags", ctypes.c_uint16), ("sequence", ctypes.c_uint32),
+                ("body_length", ctypes.c_uint32), ("hash_value", ctypes.c_uint32)]
+
+
+class _Frame(ctypes.Structure):
+    _fields_ = [("flags", ctypes.c_uint16), ("reserved", ctypes.c_uint16), ("sequence", ctypes.c_uint32),
+                ("body_offset", ctypes.c_uint64), ("body_length", ctypes.c_uint64)]
+
+
+# The same layout, read in bulk: per-element ctypes field access costs more than the decode itself
+_FRAME_LAYOUT = struct.Struct("=HHIQQ")
+assert _FRAME_LAYOUT.size == ctypes.sizeof(_Frame)
+
+
+def _load():
+    names = ["libatproto.so", "libatproto.so.1", "libatproto.dylib", "atproto.dll", "libatproto.dll"]
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = []
+    if os.environ.get("ATPROTO_LIBRARY"):
+        candidates.append(os.environ["ATPROTO_LIBRARY"])
+    for directory in (here, os.path.join(here, "..", "build"), os.path.join(here, "..", "build", "Release")):
+        candidates += [os.path.join(directory, name) for name in names]
+    found = ctypes.util.find_library("atproto")
+    if found:
+        candidates.append(found)
+    for path in candidates:
+        if os.path.exists(path) or path == found:
+            return ctypes.CDLL(path)
+    raise OSError("libatproto not found; build the 'atproto' target or set ATPROTO_LIBRARY")
+
+
+_lib = _load()
+_P = ctypes.c_void_p
+_SIZE = ctypes.c_size_t
+_lib.atproto_abi_version.restype = ctypes.c_uint32
+_lib.atproto_abi_version.argtypes = []
+_lib.atproto_crc32.restype = ctypes.c_uint32
+_lib.atproto_crc32.argtypes = [_P, _SIZE]
+_lib.atproto_pack_header.argtypes = [_P, _SIZE, ctypes.c_uint16, ctypes.c_uint32, _P, _SIZE]
+_lib.atproto_pack_frame.argtypes = [_P, _SIZE, ctypes.c_uint16, ctypes.c_uint32, _P, _SIZE, ctypes.POINTER(_SIZE)]
+_lib.atproto_parse_header.argtypes = [_P, _SIZE, ctypes.POINTER(_Header)]
+_lib.atproto_scan_frames.argtypes = [_P, _SIZE, ctypes.c_uint32, ctypes.c_int, ctypes.POINTER(_Frame), _SIZE,
+                                     ctypes.POINTER(_SIZE), ctypes.POINTER(_SIZE), ctypes.POINTER(_SIZE)]
+_lib.atproto_json_to_msgpack.argtypes = [_P, _SIZE, _P, _SIZE, ctypes.POINTER(_SIZE)]
+_lib.atproto_msgpack_to_json.argtypes = [_P, _SIZE, _P, _SIZE, ctypes.POINTER(_SIZE)]
+_lib.atproto_pack_call_msgpack.argtypes = [_P, _SIZE, ctypes.c_uint32, _P, _SIZE, ctypes.POINTER(ctypes.c_double),
+                                           _SIZE, ctypes.POINTER(_SIZE)]
+_lib.atproto_msgpack_result.argtypes = [_P, _SIZE, ctypes.POINTER(ctypes.c_double), _P, _SIZE]
+if _lib.atproto_abi_version() != ABI_VERSION:
+    raise OSError(f"libatproto ABI {_lib.atproto_abi_version()}, this binding needs {ABI_VERSION}")
+
+
+class _Buffer:
+    """Address and size of a bytes-like object, without copying it when possible.
+    Holds the buffer export (a bytearray cannot be resized meanwhile), so keep
+    it only for the duration of a call."""
+    __slots__ = ("address", "size", "_keep")
+
+    def __init__(self, data, writable=False):
+        if isinstance(data, bytes) and not writable:
+            self._keep = data
+            self.size = len(data)
+            self.address = ctypes.cast(ctypes.c_char_p(data), _P).value if data else None
+            return
+        view = data if isinstance(data, memoryview) else memoryview(data)
+        if view.ndim != 1 or view.itemsize != 1:
+            view = view.cast("B")
+        self.size = view.nbytes
+        if self.size == 0:
+            self._keep, self.address = view, None
+        elif not view.readonly:
+            self._keep = (ctypes.c_char * self.size).from_buffer(view)
+            self.address = ctypes.addressof(self._keep)
+        elif writable:
+            raise TypeError("output buffer must be writable (bytearray, writable memoryview)")
+        else:
+            self._keep = view.tobytes()  # read-only memoryview: ctypes cannot take its address
+            self.address = ctypes.cast(ctypes.c_char_p(self._keep), _P).value
+
+
+def _check(status, what):
+    if status != OK:
+        raise ATProtoError(status, what)
+
+
+def crc32(data):
+    buf = _Buffer(data)
+    return _lib.atproto_crc32(buf.address, buf.size)
+
+
+def pack_header(flags, sequence, body=b""):
+    """The 16-byte header of a frame carrying `body`"""
+    out = bytearray(HEADER_SIZE)
+    src, dst = _Buffer(body), _Buffer(out, writable=True)
+    _check(_lib.atproto_pack_header(dst.address, dst.size, flags, sequence, src.address, src.size), "pack_header")
+    del dst
+    return bytes(out)
+
+
+def pack_frame_into(out, offset, flags, sequence, body=b""):
+    """Write header + body into out[offset:]; returns the frame size"""
+    dst = _Buffer(memoryview(out)[offset:], writable=True)
+    src = _Buffer(body)
+    written = _SIZE()
+    _check(_lib.atproto_pack_frame(dst.address, dst.size, flags, sequence, src.address, src.size,
+                                   ctypes.byref(written)), "pack_frame")
+    return written.value
+
+
+def pack_frame(flags, sequence, body=b""):
+    out = bytearray(HEADER_SIZE + len(memoryview(body).cast("B")))
+    pack_frame_into(out, 0, flags, sequence, body)
+    return out
+
+
+def parse_header(data):
+    buf = _Buffer(memoryview(data)[:HEADER_SIZE])
+    header = _Header()
+    _check(_lib.atproto_parse_header(buf.address, buf.size, ctypes.byref(header)), "parse_header")
+    return Header(header.protocol_id, header.flags, header.sequence, header.body_length, header.hash_value)
+
+
+def _grow_call(fn, src, what, initial):
+    """Run an out-buffer helper, retrying once with the size it reports"""
+    size = initial
+    while True:
+        out = bytearray(size)
+        dst = _Buffer(out, writable=True)
+        written = _SIZE()
+        status = fn(src.address, src.size, dst.address, dst.size, ctypes.byref(written))
+        del dst
+        if status == ERR_BUFFER and written.value > size:
+            size = written.value
+            continue
+        _check(status, what)
+        del out[written.value:]
+        return out
+
+
+def json_to_msgpack(document):
+    """MessagePack encoding of a JSON text (str / bytes) or a Python value"""
+    if not isinstance(document, (str, bytes, bytearray, memoryview)):
+        document = json.dumps(document, separators=(",", ":"))
+    if isinstance(document, str):
+        document = document.encode()
+    src = _Buffer(document)
+    return bytes(_grow_call(_lib.atproto_json_to_msgpack, src, "json_to_msgpack", 2 * src.size + 16))
+
+
+def msgpack_to_json(data):
+    """JSON text of a MessagePack body"""
+    src = _Buffer(data)
+    return _grow_call(_lib.atproto_msgpack_to_json, src, "msgpack_to_json", 2 * src.size + 16).decode()
+
+
+def pack_call_into(out, offset, sequence, func, args):
+    """{"func": func, "args": args} as a MessagePack request frame in out[offset:]; returns its size"""
+    name = func.encode() if isinstance(func, str) else bytes(func)
+    values = (ctypes.c_double * len(args))(*args)
+    dst = _Buffer(memoryview(out)[offset:], writable=True)
+    written = _SIZE()
+    _check(_lib.atproto_pack_call_msgpack(dst.address, dst.size, sequence, name, len(name), values, len(args),
+                                          ctypes.byref(written)), "pack_call")
+    return written.value
+
+
+def pack_call(sequence, func, args):
+    name = func.encode() if isinstance(func, str) else bytes(func)
+    out = bytearray(HEADER_SIZE + 16 + len(name) + 9 * len(args) + 5)  # upper bound of the encoding
+    del out[pack_call_into(out, 0, sequence, name, args):]
+    return out
+
+
+def msgpack_result(body):
+    """The numeric "result" of a MessagePack response body; RemoteError for error answers"""
+    src = _Buffer(body)
+    result = ctypes.c_double()
+    error = ctypes.create_string_buffer(256)
+    status = _lib.atproto_msgpack_result(src.address, src.size, ctypes.byref(result), ctypes.addressof(error), 256)
+    if status == ERR_ENCODING and error.value:
+        raise RemoteError(error.value.decode(errors="replace"))
+    _check(status, "msgpack_result")
+    return result.value
+
+
+class FrameDecoder:
+    """Incremental decoder over a receive buffer it owns.
+
+    recv_into(sock) / feed(data) append bytes; frames() returns every complete
+    frame, bodies as memoryviews into the buffer. Those views stay valid until
+    the next recv_into()/feed(), which may move unconsumed bytes to the front.
+    """
+
+    def __init__(self, max_body=10 * 1024 * 1024, verify_crc=True, initial_size=64 * 1024, batch=1024):
+        self.max_body = max_body
+        self.verify_crc = verify_crc
+        self._frames = (_Frame * batch)()
+        self._frames_raw = memoryview(self._frames).cast("B")
+        self._batch = batch
+        self._start = 0  # unconsumed bytes are [start, end)
+        self._end = 0
+        self._needed = HEADER_SIZE
+        self._reset_buffer(bytearray(max(initial_size, HEADER_SIZE)))
+
+    def _reset_buffer(self, buf):
+        # A bigger buffer is a new object: views handed out earlier keep the old one alive
+        self._buf = buf
+        self._view = memoryview(buf)
+        self._base = ctypes.addressof((ctypes.c_char * len(buf)).from_buffer(buf))
+
+    def _make_room(self, want):
+        pending = self._end - self._start
+        if pending == 0:
+            self._start = self._end = 0
+        if len(self._buf) - self._end >= want:
+            return
+        if len(self._buf) >= pending + want:
+            ctypes.memmove(self._base, self._base + self._start, pending)
+        else:
+            grown = bytearray(max(2 * len(self._buf), pending + want))
+            grown[:pending] = self._view[self._start:self._end]
+            self._reset_buffer(grown)
+        self._start, self._end = 0, pending
+
+    def recv_into(self, sock, size=65536):
+        """One recv straight into the buffer; returns the byte count (0 = EOF)"""
+        pending = self._end - self._start
+        self._make_room(max(size, self._needed - pending))
+        n = sock.recv_into(self._view[self._end:])
+        self._end += n
+        return n
+
+    def feed(self, data):
+        data = memoryview(data).cast("B")
+        self._make_room(len(data))
+        self._buf[self._end:self._end + len(data)] = data
+        self._end += len(data)
+
+    def frames(self):
+        out = []
+        count, consumed, needed = _SIZE(), _SIZE(), _SIZE()
+        while True:
+            status = _lib.atproto_scan_frames(self._base + self._start, self._end - self._start, self.max_body,
+                                              1 if self.verify_crc else 0, self._frames, self._batch,
+                                              ctypes.byref(count), ctypes.byref(consumed), ctypes.byref(needed))
+            start, view = self._start, self._view
+            raw = self._frames_raw[:count.value * _FRAME_LAYOUT.size]
+            out += [Frame(flags, sequence, view[start + offset:start + offset + length])
+                    for flags, _, sequence, offset, length in _FRAME_LAYOUT.iter_unpack(raw)]
+            self._start += consumed.value
+            _check(status, "scan_frames")
+            if needed.value:
+                self._needed = needed.value
+                return out
+
+
+class Client:
+    """Blocking AT client over one connection, MessagePack bodies by default"""
+
+    def __init__(self, host="127.0.0.1", port=9999, use_msgpack=True):
+        self.sock = socket.create_connection((host, port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.use_msgpack = use_msgpack
+        self.decoder = FrameDecoder()
+        self.sequence = 0
+        self._out = bytearray(4096)
+
+    def call(self, func, args):
+        self.sequence += 1
+        if self.use_msgpack:
+            try:
+                size = pack_call_into(self._out, 0, self.sequence, func, args)
+            except ATProtoError as e:
+                if e.status != ERR_BUFFER:
+                    raise
+                self._out = pack_call(self.sequence, func, args)
+                size = len(self._out)
+        else:
+            body = json.dumps({"func": func, "args": list(args)}).encode()
+            if len(self._out) < HEADER_SIZE + len(body):
+                self._out = bytearray(HEADER_SIZE + len(body))
+            size = pack_frame_into(self._out, 0, FLAG_REQUEST, self.sequence, body)
+        self.sock.sendall(memoryview(self._out)[:size])
+        frame = self._wait(self.sequence)
+        if frame.flags & FLAG_MSGPACK:
+            return msgpack_result(frame.body)
+        response = json.loads(bytes(frame.body))
+        if response.get("status") == "error":
+            raise RemoteError(response.get("message", "Unknown remote error"))
+        return response["result"]
+
+    def call_raw(self, flags, body):
+        """Send one request frame with a ready-made body; returns the response
+        (flags, body bytes). Error responses raise RemoteError."""
+        self.sequence += 1
+        self.sock.sendall(pack_frame(FLAG_REQUEST | flags, self.sequence, body))
+        frame = self._wait(self.sequence)
+        if frame.flags & FLAG_ERROR:
+            body = bytes(frame.body)
+            document = json.loads(msgpack_to_json(body) if frame.flags & FLAG_MSGPACK else body)
+            raise RemoteError(document.get("message", "Unknown remote error"))
+        return frame.flags, bytes(frame.body)
+
+    def _wait(self, sequence):
+        while True:
+            for frame in self.decoder.frames():
+                if frame.sequence == sequence and not frame.flags & FLAG_PUSH:
+                    return frame
+            if self.decoder.recv_into(self.sock) == 0:
+                raise ConnectionError("server closed the connection")
+
+    def close(self):
+        self.sock.close()
+
+
+if __name__ == "__main__":
+    import argparse
+    import time
+
+    parser = argparse.ArgumentParser(description="Call an AT server through libatproto")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=9999)
+    parser.add_argument("--func", default="add")
+    parser.add_argument("--args", default="10,20")
+    parser.add_argument("--repeat", type=int, default=1)
+    parser.add_argument("--json", action="store_true", help="JSON bodies instead of MessagePack")
+    options = parser.parse_args()
+
+    client = Client(options.host, options.port, use_msgpack=not options.json)
+    call_args = [float(a) for a in options.args.split(",") if a.strip()]
+    t0 = time.perf_counter()
+    for _ in range(options.repeat):
+        value = client.call(options.func, call_args)
+    elapsed = time.perf_counter() - t0
+    print(f"{options.func}({options.args}) = {value}; {options.repeat} calls, {elapsed / options.repeat * 1e6:.1f} us per call")
+    client.close()
+
+# run: python python/atproto.py --port 9999 --func add --args 10,20 --repeat 10000
@@ -0,0 +1,200 @@
+# calculator_atidl.py
+"""Generated by idl/atidl.py from calculator.atidl; do not edit.
+
+Typed calls of the 'calculator' service: encode_<method>() builds a request
+body for an AT frame with FLAG_TYPED, decode_<method>_result() reads the
+response body. Client wraps an atproto.Client (anything with call_raw()). """
+
+import struct
+
+FLAG_TYPED = 0x0040
+_COUNT = struct.Struct("<I")
+
+
+def _pack_blob(data):
+    return _COUNT.pack(len(data)) + data
+
+
+def _pack_list(code, values):
+    return struct.pack(f"<I{len(values)}{code}", len(values), *values)
+
+
+def _pack_blob_list(values):
+    return _COUNT.pack(len(values)) + b"".join(_pack_blob(v) for v in values)
+
+
+def _unpack_scalar(layout, body, offset):
+    return layout.unpack_from(body, offset)[0], offset + layout.size
+
+
+def _unpack_blob(body, offset):
+    (size,) = _COUNT.unpack_from(body, offset)
+    offset += 4
+    if offset + size > len(body):
+        raise ValueError("truncated typed response")
+    return bytes(body[offset:offset + size]), offset + size
+
+
+def _unpack_list(code, body, offset):
+    (count,) = _COUNT.unpack_from(body, offset)
+    layout = struct.Struct(f"<{count}{code}")
+    return list(layout.unpack_from(body, offset + 4)), offset + 4 + layout.size
+
+
+def _unpack_blob_list(body, offset):
+    (count,) = _COUNT.unpack_from(body, offset)
+    offset += 4
+    values = []
+    for _ in range(count):
+        value, offset = _unpack_blob(body, offset)
+        values.append(value)
+    return values, offset
+
+
+def _finish(value, offset, body):
+    if offset != len(body):
+        raise ValueError("trailing bytes in typed response")
+    return value
+
+
+ADD_ID = 0x3B391274
+SUB_ID = 0xDC4E3915
+MUL_ID = 0xEB84ED81
+DIV_ID = 0xE562AB48
+SUM_ID = 0xDD4E3AA8
+SCALE_ID = 0x82971C71
+LABEL_ID = 0xF69717FD
+
+
+_ADD_0 = struct.Struct("<IIdd")
+_ADD_RESULT = struct.Struct("<d")
+
+
+def encode_add(a, b):
+    """add(a: f64, b: f64) -> f64"""
+    return _ADD_0.pack(ADD_ID, 0, a, b)
+
+
+def decode_add_result(body):
+    value, offset = _unpack_scalar(_ADD_RESULT, body, 0)
+    return _finish(value, offset, body)
+
+
+_SUB_0 = struct.Struct("<IIdd")
+_SUB_RESULT = struct.Struct("<d")
+
+
+def encode_sub(a, b):
+    """sub(a: f64, b: f64) -> f64"""
+    return _SUB_0.pack(SUB_ID, 0, a, b)
+
+
+def decode_sub_result(body):
+    value, offset = _unpack_scalar(_SUB_RESULT, body, 0)
+    return _finish(value, offset, body)
+
+
+_MUL_0 = struct.Struct("<IIdd")
+_MUL_RESULT = struct.Struct("<d")
+
+
+def encode_mul(a, b):
+    """mul(a: f64, b: f64) -> f64"""
+    return _MUL_0.pack(MUL_ID, 0, a, b)
+
+
+def decode_mul_result(body):
+    value, offset = _unpack_scalar(_MUL_RESULT, body, 0)
+    return _finish(value, offset, body)
+
+
+_DIV_0 = struct.Struct("<IIdd")
+_DIV_RESULT = struct.Struct("<d")
+
+
+def encode_div(a, b):
+    """div(a: f64, b: f64) -> f64"""
+    return _DIV_0.pack(DIV_ID, 0, a, b)
+
+
+def decode_div_result(body):
+    value, offset = _unpack_scalar(_DIV_RESULT, body, 0)
+    return _finish(value, offset, body)
+
+
+_SUM_0 = struct.Struct("<II")
+_SUM_RESULT = struct.Struct("<d")
+
+
+def encode_sum(values):
+    """sum(values: list<f64>) -> f64"""
+    return b"".join((_SUM_0.pack(SUM_ID, 0), _pack_list("d", values)))
+
+
+def decode_sum_result(body):
+    value, offset = _unpack_scalar(_SUM_RESULT, body, 0)
+    return _finish(value, offset, body)
+
+
+_SCALE_0 = struct.Struct("<II")
+_SCALE_1 = struct.Struct("<d")
+
+
+def encode_scale(values, factor):
+    """scale(values: list<f64>, factor: f64) -> list<f64>"""
+    return b"".join((_SCALE_0.pack(SCALE_ID, 0), _pack_list("d", values), _SCALE_1.pack(factor)))
+
+
+def decode_scale_result(body):
+    value, offset = _unpack_list("d", body, 0)
+    return _finish(value, offset, body)
+
+
+_LABEL_0 = struct.Struct("<II")
+_LABEL_1 = struct.Struct("<di")
+
+
+def encode_label(name, value, precision):
+    """label(name: string, value: f64, precision: i32) -> string"""
+    return b"".join((_LABEL_0.pack(LABEL_ID, 0), _pack_blob(name.encode()), _LABEL_1.pack(value, precision)))
+
+
+def decode_label_result(body):
+    value, offset = _unpack_blob(body, 0)
+    value = value.decode()
+    return _finish(value, offset, body)
+
+
+class Client:
+    """Blocking typed calls of 'calculator' over a transport with call_raw(flags, body)"""
+
+    def __init__(self, transport):
+        self.transport = transport
+
+    def add(self, a, b):
+        _, body = self.transport.call_raw(FLAG_TYPED, encode_add(a, b))
+        return decode_add_result(body)
+
+    def sub(self, a, b):
+        _, body = self.transport.call_raw(FLAG_TYPED, encode_sub(a, b))
+        return decode_sub_result(body)
+
+    def mul(self, a, b):
+        _, body = self.transport.call_raw(FLAG_TYPED, encode_mul(a, b))
+        return decode_mul_result(body)
+
+    def div(self, a, b):
+        _, body = self.transport.call_raw(FLAG_TYPED, encode_div(a, b))
+        return decode_div_result(body)
+
+    def sum(self, values):
+        _, body = self.transport.call_raw(FLAG_TYPED, encode_sum(values))
+        return decode_sum_result(body)
+
+    def scale(self, values, factor):
+        _, body = self.transport.call_raw(FLAG_TYPED, encode_scale(values, factor))
+        return decode_scale_result(body)
+
+    def label(self, name, value, precision):
+        _, body = self.transport.call_raw(FLAG_TYPED, encode_label(name, value, precision))
+        return decode_label_result(body)
@@ -6,11 +6,26 @@
 #include <functional> // For std::hash
 #include <sstream> // For logging hex output if needed
 #include "at_protocol.h"
+#include "atproto.h" // C ABI constants, kept in step below
 #include "crc32.hpp" // For CRC32 computation
 
+static_assert(ATPROTO_HEADER_SIZE == ATProtocol::HEADER_SIZE && ATPROTO_ID == ATProtocol::PROTOCOL_ID &&
+                  ATPROTO_FLAG_REQUEST == ATProtocol::FLAG_REQUEST && ATPROTO_FLAG_RESPONSE == ATProtocol::FLAG_RESPONSE &&
+                  ATPROTO_FLAG_ERROR == ATProtocol::FLAG_ERROR && ATPROTO_FLAG_BINARY == ATProtocol::FLAG_BINARY &&
+                  ATPROTO_FLAG_PUSH == ATProtocol::FLAG_PUSH && ATPROTO_FLAG_MSGPACK == ATProtocol::FLAG_MSGPACK &&
+                  ATPROTO_FLAG_TYPED == ATProtocol::FLAG_TYPED && ATPROTO_FLAG_SEALED == ATProtocol::FLAG_SEALED &&
+                  ATPROTO_FLAG_COMPRESSED == ATProtocol::FLAG_COMPRESSED &&
+                  ATPROTO_FLAG_ACCEPTS_COMPRESSED == ATProtocol::FLAG_ACCEPTS_COMPRESSED,
+              "atproto.h must match ATProtocol");
+
 std::vector<uint8_t> ATHeader::pack() const {
     std::vector<uint8_t> buffer(sizeof(ATHeader));
-    // std::memcpy(buffer.data(), this, sizeof(ATHeader));
+    pack_into(buffer.data());
+    return buffer;
+}
+
+void ATHeader::pack_into(uint8_t* out) const {
+    // std::memcpy(out, this, sizeof(ATHeader));
     if (byte_order == ByteOrder::BigEndian) {
         // Network byte order (big-endian)
         uint16_t pid = htons(protocol_id);
@@ -19,18 +34,16 @@ std::vector<uint8_t> ATHeader::pack() const {
         uint32_t len = htonl(body_length);
         uint32_t hash = htonl(hash_value);
 
-        std::memcpy(buffer.data(), &pid, sizeof(pid));
-        // *reinterpret_cast<uint16_t*>(buffer.data() + 0) = pid;
-        std::memcpy(buffer.data() + 2, &flg, sizeof(flg));
-        std::memcpy(buffer.data() + 4, &seq, sizeof(seq));
-        std::memcpy(buffer.data() + 8, &len, sizeof(len));
-        std::memcpy(buffer.data() + 12, &hash, sizeof(hash));
+        std::memcpy(out, &pid, sizeof(pid));
+        // *reinterpret_cast<uint16_t*>(out + 0) = pid;
+        std::memcpy(out + 2, &flg, sizeof(flg));
+        std::memcpy(out + 4, &seq, sizeof(seq));
+        std::memcpy(out + 8, &len, sizeof(len));
+        std::memcpy(out + 12, &hash, sizeof(hash));
     } else {
         // Little-endian
-        std::memcpy(buffer.data(), this, sizeof(ATHeader));
+        std::memcpy(out, this, sizeof(ATHeader));
     }
-
-    return buffer;
 }
 
 void ATHeader::unpack(const uint8_t* data, size_t size){
@@ -80,6 +93,17 @@ uint32_t ATProtocol::get_next_sequence() {
 
 // Pack data into wire format
 std::vector<uint8_t> ATProtocol::pack(uint16_t flags, const std::string& body, uint32_t sequence) {
+    return pack(flags, reinterpret_cast<const uint8_t*>(body.data()), body.size(), sequence);
+}
+
+std::vector<uint8_t> ATProtocol::pack(uint16_t flags, const uint8_t* body, size_t body_size, uint32_t sequence) {
+    std::vector<uint8_t> packet;
+    pack_into(packet, flags, body, body_size, sequence);
+    return packet;
+}
+
+void ATProtocol::pack_into(std::vector<uint8_t>& packet, uint16_t flags, const uint8_t* body, size_t body_size,
+                           uint32_t sequence) {
     if (sequence == 0) {
         sequence = get_next_sequence();
     }
@@ -88,48 +112,64 @@ std::vector<uint8_t> ATProtocol::pack(uint16_t flags, const std::string& body, u
     header.protocol_id = PROTOCOL_ID;
     header.flags = flags;
     header.sequence = sequence;
-    header.body_length = static_cast<uint32_t>(body.size());
-
-    header.hash_value = crc32::calculate_hash(body);
-
-    // Prepare the packet buffer
-    std::vector<uint8_t> header_buf = header.pack();  
-    std::vector<uint8_t> packet(HEADER_SIZE + body.size());
-    std::memcpy(packet.data(), header_buf.data(), HEADER_SIZE);
-    if (!body.empty())
-        std::memcpy(packet.data() + HEADER_SIZE, body.data(), body.size());
+    header.body_length = static_cast<uint32_t>(body_size);
+
+    // A frame about to be sealed is authenticated by its GCM tag instead
+    bool sealed = (flags & FLAG_SEALED) != 0;
+    header.hash_value = sealed ? 0 : crc32::calculate(body, body_size);
+
+    // Prepare the packet buffer (with room for the tag, so sealing does not reallocate)
+    packet.clear();
+    packet.reserve(HEADER_SIZE + body_size + (sealed ? SEAL_TAG_SIZE : 0));
+    packet.resize(HEADER_SIZE + body_size);
+    header.pack_into(packet.data());
+    if (body_size > 0)
+        std::memcpy(packet.data() + HEADER_SIZE, body, body_size);
     // packet.insert(packet.end(), header_buf.begin(), header_buf.end());
     // packet.insert(packet.end(), body.begin(), body.end());
     
-    spdlog::debug("Packed packet: Seq={}, Flags=0x{:04X}, Len={}, Hash=0x{:08X}", sequence, flags, body.size(), header.hash_value);
-    return packet;
+    spdlog::debug("Packed packet: Seq={}, Flags=0x{:04X}, Len={}, Hash=0x{:08X}", sequence, flags, body_size, header.hash_value);
 }
 
 // Unpack data from wire format
 bool ATProtocol::unpack(const std::vector<uint8_t>& data, uint16_t& flags, uint32_t& sequence, std::string& body) {
-    if (data.size() < HEADER_SIZE) {
+    return unpack(data.data(), data.size(), flags, sequence, body);
+}
+
+bool ATProtocol::unpack(const uint8_t* data, size_t size, uint16_t& flags, uint32_t& sequence, std::string& body) {
+    std::string_view view;
+    if (!unpack(data, size, flags, sequence, view)) {
+        return false;
+    }
+    body.assign(view.data(), view.size());
+    return true;
+}
+
+bool ATProtocol::unpack(const uint8_t* data, size_t size, uint16_t& flags, uint32_t& sequence, std::string_view& body) {
+    if (size < HEADER_SIZE) {
         spdlog::error("Data too short to contain header");
         return false;
     }
 
-    header.unpack(data.data(), HEADER_SIZE);
+    header.unpack(data, HEADER_SIZE);
 
     if (header.protocol_id != PROTOCOL_ID) {
         spdlog::error("Invalid protocol ID");
         return false;
     }
 
-    if (data.size() < HEADER_SIZE + header.body_length) {
-        spdlog::error("Packet data size ({}) less than expected (header {} + body {})", data.size(), HEADER_SIZE, header.body_length);
+    if (size < HEADER_SIZE + header.body_length) {
+        spdlog::error("Packet data size ({}) less than expected (header {} + body {})", size, HEADER_SIZE, header.body_length);
         return false;
     }
 
     // body = (reinterpret_cast<const char*>(data.data()) + HEADER_SIZE,  header.body_length); // Assign the extracted body
-    body.assign(reinterpret_cast<const char*>(data.data()) + HEADER_SIZE, header.body_length);
+    body = std::string_view(reinterpret_cast<const char*>(data) + HEADER_SIZE, header.body_length);
     flags = header.flags;
     sequence = header.sequence;
 
-    uint32_t calculated_hash = crc32::calculate_hash(body);
+    // Opened sealed frames were checked by FrameCipher::open and carry no CRC
+    uint32_t calculated_hash = header.flags & FLAG_SEALED ? header.hash_value : crc32::calculate(data + HEADER_SIZE, header.body_length);
     if (calculated_hash != header.hash_value) {
          spdlog::warn("Hash mismatch: received 0x{:08X}, calculated 0x{:08X}. Proceeding anyway.", header.hash_value, calculated_hash);
          // Depending on strictness, you could throw an exception here instead.
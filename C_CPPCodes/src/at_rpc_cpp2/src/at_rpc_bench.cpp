@@ -0,0 +1,683 @@
+// at_rpc_bench.cpp
+// One closed-loop workload against the three RPC stacks of this repository, so
+// their numbers are comparable: the AT server (at_rpc_demo / RPCServer), the
+// text JSON OptimizedServer (socket_use/socket_w&l_json) and the gRPC
+// LoginService (grpc_demo). Every connection has one call in flight at a time.
+//
+//   stack     call                                         wire
+//   at        add(1, 2)                                    AT frame, JSON body
+//   at-typed  add(1, 2) through calculator.atidl           AT frame, binary body
+//   json      {"function":"add","params":{...}}            bare JSON text, no framing
+//   grpc      Login("admin", "password")                   HTTP/2 + protobuf
+//
+// LoginService has no arithmetic method; Login is the closest small
+// request/response (a map lookup and a short string back).
+//
+// Reports throughput, latency percentiles and client CPU per call; given the
+// server's pid (--server-pid, or --server to start it) also the server's CPU
+// per call and its RSS growth per connection, from /proc (Linux only).
+// --key-file seals the at / at-typed connections (see frame_cipher.h), and
+// --codec compares the frame codec alone: plaintext + CRC against sealed, and
+// what LZ body compression (lz_codec.h) costs and saves on JSON results.
+#include "calculator.atidl.h" // generated from idl/calculator.atidl
+#include "frame_cipher.h"
+#include "lz_codec.h"
+#include "network_utils.h"
+#include "rpc_connection.h"
+#include "rpc_metrics.h"
+#include "response_writer.h"
+#include <algorithm>
+#include <atomic>
+#include <cxxopts.hpp>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <csignal>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef AT_BENCH_GRPC
+#include "account.pb.h"
+#include <grpcpp/generic/generic_stub.h>
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/impl/codegen/proto_utils.h> // SerializationTraits for protobuf messages
+#endif
+
+// One client connection of one stack; call() makes one blocking round trip
+class BenchDriver {
+public:
+    virtual ~BenchDriver() = default;
+    virtual bool connect() = 0;
+    // False on a transport failure or a wrong answer; `error` says which
+    virtual bool call(std::string& error) = 0;
+};
+
+class AtDriver : public BenchDriver {
+public:
+    AtDriver(const std::string& host, int port, const std::vector<uint8_t>& key) : conn_(host, port) {
+        if (!key.empty()) conn_.enable_encryption(key);
+    }
+
+    bool connect() override { return conn_.connect(); }
+
+    bool call(std::string& error) override {
+        try {
+            json response = conn_.call("add", {1, 2});
+            if (response.value("result", 0.0) == 3.0) {
+                return true;
+            }
+            error = "unexpected response " + response.dump();
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        return false;
+    }
+
+private:
+    RPCConnection conn_;
+};
+
+class AtTypedDriver : public BenchDriver {
+public:
+    AtTypedDriver(const std::string& host, int port, const std::vector<uint8_t>& key) : conn_(host, port), client_(conn_) {
+        if (!key.empty()) conn_.enable_encryption(key);
+    }
+
+    bool connect() override { return conn_.connect(); }
+
+    bool call(std::string& error) override {
+        try {
+            double result = client_.add(1, 2);
+            if (result == 3.0) {
+                return true;
+            }
+            error = "unexpected result " + std::to_string(result);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        return false;
+    }
+
+private:
+    RPCConnection conn_;
+    calculator::Client client_;
+};
+
+// OptimizedServer reads whatever one recv() returns as one message and answers
+// it with one JSON object, so with a single call in flight the answer is the
+// bytes up to the closing brace of that object
+class JsonDriver : public BenchDriver {
+public:
+    JsonDriver(const std::string& host, int port) : host_(host), port_(port) {}
+    ~JsonDriver() override {
+        if (socket_ != INVALID_SOCKET) {
+            close_socket(socket_);
+        }
+    }
+
+    bool connect() override {
+        socket_ = create_socket();
+        return socket_ != INVALID_SOCKET && connect_socket(socket_, host_, port_);
+    }
+
+    bool call(std::string& error) override {
+        if (send_all(socket_, request_) != request_.size()) {
+            error = "send failed";
+            return false;
+        }
+        response_.clear();
+        int depth = 0;
+        bool complete = false;
+        uint8_t buffer[1024];
+        while (!complete) {
+            int received = recv_some(socket_, buffer, sizeof(buffer));
+            if (received <= 0) {
+                error = "connection closed";
+                return false;
+            }
+            for (int i = 0; i < received && !complete; ++i) {
+                if (buffer[i] == '{') {
+                    ++depth;
+                } else if (buffer[i] == '}') {
+                    complete = --depth == 0;
+                }
+            }
+            response_.append(reinterpret_cast<const char*>(buffer), static_cast<size_t>(received));
+        }
+        try {
+            json response = json::parse(response_);
+            if (response.value("success", false) && response.value("result", 0) == 3) {
+                return true;
+            }
+            error = "unexpected response " + response_;
+        } catch (const json::exception& e) {
+            error = e.what();
+        }
+        return false;
+    }
+
+private:
+    std::string host_;
+    int port_;
+    socket_t socket_ = INVALID_SOCKET;
+    std::string request_body_ = R"({"function":"add","params":{"num1":1,"num2":2}})";
+    std::vector<uint8_t> request_{request_body_.begin(), request_body_.end()};
+    std::string response_;
+};
+
+#ifdef AT_BENCH_GRPC
+// Calls /example.LoginService/Login through the generic stub, so only the
+// message types of account.proto are needed (no grpc_cpp_plugin output). Each
+// driver has its own channel and subchannel pool: one TCP connection apiece.
+class GrpcDriver : public BenchDriver {
+    using Stub = grpc::TemplatedGenericStub<example::LoginRequest, example::LoginResponse>;
+
+public:
+    GrpcDriver(const std::string& host, int port) : target_(host + ":" + std::to_string(port)) {
+        request_.set_username("admin");
+        request_.set_password("password");
+    }
+
+    bool connect() override {
+        grpc::ChannelArguments args;
+        args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        channel_ = grpc::CreateCustomChannel(target_, grpc::InsecureChannelCredentials(), args);
+        stub_ = std::make_unique<Stub>(channel_);
+        return channel_->WaitForConnected(std::chrono::system_clock::now() + std::chrono::seconds(5));
+    }
+
+    bool call(std::string& error) override {
+        grpc::ClientContext context;
+        example::LoginResponse response;
+        grpc::Status status;
+        auto reader = stub_->PrepareUnaryCall(&context, "/example.LoginService/Login", request_, &queue_);
+        reader->StartCall();
+        reader->Finish(&response, &status, this);
+        void* tag;
+        bool ok;
+        if (!queue_.Next(&tag, &ok) || !ok || !status.ok()) {
+            error = status.error_message().empty() ? "call failed" : status.error_message();
+            return false;
+        }
+        if (!response.success()) {
+            error = "unexpected response " + response.message();
+            return false;
+        }
+        return true;
+    }
+
+    ~GrpcDriver() override {
+        queue_.Shutdown();
+        void* tag;
+        bool ok;
+        while (queue_.Next(&tag, &ok)) {
+        }
+    }
+
+private:
+    std::string target_;
+    std::shared_ptr<grpc::Channel> channel_;
+    std::unique_ptr<Stub> stub_;
+    grpc::CompletionQueue queue_;
+    example::LoginRequest request_;
+};
+#endif
+
+static std::unique_ptr<BenchDriver> make_driver(const std::string& stack, const std::string& host, int port,
+                                                const std::vector<uint8_t>& key) {
+    if (stack == "at") return std::make_unique<AtDriver>(host, port, key);
+    if (stack == "at-typed") return std::make_unique<AtTypedDriver>(host, port, key);
+    if (stack == "json") return std::make_unique<JsonDriver>(host, port);
+#ifdef AT_BENCH_GRPC
+    if (stack == "grpc") return std::make_unique<GrpcDriver>(host, port);
+#endif
+    return nullptr;
+}
+
+// --- Process accounting (Linux /proc; zeros elsewhere) ---
+
+// User + system CPU of a process in ns
+static uint64_t process_cpu_ns(int pid) {
+#ifdef __linux__
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) return 0;
+    // Fields after the parenthesised command name, which may contain spaces
+    std::istringstream rest(line.substr(line.rfind(')') + 2));
+    std::string field;
+    uint64_t utime = 0, stime = 0;
+    for (int i = 3; i <= 15 && rest >> field; ++i) {
+        if (i == 14) utime = std::stoull(field);
+        if (i == 15) stime = std::stoull(field);
+    }
+    return (utime + stime) * 1000000000ull / static_cast<uint64_t>(sysconf(_SC_CLK_TCK));
+#else
+    (void)pid;
+    return 0;
+#endif
+}
+
+static uint64_t self_cpu_ns() {
+#ifdef __linux__
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    auto ns = [](const timeval& tv) { return static_cast<uint64_t>(tv.tv_sec) * 1000000000ull + tv.tv_usec * 1000ull; };
+    return ns(usage.ru_utime) + ns(usage.ru_stime);
+#else
+    return 0;
+#endif
+}
+
+// Resident set size in bytes
+static uint64_t process_rss_bytes(int pid) {
+#ifdef __linux__
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return std::stoull(line.substr(6)) * 1024; // reported in kB
+        }
+    }
+#else
+    (void)pid;
+#endif
+    return 0;
+}
+
+#ifdef __linux__
+// Start `command` through the shell with its output discarded (the servers log
+// every call) and wait until it accepts connections on host:port
+static int spawn_server(const std::string& command, const std::string& host, int port) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        execl("/bin/sh", "sh", "-c", ("exec " + command).c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    if (pid < 0) return -1;
+    for (int i = 0; i < 200; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (waitpid(pid, nullptr, WNOHANG) == pid) return -1; // exited early
+        socket_t probe = create_socket();
+        bool up = connect_socket(probe, host, port);
+        close_socket(probe);
+        if (up) return pid;
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return -1;
+}
+
+static void stop_server(int pid) {
+    kill(pid, SIGTERM);
+    for (int i = 0; i < 40; ++i) {
+        if (waitpid(pid, nullptr, WNOHANG) == pid) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+#endif
+
+struct ConnectionResult {
+    std::vector<uint64_t> latencies_ns; // measured window only
+    uint64_t errors = 0;
+    std::string first_error;
+    bool lost = false; // stopped calling after a failure
+};
+
+static double to_us(uint64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+}
+
+// --codec: what one core spends to pack and unpack a frame, without the network:
+// plaintext with its CRC against sealed (pack, seal, open, unpack), per body size
+static int run_codec_bench(double seconds_per_case, const std::string& csv_path) {
+    static const size_t BODY_SIZES[] = {64, 1024, 16 * 1024, 256 * 1024};
+    std::unique_ptr<FrameCipher> sealer, opener;
+    if (FrameCipher::available()) {
+        std::vector<uint8_t> key(FrameCipher::KEY_SIZE, 0x5a);
+        sealer = std::make_unique<FrameCipher>(key, FrameCipher::Role::Client);
+        opener = std::make_unique<FrameCipher>(key, FrameCipher::Role::Server);
+        std::vector<uint8_t> hello = sealer->client_hello(), reply;
+        opener->accept_hello(hello.data(), hello.size(), reply);
+        sealer->finish_hello(reply.data(), reply.size());
+    }
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    std::cout << "cpu: aes-ni " << (__builtin_cpu_supports("aes") ? "yes" : "no") << ", pclmul "
+              << (__builtin_cpu_supports("pclmul") ? "yes" : "no") << "\n";
+#endif
+    if (!sealer) {
+        std::cout << "built without Crypto++ (cmake -DAT_RPC_CRYPTOPP=ON): plaintext only\n";
+    }
+
+    ATProtocol sender, receiver;
+    // Frames per second over seconds_per_case of back-to-back round trips through the codec
+    auto measure = [&](const std::vector<uint8_t>& body, bool sealed) {
+        uint16_t flags = ATProtocol::FLAG_REQUEST | (sealed ? ATProtocol::FLAG_SEALED : 0);
+        uint64_t frames = 0;
+        uint64_t t0 = metrics_now_ns();
+        uint64_t deadline = t0 + static_cast<uint64_t>(seconds_per_case * 1e9);
+        uint64_t now = t0;
+        while (now < deadline) {
+            for (int i = 0; i < 16; ++i) {
+                std::vector<uint8_t> packet = sender.pack(flags, body.data(), body.size(), 1);
+                size_t size = packet.size();
+                if (sealed) {
+                    sealer->seal(packet);
+                    size = packet.size();
+                    if (!opener->open(packet.data(), size)) {
+                        throw std::runtime_error("sealed frame failed to open");
+                    }
+                }
+                uint16_t out_flags;
+                uint32_t sequence;
+                std::string_view out_body;
+                receiver.unpack(packet.data(), size, out_flags, sequence, out_body);
+            }
+            frames += 16;
+            now = metrics_now_ns();
+        }
+        return static_cast<double>(frames) * 1e9 / static_cast<double>(now - t0);
+    };
+
+    std::ofstream csv;
+    if (!csv_path.empty()) {
+        bool fresh = !std::ifstream(csv_path).good();
+        csv.open(csv_path, std::ios::app);
+        if (fresh) csv << "body_bytes,crc_frames_per_s,crc_mb_per_s,sealed_frames_per_s,sealed_mb_per_s\n";
+    }
+    std::cout << "body bytes | crc frames/s | crc MB/s | sealed frames/s | sealed MB/s | sealed/crc\n";
+    for (size_t size : BODY_SIZES) {
+        std::vector<uint8_t> body(size);
+        for (size_t i = 0; i < size; ++i) body[i] = static_cast<uint8_t>(i * 31);
+        double crc_fps = measure(body, false);
+        double sealed_fps = sealer ? measure(body, true) : 0.0;
+        double mb = static_cast<double>(size) / 1e6;
+        std::cout << size << " | " << crc_fps << " | " << crc_fps * mb << " | " << sealed_fps << " | "
+                  << sealed_fps * mb << " | " << sealed_fps / crc_fps << "\n";
+        if (csv.is_open()) {
+            csv << size << "," << crc_fps << "," << crc_fps * mb << "," << sealed_fps << "," << sealed_fps * mb << "\n";
+        }
+    }
+
+    // LZ on the bodies it is meant for: structured results, rows of
+    // {"price", "qty", "symbol", "ts"} with random values, as ResponseWriter writes them
+    auto lz_rate = [&](auto&& step, size_t bytes) {
+        uint64_t rounds = 0;
+        uint64_t t0 = metrics_now_ns();
+        uint64_t deadline = t0 + static_cast<uint64_t>(seconds_per_case * 1e9);
+        uint64_t now = t0;
+        while (now < deadline) {
+            step();
+            ++rounds;
+            now = metrics_now_ns();
+        }
+        return static_cast<double>(rounds * bytes) * 1e3 / static_cast<double>(now - t0); // MB/s
+    };
+    static const char* SYMBOLS[] = {"AAPL", "MSFT", "GOOG", "AMZN", "NVDA", "META", "TSLA", "BABA"};
+    std::cout << "\njson result rows | body bytes | lz bytes | ratio | compress MB/s | decompress MB/s\n";
+    for (size_t count : {10, 100, 1000, 10000}) {
+        json rows = json::array();
+        uint64_t state = 88172645463325252ull;
+        auto next = [&state] { // xorshift64, reproducible runs
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        };
+        for (size_t i = 0; i < count; ++i) {
+            rows.push_back({{"symbol", SYMBOLS[next() % 8]},
+                            {"price", 100.0 + static_cast<double>(next() % 100000) / 100.0},
+                            {"qty", next() % 5000},
+                            {"ts", 1700000000000ull + i * 250 + next() % 250}});
+        }
+        ResponseWriter writer;
+        writer.success(rows);
+        std::string body(writer.body());
+        const uint8_t* raw = reinterpret_cast<const uint8_t*>(body.data());
+
+        std::vector<uint8_t> packed;
+        if (!lz_compress_body(raw, body.size(), packed)) {
+            std::cout << count << " | " << body.size() << " | - | below 1/" << LZ_MIN_SAVING << " saving, sent plain\n";
+            continue;
+        }
+        std::string inflated;
+        double compress_mbs = lz_rate([&] { packed.clear(); lz_compress_body(raw, body.size(), packed); }, body.size());
+        double decompress_mbs = lz_rate([&] { lz_decompress_body(packed.data(), packed.size(), body.size(), inflated); }, body.size());
+        if (inflated != body) {
+            throw std::runtime_error("lz round trip changed the body");
+        }
+        std::cout << count << " | " << body.size() << " | " << packed.size() << " | "
+                  << static_cast<double>(body.size()) / static_cast<double>(packed.size()) << " | " << compress_mbs << " | "
+                  << decompress_mbs << "\n";
+    }
+    std::cout << std::flush;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    spdlog::set_level(spdlog::level::warn);
+    spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] %v");
+
+    cxxopts::Options options("at_rpc_bench", "Benchmark the AT, JSON and gRPC RPC stacks with the same workload.");
+    options.add_options()
+            ("stack,s", "at, at-typed, json or grpc", cxxopts::value<std::string>()->default_value("at"))
+            ("host,H", "Server host", cxxopts::value<std::string>()->default_value("127.0.0.1"))
+            ("port,p", "Server port", cxxopts::value<int>()->default_value("9999"))
+            ("connections,c", "Concurrent connections, one call in flight on each", cxxopts::value<int>()->default_value("8"))
+            ("duration,d", "Seconds measured", cxxopts::value<double>()->default_value("10"))
+            ("warmup,w", "Seconds of calls before measuring", cxxopts::value<double>()->default_value("2"))
+            ("server-pid", "Pid of the running server, for its CPU and RSS (Linux)", cxxopts::value<int>()->default_value("0"))
+            ("server", "Start the server with this shell command and stop it afterwards (Linux)",
+             cxxopts::value<std::string>()->default_value(""))
+            ("csv", "Append a result row to this CSV file", cxxopts::value<std::string>()->default_value(""))
+            ("key-file", "Seal the at / at-typed connections with the key in this file (server needs the same)",
+             cxxopts::value<std::string>()->default_value(""))
+            ("codec", "Only time the frame codec (plaintext + CRC, sealed, LZ bodies), --duration seconds per case")
+            ("help", "Print usage")
+        ;
+    auto result = options.parse(argc, argv);
+    if (result.count("help")) {
+        std::cout << options.help() << std::endl;
+        return 0;
+    }
+    std::string stack = result["stack"].as<std::string>();
+    std::string host = result["host"].as<std::string>();
+    int port = result["port"].as<int>();
+    int connections = result["connections"].as<int>();
+    double duration_s = result["duration"].as<double>();
+    double warmup_s = result["warmup"].as<double>();
+    int server_pid = result["server-pid"].as<int>();
+    std::string server_command = result["server"].as<std::string>();
+    std::string csv_path = result["csv"].as<std::string>();
+    if (connections < 1 || duration_s <= 0 || warmup_s < 0) {
+        std::cerr << "Error: --connections must be >= 1, --duration > 0 and --warmup >= 0" << std::endl;
+        return 1;
+    }
+    if (result.count("codec")) {
+        return run_codec_bench(duration_s, csv_path);
+    }
+    std::vector<uint8_t> key;
+    if (!result["key-file"].as<std::string>().empty()) {
+        if (stack != "at" && stack != "at-typed") {
+            std::cerr << "Error: --key-file applies to the at and at-typed stacks only" << std::endl;
+            return 1;
+        }
+        if (!FrameCipher::available()) {
+            std::cerr << "Error: --key-file needs a build with Crypto++ (cmake -DAT_RPC_CRYPTOPP=ON)" << std::endl;
+            return 1;
+        }
+        try {
+            key = FrameCipher::load_key(result["key-file"].as<std::string>());
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (!make_driver(stack, host, port, key)) {
+        std::cerr << "Error: unknown stack '" << stack << "' (at, at-typed, json"
+#ifdef AT_BENCH_GRPC
+                  << ", grpc"
+#endif
+                  << ")" << std::endl;
+        return 1;
+    }
+
+    initialize_sockets();
+#ifdef __linux__
+    signal(SIGPIPE, SIG_IGN);
+    if (!server_command.empty()) {
+        server_pid = spawn_server(server_command, host, port);
+        if (server_pid < 0) {
+            std::cerr << "Error: '" << server_command << "' did not start listening on " << host << ":" << port << std::endl;
+            return 1;
+        }
+    }
+#else
+    if (!server_command.empty() || server_pid > 0) {
+        std::cerr << "Warning: server accounting needs /proc; reporting the client side only" << std::endl;
+        server_pid = 0;
+    }
+#endif
+    uint64_t rss_idle = server_pid > 0 ? process_rss_bytes(server_pid) : 0;
+
+    std::vector<std::unique_ptr<BenchDriver>> drivers;
+    for (int i = 0; i < connections; ++i) {
+        drivers.push_back(make_driver(stack, host, port, key));
+        if (!drivers.back()->connect()) {
+            std::cerr << "Error: connection " << i << " to " << host << ":" << port << " failed" << std::endl;
+#ifdef __linux__
+            if (!server_command.empty()) stop_server(server_pid);
+#endif
+            return 1;
+        }
+    }
+
+    // Every thread calls until `t_end`; only calls started after `t_start` count
+    uint64_t t_start = metrics_now_ns() + static_cast<uint64_t>(warmup_s * 1e9);
+    uint64_t t_end = t_start + static_cast<uint64_t>(duration_s * 1e9);
+    std::vector<ConnectionResult> results(connections);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < connections; ++i) {
+        threads.emplace_back([&, i]() {
+            BenchDriver& driver = *drivers[i];
+            ConnectionResult& out = results[i];
+            out.latencies_ns.reserve(1 << 16);
+            std::string error;
+            while (true) {
+                uint64_t t0 = metrics_now_ns();
+                if (t0 >= t_end) break;
+                bool ok = driver.call(error);
+                uint64_t t1 = metrics_now_ns();
+                if (!ok) {
+                    // A failed round trip leaves the connection out of step (or
+                    // closed): stop this connection rather than spin on errors
+                    out.errors++;
+                    out.first_error = error;
+                    out.lost = true;
+                    break;
+                }
+                if (t0 >= t_start) {
+                    out.latencies_ns.push_back(t1 - t0);
+                }
+            }
+        });
+    }
+
+    // Steady-state samples, taken by this (idle) thread around the measured window
+    auto sleep_until_ns = [](uint64_t deadline) {
+        uint64_t now = metrics_now_ns();
+        if (deadline > now) std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now));
+    };
+    sleep_until_ns(t_start);
+    uint64_t client_cpu_start = self_cpu_ns();
+    uint64_t server_cpu_start = server_pid > 0 ? process_cpu_ns(server_pid) : 0;
+    uint64_t rss_loaded = server_pid > 0 ? process_rss_bytes(server_pid) : 0;
+    sleep_until_ns(t_end);
+    uint64_t client_cpu = self_cpu_ns() - client_cpu_start;
+    uint64_t server_cpu = server_pid > 0 ? process_cpu_ns(server_pid) - server_cpu_start : 0;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    drivers.clear();
+#ifdef __linux__
+    if (!server_command.empty()) {
+        stop_server(server_pid);
+    }
+#endif
+
+    std::vector<uint64_t> latencies;
+    uint64_t errors = 0;
+    int lost = 0;
+    std::string first_error;
+    for (auto& r : results) {
+        lost += r.lost ? 1 : 0;
+        latencies.insert(latencies.end(), r.latencies_ns.begin(), r.latencies_ns.end());
+        if (r.errors > 0 && first_error.empty()) first_error = r.first_error;
+        errors += r.errors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double q) -> uint64_t {
+        if (latencies.empty()) return 0;
+        size_t idx = static_cast<size_t>(q * static_cast<double>(latencies.size() - 1));
+        return latencies[idx];
+    };
+    double calls = static_cast<double>(latencies.size());
+    double throughput = calls / duration_s;
+    double client_cpu_us = calls > 0 ? to_us(client_cpu) / calls : 0.0;
+    double server_cpu_us = calls > 0 ? to_us(server_cpu) / calls : 0.0;
+    double rss_per_conn_kb = rss_loaded > rss_idle ? static_cast<double>(rss_loaded - rss_idle) / connections / 1024.0 : 0.0;
+
+    std::string label = key.empty() ? stack : stack + "+sealed";
+    std::cout << "stack " << label << ": " << connections << " connections, " << duration_s << " s measured after "
+              << warmup_s << " s warmup\n"
+              << "  throughput " << throughput << " calls/s (ok " << latencies.size() << ", errors " << errors << ", connections lost " << lost << ")\n"
+              << "  latency us: p50 " << to_us(percentile(0.50)) << ", p90 " << to_us(percentile(0.90)) << ", p99 "
+              << to_us(percentile(0.99)) << ", p99.9 " << to_us(percentile(0.999)) << ", max "
+              << to_us(latencies.empty() ? 0 : latencies.back()) << "\n"
+              << "  cpu us/call: client " << client_cpu_us;
+    if (server_pid > 0) {
+        std::cout << ", server " << server_cpu_us << "\n"
+                  << "  server rss: " << rss_idle / 1024 << " KB idle, " << rss_loaded / 1024 << " KB loaded, "
+                  << rss_per_conn_kb << " KB per connection";
+    }
+    std::cout << std::endl;
+    if (!first_error.empty()) {
+        std::cout << "  first error: " << first_error << std::endl;
+    }
+
+    if (!csv_path.empty()) {
+        bool fresh = !std::ifstream(csv_path).good();
+        std::ofstream csv(csv_path, std::ios::app);
+        if (fresh) {
+            csv << "stack,connections,duration_s,calls_per_s,errors,p50_us,p90_us,p99_us,p999_us,max_us,"
+                   "client_cpu_us_per_call,server_cpu_us_per_call,server_rss_kb_per_conn\n";
+        }
+        csv << label << "," << connections << "," << duration_s << "," << throughput << "," << errors << ","
+            << to_us(percentile(0.50)) << "," << to_us(percentile(0.90)) << "," << to_us(percentile(0.99)) << ","
+            << to_us(percentile(0.999)) << "," << to_us(latencies.empty() ? 0 : latencies.back()) << ","
+            << client_cpu_us << "," << (server_pid > 0 ? std::to_string(server_cpu_us) : "") << ","
+            << (server_pid > 0 ? std::to_string(rss_per_conn_kb) : "") << "\n";
+    }
+    return errors == 0 ? 0 : 2;
+}
+
+// run: ./build/at_rpc_bench --stack at --server "./build/at_rpc_demo server --port 9999 --log-level warn" --port 9999 -c 8 --csv bench.csv
+// run: ./build/at_rpc_bench --stack at-typed --server "./build/at_rpc_demo server --port 9999 --log-level warn" --port 9999 -c 8 --csv bench.csv
+// run: ./build/at_rpc_bench --stack at --server "./build/at_rpc_demo server --port 9999 --log-level warn --key-file at_rpc.key" --port 9999 -c 8 --key-file at_rpc.key --csv bench.csv
+// run: ./build/at_rpc_bench --codec --duration 1
+// run: ./build/at_rpc_bench --stack json --server "./bin/optimized_socket_demo server" --port 6006 -c 8 --csv bench.csv
+// run: ./build/at_rpc_bench --stack grpc --server "./account_server 127.0.0.1:50051" --port 50051 -c 8 --csv bench.csv
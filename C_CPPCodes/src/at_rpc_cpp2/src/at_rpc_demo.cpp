@@ -1,14 +1,37 @@
 // at_rpc_demo.cpp
 #include "at_protocol.h"
+#include "buffer_pool.h"
+#include "bulk_ops.h"
+#include "calculator.atidl.h" // generated from idl/calculator.atidl
+#include "cpu_affinity.h"
+#include "expr_eval.h"
+#include "fast_request.h"
+#include "frame_cipher.h"
+#include "lz_codec.h"
+#include "pubsub.h"
+#include "request_arena.h"
+#include "rpc_capture.h"
+#include "rpc_connection.h"
+#include "rpc_profiler.h"
+#include "rpc_quota.h"
+#include "response_writer.h"
+#include "rpc_trace.h"
+#include "typed_call.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
 #include <cxxopts.hpp>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 #include <sstream>
 
 
-// 计算器函数
-json calculator_handler(const json& request) {
+// 计算器函数：结果直接写入响应帧，返回是否成功
+bool calculator_handler(const std::string& func_name, const InlineArgs& args, ResponseWriter& response) {
     static const std::map<std::string, std::function<double(double, double)>> functions = {
         {"add", [](double a, double b){ return a + b; }},
         {"sub", [](double a, double b){ return a - b; }},
@@ -19,20 +42,96 @@ json calculator_handler(const json& request) {
         }}
     };
 
-    json response = {{"status", "error"}, {"message", "Function not found"}};
     try {
-        std::string func_name = request["func"];
         if (functions.count(func_name)) {
-            double a = request["args"][0];
-            double b = request["args"][1];
-            double result = functions.at(func_name)(a, b);
-            response = {{"status", "success"}, {"result", result}};
+            if (args.size() < 2) throw std::runtime_error(func_name + " requires 2 arguments");
+            double result = functions.at(func_name)(args[0], args[1]);
+            response.success(result);
+            return true;
         }
     } catch (const std::exception& e) {
         spdlog::error("Error executing function: {}", e.what());
-        response = {{"status", "error"}, {"message", e.what()}};
+        response.error(e.what());
+        return false;
     }
-    return response;
+    response.error("Function not found");
+    return false;
+}
+
+// Generic path for request bodies the fast parser declined
+bool calculator_handler(const arena_json& request, ResponseWriter& response) {
+    static ExprPlanCache expr_plans; // shared by all connection threads
+    if (request.is_object() && request.value("func", "") == "eval") {
+        return handle_eval_request(request, expr_plans, response);
+    }
+    std::string func_name;
+    InlineArgs args;
+    try {
+        func_name = arena_at(request, "func").get<std::string>();
+        for (const auto& arg : arena_at(request, "args")) {
+            args.push_back(arg.get<double>());
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("Error executing function: {}", e.what());
+        response.error(e.what());
+        return false;
+    }
+    return calculator_handler(func_name, args, response);
+}
+
+// Typed flavour of the calculator (FLAG_TYPED requests, idl/calculator.atidl)
+class CalculatorService : public calculator::Service {
+public:
+    double add(const calculator::AddArgs& args) override { return args.a + args.b; }
+    double sub(const calculator::SubArgs& args) override { return args.a - args.b; }
+    double mul(const calculator::MulArgs& args) override { return args.a * args.b; }
+    double div(const calculator::DivArgs& args) override {
+        if (args.b == 0) throw std::runtime_error("Division by zero");
+        return args.a / args.b;
+    }
+    double sum(const calculator::SumArgs& args) override {
+        double total = 0.0;
+        for (double v : args.values) total += v;
+        return total;
+    }
+    std::vector<double> scale(const calculator::ScaleArgs& args) override {
+        std::vector<double> out(args.values.size());
+        for (size_t i = 0; i < out.size(); ++i) out[i] = args.values[i] * args.factor;
+        return out;
+    }
+    std::string label(const calculator::LabelArgs& args) override {
+        if (args.precision < 0 || args.precision > 17) throw std::runtime_error("precision must be 0..17");
+        std::ostringstream text;
+        text.setf(std::ios::fixed);
+        text.precision(args.precision);
+        text << args.name << " = " << args.value;
+        return text.str();
+    }
+};
+
+const TypedRegistry& typed_calculator() {
+    static CalculatorService service;
+    static const TypedRegistry registry = [] {
+        TypedRegistry methods;
+        calculator::register_service(methods, service);
+        return methods;
+    }();
+    return registry;
+}
+
+// Shared key for sealed frames (--key-file, client modes); empty = plaintext
+static std::vector<uint8_t> g_client_key;
+// --compress-threshold in client modes; 0 = plain bodies
+static size_t g_client_compress_threshold = 0;
+
+// Client modes open their connections through here, so --key-file and
+// --compress-threshold apply to all of them
+static bool connect_client(RPCConnection& conn) {
+    if (!g_client_key.empty()) {
+        conn.enable_encryption(g_client_key);
+    }
+    conn.enable_compression(g_client_compress_threshold);
+    return conn.connect();
 }
 
 void run_client(const std::string& host, int port, const std::string& func, const std::vector<double>& args, int timeout_seconds = 5) {
@@ -146,18 +245,316 @@ void run_client(const std::string& host, int port, const std::string& func, cons
         cleanup_sockets();
 }
 
-void run_server(const std::string& host, int port) {
+struct DemoServerOptions {
+    std::string capture_path;   // record incoming frames for at_rpc_replay
+    int idle_timeout_ms = 60000; // 0 = never
+    // Receive memory: per connection (also the largest accepted frame) and for
+    // all connections together (0 = unlimited)
+    size_t conn_quota = ATProtocol::HEADER_SIZE + 10 * 1024 * 1024;
+    size_t global_quota = 256 * 1024 * 1024;
+    // A read paused on the global quota longer than this drops its connection
+    int quota_wait_ms = 5000;
+    // Pin connection threads round-robin to these CPUs ("auto" = all); empty = float
+    std::string cpus;
+    // Shared key for sealed frames (see frame_cipher.h); empty = plaintext with CRC
+    std::vector<uint8_t> key;
+    // Responses of at least this many bytes are LZ-compressed for clients that
+    // accept it (see lz_codec.h); 0 = never
+    size_t compress_threshold = 0;
+    // Where __profile_stop writes collapsed stacks (see rpc_profiler.h); empty = no profiling
+    std::string profile_output;
+};
+
+static constexpr size_t BODY_CHUNK = 64 * 1024;
+static constexpr size_t PUSH_QUEUE_FRAMES = 1024; // per subscribed connection, see pubsub.h
+
+// Serve frames on one connection until the peer closes, sends a bad frame, or
+// stays idle longer than idle_timeout_ms (0 = wait forever; a connection with
+// subscriptions is never idle)
+static void serve_connection(socket_t client_socket, uint32_t conn_id, CaptureWriter& capture, ByteBudget& budget,
+                             PubSubHub& hub, const DemoServerOptions& options) {
+    ATProtocol protocol; // per connection: unpack keeps header state
+    std::vector<uint8_t> header_buffer(ATProtocol::HEADER_SIZE);
+    std::vector<uint8_t> full_request_packet;
+    std::vector<uint8_t> response_frame = BufferPool::instance().acquire(0); // one response in flight, so one buffer to recycle
+    size_t charged = 0; // bytes of full_request_packet's capacity held from the global budget
+    uint64_t served = 0;
+    // Sealed connections: frames are sealed under send_mutex, in the order they go out
+    std::unique_ptr<FrameCipher> cipher;
+    if (!options.key.empty()) {
+        cipher = std::make_unique<FrameCipher>(options.key, FrameCipher::Role::Server);
+    }
+    // Responses and push frames share the socket; each goes out whole
+    std::mutex send_mutex;
+    std::shared_ptr<PushSubscriber> subscriber; // created by the first subscribe
+    auto push_subscriber = [&]() {
+        if (!subscriber) {
+            subscriber = std::make_shared<PushSubscriber>(PUSH_QUEUE_FRAMES,
+                [client_socket, &send_mutex, &cipher](const std::vector<uint8_t>& frame) {
+                    std::lock_guard<std::mutex> lock(send_mutex);
+                    if (cipher) {
+                        std::vector<uint8_t> sealed = cipher->seal_copy(frame); // the frame is shared
+                        return send_all(client_socket, sealed) == sealed.size();
+                    }
+                    return send_all(client_socket, frame) == frame.size();
+                },
+                [client_socket, conn_id]() {
+                    spdlog::warn("Connection {} is too slow for its subscriptions, closing", conn_id);
+                    shutdown_socket(client_socket);
+                });
+        }
+        return subscriber;
+    };
+    int idle_timeout_ms = options.idle_timeout_ms;
+    const std::chrono::milliseconds quota_wait(options.quota_wait_ms);
+    // A frame that has started must finish within the idle timeout as well
+    if (idle_timeout_ms > 0) {
+        set_recv_timeout(client_socket, idle_timeout_ms);
+    }
+
+    uint64_t frame_ticket = 0; // priority on the global budget, see ByteBudget
+    while (true) {
+        budget.end_frame(frame_ticket);
+        frame_ticket = 0;
+        // Idle between frames: give back what a large frame made us commit
+        if (charged > BODY_CHUNK) {
+            BufferPool::instance().release(std::move(full_request_packet)); // for the next large frame, any connection
+            budget.release(charged);
+            charged = 0;
+        }
+        if (idle_timeout_ms > 0) {
+            bool readable = wait_readable(client_socket, idle_timeout_ms);
+            while (!readable && subscriber && subscriber->open()) {
+                readable = wait_readable(client_socket, idle_timeout_ms);
+            }
+            if (!readable) {
+                spdlog::info("Connection {} idle for {} ms, closing", conn_id, idle_timeout_ms);
+                break;
+            }
+        }
+        if (recv_all(client_socket, header_buffer, ATProtocol::HEADER_SIZE) != ATProtocol::HEADER_SIZE) {
+            break; // Peer closed (the normal end of a keep-alive session) or error
+        }
+        // Parse header
+        ATHeader header;
+        header.unpack(header_buffer.data(), header_buffer.size());
+        if (header.protocol_id != ATProtocol::PROTOCOL_ID) {
+            spdlog::error("Invalid protocol ID: {}", header.protocol_id);
+            break;
+        }
+        size_t frame_size = ATProtocol::HEADER_SIZE + static_cast<size_t>(header.body_length);
+        if (frame_size > options.conn_quota) {
+            spdlog::error("Frame of {} bytes exceeds the connection quota of {} bytes", frame_size, options.conn_quota);
+            break;
+        }
+
+        // Commit body memory as bytes arrive, not when the header announces them,
+        // so clients announcing huge bodies cost nothing until they send them
+        full_request_packet.assign(header_buffer.begin(), header_buffer.end());
+        bool complete = true;
+        while (full_request_packet.size() < frame_size) {
+            size_t have = full_request_packet.size();
+            size_t chunk = std::min(BODY_CHUNK, frame_size - have);
+            if (have + chunk > charged) {
+                // Only commit memory for bytes that are actually on their way
+                if (!wait_readable(client_socket, idle_timeout_ms > 0 ? idle_timeout_ms : -1)) {
+                    complete = false;
+                    break;
+                }
+                size_t target = std::min(frame_size, std::max(have + chunk, charged * 2));
+                if (frame_ticket == 0) {
+                    frame_ticket = budget.begin_frame();
+                }
+                bool waited = false;
+                if (!budget.acquire(target - charged, frame_ticket, quota_wait, &waited)) {
+                    spdlog::warn("Connection {}: receive memory quota exhausted ({} of {} bytes in use)",
+                                 conn_id, budget.used(), budget.limit());
+                    complete = false;
+                    break;
+                }
+                if (waited) {
+                    spdlog::debug("Connection {} paused reading on the memory quota", conn_id);
+                }
+                if (full_request_packet.capacity() < target) {
+                    std::vector<uint8_t> grown = BufferPool::instance().acquire(target);
+                    grown.assign(full_request_packet.begin(), full_request_packet.end());
+                    grown.swap(full_request_packet);
+                    BufferPool::instance().release(std::move(grown));
+                }
+                charged = target;
+            }
+            full_request_packet.resize(have + chunk);
+            int received = recv_some(client_socket, full_request_packet.data() + have, chunk);
+            if (received <= 0) {
+                complete = false;
+                break;
+            }
+            full_request_packet.resize(have + static_cast<size_t>(received));
+        }
+        if (!complete) {
+            spdlog::error("Failed to receive request body");
+            break;
+        }
+        if (cipher) {
+            if (!cipher->established()) {
+                std::vector<uint8_t> reply;
+                if (!cipher->accept_hello(full_request_packet.data(), full_request_packet.size(), reply)) {
+                    spdlog::error("Connection {} did not start with an encryption handshake", conn_id);
+                    break;
+                }
+                if (send_all(client_socket, reply) != reply.size()) {
+                    break;
+                }
+                continue;
+            }
+            size_t size = full_request_packet.size();
+            if (!cipher->open(full_request_packet.data(), size)) {
+                spdlog::error("Connection {}: frame failed to authenticate", conn_id);
+                break;
+            }
+            full_request_packet.resize(size); // captured decrypted, replayable against a plaintext server
+        }
+
+        if (capture.is_open()) {
+            capture.append(conn_id, metrics_now_ns(), full_request_packet.data(), full_request_packet.size());
+        }
+        if (!(header.flags & ATProtocol::FLAG_REQUEST)) { // Not a request
+            spdlog::warn("Received non-request packet (Seq: {}, Flags: 0x{:04X}). Ignoring.", header.sequence, header.flags);
+            continue; // Frame consumed, the connection stays usable
+        }
+
+        uint32_t received_seq = header.sequence;
+        try {
+            uint16_t received_flags;
+            std::string_view request_body_str;
+            if (!protocol.unpack(full_request_packet.data(), full_request_packet.size(), received_flags, received_seq,
+                                 request_body_str)) {
+                spdlog::error("Failed to unpack request");
+                break;
+            }
+            std::string inflated; // a compressed body, expanded; no larger than a plain frame could be
+            if (received_flags & ATProtocol::FLAG_COMPRESSED) {
+                if (!lz_decompress_body(reinterpret_cast<const uint8_t*>(request_body_str.data()), request_body_str.size(),
+                                        options.conn_quota - ATProtocol::HEADER_SIZE, inflated)) {
+                    spdlog::error("Connection {}: malformed compressed body (seq={})", conn_id, received_seq);
+                    break;
+                }
+                request_body_str = inflated;
+            }
+            ResponseWriter response(std::move(response_frame)); // reuses the previous frame's buffer
+            uint16_t response_flags = ATProtocol::FLAG_RESPONSE;
+            if (received_flags & ATProtocol::FLAG_TYPED) {
+                std::string error;
+                if (typed_calculator().execute(reinterpret_cast<const uint8_t*>(request_body_str.data()),
+                                               request_body_str.size(), response, error)) {
+                    response_flags |= ATProtocol::FLAG_TYPED;
+                } else {
+                    spdlog::error("Typed request failed: {}", error);
+                    response.error(error);
+                    response_flags |= ATProtocol::FLAG_ERROR;
+                }
+            } else if (received_flags & ATProtocol::FLAG_BINARY) {
+                // Array-valued op, run in place on the received arrays
+                std::string error;
+                if (execute_bulk(reinterpret_cast<const uint8_t*>(request_body_str.data()), request_body_str.size(),
+                                 response, error)) {
+                    response_flags |= ATProtocol::FLAG_BINARY;
+                } else {
+                    spdlog::error("Bulk request failed: {}", error);
+                    response.error(error);
+                    response_flags |= ATProtocol::FLAG_ERROR;
+                }
+            } else {
+                RequestArena::Scope arena_scope; // DOM and handler scratch of this request, freed in one reset
+                // MessagePack bodies hold the same documents; answer in kind
+                std::string transcoded;
+                if (received_flags & ATProtocol::FLAG_MSGPACK) {
+                    const uint8_t* packed = reinterpret_cast<const uint8_t*>(request_body_str.data());
+                    transcoded = json::from_msgpack(packed, packed + request_body_str.size()).dump();
+                    request_body_str = transcoded;
+                }
+                spdlog::debug("Received request: {}", request_body_str);
+                // Fast path for the usual {"func": ..., "args": [...]} body, DOM otherwise
+                FastRequest fast_request;
+                bool ok;
+                if (parse_fast_request(request_body_str, fast_request)) {
+                    std::string func(fast_request.func);
+                    ok = is_profile_method(func)
+                             ? handle_profile_request(func, fast_request.args, options.profile_output, response)
+                             : calculator_handler(func, fast_request.args, response);
+                } else {
+                    arena_json& request = RequestArena::current()->make<arena_json>(arena_json::parse(request_body_str));
+                    auto func = request.is_object() ? request.find("func") : request.end();
+                    if (func != request.end() && func->is_string() && is_pubsub_method(func->get_ref<const arena_string&>())) {
+                        ok = handle_pubsub_request(func->get<std::string>(), request, hub, push_subscriber, response);
+                    } else {
+                        ok = calculator_handler(request, response);
+                    }
+                }
+                spdlog::debug("Sending response (seq={}): {}", received_seq, response.body());
+                if (!ok) {
+                    response_flags |= ATProtocol::FLAG_ERROR;
+                }
+                if (received_flags & ATProtocol::FLAG_MSGPACK) {
+                    response.to_msgpack();
+                    response_flags |= ATProtocol::FLAG_MSGPACK;
+                }
+            }
+            if ((received_flags & ATProtocol::FLAG_ACCEPTS_COMPRESSED) && options.compress_threshold > 0 &&
+                response.compress(options.compress_threshold)) {
+                response_flags |= ATProtocol::FLAG_COMPRESSED;
+            }
+            if (cipher) {
+                response_flags |= ATProtocol::FLAG_SEALED; // no CRC: seal() adds the tag
+            }
+            response_frame = response.finish(response_flags, received_seq);
+            std::lock_guard<std::mutex> send_lock(send_mutex);
+            if (cipher) {
+                cipher->seal(response_frame);
+            }
+            if (send_all(client_socket, response_frame) != response_frame.size()) {
+                spdlog::error("Failed to send response for seq={}", received_seq);
+                break;
+            }
+            served++;
+        } catch (const std::exception& e) {
+            // A bad body does not desynchronise the stream: the whole frame was consumed
+            spdlog::error("Failed to process a message (seq={}): {}. Skipping it.", received_seq, e.what());
+            continue;
+        }
+    }
+    budget.end_frame(frame_ticket);
+    budget.release(charged);
+    BufferPool::instance().release(std::move(full_request_packet));
+    BufferPool::instance().release(std::move(response_frame));
+    if (subscriber) {
+        shutdown_socket(client_socket); // a push blocked on a client that stopped reading fails now
+        subscriber->close();
+    }
+    close_socket(client_socket);
+    spdlog::info("Connection {} closed after {} requests", conn_id, served);
+}
+
+// Thread-per-connection server: every accepted connection is served until the
+// client closes it or it stays idle for options.idle_timeout_ms.
+void run_server(const std::string& host, int port, const DemoServerOptions& options = {}) {
     initialize_sockets();
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN); // A client vanishing mid-response must not kill the server
+#endif
 
     socket_t listen_sock = create_socket();
     if (listen_sock == INVALID_SOCKET) {
         spdlog::critical("Failed to create server socket.");
+        cleanup_sockets();
+        return;
     }
 
     if (!bind_socket(listen_sock, host, port)) {
         spdlog::critical("Failed to bind server socket to {}:{}", host, port);
         close_socket(listen_sock);
         cleanup_sockets();
+        return;
     }
 
     if (::listen(listen_sock, SOMAXCONN) == SOCKET_ERROR) {
@@ -165,10 +562,38 @@ void run_server(const std::string& host, int port) {
         spdlog::critical("Listen failed: {}", get_error_message(err));
         close_socket(listen_sock);
         cleanup_sockets();
+        return;
     }
 
     spdlog::info("RPC Server listening on {}:{}",  host, port);
 
+    // Optional traffic capture for at_rpc_replay. The loop below never returns, so
+    // the file is never closed; readers stop at the first empty record.
+    static CaptureWriter capture; // outlives the detached connection threads
+    if (!options.capture_path.empty() && !capture.open(options.capture_path, 256 * 1024 * 1024)) {
+        spdlog::warn("Continuing without traffic capture.");
+    }
+    // Each connection's thread stays on one CPU, and on multi-node machines its
+    // buffers come from that CPU's NUMA node
+    CpuTopology topology = CpuTopology::detect();
+    std::vector<int> cpus;
+    if (!options.cpus.empty()) {
+        try {
+            cpus = select_cpus(topology, options.cpus);
+        } catch (const std::invalid_argument& e) {
+            spdlog::critical("--cpus: {}", e.what());
+            close_socket(listen_sock);
+            cleanup_sockets();
+            return;
+        }
+        spdlog::info("CPU topology: {}; pinning connections to cpus {}", topology.describe(), format_cpu_list(cpus));
+    }
+    uint32_t next_conn_id = 1;
+    static std::atomic<int> active{0};
+    static ByteBudget budget;
+    budget.set_limit(options.global_quota);
+    static PubSubHub hub; // topics span connections
+
     while (true) {
         sockaddr_in client_addr{};
         socklen_t client_addr_len = sizeof(client_addr);
@@ -179,77 +604,250 @@ void run_server(const std::string& host, int port) {
             spdlog::error("Accept failed: {}", get_error_message(err));
             continue; // Continue loop even on accept failure, unless shutting down
         }
-        spdlog::info("Accepted connection");
+        uint32_t conn_id = next_conn_id++;
+        spdlog::info("Accepted connection {} ({} active)", conn_id, active.fetch_add(1) + 1);
 
-        // Handle each client
-        std::vector <uint8_t> header_buffer(ATProtocol::HEADER_SIZE);
-        if (recv_all(client_socket, header_buffer, ATProtocol::HEADER_SIZE) != ATProtocol::HEADER_SIZE) {
-            spdlog::error("Failed to receive request header");
-            close_socket(client_socket);
-            continue;
-        }
-        // Parse header
-        ATHeader header;
-        header.unpack(header_buffer.data(), header_buffer.size());
-        if (header.protocol_id != ATProtocol::PROTOCOL_ID) {
-            spdlog::error("Invalid protocol ID: {}", header.protocol_id);
-            close_socket(client_socket);
-            continue;
-        }
-        if (header.body_length < 0 || header.body_length > 10 * 1024 * 1024) { // Arbitrary 10MB limit
-            spdlog::error("Unreasonable body length: {}", header.body_length);
-            close_socket(client_socket);
-            continue;
+        int cpu = cpus.empty() ? -1 : cpus[(conn_id - 1) % cpus.size()];
+        int node = cpu >= 0 && topology.nodes().size() > 1 ? topology.node_of(cpu) : -1;
+        std::thread([client_socket, conn_id, options, cpu, node]() {
+            if (cpu >= 0 && !pin_current_thread(cpu, node)) {
+                spdlog::warn("Could not pin connection {} to cpu {}", conn_id, cpu);
+            }
+            serve_connection(client_socket, conn_id, capture, budget, hub, options);
+            active.fetch_sub(1);
+        }).detach();
+    }
+    close_socket(listen_sock);
+    cleanup_sockets();
+}
+
+// Drive `repeat` calls from `concurrency` threads, each over its own persistent
+// connection, and print throughput and latency. Returns the number of failed calls.
+uint64_t run_client_load(const std::string& host, int port, const std::string& func, const std::vector<double>& args,
+                         int repeat, int concurrency) {
+    std::atomic<int> next_call{0};
+    std::atomic<uint64_t> ok{0}, remote_errors{0}, transport_errors{0};
+    std::mutex latency_mutex;
+    std::vector<uint64_t> latencies;
+    latencies.reserve(static_cast<size_t>(repeat));
+
+    uint64_t t0 = metrics_now_ns();
+    std::vector<std::thread> workers;
+    for (int w = 0; w < concurrency; ++w) {
+        workers.emplace_back([&]() {
+            RPCConnection conn(host, port);
+            std::vector<uint64_t> local;
+            while (next_call.fetch_add(1) < repeat) {
+                if (!conn.is_connected() && !connect_client(conn)) {
+                    transport_errors++;
+                    continue;
+                }
+                uint64_t start = metrics_now_ns();
+                try {
+                    conn.call(func, args);
+                    ok++;
+                } catch (const RPCTransportError& e) {
+                    spdlog::warn("Call failed: {}", e.what());
+                    transport_errors++;
+                    continue;
+                } catch (const std::exception& e) {
+                    remote_errors++;
+                }
+                local.push_back(metrics_now_ns() - start);
+            }
+            std::lock_guard<std::mutex> lock(latency_mutex);
+            latencies.insert(latencies.end(), local.begin(), local.end());
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double elapsed_s = static_cast<double>(metrics_now_ns() - t0) / 1e9;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile_us = [&latencies](double q) {
+        if (latencies.empty()) return 0.0;
+        return static_cast<double>(latencies[static_cast<size_t>(q * static_cast<double>(latencies.size() - 1))]) / 1000.0;
+    };
+    std::cout << repeat << " calls of '" << func << "' over " << concurrency << " connections in " << elapsed_s << " s\n"
+              << "  ok " << ok << ", remote errors " << remote_errors << ", transport errors " << transport_errors << "\n"
+              << "  throughput " << (elapsed_s > 0 ? static_cast<double>(ok + remote_errors) / elapsed_s : 0.0) << " calls/s\n"
+              << "  latency us: p50 " << percentile_us(0.5) << ", p99 " << percentile_us(0.99)
+              << ", max " << percentile_us(1.0) << std::endl;
+    return remote_errors + transport_errors;
+}
+
+// Run the array-valued op `op_name` `repeat` times over float64 arrays of `size`
+// elements (axpy scales by alpha) and print the result head and the data rate
+int run_client_bulk(const std::string& host, int port, const std::string& op_name, size_t size, double alpha, int repeat) {
+    BulkOp op;
+    if (!parse_bulk_op(op_name, op)) {
+        std::cerr << "Error: unknown bulk op '" << op_name << "' (add, sub, mul, div, dot, sum, min, max, axpy)" << std::endl;
+        return 1;
+    }
+    std::vector<double> a(size), b(size);
+    for (size_t i = 0; i < size; ++i) {
+        a[i] = static_cast<double>(i) * 0.5;
+        b[i] = 1.0 + static_cast<double>(i % 7);
+    }
+    std::vector<uint8_t> body = encode_bulk_request(op, a, b, alpha);
+
+    RPCConnection conn(host, port);
+    if (!connect_client(conn)) {
+        std::cerr << "Error: cannot connect to " << host << ":" << port << std::endl;
+        return 1;
+    }
+    BulkResult result;
+    uint64_t t0 = metrics_now_ns();
+    try {
+        for (int i = 0; i < repeat; ++i) {
+            result = conn.call_bulk(body);
         }
-        if (!(header.flags & ATProtocol::FLAG_REQUEST)) { // Not a request
-            spdlog::warn("Received non-request packet (Seq: {}, Flags: 0x{:04X}). Ignoring.", header.sequence, header.flags);
-            continue; // Expecting a request
+    } catch (const std::exception& e) {
+        std::cerr << "Bulk call failed: " << e.what() << std::endl;
+        return 1;
+    }
+    double elapsed_s = static_cast<double>(metrics_now_ns() - t0) / 1e9;
+
+    std::cout << "bulk " << op_name << " over " << size << " float64 -> " << result.size() << " values:";
+    for (size_t i = 0; i < std::min<size_t>(result.size(), 4); ++i) {
+        if (result.dtype == BulkDType::Float64) {
+            std::cout << " " << result.f64[i];
+        } else {
+            std::cout << " " << result.ints[i];
         }
-        std::vector<uint8_t> body_buffer(header.body_length);
-        if (recv_all(client_socket, body_buffer, header.body_length) != header.body_length) {
-            spdlog::error("Failed to receive request body");
-            close_socket(client_socket);
-            continue;
+    }
+    std::cout << (result.size() > 4 ? " ..." : "") << "\n";
+    double bytes = static_cast<double>(body.size() + result.size() * 8) * repeat;
+    std::cout << "  " << repeat << " calls in " << elapsed_s << " s, "
+              << (elapsed_s > 0 ? bytes / elapsed_s / 1e6 : 0.0) << " MB/s request + response payload" << std::endl;
+    return 0;
+}
+
+// Call `func` of idl/calculator.atidl through the generated client `repeat`
+// times: add/sub/mul/div take the first two --args, sum the whole list and
+// scale the list without its last value, which is the factor
+int run_client_typed(const std::string& host, int port, const std::string& func, const std::vector<double>& args, int repeat) {
+    RPCConnection conn(host, port);
+    if (!connect_client(conn)) {
+        std::cerr << "Error: cannot connect to " << host << ":" << port << std::endl;
+        return 1;
+    }
+    calculator::Client client(conn);
+    double a = args.size() > 0 ? args[0] : 0.0;
+    double b = args.size() > 1 ? args[1] : 0.0;
+    std::vector<double> values;
+    uint64_t t0 = metrics_now_ns();
+    try {
+        for (int i = 0; i < repeat; ++i) {
+            if (func == "add") {
+                values = {client.add(a, b)};
+            } else if (func == "sub") {
+                values = {client.sub(a, b)};
+            } else if (func == "mul") {
+                values = {client.mul(a, b)};
+            } else if (func == "div") {
+                values = {client.div(a, b)};
+            } else if (func == "sum") {
+                values = {client.sum(args)};
+            } else if (func == "scale" && !args.empty()) {
+                values = client.scale(std::vector<double>(args.begin(), args.end() - 1), args.back());
+            } else {
+                std::cerr << "Error: no typed method '" << func << "' (add, sub, mul, div, sum, scale)" << std::endl;
+                return 1;
+            }
         }
+    } catch (const std::exception& e) {
+        std::cerr << "Typed call failed: " << e.what() << std::endl;
+        return 1;
+    }
+    double elapsed_us = static_cast<double>(metrics_now_ns() - t0) / 1e3;
+    std::cout << "typed " << func << " ->";
+    for (double v : values) {
+        std::cout << " " << v;
+    }
+    std::cout << "\n  " << repeat << " calls, " << elapsed_us / repeat << " us per call" << std::endl;
+    return 0;
+}
 
-        std::vector<uint8_t> full_request_packet;
-        full_request_packet.insert(full_request_packet.end(), header_buffer.begin(), header_buffer.end());
-        full_request_packet.insert(full_request_packet.end(), body_buffer.begin(), body_buffer.end());
+// Evaluate `expr` for one binding (variables in order of first appearance) in a
+// single round trip, `repeat` times, and print the result and mean latency
+int run_client_expr(const std::string& host, int port, const std::string& expr, const std::vector<double>& args, int repeat) {
+    RPCConnection conn(host, port);
+    if (!connect_client(conn)) {
+        std::cerr << "Error: cannot connect to " << host << ":" << port << std::endl;
+        return 1;
+    }
+    json request = {{"func", "eval"}, {"expr", expr}, {"args", args}};
+    json response;
+    uint64_t t0 = metrics_now_ns();
+    try {
+        for (int i = 0; i < repeat; ++i) {
+            response = conn.request(request);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "eval failed: " << e.what() << std::endl;
+        return 1;
+    }
+    double elapsed_us = static_cast<double>(metrics_now_ns() - t0) / 1e3;
+    std::cout << expr << " = " << response.value("result", json()).dump() << "\n"
+              << "  " << repeat << " calls, " << elapsed_us / repeat << " us per call" << std::endl;
+    return 0;
+}
 
-        try {
-            ATProtocol protocol;
-            uint16_t received_flags;
-            uint32_t received_seq;
-            std::string request_body_str;
-            if (!protocol.unpack(full_request_packet, received_flags, received_seq, request_body_str)) {
-                spdlog::error("Failed to unpack request");
-                close_socket(client_socket);
-                continue;
-            }
-            spdlog::debug("Received request: {}", request_body_str);
-            json request = json::parse(request_body_str);
-            json response_json = calculator_handler(request);
-            std::string response_body_str = response_json.dump(); // Serialize response
+// Subscribe to `topic` and print pushed messages until `count` have arrived
+int run_client_subscribe(const std::string& host, int port, const std::string& topic, const std::string& policy, int count) {
+    RPCConnection conn(host, port);
+    if (!connect_client(conn)) {
+        std::cerr << "Error: cannot connect to " << host << ":" << port << std::endl;
+        return 1;
+    }
+    std::mutex mutex;
+    std::condition_variable arrived;
+    int received = 0;
+    conn.set_push_handler([&](const std::string& from, uint32_t seq, json&& data) {
+        std::cout << from << " #" << seq << ": " << data.dump() << std::endl;
+        std::lock_guard<std::mutex> lock(mutex);
+        ++received;
+        arrived.notify_one();
+    });
+    try {
+        conn.request({{"func", "subscribe"}, {"topic", topic}, {"policy", policy}});
+    } catch (const std::exception& e) {
+        std::cerr << "subscribe failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Subscribed to '" << topic << "' (" << policy << "), waiting for " << count << " messages" << std::endl;
+    std::unique_lock<std::mutex> lock(mutex);
+    // A lost connection does not notify, so look again now and then
+    while (!arrived.wait_for(lock, std::chrono::milliseconds(200),
+                             [&]() { return received >= count || !conn.is_connected(); })) {
+    }
+    return received >= count ? 0 : 1;
+}
 
-            uint16_t response_flags = ATProtocol::FLAG_RESPONSE;
-            if (response_json["status"] == "error") {
-                response_flags |= ATProtocol::FLAG_ERROR;
-            }
-            auto packed_response = protocol.pack(response_flags, response_body_str, received_seq);
-            if (send_all(client_socket, packed_response) != packed_response.size()) {
-                spdlog::error("Failed to send response for seq={}", received_seq);
-            }
-            spdlog::info("Sent response (seq={}): {}", received_seq, response_body_str);
-        
-        } catch (const std::exception& e) {
-            spdlog::error("Failed to process a message (seq={}): {}. Skipping it.", header.sequence, e.what());
-            // buffer.clear();
-            continue;
+// Publish `data` to `topic` `repeat` times and print how many subscribers the last one reached
+int run_client_publish(const std::string& host, int port, const std::string& topic, const json& data, int repeat) {
+    RPCConnection conn(host, port);
+    if (!connect_client(conn)) {
+        std::cerr << "Error: cannot connect to " << host << ":" << port << std::endl;
+        return 1;
+    }
+    json response;
+    uint64_t t0 = metrics_now_ns();
+    try {
+        for (int i = 0; i < repeat; ++i) {
+            response = conn.request({{"func", "publish"}, {"topic", topic}, {"data", data}});
         }
-        close_socket(client_socket);
+    } catch (const std::exception& e) {
+        std::cerr << "publish failed: " << e.what() << std::endl;
+        return 1;
     }
-    close_socket(listen_sock);
-    cleanup_sockets();
+    double elapsed_us = static_cast<double>(metrics_now_ns() - t0) / 1e3;
+    std::cout << "Published " << repeat << " messages to '" << topic << "', the last reached "
+              << response.value("result", json()).dump() << " subscribers, " << elapsed_us / repeat << " us per publish"
+              << std::endl;
+    return 0;
 }
 
 std::vector<double> parse_args(const std::string& args_str) {
@@ -282,13 +880,42 @@ int main(int argc, char* argv[]) {
 
     options.add_options()
             // 位置参数，不带 '--' 前缀
-            ("mode", "Run as 'server' or 'client'", cxxopts::value<std::string>())
+            ("mode", "Run as 'server' or 'client', or 'trace2chrome' to convert a trace dump", cxxopts::value<std::string>())
             
             // 可选参数，带 '--' 前缀
             ("host,H", "Host to connect to or bind to", cxxopts::value<std::string>()->default_value("127.0.0.1"))
             ("port,p", "Port to connect to or bind to", cxxopts::value<int>()->default_value("9999"))
             ("func,f", "Function to call on the server (client mode only)", cxxopts::value<std::string>()->default_value("add"))
             ("args,a", "Arguments for the function (client mode only)", cxxopts::value<std::string>()->default_value("10,20"))
+            ("input,i", "Binary trace dump (trace2chrome mode only)", cxxopts::value<std::string>()->default_value("at_rpc_trace.bin"))
+            ("output,o", "Chrome trace JSON to write (trace2chrome mode only)", cxxopts::value<std::string>()->default_value("at_rpc_trace.json"))
+            ("capture", "Record incoming frames to this file for at_rpc_replay (server mode only)", cxxopts::value<std::string>()->default_value(""))
+            ("idle-timeout", "Close connections idle for this many ms, 0 = never (server mode only)", cxxopts::value<int>()->default_value("60000"))
+            ("conn-quota", "Receive buffer bytes per connection, also the largest frame (server mode only)", cxxopts::value<int>()->default_value("10485776"))
+            ("global-quota", "Receive buffer bytes for all connections, 0 = unlimited (server mode only)", cxxopts::value<int>()->default_value("268435456"))
+            ("quota-wait", "Ms a read may pause on the global quota before the connection is dropped (server mode only)", cxxopts::value<int>()->default_value("5000"))
+            ("cpus", "Pin connection threads to these CPUs, e.g. 0-7,16-23 or auto (server mode only)", cxxopts::value<std::string>()->default_value(""))
+            ("key-file", "Seal frames with AES-256-GCM under the 64-hex-digit key in this file; server and client need the same one",
+             cxxopts::value<std::string>()->default_value(""))
+            ("compress-threshold", "LZ-compress bodies of at least this many bytes, 0 = never; the server only compresses for clients that set it too",
+             cxxopts::value<int>()->default_value("0"))
+            ("profile-output", "Allow __profile_start / __profile_stop; stop writes collapsed stacks here (server mode only)",
+             cxxopts::value<std::string>()->default_value(""))
+            ("hugepages", "Back pooled packet buffers of 4 MiB and up with transparent huge pages (Linux)")
+            ("repeat,n", "Number of calls to make (client mode only)", cxxopts::value<int>()->default_value("1"))
+            ("bulk", "Call the array op named by --func on float64 arrays of this size; axpy scales by the first --args value (client mode only)",
+             cxxopts::value<int>()->default_value("0"))
+            ("typed", "Call --func through the code generated from idl/calculator.atidl: binary bodies, no JSON (client mode only)")
+            ("expr,e", "Evaluate this formula server-side in one call, binding its variables to --args in order of appearance (client mode only)",
+             cxxopts::value<std::string>()->default_value(""))
+            ("subscribe", "Subscribe to this topic and print --repeat pushed messages (client mode only)",
+             cxxopts::value<std::string>()->default_value(""))
+            ("policy", "For --subscribe: what the server does when this client falls behind, conflate or drop",
+             cxxopts::value<std::string>()->default_value("conflate"))
+            ("publish", "Publish the --args array to this topic, --repeat times (client mode only)",
+             cxxopts::value<std::string>()->default_value(""))
+            ("concurrency,c", "Parallel connections driving the calls (client mode only)", cxxopts::value<int>()->default_value("1"))
+            ("log-level", "trace, debug, info, warn, error (default: debug, warn for client load runs)", cxxopts::value<std::string>())
             ("help", "Print usage")
         ;
 
@@ -311,15 +938,83 @@ int main(int argc, char* argv[]) {
 
      // 从解析结果中提取所有参数
     std::string mode = result["mode"].as<std::string>();
+    int repeat = result["repeat"].as<int>();
+    int concurrency = result["concurrency"].as<int>();
+    bool load_run = mode == "client" && (repeat > 1 || concurrency > 1);
+    if (result.count("log-level")) {
+        spdlog::set_level(spdlog::level::from_str(result["log-level"].as<std::string>()));
+    } else if (load_run) {
+        spdlog::set_level(spdlog::level::warn); // Per-call debug logging would dominate the measurement
+    }
 
     std::string host = result["host"].as<std::string>();
     int port = result["port"].as<int>();
+    if (result.count("hugepages")) {
+        BufferPool::instance().set_hugepages(true);
+    }
+    int compress_threshold = result["compress-threshold"].as<int>();
+    if (compress_threshold < 0) {
+        std::cerr << "Error: --compress-threshold must be >= 0" << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> key;
+    if (!result["key-file"].as<std::string>().empty()) {
+        if (!FrameCipher::available()) {
+            std::cerr << "Error: --key-file needs a build with Crypto++ (cmake -DAT_RPC_CRYPTOPP=ON)" << std::endl;
+            return 1;
+        }
+        try {
+            key = FrameCipher::load_key(result["key-file"].as<std::string>());
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
 
      if (mode == "server") {
         spdlog::info("Starting RPC Server...");
-        run_server(host, port);
+        DemoServerOptions server_options;
+        server_options.capture_path = result["capture"].as<std::string>();
+        server_options.idle_timeout_ms = result["idle-timeout"].as<int>();
+        server_options.conn_quota = static_cast<size_t>(result["conn-quota"].as<int>());
+        server_options.global_quota = static_cast<size_t>(result["global-quota"].as<int>());
+        server_options.quota_wait_ms = result["quota-wait"].as<int>();
+        server_options.cpus = result["cpus"].as<std::string>();
+        server_options.key = key;
+        server_options.compress_threshold = static_cast<size_t>(compress_threshold);
+        server_options.profile_output = result["profile-output"].as<std::string>();
+        run_server(host, port, server_options);
     } else if (mode == "client") {
-        if (!result.count("func") || !result.count("args")) {
+        g_client_key = key;
+        g_client_compress_threshold = static_cast<size_t>(compress_threshold);
+        int bulk_size = result["bulk"].as<int>();
+        std::string expr = result["expr"].as<std::string>();
+        if (!expr.empty()) {
+            std::vector<double> args;
+            try {
+                if (result.count("args")) args = parse_args(result["args"].as<std::string>());
+            } catch (const std::exception& e) {
+                std::cerr << "Error parsing arguments: " << e.what() << std::endl;
+                return 1;
+            }
+            return run_client_expr(host, port, expr, args, std::max(repeat, 1));
+        }
+        std::string subscribe_topic = result["subscribe"].as<std::string>();
+        if (!subscribe_topic.empty()) {
+            return run_client_subscribe(host, port, subscribe_topic, result["policy"].as<std::string>(), std::max(repeat, 1));
+        }
+        std::string publish_topic = result["publish"].as<std::string>();
+        if (!publish_topic.empty()) {
+            std::vector<double> data;
+            try {
+                data = parse_args(result["args"].as<std::string>());
+            } catch (const std::exception& e) {
+                std::cerr << "Error parsing arguments: " << e.what() << std::endl;
+                return 1;
+            }
+            return run_client_publish(host, port, publish_topic, data, std::max(repeat, 1));
+        }
+        if (!result.count("func") || (!result.count("args") && bulk_size <= 0)) {
             std::cerr << "Error: Client mode requires --func and --args." << std::endl;
             std::cout << options.help({"Client"}) << std::endl;
             return 1;
@@ -333,13 +1028,55 @@ int main(int argc, char* argv[]) {
             std::cerr << "Error parsing arguments: " << e.what() << std::endl;
             return 1;
         }
+        if (repeat < 1 || concurrency < 1) {
+            std::cerr << "Error: --repeat and --concurrency must be at least 1." << std::endl;
+            return 1;
+        }
+        if (result.count("typed")) {
+            return run_client_typed(host, port, func, args, repeat);
+        }
+        if (bulk_size > 0) {
+            return run_client_bulk(host, port, func, static_cast<size_t>(bulk_size), args.empty() ? 1.0 : args[0], repeat);
+        }
+        if (load_run || !key.empty() || compress_threshold > 0) { // run_client below speaks plain frames only
+            return run_client_load(host, port, func, args, repeat, std::min(concurrency, repeat)) == 0 ? 0 : 1;
+        }
         std::cout << "Calling remote function '" << func << ", args {"<< args_str <<"}"<<std::endl;
         spdlog::info("Running RPC Client...");
-        run_client(host, port, func, args);
+        try {
+            run_client(host, port, func, args);
+        } catch (const std::exception& e) {
+            std::cerr << "RPC call failed: " << e.what() << std::endl;
+            return 1;
+        }
+    } else if (mode == "trace2chrome") {
+        std::string input = result["input"].as<std::string>();
+        std::string output = result["output"].as<std::string>();
+        if (!trace_dump_to_chrome(input, output)) {
+            return 1;
+        }
+        std::cout << "Open " << output << " in chrome://tracing or https://ui.perfetto.dev" << std::endl;
     }
 
     return 0;
 }
 
 // run: .\build\at_rpc_demo server --host 127.0.0.1 --port 9999
-// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --func add --args 10,20
\ No newline at end of file
+// run: .\build\at_rpc_demo server --host 127.0.0.1 --port 9999 --capture at_rpc_capture.bin
+// run: .\build\at_rpc_demo server --host 127.0.0.1 --port 9999 --cpus auto
+// run: .\build\at_rpc_demo server --host 127.0.0.1 --port 9999 --key-file at_rpc.key
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --func add --args 10,20
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --func add --args 10,20 --repeat 100000 --concurrency 8
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --func add --args 10,20 --repeat 100000 --concurrency 8 --key-file at_rpc.key
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --func dot --bulk 1000000 --repeat 100
+// run: .\build\at_rpc_demo server --host 127.0.0.1 --port 9999 --compress-threshold 4096
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --func add --bulk 1000000 --repeat 100 --compress-threshold 4096
+// run: .\build\at_rpc_demo server --host 127.0.0.1 --port 9999 --hugepages
+// run: .\build\at_rpc_demo server --host 127.0.0.1 --port 9999 --profile-output at_rpc_profile.folded
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --func __profile_start --args 99
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --func __profile_stop --args 0
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --func scale --args 1,2,3,10 --typed
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --expr "(a+b)*c/d" --args 1,2,3,4
+// run: .\build\at_rpc_demo trace2chrome --input at_rpc_trace.bin --output at_rpc_trace.json
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --subscribe prices --repeat 10
+// run: .\build\at_rpc_demo client --host 127.0.0.1 --port 9999 --publish prices --args 101.5,99.8
@@ -0,0 +1,356 @@
+// at_rpc_netem.cpp
+// TCP proxy that makes the path between a client and an AT server look like a
+// WAN: one-way latency with jitter, a bandwidth cap and random connection
+// resets, all in user space (no root, no tc/netem). Point clients at
+// --listen-port; every connection is forwarded to --host:--port.
+#include "network_utils.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cxxopts.hpp>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#ifndef _WIN32
+#include <netinet/tcp.h> // TCP_NODELAY
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct ImpairmentOptions {
+    Clock::duration delay{0};     // one way, added in each direction
+    Clock::duration jitter{0};    // the delay varies uniformly within +-jitter
+    double bytes_per_second = 0;  // per direction, shared by all connections; 0 = unlimited
+    double reset_probability = 0; // per forwarded chunk, either direction
+    size_t max_buffered = 4 * 1024 * 1024; // in flight per direction of a connection; reading pauses beyond it
+    uint64_t seed = 1;
+};
+
+static constexpr size_t CHUNK_SIZE = 16 * 1024; // largest piece forwarded as one unit
+
+// One direction of the emulated path. A chunk occupies the link for
+// size / bandwidth, so proxied connections compete for it like on a real link.
+class Link {
+public:
+    explicit Link(double bytes_per_second) : bytes_per_second_(bytes_per_second) {}
+
+    // When a chunk that arrived at `arrival` has been fully put on the wire
+    Clock::time_point transmit(Clock::time_point arrival, size_t bytes) {
+        if (bytes_per_second_ <= 0) {
+            return arrival;
+        }
+        auto serialization = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(bytes) / bytes_per_second_));
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_at_ = std::max(arrival, free_at_) + serialization;
+        return free_at_;
+    }
+
+private:
+    const double bytes_per_second_;
+    std::mutex mutex_;
+    Clock::time_point free_at_{};
+};
+
+// Received bytes waiting for their delivery time; empty data marks the sender's EOF
+struct Chunk {
+    Clock::time_point deliver_at;
+    std::vector<uint8_t> data;
+};
+
+class ProxiedConnection;
+
+// One direction of one connection: a reader stamps chunks with their delivery
+// time, a writer forwards them when it comes. Delivery times never decrease, as
+// TCP hands bytes over in order however much individual segments are delayed.
+struct Pipe {
+    Pipe(ProxiedConnection& owner, socket_t source, socket_t sink, Link& link, uint64_t seed)
+        : conn(owner), from(source), to(sink), path(link), rng(seed) {}
+
+    void read_loop();
+    void write_loop();
+
+    ProxiedConnection& conn;
+    socket_t from;
+    socket_t to;
+    Link& path;
+    std::mt19937_64 rng; // reader thread only
+
+    std::mutex mutex;
+    std::condition_variable ready; // a chunk was queued, or the connection is being reset
+    std::condition_variable space; // buffered went down
+    std::deque<Chunk> queue;
+    size_t buffered = 0;
+    Clock::time_point last_delivery{};
+    uint64_t bytes = 0;
+};
+
+class ProxiedConnection {
+public:
+    ProxiedConnection(uint32_t id, socket_t client, socket_t server, Link& upstream, Link& downstream,
+                      const ImpairmentOptions& options)
+        : id_(id), client_(client), server_(server), options_(options),
+          up_(*this, client, server, upstream, options.seed + 2 * id),
+          down_(*this, server, client, downstream, options.seed + 2 * id + 1) {}
+
+    // Forward until both directions have ended, or the connection is reset
+    void run() {
+        std::thread threads[] = {
+            std::thread(&Pipe::read_loop, &up_), std::thread(&Pipe::write_loop, &up_),
+            std::thread(&Pipe::read_loop, &down_), std::thread(&Pipe::write_loop, &down_),
+        };
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (aborted_.load()) {
+            // Zero linger turns the close into a RST, as a middlebox dropping state would
+            set_abortive_close(client_);
+            set_abortive_close(server_);
+        }
+        close_socket(client_);
+        close_socket(server_);
+        spdlog::info("Connection {} closed: {} bytes up, {} bytes down{}", id_, up_.bytes, down_.bytes,
+                     injected_.load() ? " (reset injected)" : aborted_.load() ? " (aborted)" : "");
+    }
+
+    // Tear both sides down with a RST. injected: decided by --reset-prob,
+    // rather than caused by a peer failing.
+    void abort(bool injected) {
+        if (aborted_.exchange(true)) {
+            return;
+        }
+        injected_ = injected;
+        // Readers wake from recv; writers from their condition variables
+        shutdown_read(client_);
+        shutdown_read(server_);
+        for (Pipe* pipe : {&up_, &down_}) {
+            std::lock_guard<std::mutex> lock(pipe->mutex);
+            pipe->ready.notify_all();
+            pipe->space.notify_all();
+        }
+    }
+
+    bool aborted() const { return aborted_.load(std::memory_order_acquire); }
+    const ImpairmentOptions& options() const { return options_; }
+
+private:
+    static void shutdown_read(socket_t sock) {
+#ifdef _WIN32
+        ::shutdown(sock, SD_RECEIVE);
+#else
+        ::shutdown(sock, SHUT_RD);
+#endif
+    }
+
+    static void set_abortive_close(socket_t sock) {
+        linger lin{};
+        lin.l_onoff = 1;
+        lin.l_linger = 0;
+        setsockopt(sock, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&lin), sizeof(lin));
+    }
+
+    const uint32_t id_;
+    const socket_t client_;
+    const socket_t server_;
+    const ImpairmentOptions& options_;
+    Pipe up_;   // client -> server
+    Pipe down_; // server -> client
+    std::atomic<bool> aborted_{false};
+    std::atomic<bool> injected_{false};
+};
+
+void Pipe::read_loop() {
+    const ImpairmentOptions& options = conn.options();
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<uint8_t> buffer(CHUNK_SIZE);
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            space.wait(lock, [this, &options]() { return buffered < options.max_buffered || conn.aborted(); });
+        }
+        int received = recv_some(from, buffer.data(), buffer.size());
+        if (conn.aborted()) {
+            return;
+        }
+        if (received < 0) {
+            conn.abort(false); // the peer reset: pass it on
+            return;
+        }
+        if (received > 0 && options.reset_probability > 0 && unit(rng) < options.reset_probability) {
+            conn.abort(true);
+            return;
+        }
+
+        Clock::time_point deliver_at = Clock::now();
+        if (received > 0) {
+            deliver_at = path.transmit(deliver_at, static_cast<size_t>(received)) + options.delay;
+            if (options.jitter.count() > 0) {
+                double offset = (2.0 * unit(rng) - 1.0) * static_cast<double>(options.jitter.count());
+                deliver_at += Clock::duration(static_cast<Clock::duration::rep>(offset));
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        // The EOF goes out right after the last data
+        last_delivery = std::max(last_delivery, deliver_at);
+        queue.push_back({last_delivery, std::vector<uint8_t>(buffer.begin(), buffer.begin() + std::max(received, 0))});
+        buffered += static_cast<size_t>(received);
+        ready.notify_one();
+        if (received == 0) {
+            return;
+        }
+    }
+}
+
+void Pipe::write_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        ready.wait(lock, [this]() { return !queue.empty() || conn.aborted(); });
+        if (conn.aborted()) {
+            return;
+        }
+        Clock::time_point due = queue.front().deliver_at;
+        if (ready.wait_until(lock, due, [this]() { return conn.aborted(); })) {
+            return;
+        }
+        Chunk chunk = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        if (chunk.data.empty()) {
+            // Half-close: the other direction may still be talking
+#ifdef _WIN32
+            ::shutdown(to, SD_SEND);
+#else
+            ::shutdown(to, SHUT_WR);
+#endif
+            return;
+        }
+        bool ok = send_all(to, chunk.data) == chunk.data.size();
+        lock.lock();
+        buffered -= chunk.data.size();
+        bytes += chunk.data.size();
+        space.notify_one();
+        if (!ok) {
+            lock.unlock();
+            conn.abort(false);
+            return;
+        }
+    }
+}
+
+static void set_no_delay(socket_t sock) {
+    // The proxy forwards what it received right away; Nagle would add its own delay
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+}
+
+static Clock::duration from_ms(double ms) {
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+}
+
+int main(int argc, char* argv[]) {
+    spdlog::set_level(spdlog::level::info);
+    spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] %v");
+
+    cxxopts::Options options("at_rpc_netem", "TCP proxy adding latency, jitter, a bandwidth cap and resets.");
+    options.add_options()
+            ("listen-host", "Address to accept clients on", cxxopts::value<std::string>()->default_value("127.0.0.1"))
+            ("listen-port,l", "Port to accept clients on", cxxopts::value<int>()->default_value("9998"))
+            ("host,H", "Server host", cxxopts::value<std::string>()->default_value("127.0.0.1"))
+            ("port,p", "Server port", cxxopts::value<int>()->default_value("9999"))
+            ("delay,d", "One-way delay in ms, added in each direction (RTT = 2 x delay)",
+             cxxopts::value<double>()->default_value("0"))
+            ("jitter,j", "The delay varies uniformly within +- this many ms", cxxopts::value<double>()->default_value("0"))
+            ("bandwidth,b", "Link rate in Mbit/s per direction, shared by all connections; 0 = unlimited",
+             cxxopts::value<double>()->default_value("0"))
+            ("reset-prob", "Probability that a forwarded chunk resets its connection instead",
+             cxxopts::value<double>()->default_value("0"))
+            ("buffer", "Bytes in flight per direction of a connection before reading pauses",
+             cxxopts::value<size_t>()->default_value("4194304"))
+            ("seed", "Random seed for jitter and resets", cxxopts::value<uint64_t>()->default_value("1"))
+            ("log-level", "trace, debug, info, warn, error", cxxopts::value<std::string>()->default_value("info"))
+            ("help", "Print usage")
+        ;
+    auto result = options.parse(argc, argv);
+    if (result.count("help")) {
+        std::cout << options.help() << std::endl;
+        return 0;
+    }
+    spdlog::set_level(spdlog::level::from_str(result["log-level"].as<std::string>()));
+
+    std::string listen_host = result["listen-host"].as<std::string>();
+    int listen_port = result["listen-port"].as<int>();
+    std::string host = result["host"].as<std::string>();
+    int port = result["port"].as<int>();
+    double delay_ms = result["delay"].as<double>();
+    double jitter_ms = result["jitter"].as<double>();
+    double mbit = result["bandwidth"].as<double>();
+
+    static ImpairmentOptions impairment; // outlives the detached connection threads
+    impairment.delay = from_ms(delay_ms);
+    impairment.jitter = from_ms(std::min(jitter_ms, delay_ms)); // delays never go negative
+    impairment.bytes_per_second = mbit * 1e6 / 8;
+    impairment.reset_probability = result["reset-prob"].as<double>();
+    impairment.max_buffered = std::max<size_t>(result["buffer"].as<size_t>(), CHUNK_SIZE);
+    impairment.seed = result["seed"].as<uint64_t>();
+    if (delay_ms < 0 || jitter_ms < 0 || mbit < 0 || impairment.reset_probability < 0 ||
+        impairment.reset_probability > 1) {
+        std::cerr << "Error: --delay, --jitter and --bandwidth must be >= 0, --reset-prob within [0, 1]" << std::endl;
+        return 1;
+    }
+    if (jitter_ms > delay_ms) {
+        spdlog::warn("Jitter capped at the delay ({} ms)", delay_ms);
+    }
+
+    initialize_sockets();
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN); // a peer vanishing mid-forward must not kill the proxy
+#endif
+    socket_t listen_sock = create_socket();
+    if (listen_sock == INVALID_SOCKET || !bind_socket(listen_sock, listen_host, listen_port) ||
+        ::listen(listen_sock, SOMAXCONN) == SOCKET_ERROR) {
+        spdlog::critical("Cannot listen on {}:{}: {}", listen_host, listen_port, get_error_message(get_last_error()));
+        cleanup_sockets();
+        return 1;
+    }
+    spdlog::info("Forwarding {}:{} -> {}:{} with delay {} ms +- {} ms, bandwidth {}, reset probability {}",
+                 listen_host, listen_port, host, port, delay_ms, std::min(jitter_ms, delay_ms),
+                 mbit > 0 ? std::to_string(mbit) + " Mbit/s" : std::string("unlimited"), impairment.reset_probability);
+
+    static Link upstream(impairment.bytes_per_second);
+    static Link downstream(impairment.bytes_per_second);
+    uint32_t next_conn_id = 1;
+    while (true) {
+        socket_t client = ::accept(listen_sock, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            spdlog::error("Accept failed: {}", get_error_message(get_last_error()));
+            continue;
+        }
+        socket_t server = create_socket();
+        if (server == INVALID_SOCKET || !connect_socket(server, host, port)) {
+            spdlog::error("Cannot connect to {}:{}; dropping the client", host, port);
+            if (server != INVALID_SOCKET) close_socket(server);
+            close_socket(client);
+            continue;
+        }
+        set_no_delay(client);
+        set_no_delay(server);
+        uint32_t conn_id = next_conn_id++;
+        spdlog::info("Connection {} accepted", conn_id);
+        std::thread([conn_id, client, server]() {
+            ProxiedConnection conn(conn_id, client, server, upstream, downstream, impairment);
+            conn.run();
+        }).detach();
+    }
+    close_socket(listen_sock);
+    cleanup_sockets();
+    return 0;
+}
+
+// run: ./build/at_rpc_netem --listen-port 9998 --port 9999 --delay 25 --jitter 5
+// run: ./build/at_rpc_netem --listen-port 9998 --port 9999 --delay 40 --bandwidth 10 --reset-prob 0.001
@@ -0,0 +1,230 @@
+// at_rpc_replay.cpp
+// Re-drive a traffic capture (RPCServer::enable_capture, at_rpc_demo server --capture)
+// against an AT server and report response latency.
+#include "at_protocol.h"
+#include "network_utils.h"
+#include "rpc_capture.h"
+#include "rpc_metrics.h"
+#include <algorithm>
+#include <cxxopts.hpp>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// One replayed client connection: frames of one captured conn_id go out on it
+// in capture order, a reader thread matches responses by sequence number.
+struct ReplayConnection {
+    socket_t socket = INVALID_SOCKET;
+    std::thread reader;
+
+    std::mutex mutex;
+    std::unordered_map<uint32_t, std::deque<uint64_t>> sent_at; // sequence -> send times (sequences may repeat)
+    size_t outstanding = 0;
+
+    std::vector<uint64_t> latencies_ns; // reader thread only
+    uint64_t responses = 0;
+    uint64_t errors = 0;
+    uint64_t unmatched = 0;
+};
+
+static void read_responses(ReplayConnection& conn) {
+    std::vector<uint8_t> header_buffer(ATProtocol::HEADER_SIZE);
+    std::vector<uint8_t> body_buffer;
+    while (recv_all(conn.socket, header_buffer, ATProtocol::HEADER_SIZE) == ATProtocol::HEADER_SIZE) {
+        ATHeader header;
+        header.unpack(header_buffer.data(), header_buffer.size());
+        if (header.protocol_id != ATProtocol::PROTOCOL_ID || header.body_length > 10 * 1024 * 1024) {
+            spdlog::error("Invalid response header (id 0x{:04X}, len {})", header.protocol_id, header.body_length);
+            break;
+        }
+        body_buffer.resize(header.body_length);
+        if (recv_all(conn.socket, body_buffer, header.body_length) != header.body_length) {
+            break;
+        }
+        uint64_t now = metrics_now_ns();
+
+        std::lock_guard<std::mutex> lock(conn.mutex);
+        auto it = conn.sent_at.find(header.sequence);
+        if (it == conn.sent_at.end() || it->second.empty()) {
+            conn.unmatched++;
+            continue;
+        }
+        conn.latencies_ns.push_back(now - it->second.front());
+        it->second.pop_front();
+        conn.outstanding--;
+        conn.responses++;
+        if (header.flags & ATProtocol::FLAG_ERROR) {
+            conn.errors++;
+        }
+    }
+}
+
+static double to_us(uint64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+    spdlog::set_level(spdlog::level::info);
+    spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] %v");
+
+    cxxopts::Options options("at_rpc_replay", "Replay a captured AT traffic file against a server.");
+    options.add_options()
+            ("input,i", "Capture file written by the server", cxxopts::value<std::string>()->default_value("at_rpc_capture.bin"))
+            ("host,H", "Server host", cxxopts::value<std::string>()->default_value("127.0.0.1"))
+            ("port,p", "Server port", cxxopts::value<int>()->default_value("9999"))
+            ("speed,s", "Pacing: 1 = original timing, N = N times faster, 0 = as fast as possible",
+             cxxopts::value<double>()->default_value("1"))
+            ("timeout,t", "Milliseconds to wait for outstanding responses after the last send",
+             cxxopts::value<int>()->default_value("5000"))
+            ("help", "Print usage")
+        ;
+    auto result = options.parse(argc, argv);
+    if (result.count("help")) {
+        std::cout << options.help() << std::endl;
+        return 0;
+    }
+    std::string input = result["input"].as<std::string>();
+    std::string host = result["host"].as<std::string>();
+    int port = result["port"].as<int>();
+    double speed = result["speed"].as<double>();
+    int timeout_ms = result["timeout"].as<int>();
+    if (speed < 0) {
+        std::cerr << "Error: --speed must be >= 0" << std::endl;
+        return 1;
+    }
+
+    std::vector<CapturedFrame> frames;
+    if (!read_capture(input, frames)) {
+        return 1;
+    }
+    if (frames.empty()) {
+        std::cerr << "Capture " << input << " holds no frames" << std::endl;
+        return 1;
+    }
+
+    initialize_sockets();
+    // Connections open when their first captured frame is due, as they did originally
+    std::map<uint32_t, std::unique_ptr<ReplayConnection>> connections;
+    uint64_t sent = 0;
+    uint64_t send_failures = 0;
+    uint64_t max_lag_ns = 0;
+
+    uint64_t t0 = metrics_now_ns();
+    for (const CapturedFrame& frame : frames) {
+        if (speed > 0) {
+            uint64_t due = t0 + static_cast<uint64_t>(static_cast<double>(frame.ts_ns) / speed);
+            uint64_t now = metrics_now_ns();
+            if (now < due) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+            } else {
+                max_lag_ns = std::max(max_lag_ns, now - due);
+            }
+        }
+
+        auto& slot = connections[frame.conn_id];
+        if (!slot) {
+            slot = std::make_unique<ReplayConnection>();
+            slot->socket = create_socket();
+            if (slot->socket == INVALID_SOCKET || !connect_socket(slot->socket, host, port)) {
+                spdlog::error("Cannot connect to {}:{} for captured connection {}", host, port, frame.conn_id);
+                if (slot->socket != INVALID_SOCKET) close_socket(slot->socket);
+                slot->socket = INVALID_SOCKET;
+            } else {
+                slot->reader = std::thread(read_responses, std::ref(*slot));
+            }
+        }
+        ReplayConnection& conn = *slot;
+        if (conn.socket == INVALID_SOCKET || frame.bytes.size() < ATProtocol::HEADER_SIZE) {
+            send_failures++;
+            continue;
+        }
+
+        ATHeader header;
+        header.unpack(frame.bytes.data(), ATProtocol::HEADER_SIZE);
+        bool expects_response = (header.flags & ATProtocol::FLAG_REQUEST) != 0;
+        if (expects_response) {
+            // Registered before the send, the response may beat us back
+            std::lock_guard<std::mutex> lock(conn.mutex);
+            conn.sent_at[header.sequence].push_back(metrics_now_ns());
+            conn.outstanding++;
+        }
+        if (send_all(conn.socket, frame.bytes) != frame.bytes.size()) {
+            send_failures++;
+            if (expects_response) {
+                std::lock_guard<std::mutex> lock(conn.mutex);
+                conn.sent_at[header.sequence].pop_back();
+                conn.outstanding--;
+            }
+            continue;
+        }
+        sent++;
+    }
+    uint64_t t_sent = metrics_now_ns();
+
+    // Drain: wait for the answers still in flight
+    uint64_t deadline = t_sent + static_cast<uint64_t>(timeout_ms) * 1000000;
+    while (metrics_now_ns() < deadline) {
+        size_t outstanding = 0;
+        for (auto& entry : connections) {
+            std::lock_guard<std::mutex> lock(entry.second->mutex);
+            outstanding += entry.second->outstanding;
+        }
+        if (outstanding == 0) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    uint64_t t_done = metrics_now_ns();
+
+    for (auto& entry : connections) {
+        ReplayConnection& conn = *entry.second;
+        if (conn.socket == INVALID_SOCKET) continue;
+#ifdef _WIN32
+        ::shutdown(conn.socket, SD_BOTH);
+#else
+        ::shutdown(conn.socket, SHUT_RDWR);
+#endif
+        if (conn.reader.joinable()) conn.reader.join();
+        close_socket(conn.socket);
+    }
+    cleanup_sockets();
+
+    std::vector<uint64_t> latencies;
+    uint64_t responses = 0, errors = 0, unmatched = 0, missing = 0;
+    for (auto& entry : connections) {
+        ReplayConnection& conn = *entry.second;
+        latencies.insert(latencies.end(), conn.latencies_ns.begin(), conn.latencies_ns.end());
+        responses += conn.responses;
+        errors += conn.errors;
+        unmatched += conn.unmatched;
+        missing += conn.outstanding;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double q) -> uint64_t {
+        if (latencies.empty()) return 0;
+        size_t idx = static_cast<size_t>(q * static_cast<double>(latencies.size() - 1));
+        return latencies[idx];
+    };
+
+    double elapsed_s = static_cast<double>(t_done - t0) / 1e9;
+    double capture_s = static_cast<double>(frames.back().ts_ns) / 1e9;
+    std::cout << "Replayed " << sent << "/" << frames.size() << " frames over " << connections.size()
+              << " connections in " << elapsed_s << " s (captured span " << capture_s << " s, speed "
+              << (speed > 0 ? std::to_string(speed) + "x" : std::string("max")) << ")\n"
+              << "  responses " << responses << ", errors " << errors << ", missing " << missing
+              << ", unmatched " << unmatched << ", send failures " << send_failures << "\n"
+              << "  throughput " << (elapsed_s > 0 ? static_cast<double>(responses) / elapsed_s : 0.0) << " resp/s\n"
+              << "  latency us: p50 " << to_us(percentile(0.50)) << ", p90 " << to_us(percentile(0.90))
+              << ", p99 " << to_us(percentile(0.99)) << ", p99.9 " << to_us(percentile(0.999))
+              << ", max " << to_us(latencies.empty() ? 0 : latencies.back()) << "\n";
+    if (speed > 0) {
+        // Large lag means the replayer could not keep the requested pace
+        std::cout << "  max schedule lag " << to_us(max_lag_ns) << " us" << std::endl;
+    }
+    return missing == 0 && send_failures == 0 ? 0 : 2;
+}
+
+// run: ./build/at_rpc_replay --input at_rpc_capture.bin --port 9999 --speed 1
+// run: ./build/at_rpc_replay --input at_rpc_capture.bin --port 9999 --speed 0
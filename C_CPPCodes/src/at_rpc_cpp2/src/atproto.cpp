@@ -0,0 +1,299 @@
+// atproto.cpp
+// libatproto: the C ABI of atproto.h over the same CRC and header layout as
+// ATProtocol. Self-contained (header-only dependencies), so the shared library
+// does not pull in the server's logging or sockets. No exception crosses the ABI.
+#include "atproto.h"
+#include "crc32.hpp"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+
+void put16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
+}
+
+void put32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+uint16_t get16(const uint8_t* in) {
+    return static_cast<uint16_t>((in[0] << 8) | in[1]);
+}
+
+uint32_t get32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+// Big-endian header, as ATHeader::pack_into writes it
+void write_header(uint8_t* out, uint16_t flags, uint32_t sequence, uint32_t body_length, uint32_t hash) {
+    put16(out, ATPROTO_ID);
+    put16(out + 2, flags);
+    put32(out + 4, sequence);
+    put32(out + 8, body_length);
+    put32(out + 12, hash);
+}
+
+// Copy `bytes` to the caller's buffer, or report the size it would need
+template <typename Out, typename Bytes>
+int copy_out(const Bytes& bytes, Out* out, size_t out_size, size_t* written) {
+    *written = bytes.size();
+    if (out == nullptr || out_size < bytes.size()) {
+        return ATPROTO_ERR_BUFFER;
+    }
+    std::memcpy(out, bytes.data(), bytes.size());
+    return ATPROTO_OK;
+}
+
+// MessagePack writer for the fixed request shape of atproto_pack_call_msgpack
+struct MsgpackWriter {
+    uint8_t* out;
+    size_t pos = 0;
+
+    void byte(uint8_t value) { out[pos++] = value; }
+
+    void str(const char* text, size_t size) {
+        if (size < 32) {
+            byte(static_cast<uint8_t>(0xa0 | size));
+        } else if (size <= 0xff) {
+            byte(0xd9);
+            byte(static_cast<uint8_t>(size));
+        } else if (size <= 0xffff) {
+            byte(0xda);
+            put16(out + pos, static_cast<uint16_t>(size));
+            pos += 2;
+        } else {
+            byte(0xdb);
+            put32(out + pos, static_cast<uint32_t>(size));
+            pos += 4;
+        }
+        std::memcpy(out + pos, text, size);
+        pos += size;
+    }
+
+    void array_header(size_t count) {
+        if (count < 16) {
+            byte(static_cast<uint8_t>(0x90 | count));
+        } else if (count <= 0xffff) {
+            byte(0xdc);
+            put16(out + pos, static_cast<uint16_t>(count));
+            pos += 2;
+        } else {
+            byte(0xdd);
+            put32(out + pos, static_cast<uint32_t>(count));
+            pos += 4;
+        }
+    }
+
+    void float64(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        byte(0xcb);
+        put32(out + pos, static_cast<uint32_t>(bits >> 32));
+        put32(out + pos + 4, static_cast<uint32_t>(bits));
+        pos += 8;
+    }
+
+    static size_t str_size(size_t size) { return size + (size < 32 ? 1 : size <= 0xff ? 2 : size <= 0xffff ? 3 : 5); }
+    static size_t array_header_size(size_t count) { return count < 16 ? 1 : count <= 0xffff ? 3 : 5; }
+};
+
+} // namespace
+
+extern "C" {
+
+uint32_t atproto_abi_version(void) {
+    return ATPROTO_ABI_VERSION;
+}
+
+uint32_t atproto_crc32(const uint8_t* data, size_t size) {
+    return crc32::calculate(data, size);
+}
+
+int atproto_pack_header(uint8_t* out, size_t out_size, uint16_t flags, uint32_t sequence, const uint8_t* body,
+                        size_t body_size) {
+    if (out == nullptr || (body == nullptr && body_size > 0) || body_size > UINT32_MAX) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+    if (out_size < ATPROTO_HEADER_SIZE) {
+        return ATPROTO_ERR_BUFFER;
+    }
+    write_header(out, flags, sequence, static_cast<uint32_t>(body_size), atproto_crc32(body, body_size));
+    return ATPROTO_OK;
+}
+
+int atproto_pack_frame(uint8_t* out, size_t out_size, uint16_t flags, uint32_t sequence, const uint8_t* body,
+                       size_t body_size, size_t* written) {
+    if (written == nullptr || (body == nullptr && body_size > 0) || body_size > UINT32_MAX) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+    *written = ATPROTO_HEADER_SIZE + body_size;
+    if (out == nullptr || out_size < *written) {
+        return ATPROTO_ERR_BUFFER;
+    }
+    uint32_t hash = atproto_crc32(body, body_size);
+    if (body_size > 0) {
+        std::memmove(out + ATPROTO_HEADER_SIZE, body, body_size); // the body may already sit in `out`
+    }
+    write_header(out, flags, sequence, static_cast<uint32_t>(body_size), hash);
+    return ATPROTO_OK;
+}
+
+int atproto_parse_header(const uint8_t* data, size_t size, atproto_header* header) {
+    if (data == nullptr || header == nullptr) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+    if (size < ATPROTO_HEADER_SIZE) {
+        return ATPROTO_ERR_BUFFER;
+    }
+    header->protocol_id = get16(data);
+    header->flags = get16(data + 2);
+    header->sequence = get32(data + 4);
+    header->body_length = get32(data + 8);
+    header->hash_value = get32(data + 12);
+    return header->protocol_id == ATPROTO_ID ? ATPROTO_OK : ATPROTO_ERR_PROTOCOL;
+}
+
+int atproto_scan_frames(const uint8_t* data, size_t size, uint32_t max_body, int verify_crc, atproto_frame* frames,
+                        size_t max_frames, size_t* count, size_t* consumed, size_t* needed) {
+    if ((data == nullptr && size > 0) || (frames == nullptr && max_frames > 0) || count == nullptr ||
+        consumed == nullptr || needed == nullptr) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+    size_t found = 0;
+    size_t offset = 0;
+    int status = ATPROTO_OK;
+    *needed = 0;
+    while (found < max_frames) {
+        size_t left = size - offset;
+        if (left < ATPROTO_HEADER_SIZE) {
+            *needed = ATPROTO_HEADER_SIZE;
+            break;
+        }
+        atproto_header header;
+        status = atproto_parse_header(data + offset, left, &header);
+        if (status != ATPROTO_OK) {
+            break;
+        }
+        if (max_body > 0 && header.body_length > max_body) {
+            status = ATPROTO_ERR_TOO_LARGE;
+            break;
+        }
+        size_t frame_size = ATPROTO_HEADER_SIZE + static_cast<size_t>(header.body_length);
+        if (left < frame_size) {
+            *needed = frame_size;
+            break;
+        }
+        const uint8_t* body = data + offset + ATPROTO_HEADER_SIZE;
+        if (verify_crc && !(header.flags & ATPROTO_FLAG_SEALED) &&
+            atproto_crc32(body, header.body_length) != header.hash_value) {
+            status = ATPROTO_ERR_CHECKSUM;
+            break;
+        }
+        atproto_frame& frame = frames[found++];
+        frame.flags = header.flags;
+        frame.reserved = 0;
+        frame.sequence = header.sequence;
+        frame.body_offset = offset + ATPROTO_HEADER_SIZE;
+        frame.body_length = header.body_length;
+        offset += frame_size;
+    }
+    *count = found;
+    *consumed = offset;
+    return status;
+}
+
+int atproto_json_to_msgpack(const char* json_text, size_t json_size, uint8_t* out, size_t out_size, size_t* written) {
+    if ((json_text == nullptr && json_size > 0) || written == nullptr) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+    try {
+        std::vector<uint8_t> packed = json::to_msgpack(json::parse(json_text, json_text + json_size));
+        return copy_out(packed, out, out_size, written);
+    } catch (const json::exception&) {
+        return ATPROTO_ERR_ENCODING;
+    } catch (...) {
+        return ATPROTO_ERR_ARGUMENT; // out of memory
+    }
+}
+
+int atproto_msgpack_to_json(const uint8_t* data, size_t size, char* out, size_t out_size, size_t* written) {
+    if ((data == nullptr && size > 0) || written == nullptr) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+    try {
+        std::string text = json::from_msgpack(data, data + size).dump();
+        return copy_out(text, out, out_size, written);
+    } catch (const json::exception&) {
+        return ATPROTO_ERR_ENCODING;
+    } catch (...) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+}
+
+int atproto_pack_call_msgpack(uint8_t* out, size_t out_size, uint32_t sequence, const char* func, size_t func_size,
+                              const double* args, size_t arg_count, size_t* written) {
+    if (func == nullptr || (args == nullptr && arg_count > 0) || written == nullptr || func_size > UINT32_MAX ||
+        arg_count > UINT32_MAX) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+    size_t body_size = 1 + MsgpackWriter::str_size(4) + MsgpackWriter::str_size(func_size) +
+                       MsgpackWriter::str_size(4) + MsgpackWriter::array_header_size(arg_count) + 9 * arg_count;
+    *written = ATPROTO_HEADER_SIZE + body_size;
+    if (body_size > UINT32_MAX) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+    if (out == nullptr || out_size < *written) {
+        return ATPROTO_ERR_BUFFER;
+    }
+    MsgpackWriter body{out + ATPROTO_HEADER_SIZE};
+    body.byte(0x82); // fixmap of 2
+    body.str("func", 4);
+    body.str(func, func_size);
+    body.str("args", 4);
+    body.array_header(arg_count);
+    for (size_t i = 0; i < arg_count; ++i) {
+        body.float64(args[i]);
+    }
+    write_header(out, ATPROTO_FLAG_REQUEST | ATPROTO_FLAG_MSGPACK, sequence, static_cast<uint32_t>(body_size),
+                 atproto_crc32(out + ATPROTO_HEADER_SIZE, body_size));
+    return ATPROTO_OK;
+}
+
+int atproto_msgpack_result(const uint8_t* data, size_t size, double* result, char* error, size_t error_size) {
+    if ((data == nullptr && size > 0) || result == nullptr) {
+        return ATPROTO_ERR_ARGUMENT;
+    }
+    try {
+        json response = json::from_msgpack(data, data + size);
+        if (response.is_object() && response.value("status", "") == "error") {
+            if (error != nullptr && error_size > 0) {
+                std::string message = response.value("message", "Unknown remote error");
+                size_t n = std::min(message.size(), error_size - 1);
+                std::memcpy(error, message.data(), n);
+                error[n] = '\0';
+            }
+            return ATPROTO_ERR_ENCODING;
+        }
+        auto it = response.is_object() ? response.find("result") : response.end();
+        if (it == response.end() || !it->is_number()) {
+            return ATPROTO_ERR_ENCODING;
+        }
+        *result = it->get<double>();
+        return ATPROTO_OK;
+    } catch (...) {
+        return ATPROTO_ERR_ENCODING;
+    }
+}
+
+} // extern "C"
@@ -0,0 +1,206 @@
+// buffer_pool.cpp
+#include "buffer_pool.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+// Smallest class holding `size` bytes
+unsigned class_shift_for(size_t size) {
+    unsigned shift = BufferPool::MIN_CLASS_SHIFT;
+    while ((size_t(1) << shift) < size) {
+        ++shift;
+    }
+    return shift;
+}
+
+// Largest class a capacity covers; 0 when below the smallest
+unsigned class_shift_of(size_t capacity) {
+    if (capacity < (size_t(1) << BufferPool::MIN_CLASS_SHIFT)) {
+        return 0;
+    }
+    unsigned shift = BufferPool::MIN_CLASS_SHIFT;
+    while (shift < BufferPool::MAX_CLASS_SHIFT && (size_t(1) << (shift + 1)) <= capacity) {
+        ++shift;
+    }
+    return shift;
+}
+
+} // namespace
+
+// This thread's share of the small classes; flushed to the depot at thread exit
+struct BufferCache {
+    std::vector<std::vector<uint8_t>> lists[BufferPool::THREAD_CACHE_MAX_SHIFT - BufferPool::MIN_CLASS_SHIFT + 1];
+
+    ~BufferCache() {
+        BufferPool& pool = BufferPool::instance();
+        for (size_t cls = 0; cls < sizeof(lists) / sizeof(lists[0]); ++cls) {
+            for (auto& buffer : lists[cls]) {
+                pool.give_to_depot(cls, std::move(buffer));
+            }
+        }
+    }
+};
+
+static BufferCache& local_cache() {
+    thread_local BufferCache cache;
+    return cache;
+}
+
+BufferPool& BufferPool::instance() {
+    static BufferPool pool;
+    return pool;
+}
+
+std::vector<uint8_t> BufferPool::acquire(size_t size) {
+    unsigned shift = class_shift_for(size);
+    if (shift > MAX_CLASS_SHIFT) {
+        oversize_.fetch_add(1, std::memory_order_relaxed);
+        std::vector<uint8_t> buffer;
+        buffer.reserve(size);
+        return buffer;
+    }
+    size_t cls = shift - MIN_CLASS_SHIFT;
+    if (shift <= THREAD_CACHE_MAX_SHIFT) {
+        auto& list = local_cache().lists[cls];
+        if (list.empty()) {
+            // Refill half the cache in one visit to the depot
+            take_from_depot(cls, list, THREAD_CACHE_BUFFERS / 2);
+        }
+        if (!list.empty()) {
+            std::vector<uint8_t> buffer = std::move(list.back());
+            list.pop_back();
+            return buffer;
+        }
+        return allocate(shift);
+    }
+    std::vector<uint8_t> buffer;
+    if (take_from_depot(cls, buffer)) {
+        return buffer;
+    }
+    return allocate(shift);
+}
+
+void BufferPool::release(std::vector<uint8_t>&& buffer) {
+    if (buffer.capacity() == 0) {
+        return; // moved-from or never used
+    }
+    unsigned shift = class_shift_of(buffer.capacity());
+    if (shift == 0 || buffer.capacity() >= (size_t(2) << MAX_CLASS_SHIFT)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        std::vector<uint8_t>().swap(buffer);
+        return;
+    }
+    buffer.clear();
+    size_t cls = shift - MIN_CLASS_SHIFT;
+    if (shift <= THREAD_CACHE_MAX_SHIFT) {
+        auto& list = local_cache().lists[cls];
+        if (list.size() >= THREAD_CACHE_BUFFERS) {
+            // Full: pass the older half on, so a thread that only frees (a
+            // reader releasing what writers acquired) does not hoard
+            for (size_t i = 0; i < THREAD_CACHE_BUFFERS / 2; ++i) {
+                give_to_depot(cls, std::move(list[i]));
+            }
+            list.erase(list.begin(), list.begin() + THREAD_CACHE_BUFFERS / 2);
+        }
+        list.push_back(std::move(buffer));
+        return;
+    }
+    give_to_depot(cls, std::move(buffer));
+}
+
+void BufferPool::set_depot_limit(size_t bytes) {
+    std::vector<std::vector<uint8_t>> freed;
+    std::lock_guard<std::mutex> lock(depot_mutex_);
+    depot_limit_ = bytes;
+    // Largest classes first: they free the most for the fewest reallocations later
+    for (size_t cls = CLASSES; cls-- > 0 && depot_bytes_ > depot_limit_;) {
+        auto& list = depot_[cls];
+        while (!list.empty() && depot_bytes_ > depot_limit_) {
+            depot_bytes_ -= list.back().capacity();
+            freed.push_back(std::move(list.back()));
+            list.pop_back();
+        }
+    }
+}
+
+void BufferPool::set_hugepages(bool enabled) {
+    hugepages_.store(enabled, std::memory_order_relaxed);
+}
+
+json BufferPool::stats() const {
+    size_t depot_bytes;
+    {
+        std::lock_guard<std::mutex> lock(depot_mutex_);
+        depot_bytes = depot_bytes_;
+    }
+    return {{"allocated", allocated_.load(std::memory_order_relaxed)},
+            {"reused", reused_.load(std::memory_order_relaxed)},
+            {"dropped", dropped_.load(std::memory_order_relaxed)},
+            {"oversize", oversize_.load(std::memory_order_relaxed)},
+            {"depot_bytes", depot_bytes}};
+}
+
+std::vector<uint8_t> BufferPool::allocate(unsigned shift) {
+    allocated_.fetch_add(1, std::memory_order_relaxed);
+    size_t capacity = size_t(1) << shift;
+    std::vector<uint8_t> buffer;
+    buffer.reserve(capacity);
+#ifdef __linux__
+    // Untouched yet, so the pages fault in huge where the kernel has them. The
+    // allocator's block header sits in front, so advise the aligned interior.
+    if (capacity >= 2 * HUGE_PAGE_SIZE && hugepages_.load(std::memory_order_relaxed)) {
+        uintptr_t begin = reinterpret_cast<uintptr_t>(buffer.data());
+        uintptr_t aligned = (begin + HUGE_PAGE_SIZE - 1) & ~(uintptr_t(HUGE_PAGE_SIZE) - 1);
+        uintptr_t end = (begin + capacity) & ~(uintptr_t(HUGE_PAGE_SIZE) - 1);
+        if (end > aligned) {
+            madvise(reinterpret_cast<void*>(aligned), end - aligned, MADV_HUGEPAGE);
+        }
+    }
+#endif
+    return buffer;
+}
+
+size_t BufferPool::take_from_depot(size_t cls, std::vector<std::vector<uint8_t>>& out, size_t count) {
+    std::lock_guard<std::mutex> lock(depot_mutex_);
+    auto& list = depot_[cls];
+    size_t taken = 0;
+    while (taken < count && !list.empty()) {
+        depot_bytes_ -= list.back().capacity();
+        out.push_back(std::move(list.back()));
+        list.pop_back();
+        ++taken;
+    }
+    if (taken) {
+        reused_.fetch_add(taken, std::memory_order_relaxed);
+    }
+    return taken;
+}
+
+bool BufferPool::take_from_depot(size_t cls, std::vector<uint8_t>& out) {
+    std::lock_guard<std::mutex> lock(depot_mutex_);
+    auto& list = depot_[cls];
+    if (list.empty()) {
+        return false;
+    }
+    depot_bytes_ -= list.back().capacity();
+    out = std::move(list.back());
+    list.pop_back();
+    reused_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void BufferPool::give_to_depot(size_t cls, std::vector<uint8_t>&& buffer) {
+    {
+        std::lock_guard<std::mutex> lock(depot_mutex_);
+        if (depot_bytes_ + buffer.capacity() <= depot_limit_) {
+            depot_bytes_ += buffer.capacity();
+            depot_[cls].push_back(std::move(buffer));
+            return;
+        }
+    }
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    std::vector<uint8_t>().swap(buffer); // freed outside the lock
+}
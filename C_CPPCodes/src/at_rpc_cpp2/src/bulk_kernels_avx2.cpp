@@ -0,0 +1,223 @@
+// bulk_kernels_avx2.cpp
+// Compiled with AVX2 + FMA code generation (see CMakeLists.txt); nothing here
+// may run before bulk_ops.cpp has checked the CPU. For the same reason this file
+// instantiates no shared inline code (std::min, load_unaligned, ...): the linker
+// could pick the AVX2 copy for callers elsewhere.
+#include "bulk_kernels.h"
+
+#ifdef AT_BULK_AVX2
+#include <immintrin.h>
+
+namespace {
+
+template <typename T>
+T ld(const T* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void st(T* p, T value) {
+    std::memcpy(p, &value, sizeof(T));
+}
+
+template <typename T>
+T min_of(T x, T y) { return y < x ? y : x; }
+
+template <typename T>
+T max_of(T x, T y) { return x < y ? y : x; }
+
+// Two 4-lane vectors per iteration keep both load ports and the FMA units busy
+template <typename VecOp, typename ScalarOp>
+void avx2_map_f64(const double* a, const double* b, double* out, size_t n, VecOp vop, ScalarOp sop) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d x0 = _mm256_loadu_pd(a + i), x1 = _mm256_loadu_pd(a + i + 4);
+        __m256d y0 = _mm256_loadu_pd(b + i), y1 = _mm256_loadu_pd(b + i + 4);
+        _mm256_storeu_pd(out + i, vop(x0, y0));
+        _mm256_storeu_pd(out + i + 4, vop(x1, y1));
+    }
+    for (; i < n; ++i) {
+        st(out + i, sop(ld(a + i), ld(b + i)));
+    }
+}
+
+template <typename VecOp, typename ScalarOp>
+void avx2_map_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n, VecOp vop, ScalarOp sop) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), vop(x, y));
+    }
+    for (; i < n; ++i) {
+        uint32_t x = static_cast<uint32_t>(ld(a + i));
+        uint32_t y = static_cast<uint32_t>(ld(b + i));
+        st(out + i, static_cast<int32_t>(sop(x, y)));
+    }
+}
+
+double hsum(__m256d v) {
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+int64_t hsum_epi64(__m256i v) {
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+    return static_cast<int64_t>(static_cast<uint64_t>(lanes[0]) + static_cast<uint64_t>(lanes[1]) +
+                                static_cast<uint64_t>(lanes[2]) + static_cast<uint64_t>(lanes[3]));
+}
+
+void add_f64(const double* a, const double* b, double* out, size_t n) {
+    avx2_map_f64(a, b, out, n, [](__m256d x, __m256d y) { return _mm256_add_pd(x, y); }, [](double x, double y) { return x + y; });
+}
+void sub_f64(const double* a, const double* b, double* out, size_t n) {
+    avx2_map_f64(a, b, out, n, [](__m256d x, __m256d y) { return _mm256_sub_pd(x, y); }, [](double x, double y) { return x - y; });
+}
+void mul_f64(const double* a, const double* b, double* out, size_t n) {
+    avx2_map_f64(a, b, out, n, [](__m256d x, __m256d y) { return _mm256_mul_pd(x, y); }, [](double x, double y) { return x * y; });
+}
+void div_f64(const double* a, const double* b, double* out, size_t n) {
+    avx2_map_f64(a, b, out, n, [](__m256d x, __m256d y) { return _mm256_div_pd(x, y); }, [](double x, double y) { return x / y; });
+}
+void axpy_f64(double alpha, const double* x, const double* y, double* out, size_t n) {
+    __m256d va = _mm256_set1_pd(alpha);
+    avx2_map_f64(x, y, out, n, [va](__m256d xv, __m256d yv) { return _mm256_fmadd_pd(va, xv, yv); },
+                 [alpha](double xi, double yi) { return alpha * xi + yi; });
+}
+
+double dot_f64(const double* a, const double* b, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc0);
+        acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), acc1);
+    }
+    double acc = hsum(_mm256_add_pd(acc0, acc1));
+    for (; i < n; ++i) acc += ld(a + i) * ld(b + i);
+    return acc;
+}
+double sum_f64(const double* a, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(a + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(a + i + 4));
+    }
+    double acc = hsum(_mm256_add_pd(acc0, acc1));
+    for (; i < n; ++i) acc += ld(a + i);
+    return acc;
+}
+double min_f64(const double* a, size_t n) {
+    double r = ld(a);
+    size_t i = 0;
+    if (n >= 4) {
+        __m256d m = _mm256_loadu_pd(a);
+        for (i = 4; i + 4 <= n; i += 4) m = _mm256_min_pd(m, _mm256_loadu_pd(a + i));
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, m);
+        r = min_of(min_of(lanes[0], lanes[1]), min_of(lanes[2], lanes[3]));
+    }
+    for (; i < n; ++i) r = min_of(r, ld(a + i));
+    return r;
+}
+double max_f64(const double* a, size_t n) {
+    double r = ld(a);
+    size_t i = 0;
+    if (n >= 4) {
+        __m256d m = _mm256_loadu_pd(a);
+        for (i = 4; i + 4 <= n; i += 4) m = _mm256_max_pd(m, _mm256_loadu_pd(a + i));
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, m);
+        r = max_of(max_of(lanes[0], lanes[1]), max_of(lanes[2], lanes[3]));
+    }
+    for (; i < n; ++i) r = max_of(r, ld(a + i));
+    return r;
+}
+
+void add_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    avx2_map_i32(a, b, out, n, [](__m256i x, __m256i y) { return _mm256_add_epi32(x, y); },
+                 [](uint32_t x, uint32_t y) { return x + y; });
+}
+void sub_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    avx2_map_i32(a, b, out, n, [](__m256i x, __m256i y) { return _mm256_sub_epi32(x, y); },
+                 [](uint32_t x, uint32_t y) { return x - y; });
+}
+void mul_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    avx2_map_i32(a, b, out, n, [](__m256i x, __m256i y) { return _mm256_mullo_epi32(x, y); },
+                 [](uint32_t x, uint32_t y) { return x * y; });
+}
+
+// Widen 4 int32 at a time to int64 lanes; _mm256_mul_epi32 multiplies the
+// (sign-extended) low halves, giving exact 64-bit products
+int64_t dot_i32(const int32_t* a, const int32_t* b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m256i y = _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(x, y));
+    }
+    uint64_t r = static_cast<uint64_t>(hsum_epi64(acc));
+    for (; i < n; ++i) {
+        r += static_cast<uint64_t>(static_cast<int64_t>(ld(a + i)) * ld(b + i));
+    }
+    return static_cast<int64_t>(r);
+}
+int64_t sum_i32(const int32_t* a, size_t n) {
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_epi64(acc0, _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i))));
+        acc1 = _mm256_add_epi64(acc1, _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 4))));
+    }
+    int64_t r = hsum_epi64(_mm256_add_epi64(acc0, acc1));
+    for (; i < n; ++i) r += ld(a + i);
+    return r;
+}
+int32_t min_i32(const int32_t* a, size_t n) {
+    int32_t r = ld(a);
+    size_t i = 0;
+    if (n >= 8) {
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+        for (i = 8; i + 8 <= n; i += 8) m = _mm256_min_epi32(m, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+        alignas(32) int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), m);
+        r = lanes[0];
+        for (int lane = 1; lane < 8; ++lane) r = min_of(r, lanes[lane]);
+    }
+    for (; i < n; ++i) r = min_of(r, ld(a + i));
+    return r;
+}
+int32_t max_i32(const int32_t* a, size_t n) {
+    int32_t r = ld(a);
+    size_t i = 0;
+    if (n >= 8) {
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+        for (i = 8; i + 8 <= n; i += 8) m = _mm256_max_epi32(m, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+        alignas(32) int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), m);
+        r = lanes[0];
+        for (int lane = 1; lane < 8; ++lane) r = max_of(r, lanes[lane]);
+    }
+    for (; i < n; ++i) r = max_of(r, ld(a + i));
+    return r;
+}
+
+} // namespace
+
+const BulkKernels& bulk_kernels_avx2() {
+    static const BulkKernels kernels = {
+        "avx2",
+        add_f64, sub_f64, mul_f64, div_f64, axpy_f64,
+        dot_f64, sum_f64, min_f64, max_f64,
+        add_i32, sub_i32, mul_i32,
+        dot_i32, sum_i32, min_i32, max_i32,
+    };
+    return kernels;
+}
+#endif // AT_BULK_AVX2
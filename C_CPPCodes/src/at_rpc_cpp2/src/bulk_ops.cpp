@@ -0,0 +1,493 @@
+// bulk_ops.cpp
+#include "bulk_ops.h"
+#include "bulk_kernels.h"
+#include "response_writer.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(AT_BULK_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// --- Portable kernels ---
+
+namespace {
+
+template <typename Op>
+void map_f64(const double* a, const double* b, double* out, size_t n, Op op) {
+    for (size_t i = 0; i < n; ++i) {
+        store_unaligned(out + i, op(load_unaligned(a + i), load_unaligned(b + i)));
+    }
+}
+
+// int32 arithmetic wraps around: done in uint32, where overflow is defined
+template <typename Op>
+void map_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n, Op op) {
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t x = static_cast<uint32_t>(load_unaligned(a + i));
+        uint32_t y = static_cast<uint32_t>(load_unaligned(b + i));
+        store_unaligned(out + i, static_cast<int32_t>(op(x, y)));
+    }
+}
+
+void scalar_add_f64(const double* a, const double* b, double* out, size_t n) {
+    map_f64(a, b, out, n, [](double x, double y) { return x + y; });
+}
+void scalar_sub_f64(const double* a, const double* b, double* out, size_t n) {
+    map_f64(a, b, out, n, [](double x, double y) { return x - y; });
+}
+void scalar_mul_f64(const double* a, const double* b, double* out, size_t n) {
+    map_f64(a, b, out, n, [](double x, double y) { return x * y; });
+}
+void scalar_div_f64(const double* a, const double* b, double* out, size_t n) {
+    map_f64(a, b, out, n, [](double x, double y) { return x / y; });
+}
+void scalar_axpy_f64(double alpha, const double* x, const double* y, double* out, size_t n) {
+    map_f64(x, y, out, n, [alpha](double xi, double yi) { return alpha * xi + yi; });
+}
+double scalar_dot_f64(const double* a, const double* b, size_t n) {
+    double acc = 0.0;
+    for (size_t i = 0; i < n; ++i) acc += load_unaligned(a + i) * load_unaligned(b + i);
+    return acc;
+}
+double scalar_sum_f64(const double* a, size_t n) {
+    double acc = 0.0;
+    for (size_t i = 0; i < n; ++i) acc += load_unaligned(a + i);
+    return acc;
+}
+double scalar_min_f64(const double* a, size_t n) {
+    double m = load_unaligned(a);
+    for (size_t i = 1; i < n; ++i) m = std::min(m, load_unaligned(a + i));
+    return m;
+}
+double scalar_max_f64(const double* a, size_t n) {
+    double m = load_unaligned(a);
+    for (size_t i = 1; i < n; ++i) m = std::max(m, load_unaligned(a + i));
+    return m;
+}
+
+void scalar_add_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    map_i32(a, b, out, n, [](uint32_t x, uint32_t y) { return x + y; });
+}
+void scalar_sub_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    map_i32(a, b, out, n, [](uint32_t x, uint32_t y) { return x - y; });
+}
+void scalar_mul_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    map_i32(a, b, out, n, [](uint32_t x, uint32_t y) { return x * y; });
+}
+int64_t scalar_dot_i32(const int32_t* a, const int32_t* b, size_t n) {
+    uint64_t acc = 0; // wraps like the SIMD lanes do, instead of overflowing
+    for (size_t i = 0; i < n; ++i) {
+        acc += static_cast<uint64_t>(static_cast<int64_t>(load_unaligned(a + i)) * load_unaligned(b + i));
+    }
+    return static_cast<int64_t>(acc);
+}
+int64_t scalar_sum_i32(const int32_t* a, size_t n) {
+    int64_t acc = 0;
+    for (size_t i = 0; i < n; ++i) acc += load_unaligned(a + i);
+    return acc;
+}
+int32_t scalar_min_i32(const int32_t* a, size_t n) {
+    int32_t m = load_unaligned(a);
+    for (size_t i = 1; i < n; ++i) m = std::min(m, load_unaligned(a + i));
+    return m;
+}
+int32_t scalar_max_i32(const int32_t* a, size_t n) {
+    int32_t m = load_unaligned(a);
+    for (size_t i = 1; i < n; ++i) m = std::max(m, load_unaligned(a + i));
+    return m;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+// --- SSE2 (baseline on x86-64): float64 ops and int32 add/sub ---
+
+template <typename VecOp, typename ScalarOp>
+void sse2_map_f64(const double* a, const double* b, double* out, size_t n, VecOp vop, ScalarOp sop) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128d x0 = _mm_loadu_pd(a + i), x1 = _mm_loadu_pd(a + i + 2);
+        __m128d y0 = _mm_loadu_pd(b + i), y1 = _mm_loadu_pd(b + i + 2);
+        _mm_storeu_pd(out + i, vop(x0, y0));
+        _mm_storeu_pd(out + i + 2, vop(x1, y1));
+    }
+    for (; i < n; ++i) {
+        store_unaligned(out + i, sop(load_unaligned(a + i), load_unaligned(b + i)));
+    }
+}
+
+void sse2_add_f64(const double* a, const double* b, double* out, size_t n) {
+    sse2_map_f64(a, b, out, n, [](__m128d x, __m128d y) { return _mm_add_pd(x, y); }, [](double x, double y) { return x + y; });
+}
+void sse2_sub_f64(const double* a, const double* b, double* out, size_t n) {
+    sse2_map_f64(a, b, out, n, [](__m128d x, __m128d y) { return _mm_sub_pd(x, y); }, [](double x, double y) { return x - y; });
+}
+void sse2_mul_f64(const double* a, const double* b, double* out, size_t n) {
+    sse2_map_f64(a, b, out, n, [](__m128d x, __m128d y) { return _mm_mul_pd(x, y); }, [](double x, double y) { return x * y; });
+}
+void sse2_div_f64(const double* a, const double* b, double* out, size_t n) {
+    sse2_map_f64(a, b, out, n, [](__m128d x, __m128d y) { return _mm_div_pd(x, y); }, [](double x, double y) { return x / y; });
+}
+void sse2_axpy_f64(double alpha, const double* x, const double* y, double* out, size_t n) {
+    __m128d va = _mm_set1_pd(alpha);
+    sse2_map_f64(x, y, out, n, [va](__m128d xv, __m128d yv) { return _mm_add_pd(_mm_mul_pd(va, xv), yv); },
+                 [alpha](double xi, double yi) { return alpha * xi + yi; });
+}
+
+double sse2_hsum(__m128d v) {
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+double sse2_dot_f64(const double* a, const double* b, size_t n) {
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double acc = sse2_hsum(_mm_add_pd(acc0, acc1));
+    for (; i < n; ++i) acc += load_unaligned(a + i) * load_unaligned(b + i);
+    return acc;
+}
+double sse2_sum_f64(const double* a, size_t n) {
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(a + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(a + i + 2));
+    }
+    double acc = sse2_hsum(_mm_add_pd(acc0, acc1));
+    for (; i < n; ++i) acc += load_unaligned(a + i);
+    return acc;
+}
+double sse2_min_f64(const double* a, size_t n) {
+    if (n < 2) return load_unaligned(a);
+    __m128d m = _mm_loadu_pd(a);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) m = _mm_min_pd(m, _mm_loadu_pd(a + i));
+    double r = _mm_cvtsd_f64(_mm_min_sd(m, _mm_unpackhi_pd(m, m)));
+    for (; i < n; ++i) r = std::min(r, load_unaligned(a + i));
+    return r;
+}
+double sse2_max_f64(const double* a, size_t n) {
+    if (n < 2) return load_unaligned(a);
+    __m128d m = _mm_loadu_pd(a);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) m = _mm_max_pd(m, _mm_loadu_pd(a + i));
+    double r = _mm_cvtsd_f64(_mm_max_sd(m, _mm_unpackhi_pd(m, m)));
+    for (; i < n; ++i) r = std::max(r, load_unaligned(a + i));
+    return r;
+}
+
+void sse2_add_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(x, y));
+    }
+    scalar_add_i32(a + i, b + i, out + i, n - i);
+}
+void sse2_sub_i32(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi32(x, y));
+    }
+    scalar_sub_i32(a + i, b + i, out + i, n - i);
+}
+#endif
+
+} // namespace
+
+const BulkKernels& bulk_kernels_scalar() {
+    static const BulkKernels kernels = {
+        "scalar",
+        scalar_add_f64, scalar_sub_f64, scalar_mul_f64, scalar_div_f64, scalar_axpy_f64,
+        scalar_dot_f64, scalar_sum_f64, scalar_min_f64, scalar_max_f64,
+        scalar_add_i32, scalar_sub_i32, scalar_mul_i32,
+        scalar_dot_i32, scalar_sum_i32, scalar_min_i32, scalar_max_i32,
+    };
+    return kernels;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+const BulkKernels& bulk_kernels_sse2() {
+    // int32 mul / min / max need SSE4.1, the scalar loops stand in
+    static const BulkKernels kernels = {
+        "sse2",
+        sse2_add_f64, sse2_sub_f64, sse2_mul_f64, sse2_div_f64, sse2_axpy_f64,
+        sse2_dot_f64, sse2_sum_f64, sse2_min_f64, sse2_max_f64,
+        sse2_add_i32, sse2_sub_i32, scalar_mul_i32,
+        scalar_dot_i32, scalar_sum_i32, scalar_min_i32, scalar_max_i32,
+    };
+    return kernels;
+}
+#endif
+
+// --- Runtime dispatch ---
+
+#ifdef AT_BULK_AVX2
+static bool cpu_has_avx2_fma() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!fma || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false; // OS saves YMM state
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#endif
+
+static const BulkKernels& select_kernels() {
+    const char* cap = std::getenv("AT_BULK_ISA");
+    std::string limit = cap ? cap : "";
+#ifdef AT_BULK_AVX2
+    if ((limit.empty() || limit == "avx2") && cpu_has_avx2_fma()) {
+        return bulk_kernels_avx2();
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (limit != "scalar") {
+        return bulk_kernels_sse2();
+    }
+#endif
+    return bulk_kernels_scalar();
+}
+
+static const BulkKernels& kernels() {
+    static const BulkKernels& selected = [] () -> const BulkKernels& {
+        const BulkKernels& k = select_kernels();
+        spdlog::info("Bulk kernels: {}", k.isa);
+        return k;
+    }();
+    return selected;
+}
+
+const char* bulk_kernel_isa() {
+    return kernels().isa;
+}
+
+// --- Wire format ---
+
+static const char* const OP_NAMES[] = {"invalid", "add", "sub", "mul", "div", "dot", "sum", "min", "max", "axpy"};
+
+const char* bulk_op_name(BulkOp op) {
+    uint8_t index = static_cast<uint8_t>(op);
+    return index < sizeof(OP_NAMES) / sizeof(OP_NAMES[0]) ? OP_NAMES[index] : OP_NAMES[0];
+}
+
+bool parse_bulk_op(const std::string& name, BulkOp& op) {
+    for (uint8_t i = 1; i < sizeof(OP_NAMES) / sizeof(OP_NAMES[0]); ++i) {
+        if (name == OP_NAMES[i]) {
+            op = static_cast<BulkOp>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool bulk_op_takes_two(BulkOp op) {
+    return op != BulkOp::Sum && op != BulkOp::Min && op != BulkOp::Max;
+}
+
+static std::vector<uint8_t> encode_request(BulkOp op, BulkDType dtype, size_t count, const void* a,
+                                           const void* b, size_t element_size, double alpha) {
+    BulkRequestHeader header{};
+    header.op = static_cast<uint8_t>(op);
+    header.dtype = static_cast<uint8_t>(dtype);
+    header.count = static_cast<uint32_t>(count);
+    header.alpha = alpha;
+
+    size_t array_bytes = count * element_size;
+    bool two = bulk_op_takes_two(op);
+    std::vector<uint8_t> body(sizeof(header) + array_bytes * (two ? 2 : 1));
+    std::memcpy(body.data(), &header, sizeof(header));
+    if (array_bytes > 0) {
+        std::memcpy(body.data() + sizeof(header), a, array_bytes);
+        if (two) std::memcpy(body.data() + sizeof(header) + array_bytes, b, array_bytes);
+    }
+    return body;
+}
+
+std::vector<uint8_t> encode_bulk_request(BulkOp op, const std::vector<double>& a, const std::vector<double>& b,
+                                         double alpha) {
+    if (bulk_op_takes_two(op) && b.size() != a.size()) {
+        throw std::invalid_argument(std::string("bulk ") + bulk_op_name(op) + " needs two arrays of equal length");
+    }
+    return encode_request(op, BulkDType::Float64, a.size(), a.data(), b.data(), sizeof(double), alpha);
+}
+
+std::vector<uint8_t> encode_bulk_request(BulkOp op, const std::vector<int32_t>& a, const std::vector<int32_t>& b) {
+    if (bulk_op_takes_two(op) && b.size() != a.size()) {
+        throw std::invalid_argument(std::string("bulk ") + bulk_op_name(op) + " needs two arrays of equal length");
+    }
+    return encode_request(op, BulkDType::Int32, a.size(), a.data(), b.data(), sizeof(int32_t), 0.0);
+}
+
+static size_t dtype_size(BulkDType dtype) {
+    switch (dtype) {
+        case BulkDType::Float64: return 8;
+        case BulkDType::Int32: return 4;
+        case BulkDType::Int64: return 8;
+    }
+    return 0;
+}
+
+bool decode_bulk_response(const uint8_t* body, size_t size, BulkResult& result) {
+    BulkResponseHeader header;
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, body, sizeof(header));
+    BulkDType dtype = static_cast<BulkDType>(header.dtype);
+    size_t element_size = dtype_size(dtype);
+    if (element_size == 0 || size != sizeof(header) + static_cast<uint64_t>(header.count) * element_size) {
+        return false;
+    }
+    const uint8_t* values = body + sizeof(header);
+    result.dtype = dtype;
+    result.f64.clear();
+    result.ints.clear();
+    if (dtype == BulkDType::Float64) {
+        result.f64.resize(header.count);
+        if (header.count > 0) std::memcpy(result.f64.data(), values, header.count * element_size);
+    } else if (dtype == BulkDType::Int32) {
+        result.ints.reserve(header.count);
+        for (uint32_t i = 0; i < header.count; ++i) {
+            result.ints.push_back(load_unaligned(reinterpret_cast<const int32_t*>(values) + i));
+        }
+    } else {
+        result.ints.resize(header.count);
+        if (header.count > 0) std::memcpy(result.ints.data(), values, header.count * element_size);
+    }
+    return true;
+}
+
+// --- Execution ---
+
+std::string bulk_method_name(const uint8_t* body, size_t size) {
+    BulkOp op = static_cast<BulkOp>(0);
+    if (size >= sizeof(BulkRequestHeader)) {
+        op = static_cast<BulkOp>(body[0]);
+    }
+    return std::string("bulk.") + bulk_op_name(op);
+}
+
+// Append the response header and room for `count` values
+static uint8_t* begin_result(ResponseWriter& response, BulkDType dtype, size_t count) {
+    BulkResponseHeader header{};
+    header.dtype = static_cast<uint8_t>(dtype);
+    header.count = static_cast<uint32_t>(count);
+    uint8_t* out = response.binary(sizeof(header) + count * dtype_size(dtype));
+    std::memcpy(out, &header, sizeof(header));
+    return out + sizeof(header);
+}
+
+template <typename T>
+static void write_scalar(ResponseWriter& response, BulkDType dtype, T value) {
+    store_unaligned(reinterpret_cast<T*>(begin_result(response, dtype, 1)), value);
+}
+
+bool execute_bulk(const uint8_t* body, size_t size, ResponseWriter& response, std::string& error) {
+    BulkRequestHeader header;
+    if (size < sizeof(header)) {
+        error = "Bulk request too short";
+        return false;
+    }
+    std::memcpy(&header, body, sizeof(header));
+    BulkOp op = static_cast<BulkOp>(header.op);
+    BulkDType dtype = static_cast<BulkDType>(header.dtype);
+    if (header.op < static_cast<uint8_t>(BulkOp::Add) || header.op > static_cast<uint8_t>(BulkOp::Axpy)) {
+        error = "Unknown bulk op " + std::to_string(header.op);
+        return false;
+    }
+    if (dtype != BulkDType::Float64 && dtype != BulkDType::Int32) {
+        error = "Unsupported bulk dtype " + std::to_string(header.dtype);
+        return false;
+    }
+    size_t n = header.count;
+    size_t element_size = dtype_size(dtype);
+    uint64_t expected = sizeof(header) + static_cast<uint64_t>(n) * element_size * (bulk_op_takes_two(op) ? 2 : 1);
+    if (size != expected) {
+        error = "Bulk body is " + std::to_string(size) + " bytes, count " + std::to_string(n) + " needs " +
+                std::to_string(expected);
+        return false;
+    }
+    if ((op == BulkOp::Min || op == BulkOp::Max) && n == 0) {
+        error = std::string(bulk_op_name(op)) + " of an empty array";
+        return false;
+    }
+    if (op == BulkOp::Axpy && dtype != BulkDType::Float64) {
+        error = "axpy requires float64 arrays";
+        return false;
+    }
+
+    const uint8_t* a_bytes = body + sizeof(header);
+    const uint8_t* b_bytes = a_bytes + n * element_size;
+    const BulkKernels& k = kernels();
+
+    if (dtype == BulkDType::Float64) {
+        const double* a = reinterpret_cast<const double*>(a_bytes);
+        const double* b = reinterpret_cast<const double*>(b_bytes);
+        switch (op) {
+            case BulkOp::Add: k.add_f64(a, b, reinterpret_cast<double*>(begin_result(response, dtype, n)), n); break;
+            case BulkOp::Sub: k.sub_f64(a, b, reinterpret_cast<double*>(begin_result(response, dtype, n)), n); break;
+            case BulkOp::Mul: k.mul_f64(a, b, reinterpret_cast<double*>(begin_result(response, dtype, n)), n); break;
+            case BulkOp::Div: k.div_f64(a, b, reinterpret_cast<double*>(begin_result(response, dtype, n)), n); break;
+            case BulkOp::Axpy:
+                k.axpy_f64(header.alpha, a, b, reinterpret_cast<double*>(begin_result(response, dtype, n)), n);
+                break;
+            case BulkOp::Dot: write_scalar(response, dtype, k.dot_f64(a, b, n)); break;
+            case BulkOp::Sum: write_scalar(response, dtype, k.sum_f64(a, n)); break;
+            case BulkOp::Min: write_scalar(response, dtype, k.min_f64(a, n)); break;
+            case BulkOp::Max: write_scalar(response, dtype, k.max_f64(a, n)); break;
+        }
+        return true;
+    }
+
+    const int32_t* a = reinterpret_cast<const int32_t*>(a_bytes);
+    const int32_t* b = reinterpret_cast<const int32_t*>(b_bytes);
+    if (op == BulkOp::Div) {
+        // Checked up front, so a bad divisor leaves no partial result behind
+        for (size_t i = 0; i < n; ++i) {
+            int32_t y = load_unaligned(b + i);
+            if (y == 0) {
+                error = "Division by zero at index " + std::to_string(i);
+                return false;
+            }
+            if (y == -1 && load_unaligned(a + i) == std::numeric_limits<int32_t>::min()) {
+                error = "Integer overflow in division at index " + std::to_string(i);
+                return false;
+            }
+        }
+        int32_t* out = reinterpret_cast<int32_t*>(begin_result(response, dtype, n));
+        for (size_t i = 0; i < n; ++i) {
+            store_unaligned(out + i, load_unaligned(a + i) / load_unaligned(b + i));
+        }
+        return true;
+    }
+    switch (op) {
+        case BulkOp::Add: k.add_i32(a, b, reinterpret_cast<int32_t*>(begin_result(response, dtype, n)), n); break;
+        case BulkOp::Sub: k.sub_i32(a, b, reinterpret_cast<int32_t*>(begin_result(response, dtype, n)), n); break;
+        case BulkOp::Mul: k.mul_i32(a, b, reinterpret_cast<int32_t*>(begin_result(response, dtype, n)), n); break;
+        case BulkOp::Dot: write_scalar(response, BulkDType::Int64, k.dot_i32(a, b, n)); break;
+        case BulkOp::Sum: write_scalar(response, BulkDType::Int64, k.sum_i32(a, n)); break;
+        case BulkOp::Min: write_scalar(response, dtype, k.min_i32(a, n)); break;
+        case BulkOp::Max: write_scalar(response, dtype, k.max_i32(a, n)); break;
+        default: break; // Div handled above, Axpy rejected
+    }
+    return true;
+}
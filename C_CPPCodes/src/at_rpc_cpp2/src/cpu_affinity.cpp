@@ -0,0 +1,185 @@
+// cpu_affinity.cpp
+#include "cpu_affinity.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+constexpr int MPOL_PREFERRED_MODE = 1; // MPOL_PREFERRED from <numaif.h>, without linking libnuma
+
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+bool read_line(const std::string& path, std::string& line) {
+    std::ifstream in(path);
+    return in && std::getline(in, line) && !line.empty();
+}
+#endif
+
+} // namespace
+
+std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t\n"));
+        item.erase(item.find_last_not_of(" \t\n") + 1);
+        if (item.empty()) continue;
+        size_t dash = item.find('-');
+        try {
+            size_t used = 0;
+            int first = std::stoi(item.substr(0, dash), &used);
+            if (used != (dash == std::string::npos ? item.size() : dash)) throw std::invalid_argument(item);
+            int last = first;
+            if (dash != std::string::npos) {
+                std::string tail = item.substr(dash + 1);
+                last = std::stoi(tail, &used);
+                if (used != tail.size()) throw std::invalid_argument(item);
+            }
+            if (first < 0 || last < first) throw std::invalid_argument(item);
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        } catch (const std::logic_error&) {
+            throw std::invalid_argument("Invalid CPU list entry '" + item + "'");
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+std::string format_cpu_list(const std::vector<int>& cpus) {
+    std::string out;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+        if (!out.empty()) out += ',';
+        out += std::to_string(cpus[i]);
+        if (j > i) out += '-' + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return out;
+}
+
+CpuTopology CpuTopology::detect() {
+    CpuTopology topology;
+#ifdef __linux__
+    std::vector<int> allowed = allowed_cpus();
+    std::string online;
+    if (read_line("/sys/devices/system/node/online", online)) {
+        try {
+            for (int node : parse_cpu_list(online)) {
+                std::string list;
+                if (!read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", list)) continue;
+                Node entry{node, {}};
+                for (int cpu : parse_cpu_list(list)) {
+                    if (std::binary_search(allowed.begin(), allowed.end(), cpu)) entry.cpus.push_back(cpu);
+                }
+                if (!entry.cpus.empty()) topology.nodes_.push_back(std::move(entry));
+            }
+        } catch (const std::invalid_argument& e) {
+            spdlog::warn("Unreadable NUMA topology in sysfs ({}); assuming one node", e.what());
+            topology.nodes_.clear();
+        }
+    }
+    if (topology.nodes_.empty() && !allowed.empty()) {
+        topology.nodes_.push_back({0, allowed});
+    }
+#endif
+    if (topology.nodes_.empty()) {
+        Node node{0, {}};
+        unsigned count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned cpu = 0; cpu < count; ++cpu) node.cpus.push_back(static_cast<int>(cpu));
+        topology.nodes_.push_back(std::move(node));
+    }
+    return topology;
+}
+
+std::vector<int> CpuTopology::cpus() const {
+    std::vector<int> all;
+    for (const auto& node : nodes_) all.insert(all.end(), node.cpus.begin(), node.cpus.end());
+    return all;
+}
+
+int CpuTopology::node_of(int cpu) const {
+    for (const auto& node : nodes_) {
+        if (std::find(node.cpus.begin(), node.cpus.end(), cpu) != node.cpus.end()) return node.id;
+    }
+    return -1;
+}
+
+std::string CpuTopology::describe() const {
+    std::string out = std::to_string(nodes_.size()) + (nodes_.size() == 1 ? " NUMA node: " : " NUMA nodes: ");
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (i) out += ", ";
+        out += "node" + std::to_string(nodes_[i].id) + " cpus " + format_cpu_list(nodes_[i].cpus);
+    }
+    return out;
+}
+
+std::vector<int> select_cpus(const CpuTopology& topology, const std::string& spec) {
+    if (spec == "auto") {
+        return topology.cpus();
+    }
+    std::vector<int> cpus = parse_cpu_list(spec);
+    if (cpus.empty()) {
+        throw std::invalid_argument("Empty CPU list");
+    }
+    for (int cpu : cpus) {
+        if (!topology.contains(cpu)) {
+            throw std::invalid_argument("CPU " + std::to_string(cpu) + " is not available (" + topology.describe() + ")");
+        }
+    }
+    return cpus;
+}
+
+bool pin_current_thread(int cpu, int numa_node) {
+#ifdef _WIN32
+    (void)numa_node; // first-touch placement follows the pinned thread
+    if (cpu < 0 || cpu >= 64) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        return false;
+    }
+    if (numa_node >= 0 && numa_node < 64) {
+        // Preferred rather than bound: a full node falls back to remote memory
+        unsigned long mask = 1UL << numa_node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, &mask, 64UL) != 0) {
+            spdlog::debug("set_mempolicy(node {}) failed; relying on first-touch placement", numa_node);
+        }
+    }
+    return true;
+#else
+    (void)cpu;
+    (void)numa_node;
+    return false;
+#endif
+}
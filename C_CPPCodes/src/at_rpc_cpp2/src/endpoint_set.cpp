@@ -0,0 +1,353 @@
+// endpoint_set.cpp
+#include "endpoint_set.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <sstream>
+#include <spdlog/spdlog.h>
+
+#include "rpc_metrics.h" // metrics_now_ns()
+
+std::vector<Endpoint> parse_endpoints(const std::string& spec) {
+    std::vector<Endpoint> endpoints;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(0, item.find_first_not_of(' '));
+        item.erase(item.find_last_not_of(' ') + 1);
+        if (item.empty()) continue;
+        size_t colon = item.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == item.size()) {
+            throw std::invalid_argument("Endpoint must be host:port: " + item);
+        }
+        int port = std::stoi(item.substr(colon + 1));
+        endpoints.push_back({item.substr(0, colon), port});
+    }
+    return endpoints;
+}
+
+EndpointSetClient::EndpointSetClient(std::vector<Endpoint> endpoints, EndpointSetOptions options)
+    : options_(options), rng_(std::random_device{}()) {
+    if (endpoints.empty()) {
+        throw std::invalid_argument("EndpointSetClient needs at least one endpoint");
+    }
+    for (auto& ep : endpoints) {
+        auto state = std::make_unique<EndpointState>();
+        state->endpoint = std::move(ep);
+        endpoints_.push_back(std::move(state));
+    }
+}
+
+EndpointSetClient::~EndpointSetClient() = default;
+
+size_t EndpointSetClient::outstanding(EndpointState& state) {
+    std::lock_guard<std::mutex> lock(state.conn_mutex);
+    return state.conn ? state.conn->outstanding() : 0;
+}
+
+EndpointSetClient::EndpointState* EndpointSetClient::pick(const EndpointState* exclude, bool& probe) {
+    int64_t now = static_cast<int64_t>(metrics_now_ns());
+    probe = false;
+
+    // Ejected endpoints whose time is up get exactly one probe call at a time
+    for (auto& st : endpoints_) {
+        int64_t until = st->ejected_until_ns.load(std::memory_order_acquire);
+        if (until != 0 && now >= until && st.get() != exclude) {
+            bool expected = false;
+            if (st->probing.compare_exchange_strong(expected, true)) {
+                probe = true;
+                return st.get();
+            }
+        }
+    }
+
+    std::vector<EndpointState*> healthy;
+    healthy.reserve(endpoints_.size());
+    for (auto& st : endpoints_) {
+        if (st->ejected_until_ns.load(std::memory_order_acquire) == 0 && st.get() != exclude) {
+            healthy.push_back(st.get());
+        }
+    }
+    if (healthy.empty()) {
+        // Everything ejected (or only the excluded one left): degrade to the
+        // endpoint closest to coming back rather than failing outright
+        EndpointState* best = nullptr;
+        for (auto& st : endpoints_) {
+            if (st.get() == exclude && endpoints_.size() > 1) continue;
+            if (!best || st->ejected_until_ns.load() < best->ejected_until_ns.load()) best = st.get();
+        }
+        return best;
+    }
+
+    if (options_.policy == LoadBalancePolicy::RoundRobin || healthy.size() == 1) {
+        uint64_t n = rr_counter_.fetch_add(1, std::memory_order_relaxed);
+        return healthy[n % healthy.size()];
+    }
+
+    size_t a, b;
+    {
+        std::lock_guard<std::mutex> lock(rng_mutex_);
+        std::uniform_int_distribution<size_t> dist(0, healthy.size() - 1);
+        a = dist(rng_);
+        b = dist(rng_);
+        while (b == a) b = dist(rng_);
+    }
+    return outstanding(*healthy[b]) < outstanding(*healthy[a]) ? healthy[b] : healthy[a];
+}
+
+std::shared_ptr<RPCConnection> EndpointSetClient::connection(EndpointState& state, bool secondary) {
+    std::lock_guard<std::mutex> lock(state.conn_mutex);
+    std::shared_ptr<RPCConnection>& slot = secondary ? state.hedge_conn : state.conn;
+    if (!slot || !slot->is_connected()) {
+        // Callers still holding the old connection keep it alive until they finish
+        auto conn = std::make_shared<RPCConnection>(state.endpoint.host, state.endpoint.port);
+        if (!conn->connect()) {
+            return nullptr;
+        }
+        slot = std::move(conn);
+    }
+    return slot;
+}
+
+void EndpointSetClient::on_success(EndpointState& state, bool probe) {
+    state.consecutive_failures.store(0, std::memory_order_relaxed);
+    if (state.ejected_until_ns.exchange(0) != 0) {
+        state.ejections.store(0);
+        spdlog::info("Endpoint {} is healthy again", state.endpoint.to_string());
+    }
+    if (probe) state.probing.store(false);
+}
+
+void EndpointSetClient::on_failure(EndpointState& state, bool probe) {
+    state.failures.fetch_add(1, std::memory_order_relaxed);
+    int failures = state.consecutive_failures.fetch_add(1) + 1;
+    bool already_ejected = state.ejected_until_ns.load() != 0;
+    if (probe || (!already_ejected && failures >= options_.failure_threshold)) {
+        int round = std::min(state.ejections.fetch_add(1), 16);
+        auto ejection = std::min(options_.base_ejection * (int64_t(1) << round), options_.max_ejection);
+        int64_t until = static_cast<int64_t>(metrics_now_ns()) +
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(ejection).count();
+        state.ejected_until_ns.store(until, std::memory_order_release);
+        spdlog::warn("Ejecting endpoint {} for {} ms after {} consecutive failures",
+                     state.endpoint.to_string(), ejection.count(), failures);
+    }
+    if (probe) state.probing.store(false);
+}
+
+json EndpointSetClient::call(const std::string& func, const std::vector<double>& args) {
+    calls_total_.fetch_add(1, std::memory_order_relaxed);
+    if (options_.max_hedge_ratio > 0) {
+        int64_t cap = 10 * 1000; // allow short bursts of up to 10 hedges
+        int64_t budget = hedge_budget_milli_.fetch_add(static_cast<int64_t>(options_.max_hedge_ratio * 1000));
+        if (budget > cap) hedge_budget_milli_.store(cap, std::memory_order_relaxed);
+    }
+    if (is_hedged(func)) {
+        return call_hedged(func, args);
+    }
+
+    bool probe = false;
+    EndpointState* state = pick(nullptr, probe);
+    state->calls.fetch_add(1, std::memory_order_relaxed);
+
+    std::shared_ptr<RPCConnection> conn = connection(*state);
+    if (!conn) {
+        on_failure(*state, probe);
+        throw RPCTransportError("Cannot connect to " + state->endpoint.to_string());
+    }
+    try {
+        uint64_t t_start = metrics_now_ns();
+        json response = conn->call(func, args, options_.call_timeout_ms);
+        record_latency(metrics_now_ns() - t_start);
+        on_success(*state, probe);
+        return response;
+    } catch (const RPCTransportError&) {
+        on_failure(*state, probe);
+        throw;
+    } catch (...) {
+        on_success(*state, probe); // the server answered, so the endpoint is alive
+        throw;
+    }
+}
+
+size_t EndpointSetClient::healthy_count() const {
+    size_t n = 0;
+    for (const auto& st : endpoints_) {
+        if (st->ejected_until_ns.load() == 0) ++n;
+    }
+    return n;
+}
+
+json EndpointSetClient::status() const {
+    json list = json::array();
+    for (const auto& st : endpoints_) {
+        list.push_back({
+            {"endpoint", st->endpoint.to_string()},
+            {"healthy", st->ejected_until_ns.load() == 0},
+            {"calls", st->calls.load()},
+            {"failures", st->failures.load()},
+            {"consecutive_failures", st->consecutive_failures.load()}
+        });
+    }
+    return {
+        {"endpoints", list},
+        {"calls", calls_total_.load()},
+        {"hedges_sent", hedges_sent_.load()},
+        {"hedge_wins", hedge_wins_.load()},
+        {"hedge_delay_us", hedge_delay_ns() / 1000}
+    };
+}
+
+// --- Hedged requests ---
+
+bool EndpointSetClient::is_hedged(const std::string& func) const {
+    return std::find(options_.hedged_methods.begin(), options_.hedged_methods.end(), func) !=
+           options_.hedged_methods.end();
+}
+
+void EndpointSetClient::record_latency(uint64_t ns) {
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    if (latency_window_.size() < LATENCY_WINDOW) {
+        latency_window_.push_back(ns);
+    } else {
+        latency_window_[latency_samples_ % LATENCY_WINDOW] = ns;
+    }
+    ++latency_samples_;
+    if (latency_samples_ % LATENCY_REFRESH != 0) return;
+
+    std::vector<uint64_t> sorted = latency_window_;
+    size_t k = std::min(sorted.size() - 1, static_cast<size_t>(options_.hedge_percentile * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    int64_t floor_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(options_.min_hedge_delay).count();
+    hedge_delay_ns_.store(std::max<int64_t>(static_cast<int64_t>(sorted[k]), floor_ns), std::memory_order_relaxed);
+}
+
+bool EndpointSetClient::take_hedge_token() {
+    int64_t budget = hedge_budget_milli_.load(std::memory_order_relaxed);
+    while (budget >= 1000) {
+        if (hedge_budget_milli_.compare_exchange_weak(budget, budget - 1000)) return true;
+    }
+    return false;
+}
+
+namespace {
+bool is_transport_error(const std::exception_ptr& error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const RPCTransportError&) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+} // namespace
+
+json EndpointSetClient::call_hedged(const std::string& func, const std::vector<double>& args) {
+    struct Leg {
+        EndpointState* state = nullptr;
+        bool probe = false;
+        std::shared_ptr<RPCConnection> conn;
+        uint32_t sequence = 0;
+    };
+    // Shared with the completion callbacks, which may outlive this frame
+    struct Race {
+        std::mutex mutex;
+        std::condition_variable cv;
+        int in_flight = 0;
+        int winner = -1;
+        json result;
+        std::exception_ptr error; // first error seen; reported when every leg failed
+    };
+    auto race = std::make_shared<Race>();
+    Leg legs[2];
+
+    auto launch = [&](int i) -> bool {
+        Leg& leg = legs[i];
+        leg.state->calls.fetch_add(1, std::memory_order_relaxed);
+        leg.conn = connection(*leg.state, i == 1 && legs[0].state == leg.state);
+        if (!leg.conn) {
+            on_failure(*leg.state, leg.probe);
+            std::lock_guard<std::mutex> lock(race->mutex);
+            if (!race->error) {
+                race->error = std::make_exception_ptr(RPCTransportError("Cannot connect to " + leg.state->endpoint.to_string()));
+            }
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            ++race->in_flight;
+        }
+        uint64_t t_start = metrics_now_ns();
+        EndpointState* state = leg.state;
+        bool probe = leg.probe;
+        leg.sequence = leg.conn->call_async(func, args,
+            [this, race, i, state, probe, t_start](json&& response, std::exception_ptr error) {
+                bool transport = error && is_transport_error(error);
+                if (transport) {
+                    on_failure(*state, probe);
+                } else {
+                    on_success(*state, probe);
+                    record_latency(metrics_now_ns() - t_start);
+                }
+                std::lock_guard<std::mutex> lock(race->mutex);
+                --race->in_flight;
+                if (race->winner < 0) {
+                    if (!transport) {
+                        race->winner = i;
+                        race->result = std::move(response);
+                        race->error = error;
+                    } else if (!race->error) {
+                        race->error = error;
+                    }
+                }
+                race->cv.notify_all();
+            });
+        return true;
+    };
+
+    legs[0].state = pick(nullptr, legs[0].probe);
+    launch(0);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options_.call_timeout_ms);
+    int64_t delay_ns = hedge_delay_ns();
+    std::unique_lock<std::mutex> lock(race->mutex);
+    auto settled = [&race] { return race->winner >= 0 || race->in_flight == 0; };
+
+    if (delay_ns > 0 && !race->cv.wait_for(lock, std::chrono::nanoseconds(delay_ns), settled) && take_hedge_token()) {
+        lock.unlock();
+        legs[1].state = pick(legs[0].state, legs[1].probe);
+        hedges_sent_.fetch_add(1, std::memory_order_relaxed);
+        spdlog::debug("Hedging '{}' to {} after {} us", func, legs[1].state->endpoint.to_string(), delay_ns / 1000);
+        launch(1);
+        lock.lock();
+    }
+
+    bool done = race->cv.wait_until(lock, deadline, settled);
+    int winner = race->winner;
+    json result = std::move(race->result);
+    std::exception_ptr error = race->error;
+    lock.unlock();
+
+    // Cancel whatever is still outstanding; a cancelled probe gives up its slot
+    for (int i = 0; i < 2; ++i) {
+        Leg& leg = legs[i];
+        if (!leg.conn || i == winner) continue;
+        if (leg.conn->cancel(leg.sequence)) {
+            if (!done) {
+                on_failure(*leg.state, leg.probe); // timed out
+            } else if (leg.probe) {
+                leg.state->probing.store(false);
+            }
+        }
+    }
+
+    if (!done) {
+        throw RPCTransportError("Timeout waiting for response to '" + func + "'");
+    }
+    if (winner == 1) {
+        hedge_wins_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return result;
+}
@@ -0,0 +1,567 @@
+// expr_eval.cpp
+#include "expr_eval.h"
+#include "response_writer.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t CHUNK_ROWS = 256; // rows evaluated per pass over the program
+
+struct FunctionInfo {
+    const char* name;
+    ExprOp op;
+    size_t arity;
+};
+
+const FunctionInfo FUNCTIONS[] = {
+    {"sqrt", ExprOp::Sqrt, 1}, {"abs", ExprOp::Abs, 1}, {"exp", ExprOp::Exp, 1}, {"log", ExprOp::Log, 1},
+    {"min", ExprOp::Min, 2},   {"max", ExprOp::Max, 2}, {"pow", ExprOp::Pow, 2},
+};
+
+const FunctionInfo* find_function(std::string_view name) {
+    for (const auto& f : FUNCTIONS) {
+        if (name == f.name) return &f;
+    }
+    return nullptr;
+}
+
+size_t arity_of(ExprOp op) {
+    switch (op) {
+        case ExprOp::PushConst:
+        case ExprOp::PushVar: return 0;
+        case ExprOp::Neg:
+        case ExprOp::Abs:
+        case ExprOp::Sqrt:
+        case ExprOp::Exp:
+        case ExprOp::Log: return 1;
+        default: return 2;
+    }
+}
+
+double apply_unary(ExprOp op, double a) {
+    switch (op) {
+        case ExprOp::Neg: return -a;
+        case ExprOp::Abs: return std::fabs(a);
+        case ExprOp::Sqrt: return std::sqrt(a);
+        case ExprOp::Exp: return std::exp(a);
+        case ExprOp::Log: return std::log(a);
+        default: return a;
+    }
+}
+
+double apply_binary(ExprOp op, double a, double b) {
+    switch (op) {
+        case ExprOp::Add: return a + b;
+        case ExprOp::Sub: return a - b;
+        case ExprOp::Mul: return a * b;
+        case ExprOp::Div: return a / b;
+        case ExprOp::Pow: return std::pow(a, b);
+        case ExprOp::Min: return b < a ? b : a;
+        case ExprOp::Max: return a < b ? b : a;
+        default: return a;
+    }
+}
+
+bool is_ident_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool is_ident_char(char c) {
+    return is_ident_start(c) || (c >= '0' && c <= '9');
+}
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool is_identifier(std::string_view name) {
+    if (name.empty() || !is_ident_start(name[0])) return false;
+    return std::all_of(name.begin(), name.end(), is_ident_char);
+}
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Emits the postfix program for either syntax, folding constants and tracking
+// the stack depth as it goes
+class Compiler {
+public:
+    Compiler(std::string_view text, const std::vector<std::string>& variables)
+        : variables_(variables), text_(text), fixed_variables_(!variables.empty()) {
+        if (variables_.size() > ExprPlan::MAX_VARIABLES) {
+            throw std::invalid_argument("Too many variables (limit " + std::to_string(ExprPlan::MAX_VARIABLES) + ")");
+        }
+        for (size_t i = 0; i < variables_.size(); ++i) {
+            if (!is_identifier(variables_[i])) {
+                throw std::invalid_argument("Invalid variable name '" + variables_[i] + "'");
+            }
+            if (std::find(variables_.begin(), variables_.begin() + i, variables_[i]) != variables_.begin() + i) {
+                throw std::invalid_argument("Duplicate variable '" + variables_[i] + "'");
+            }
+        }
+    }
+
+    void compile(ExprSyntax syntax) {
+        if (text_.size() > ExprPlan::MAX_TEXT_LENGTH) {
+            throw std::invalid_argument("Expression longer than " + std::to_string(ExprPlan::MAX_TEXT_LENGTH) + " characters");
+        }
+        if (syntax == ExprSyntax::Infix) {
+            compile_infix();
+        } else {
+            compile_postfix();
+        }
+        if (code_.empty()) fail("Empty expression", 0);
+        if (depth_ != 1) fail("Program leaves " + std::to_string(depth_) + " values on the stack", text_.size());
+    }
+
+    std::vector<std::string> variables_;
+    std::vector<ExprInstr> code_;
+    size_t max_depth_ = 0;
+
+private:
+    [[noreturn]] void fail(const std::string& what, size_t at) const {
+        throw std::invalid_argument(what + " at position " + std::to_string(at));
+    }
+
+    void push(const ExprInstr& instr, size_t at) {
+        code_.push_back(instr);
+        if (++depth_ > ExprPlan::MAX_STACK) {
+            fail("Expression needs more than " + std::to_string(ExprPlan::MAX_STACK) + " stack slots", at);
+        }
+        max_depth_ = std::max(max_depth_, depth_);
+    }
+
+    void push_const(double value, size_t at) {
+        push({ExprOp::PushConst, 0, value}, at);
+    }
+
+    void push_var(std::string_view name, size_t at) {
+        auto it = std::find(variables_.begin(), variables_.end(), name);
+        if (it == variables_.end()) {
+            if (fixed_variables_) fail("Unknown variable '" + std::string(name) + "'", at);
+            if (variables_.size() == ExprPlan::MAX_VARIABLES) {
+                fail("Too many variables (limit " + std::to_string(ExprPlan::MAX_VARIABLES) + ")", at);
+            }
+            variables_.emplace_back(name);
+            it = variables_.end() - 1;
+        }
+        push({ExprOp::PushVar, static_cast<uint32_t>(it - variables_.begin()), 0.0}, at);
+    }
+
+    // The top `arity` values were produced by the last `arity` instructions
+    // exactly when those are all pushes; constant ones fold into one push.
+    // Division by a constant zero is left for evaluate() to report.
+    void apply(ExprOp op, size_t at) {
+        size_t arity = arity_of(op);
+        if (depth_ < arity) fail("Missing operand", at);
+        bool foldable = code_.size() >= arity &&
+                        std::all_of(code_.end() - arity, code_.end(),
+                                    [](const ExprInstr& i) { return i.op == ExprOp::PushConst; });
+        if (foldable && !(op == ExprOp::Div && code_.back().value == 0.0)) {
+            double value = arity == 1 ? apply_unary(op, code_.back().value)
+                                      : apply_binary(op, code_[code_.size() - 2].value, code_.back().value);
+            code_.resize(code_.size() - arity);
+            code_.push_back({ExprOp::PushConst, 0, value});
+        } else {
+            code_.push_back({op, 0, 0.0});
+        }
+        depth_ -= arity - 1;
+    }
+
+    // --- infix: precedence climbing by recursive descent ---
+    //   expr    := term (('+' | '-') term)*
+    //   term    := unary (('*' | '/') unary)*
+    //   unary   := ('-' | '+') unary | power
+    //   power   := primary ('^' unary)?          right-associative, -a^2 = -(a^2)
+    //   primary := number | name | name '(' expr (',' expr)* ')' | '(' expr ')'
+
+    void compile_infix() {
+        skip_space();
+        if (pos_ == text_.size()) fail("Empty expression", pos_);
+        parse_expr();
+        if (pos_ != text_.size()) fail(std::string("Unexpected '") + text_[pos_] + "'", pos_);
+    }
+
+    void skip_space() {
+        while (pos_ < text_.size() && is_space(text_[pos_])) ++pos_;
+    }
+
+    bool accept(char c) {
+        skip_space();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!accept(c)) {
+            if (pos_ == text_.size()) fail(std::string("Expected '") + c + "', got end of expression", pos_);
+            fail(std::string("Expected '") + c + "', got '" + text_[pos_] + "'", pos_);
+        }
+    }
+
+    void parse_expr() {
+        if (++nesting_ > ExprPlan::MAX_STACK) fail("Expression nested too deeply", pos_);
+        parse_term();
+        for (;;) {
+            size_t at = pos_;
+            if (accept('+')) {
+                parse_term();
+                apply(ExprOp::Add, at);
+            } else if (accept('-')) {
+                parse_term();
+                apply(ExprOp::Sub, at);
+            } else {
+                break;
+            }
+        }
+        --nesting_;
+    }
+
+    void parse_term() {
+        parse_unary();
+        for (;;) {
+            size_t at = pos_;
+            if (accept('*')) {
+                parse_unary();
+                apply(ExprOp::Mul, at);
+            } else if (accept('/')) {
+                parse_unary();
+                apply(ExprOp::Div, at);
+            } else {
+                break;
+            }
+        }
+    }
+
+    void parse_unary() {
+        if (++nesting_ > ExprPlan::MAX_STACK) fail("Expression nested too deeply", pos_);
+        size_t at = pos_;
+        if (accept('-')) {
+            parse_unary();
+            apply(ExprOp::Neg, at);
+        } else if (accept('+')) {
+            parse_unary();
+        } else {
+            parse_primary();
+            at = pos_;
+            if (accept('^')) {
+                parse_unary();
+                apply(ExprOp::Pow, at);
+            }
+        }
+        --nesting_;
+    }
+
+    void parse_primary() {
+        skip_space();
+        if (pos_ == text_.size()) fail("Unexpected end of expression", pos_);
+        size_t at = pos_;
+        char c = text_[pos_];
+        if (c == '(') {
+            ++pos_;
+            parse_expr();
+            expect(')');
+        } else if (is_digit(c) || c == '.') {
+            push_const(scan_number(), at);
+        } else if (is_ident_start(c)) {
+            while (pos_ < text_.size() && is_ident_char(text_[pos_])) ++pos_;
+            std::string_view name = text_.substr(at, pos_ - at);
+            if (accept('(')) {
+                const FunctionInfo* f = find_function(name);
+                if (!f) fail("Unknown function '" + std::string(name) + "'", at);
+                parse_expr();
+                for (size_t i = 1; i < f->arity; ++i) {
+                    expect(',');
+                    parse_expr();
+                }
+                expect(')');
+                apply(f->op, at);
+            } else {
+                push_var(name, at);
+            }
+        } else {
+            fail(std::string("Unexpected '") + c + "'", at);
+        }
+    }
+
+    // digits [. digits] [e [+-] digits], parsed with from_chars
+    double scan_number() {
+        size_t start = pos_;
+        while (pos_ < text_.size() && (is_digit(text_[pos_]) || text_[pos_] == '.')) ++pos_;
+        if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+            size_t exp = pos_ + 1;
+            if (exp < text_.size() && (text_[exp] == '+' || text_[exp] == '-')) ++exp;
+            if (exp < text_.size() && is_digit(text_[exp])) {
+                pos_ = exp;
+                while (pos_ < text_.size() && is_digit(text_[pos_])) ++pos_;
+            }
+        }
+        double value = 0.0;
+        auto res = std::from_chars(text_.data() + start, text_.data() + pos_, value);
+        if (res.ec != std::errc() || res.ptr != text_.data() + pos_) {
+            fail("Invalid number '" + std::string(text_.substr(start, pos_ - start)) + "'", start);
+        }
+        return value;
+    }
+
+    // --- postfix: whitespace-separated tokens ---
+    //   numbers push, names push variables, + - * / ^ pop two, neg pops one,
+    //   functions pop their arity
+
+    void compile_postfix() {
+        while (true) {
+            skip_space();
+            if (pos_ == text_.size()) break;
+            size_t at = pos_;
+            while (pos_ < text_.size() && !is_space(text_[pos_])) ++pos_;
+            std::string_view token = text_.substr(at, pos_ - at);
+
+            if (token.size() == 1 && std::string_view("+-*/^").find(token[0]) != std::string_view::npos) {
+                static const ExprOp OPS[] = {ExprOp::Add, ExprOp::Sub, ExprOp::Mul, ExprOp::Div, ExprOp::Pow};
+                apply(OPS[std::string_view("+-*/^").find(token[0])], at);
+            } else if (is_digit(token[0]) || token[0] == '.' || token[0] == '-' || token[0] == '+') {
+                double value = 0.0;
+                const char* first = token.data() + (token[0] == '+');
+                auto res = std::from_chars(first, token.data() + token.size(), value);
+                if (res.ec != std::errc() || res.ptr != token.data() + token.size()) {
+                    fail("Invalid number '" + std::string(token) + "'", at);
+                }
+                push_const(value, at);
+            } else if (token == "neg") {
+                apply(ExprOp::Neg, at);
+            } else if (const FunctionInfo* f = find_function(token)) {
+                apply(f->op, at);
+            } else if (is_identifier(token)) {
+                push_var(token, at);
+            } else {
+                fail("Unexpected token '" + std::string(token) + "'", at);
+            }
+        }
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+    bool fixed_variables_;
+    size_t depth_ = 0;
+    size_t nesting_ = 0;
+};
+
+// Length-prefixed fields, so no (text, variables) pair can alias another. In
+// the request arena: only a miss copies it into the cache.
+arena_string cache_key(std::string_view text, ExprSyntax syntax, const std::vector<std::string>& variables) {
+    arena_string key;
+    key.reserve(text.size() + 16);
+    key.push_back(static_cast<char>(syntax));
+    auto field = [&key](std::string_view s) {
+        key += std::to_string(s.size());
+        key.push_back(':');
+        key.append(s.data(), s.size());
+    };
+    field(text);
+    for (const auto& v : variables) field(v);
+    return key;
+}
+
+uint64_t fnv1a64(std::string_view data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+} // namespace
+
+std::shared_ptr<const ExprPlan> ExprPlan::compile(std::string_view text, ExprSyntax syntax,
+                                                  const std::vector<std::string>& variables) {
+    Compiler compiler(text, variables);
+    compiler.compile(syntax);
+
+    auto plan = std::make_shared<ExprPlan>();
+    plan->variables_ = std::move(compiler.variables_);
+    plan->code_ = std::move(compiler.code_);
+    plan->max_stack_ = compiler.max_depth_;
+    return plan;
+}
+
+double ExprPlan::evaluate(const double* binding) const {
+    double stack[MAX_STACK];
+    size_t sp = 0;
+    for (const auto& ins : code_) {
+        switch (ins.op) {
+            case ExprOp::PushConst: stack[sp++] = ins.value; break;
+            case ExprOp::PushVar: stack[sp++] = binding[ins.var]; break;
+            default:
+                if (arity_of(ins.op) == 1) {
+                    stack[sp - 1] = apply_unary(ins.op, stack[sp - 1]);
+                } else {
+                    if (ins.op == ExprOp::Div && stack[sp - 1] == 0.0) throw std::domain_error("Division by zero");
+                    stack[sp - 2] = apply_binary(ins.op, stack[sp - 2], stack[sp - 1]);
+                    --sp;
+                }
+        }
+    }
+    return stack[0];
+}
+
+// The stack holds one column of up to CHUNK_ROWS values per slot, so every
+// instruction is a tight loop over a column instead of a dispatch per row
+void ExprPlan::evaluate(const double* bindings, size_t count, double* out) const {
+    const size_t nvars = variables_.size();
+    std::vector<double> stack(max_stack_ * std::min(count, CHUNK_ROWS));
+
+    for (size_t row0 = 0; row0 < count; row0 += CHUNK_ROWS) {
+        const size_t n = std::min(CHUNK_ROWS, count - row0);
+        auto column = [&](size_t slot) { return stack.data() + slot * n; };
+        size_t sp = 0;
+        for (const auto& ins : code_) {
+            if (ins.op == ExprOp::PushConst) {
+                std::fill_n(column(sp++), n, ins.value);
+                continue;
+            }
+            if (ins.op == ExprOp::PushVar) {
+                double* dst = column(sp++);
+                const double* src = bindings + row0 * nvars + ins.var;
+                for (size_t i = 0; i < n; ++i) dst[i] = src[i * nvars];
+                continue;
+            }
+            if (arity_of(ins.op) == 1) {
+                double* a = column(sp - 1);
+                switch (ins.op) {
+                    case ExprOp::Neg: for (size_t i = 0; i < n; ++i) a[i] = -a[i]; break;
+                    case ExprOp::Abs: for (size_t i = 0; i < n; ++i) a[i] = std::fabs(a[i]); break;
+                    default: for (size_t i = 0; i < n; ++i) a[i] = apply_unary(ins.op, a[i]); break;
+                }
+                continue;
+            }
+            double* a = column(sp - 2);
+            const double* b = column(sp - 1);
+            switch (ins.op) {
+                case ExprOp::Add: for (size_t i = 0; i < n; ++i) a[i] += b[i]; break;
+                case ExprOp::Sub: for (size_t i = 0; i < n; ++i) a[i] -= b[i]; break;
+                case ExprOp::Mul: for (size_t i = 0; i < n; ++i) a[i] *= b[i]; break;
+                case ExprOp::Div:
+                    for (size_t i = 0; i < n; ++i) {
+                        if (b[i] == 0.0) throw std::domain_error("Division by zero in binding " + std::to_string(row0 + i));
+                    }
+                    for (size_t i = 0; i < n; ++i) a[i] /= b[i];
+                    break;
+                default: for (size_t i = 0; i < n; ++i) a[i] = apply_binary(ins.op, a[i], b[i]); break;
+            }
+            --sp;
+        }
+        std::copy_n(column(0), n, out + row0);
+    }
+}
+
+std::shared_ptr<const ExprPlan> ExprPlanCache::get(std::string_view text, ExprSyntax syntax,
+                                                   const std::vector<std::string>& variables, bool& hit) {
+    arena_string key = cache_key(text, syntax, variables);
+    uint64_t hash = fnv1a64(key);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(hash);
+        if (it != index_.end() && std::string_view(it->second->key) == std::string_view(key)) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            ++hits_;
+            hit = true;
+            return it->second->plan;
+        }
+        ++misses_;
+    }
+    hit = false;
+
+    // Compile outside the lock; two threads missing on the same text both
+    // compile and the later insert wins, which is harmless
+    auto plan = ExprPlan::compile(text, syntax, variables);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(hash);
+    if (it != index_.end()) { // same text raced in, or a hash collision: replace
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    lru_.push_front({hash, std::string(key), plan});
+    index_[hash] = lru_.begin();
+    while (lru_.size() > capacity_) {
+        index_.erase(lru_.back().hash);
+        lru_.pop_back();
+    }
+    return plan;
+}
+
+size_t ExprPlanCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+uint64_t ExprPlanCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t ExprPlanCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+bool handle_eval_request(const arena_json& request, ExprPlanCache& cache, ResponseWriter& response) {
+    try {
+        std::string_view text; // points into the request DOM
+        ExprSyntax syntax;
+        if (request.contains("expr")) {
+            text = arena_at(request, "expr").get_ref<const arena_string&>();
+            syntax = ExprSyntax::Infix;
+        } else if (request.contains("program")) {
+            text = arena_at(request, "program").get_ref<const arena_string&>();
+            syntax = ExprSyntax::Postfix;
+        } else {
+            response.error("eval needs \"expr\" or \"program\"");
+            return false;
+        }
+        std::vector<std::string> variables; // kept by the plan cache, so not arena memory
+        if (request.contains("vars")) variables = arena_at(request, "vars").get<std::vector<std::string>>();
+
+        bool hit = false;
+        auto plan = cache.get(text, syntax, variables, hit);
+        const size_t nvars = plan->variables().size();
+
+        if (request.contains("batch")) {
+            const arena_json& batch = arena_at(request, "batch");
+            if (!batch.is_array()) throw std::invalid_argument("\"batch\" must be an array of bindings");
+            arena_vector<double> bindings;
+            bindings.reserve(batch.size() * nvars);
+            for (const auto& row : batch) {
+                if (!row.is_array() || row.size() != nvars) {
+                    throw std::invalid_argument("Each binding needs " + std::to_string(nvars) + " values");
+                }
+                for (const auto& v : row) bindings.push_back(v.get<double>());
+            }
+            arena_vector<double> results(batch.size());
+            plan->evaluate(bindings.data(), results.size(), results.data());
+            response.success(results.data(), results.size());
+            return true;
+        }
+
+        arena_vector<double> args;
+        if (request.contains("args")) args = arena_at(request, "args").get<arena_vector<double>>();
+        if (args.size() != nvars) {
+            throw std::invalid_argument("Expected " + std::to_string(nvars) + " arguments, got " + std::to_string(args.size()));
+        }
+        response.success(plan->evaluate(args.data()));
+        return true;
+    } catch (const json::exception&) {
+        response.error("Invalid arguments format");
+    } catch (const std::exception& e) {
+        response.error(e.what());
+    }
+    return false;
+}
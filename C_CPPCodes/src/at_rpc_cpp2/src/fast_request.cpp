@@ -0,0 +1,128 @@
+// fast_request.cpp
+#include "fast_request.h"
+
+#include <charconv>
+
+namespace {
+
+struct Cursor {
+    const char* p;
+    const char* end;
+
+    void skip_ws() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    }
+    bool consume(char c) {
+        if (p < end && *p == c) {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+};
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// A string without escapes and with printable ASCII only; anything else is
+// left to the generic parser (which also validates UTF-8)
+bool parse_plain_string(Cursor& c, std::string_view& out) {
+    if (!c.consume('"')) return false;
+    const char* start = c.p;
+    while (c.p < c.end) {
+        unsigned char ch = static_cast<unsigned char>(*c.p);
+        if (ch == '"') {
+            out = std::string_view(start, static_cast<size_t>(c.p - start));
+            ++c.p;
+            return true;
+        }
+        if (ch == '\\' || ch < 0x20 || ch >= 0x80) return false;
+        ++c.p;
+    }
+    return false;
+}
+
+// JSON number grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+bool parse_number(Cursor& c, double& value) {
+    const char* start = c.p;
+    const char* p = c.p;
+    if (p < c.end && *p == '-') ++p;
+    if (p >= c.end) return false;
+    if (*p == '0') {
+        ++p;
+    } else if (is_digit(*p)) {
+        while (p < c.end && is_digit(*p)) ++p;
+    } else {
+        return false;
+    }
+    bool integer = true;
+    if (p < c.end && *p == '.') {
+        integer = false;
+        ++p;
+        if (p >= c.end || !is_digit(*p)) return false;
+        while (p < c.end && is_digit(*p)) ++p;
+    }
+    if (p < c.end && (*p == 'e' || *p == 'E')) {
+        integer = false;
+        ++p;
+        if (p < c.end && (*p == '+' || *p == '-')) ++p;
+        if (p >= c.end || !is_digit(*p)) return false;
+        while (p < c.end && is_digit(*p)) ++p;
+    }
+    auto result = std::from_chars(start, p, value);
+    if (result.ec != std::errc() || result.ptr != p) return false;
+    // nlohmann stores "-0" as the integer 0, which converts to +0.0
+    if (integer && value == 0) value = 0.0;
+    c.p = p;
+    return true;
+}
+
+bool parse_args(Cursor& c, InlineArgs& args) {
+    if (!c.consume('[')) return false;
+    c.skip_ws();
+    if (c.consume(']')) return true;
+    while (true) {
+        double value;
+        if (!parse_number(c, value)) return false;
+        args.push_back(value);
+        c.skip_ws();
+        if (c.consume(']')) return true;
+        if (!c.consume(',')) return false;
+        c.skip_ws();
+    }
+}
+
+} // namespace
+
+bool parse_fast_request(std::string_view body, FastRequest& out) {
+    Cursor c{body.data(), body.data() + body.size()};
+    out.args.clear();
+    bool seen_func = false;
+    bool seen_args = false;
+
+    c.skip_ws();
+    if (!c.consume('{')) return false;
+    while (true) {
+        c.skip_ws();
+        std::string_view key;
+        if (!parse_plain_string(c, key)) return false;
+        c.skip_ws();
+        if (!c.consume(':')) return false;
+        c.skip_ws();
+        if (key == "func" && !seen_func) {
+            if (!parse_plain_string(c, out.func)) return false;
+            seen_func = true;
+        } else if (key == "args" && !seen_args) {
+            if (!parse_args(c, out.args)) return false;
+            seen_args = true;
+        } else {
+            return false;
+        }
+        c.skip_ws();
+        if (c.consume('}')) break;
+        if (!c.consume(',')) return false;
+    }
+    c.skip_ws();
+    return c.p == c.end && seen_func && seen_args;
+}
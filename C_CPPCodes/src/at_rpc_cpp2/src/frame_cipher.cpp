@@ -0,0 +1,255 @@
+// frame_cipher.cpp
+#include "frame_cipher.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef AT_RPC_WITH_CRYPTOPP
+#include <aes.h>
+#include <gcm.h>
+#include <hkdf.h>
+#include <osrng.h>
+#include <secblock.h>
+#include <sha.h>
+#endif
+
+std::vector<uint8_t> FrameCipher::load_key(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot read key file '" + path + "'");
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    std::string hex = text.str();
+    size_t begin = hex.find_first_not_of(" \t\r\n");
+    size_t end = hex.find_last_not_of(" \t\r\n");
+    hex = begin == std::string::npos ? std::string() : hex.substr(begin, end - begin + 1);
+    if (hex.size() != KEY_SIZE * 2) {
+        throw std::runtime_error("Key file '" + path + "' must hold " + std::to_string(KEY_SIZE * 2) + " hex digits");
+    }
+    std::vector<uint8_t> key(KEY_SIZE);
+    for (size_t i = 0; i < KEY_SIZE; ++i) {
+        char pair[3] = {hex[2 * i], hex[2 * i + 1], 0};
+        if (!std::isxdigit(static_cast<unsigned char>(pair[0])) || !std::isxdigit(static_cast<unsigned char>(pair[1]))) {
+            throw std::runtime_error("Key file '" + path + "' must hold " + std::to_string(KEY_SIZE * 2) + " hex digits");
+        }
+        key[i] = static_cast<uint8_t>(std::strtoul(pair, nullptr, 16));
+    }
+    return key;
+}
+
+#ifdef AT_RPC_WITH_CRYPTOPP
+
+namespace {
+
+constexpr size_t NONCE_SIZE = 12;
+constexpr char KEY_INFO[] = "at-rpc sealed frames v1";
+// First 4 nonce bytes: which way the frame travels, so both directions can use
+// the one connection key with their own counters
+constexpr uint8_t CLIENT_TO_SERVER[4] = {'C', '-', '>', 'S'};
+constexpr uint8_t SERVER_TO_CLIENT[4] = {'S', '-', '>', 'C'};
+
+void write_header(uint8_t* out, uint16_t flags, size_t body_length) {
+    ATHeader header{};
+    header.protocol_id = ATProtocol::PROTOCOL_ID;
+    header.flags = flags;
+    header.sequence = 0;
+    header.body_length = static_cast<uint32_t>(body_length);
+    header.hash_value = 0;
+    header.pack_into(out);
+}
+
+bool is_hello(const uint8_t* frame, size_t size, uint16_t flags, size_t body_length) {
+    if (size != ATProtocol::HEADER_SIZE + body_length) {
+        return false;
+    }
+    ATHeader header;
+    header.unpack(frame, size);
+    return header.protocol_id == ATProtocol::PROTOCOL_ID && header.flags == flags && header.sequence == 0 &&
+           header.body_length == body_length;
+}
+
+} // namespace
+
+struct FrameCipher::Impl {
+    Role role;
+    CryptoPP::SecByteBlock shared_key;
+    uint8_t client_salt[SALT_SIZE] = {};
+    bool established = false;
+    // Keyed once per connection; every frame only resynchronises the nonce
+    CryptoPP::GCM<CryptoPP::AES>::Encryption sealer;
+    CryptoPP::GCM<CryptoPP::AES>::Decryption opener;
+    uint64_t sent = 0;     // frames sealed, the next outgoing nonce
+    uint64_t received = 0; // frames opened, the next incoming nonce
+
+    void derive(const uint8_t* server_salt) {
+        uint8_t salt[2 * SALT_SIZE];
+        std::memcpy(salt, client_salt, SALT_SIZE);
+        std::memcpy(salt + SALT_SIZE, server_salt, SALT_SIZE);
+        CryptoPP::SecByteBlock key(KEY_SIZE);
+        CryptoPP::HKDF<CryptoPP::SHA256>().DeriveKey(key, key.size(), shared_key, shared_key.size(), salt, sizeof(salt),
+                                                     reinterpret_cast<const uint8_t*>(KEY_INFO), sizeof(KEY_INFO) - 1);
+        uint8_t iv[NONCE_SIZE] = {};
+        sealer.SetKeyWithIV(key, key.size(), iv, sizeof(iv));
+        opener.SetKeyWithIV(key, key.size(), iv, sizeof(iv));
+    }
+
+    void nonce(uint8_t* out, bool outgoing) const {
+        bool client_to_server = outgoing == (role == Role::Client);
+        std::memcpy(out, client_to_server ? CLIENT_TO_SERVER : SERVER_TO_CLIENT, 4);
+        uint64_t counter = outgoing ? sent : received;
+        for (int i = 11; i >= 4; --i) {
+            out[i] = static_cast<uint8_t>(counter);
+            counter >>= 8;
+        }
+    }
+};
+
+bool FrameCipher::available() {
+    return true;
+}
+
+FrameCipher::FrameCipher(const std::vector<uint8_t>& key, Role role) : impl_(std::make_unique<Impl>()) {
+    if (key.size() != KEY_SIZE) {
+        throw std::invalid_argument("Sealed frames need a " + std::to_string(KEY_SIZE) + "-byte key");
+    }
+    impl_->role = role;
+    impl_->shared_key.Assign(key.data(), key.size());
+}
+
+FrameCipher::~FrameCipher() = default;
+
+std::vector<uint8_t> FrameCipher::client_hello() {
+    CryptoPP::AutoSeededRandomPool().GenerateBlock(impl_->client_salt, SALT_SIZE);
+    std::vector<uint8_t> frame(ATProtocol::HEADER_SIZE + SALT_SIZE);
+    write_header(frame.data(), ATProtocol::FLAG_SEALED, SALT_SIZE);
+    std::memcpy(frame.data() + ATProtocol::HEADER_SIZE, impl_->client_salt, SALT_SIZE);
+    return frame;
+}
+
+bool FrameCipher::accept_hello(const uint8_t* frame, size_t size, std::vector<uint8_t>& reply) {
+    if (impl_->role != Role::Server || impl_->established || !is_hello(frame, size, ATProtocol::FLAG_SEALED, SALT_SIZE)) {
+        return false;
+    }
+    std::memcpy(impl_->client_salt, frame + ATProtocol::HEADER_SIZE, SALT_SIZE);
+    reply.assign(ATProtocol::HEADER_SIZE + SALT_SIZE + TAG_SIZE, 0);
+    uint8_t* server_salt = reply.data() + ATProtocol::HEADER_SIZE;
+    CryptoPP::AutoSeededRandomPool().GenerateBlock(server_salt, SALT_SIZE);
+    impl_->derive(server_salt);
+
+    // The tag over header and salt shows the client that this end has the key
+    write_header(reply.data(), ATProtocol::FLAG_SEALED | ATProtocol::FLAG_RESPONSE, SALT_SIZE + TAG_SIZE);
+    uint8_t* tag = server_salt + SALT_SIZE;
+    uint8_t nonce[NONCE_SIZE];
+    impl_->nonce(nonce, true);
+    impl_->sealer.EncryptAndAuthenticate(tag, tag, TAG_SIZE, nonce, NONCE_SIZE, reply.data(),
+                                         ATProtocol::HEADER_SIZE + SALT_SIZE, tag, 0);
+    ++impl_->sent;
+    impl_->established = true;
+    return true;
+}
+
+bool FrameCipher::finish_hello(const uint8_t* frame, size_t size) {
+    if (impl_->role != Role::Client || impl_->established ||
+        !is_hello(frame, size, ATProtocol::FLAG_SEALED | ATProtocol::FLAG_RESPONSE, SALT_SIZE + TAG_SIZE)) {
+        return false;
+    }
+    const uint8_t* server_salt = frame + ATProtocol::HEADER_SIZE;
+    impl_->derive(server_salt);
+    const uint8_t* tag = server_salt + SALT_SIZE;
+    uint8_t nonce[NONCE_SIZE];
+    impl_->nonce(nonce, false);
+    uint8_t none = 0;
+    if (!impl_->opener.DecryptAndVerify(&none, tag, TAG_SIZE, nonce, NONCE_SIZE, frame,
+                                        ATProtocol::HEADER_SIZE + SALT_SIZE, tag, 0)) {
+        return false;
+    }
+    ++impl_->received;
+    impl_->established = true;
+    return true;
+}
+
+bool FrameCipher::established() const {
+    return impl_->established;
+}
+
+void FrameCipher::seal(std::vector<uint8_t>& frame) {
+    if (!impl_->established) {
+        throw std::logic_error("FrameCipher::seal before the handshake");
+    }
+    ATHeader header;
+    header.unpack(frame.data(), frame.size());
+    size_t body_size = frame.size() - ATProtocol::HEADER_SIZE;
+    header.flags |= ATProtocol::FLAG_SEALED;
+    header.hash_value = 0;
+    header.body_length = static_cast<uint32_t>(body_size + TAG_SIZE);
+    frame.resize(frame.size() + TAG_SIZE);
+    header.pack_into(frame.data());
+
+    uint8_t nonce[NONCE_SIZE];
+    impl_->nonce(nonce, true);
+    uint8_t* body = frame.data() + ATProtocol::HEADER_SIZE;
+    impl_->sealer.EncryptAndAuthenticate(body, body + body_size, TAG_SIZE, nonce, NONCE_SIZE, frame.data(),
+                                         ATProtocol::HEADER_SIZE, body, body_size);
+    ++impl_->sent;
+}
+
+std::vector<uint8_t> FrameCipher::seal_copy(const std::vector<uint8_t>& frame) {
+    std::vector<uint8_t> copy;
+    copy.reserve(frame.size() + TAG_SIZE);
+    copy.assign(frame.begin(), frame.end());
+    seal(copy);
+    return copy;
+}
+
+bool FrameCipher::open(uint8_t* frame, size_t& size) {
+    if (!impl_->established || size < ATProtocol::HEADER_SIZE + TAG_SIZE) {
+        return false;
+    }
+    ATHeader header;
+    header.unpack(frame, size);
+    if (!(header.flags & ATProtocol::FLAG_SEALED) || ATProtocol::HEADER_SIZE + header.body_length != size) {
+        return false;
+    }
+    size_t body_size = size - ATProtocol::HEADER_SIZE - TAG_SIZE;
+    uint8_t nonce[NONCE_SIZE];
+    impl_->nonce(nonce, false);
+    uint8_t* body = frame + ATProtocol::HEADER_SIZE;
+    if (!impl_->opener.DecryptAndVerify(body, body + body_size, TAG_SIZE, nonce, NONCE_SIZE, frame,
+                                        ATProtocol::HEADER_SIZE, body, body_size)) {
+        return false;
+    }
+    ++impl_->received;
+    header.body_length = static_cast<uint32_t>(body_size);
+    header.pack_into(frame);
+    size -= TAG_SIZE;
+    return true;
+}
+
+#else // !AT_RPC_WITH_CRYPTOPP
+
+struct FrameCipher::Impl {};
+
+bool FrameCipher::available() {
+    return false;
+}
+
+FrameCipher::FrameCipher(const std::vector<uint8_t>&, Role) {
+    throw std::runtime_error("Sealed frames need a build with Crypto++ (cmake -DAT_RPC_CRYPTOPP=ON)");
+}
+
+FrameCipher::~FrameCipher() = default;
+
+// Unreachable: the constructor always throws
+std::vector<uint8_t> FrameCipher::client_hello() { return {}; }
+bool FrameCipher::accept_hello(const uint8_t*, size_t, std::vector<uint8_t>&) { return false; }
+bool FrameCipher::finish_hello(const uint8_t*, size_t) { return false; }
+bool FrameCipher::established() const { return false; }
+void FrameCipher::seal(std::vector<uint8_t>&) {}
+std::vector<uint8_t> FrameCipher::seal_copy(const std::vector<uint8_t>&) { return {}; }
+bool FrameCipher::open(uint8_t*, size_t&) { return false; }
+
+#endif
@@ -0,0 +1,338 @@
+// lz_codec.cpp
+#include "lz_codec.h"
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Block format: sequences of
+//   token       high nibble literal count, low nibble match length - MIN_MATCH
+//               (15 means more: add bytes until one is below 255)
+//   literals
+//   offset      2 bytes, little-endian, distance back to the match
+// The last sequence ends after its literals. As in LZ4, the last LAST_LITERALS
+// bytes are always literals and no match starts within MFLIMIT of the end.
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MFLIMIT = 12;
+constexpr size_t MAX_DISTANCE = 65535;
+constexpr unsigned HASH_LOG = 12; // 16 KB table: stays in L1 next to the data
+constexpr unsigned MIN_HASH_LOG = 8; // smaller inputs get smaller tables, cheaper to clear
+constexpr unsigned SKIP_TRIGGER = 6; // probe further apart after 2^6 misses in a row
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t read64(const uint8_t* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Index of the first differing byte in two little-endian words that differ
+inline size_t first_difference(uint64_t diff) {
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanForward64(&bit, diff);
+    return bit >> 3;
+#else
+    return static_cast<size_t>(__builtin_ctzll(diff)) >> 3;
+#endif
+}
+
+inline uint32_t hash4(const uint8_t* p, unsigned hash_log) {
+    return (read32(p) * 2654435761u) >> (32 - hash_log);
+}
+
+// Length continuation bytes for a nibble that overflowed
+inline uint8_t* write_length(uint8_t* op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = static_cast<uint8_t>(length);
+    return op;
+}
+
+// Bytes matching from ip and match on, ip not passing limit (little-endian hosts, see bulk_ops.h)
+inline size_t match_length(const uint8_t* ip, const uint8_t* match, const uint8_t* limit) {
+    const uint8_t* start = ip;
+    while (ip + 8 <= limit) {
+        uint64_t diff = read64(ip) ^ read64(match);
+        if (diff) {
+            return static_cast<size_t>(ip - start) + first_difference(diff);
+        }
+        ip += 8;
+        match += 8;
+    }
+    while (ip < limit && *ip == *match) {
+        ++ip;
+        ++match;
+    }
+    return static_cast<size_t>(ip - start);
+}
+
+// Copy n bytes in 16-byte steps, writing up to 15 bytes past dst + n: only
+// where both buffers have that much slack. Overlap is fine when src trails dst
+// by at least 16 bytes (every step reads bytes written before it).
+inline void wild_copy(uint8_t* dst, const uint8_t* src, size_t n) {
+    uint8_t* const end = dst + n;
+    do {
+        std::memcpy(dst, src, 16);
+        dst += 16;
+        src += 16;
+    } while (dst < end);
+}
+
+constexpr size_t WILD_SLACK = 16;
+
+} // namespace
+
+size_t lz_compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t lz_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity) {
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src; // first byte not yet emitted
+    const uint8_t* const iend = src + size;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + capacity;
+
+    if (size > MFLIMIT) {
+        const uint8_t* const mflimit = iend - MFLIMIT;
+        const uint8_t* const matchlimit = iend - LAST_LITERALS;
+        unsigned hash_log = HASH_LOG;
+        while (hash_log > MIN_HASH_LOG && (size_t(1) << hash_log) > size) {
+            --hash_log;
+        }
+        uint32_t table[1u << HASH_LOG]; // positions relative to src
+        std::memset(table, 0, sizeof(uint32_t) << hash_log);
+        ++ip; // position 0 is what every empty slot points at
+
+        while (true) {
+            // Find a match, probing further apart the longer none turns up
+            const uint8_t* match;
+            size_t misses = 1u << SKIP_TRIGGER;
+            while (true) {
+                if (ip > mflimit) {
+                    goto last_literals;
+                }
+                uint32_t h = hash4(ip, hash_log);
+                match = src + table[h];
+                table[h] = static_cast<uint32_t>(ip - src);
+                if (static_cast<size_t>(ip - match) <= MAX_DISTANCE && read32(match) == read32(ip)) {
+                    break;
+                }
+                ip += misses++ >> SKIP_TRIGGER;
+            }
+            // Extend backwards over bytes the probe stepped past
+            while (ip > anchor && match > src && ip[-1] == match[-1]) {
+                --ip;
+                --match;
+            }
+
+            size_t literals = static_cast<size_t>(ip - anchor);
+            if (static_cast<size_t>(oend - op) < 1 + literals + literals / 255 + 1 + 2) {
+                return 0;
+            }
+            uint8_t* token = op++;
+            if (literals >= 15) {
+                *token = 15 << 4;
+                op = write_length(op, literals - 15);
+            } else {
+                *token = static_cast<uint8_t>(literals << 4);
+            }
+            std::memcpy(op, anchor, literals);
+            op += literals;
+
+            // Matches straight after a match share the scan below
+            while (true) {
+                uint16_t offset = static_cast<uint16_t>(ip - match);
+                *op++ = static_cast<uint8_t>(offset);
+                *op++ = static_cast<uint8_t>(offset >> 8);
+
+                size_t extra = match_length(ip + MIN_MATCH, match + MIN_MATCH, matchlimit);
+                ip += MIN_MATCH + extra;
+                if (static_cast<size_t>(oend - op) < extra / 255 + 1 + 1 + LAST_LITERALS) {
+                    return 0;
+                }
+                if (extra >= 15) {
+                    *token += 15;
+                    op = write_length(op, extra - 15);
+                } else {
+                    *token += static_cast<uint8_t>(extra);
+                }
+                anchor = ip;
+                if (ip > mflimit) {
+                    goto last_literals;
+                }
+
+                table[hash4(ip - 2, hash_log)] = static_cast<uint32_t>(ip - 2 - src);
+                uint32_t h = hash4(ip, hash_log);
+                match = src + table[h];
+                table[h] = static_cast<uint32_t>(ip - src);
+                if (static_cast<size_t>(ip - match) > MAX_DISTANCE || read32(match) != read32(ip)) {
+                    break;
+                }
+                if (static_cast<size_t>(oend - op) < 1 + 2) {
+                    return 0;
+                }
+                token = op++;
+                *token = 0; // no literals in between
+            }
+            ++ip;
+        }
+    }
+
+last_literals:
+    size_t literals = static_cast<size_t>(iend - anchor);
+    if (static_cast<size_t>(oend - op) < 1 + literals + literals / 255 + 1) {
+        return 0;
+    }
+    if (literals >= 15) {
+        *op++ = 15 << 4;
+        op = write_length(op, literals - 15);
+    } else {
+        *op++ = static_cast<uint8_t>(literals << 4);
+    }
+    std::memcpy(op, anchor, literals);
+    op += literals;
+    return static_cast<size_t>(op - dst);
+}
+
+bool lz_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t raw_size) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + size;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + raw_size;
+
+    // A length nibble of 15 continues in the following bytes
+    auto read_length = [&](size_t& length) {
+        uint8_t byte;
+        do {
+            if (ip == iend) return false;
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t literals = token >> 4;
+
+        // Shortcut for the bulk of sequences: under 15 literals, a match of at
+        // most 18 bytes at least 8 back, far from both ends. Fixed-size copies,
+        // no length loops.
+        if (literals < 15 && (token & 15) < 15 && static_cast<size_t>(iend - ip) >= 16 + 2 &&
+            static_cast<size_t>(oend - op) >= 16 + 24) {
+            std::memcpy(op, ip, 16);
+            op += literals;
+            ip += literals;
+            size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+            if (offset >= 8 && offset <= static_cast<size_t>(op - dst)) {
+                ip += 2;
+                const uint8_t* match = op - offset;
+                std::memcpy(op, match, 8);
+                std::memcpy(op + 8, match + 8, 8);
+                std::memcpy(op + 16, match + 16, 8);
+                op += (token & 15) + MIN_MATCH;
+                continue;
+            }
+            op -= literals; // rare: take the general path below
+            ip -= literals;
+        }
+
+        if (literals == 15 && !read_length(literals)) {
+            return false;
+        }
+        if (literals > static_cast<size_t>(iend - ip) || literals > static_cast<size_t>(oend - op)) {
+            return false;
+        }
+        if (static_cast<size_t>(iend - ip) - literals >= WILD_SLACK &&
+            static_cast<size_t>(oend - op) - literals >= WILD_SLACK) {
+            wild_copy(op, ip, literals); // the common case: not near either end
+        } else {
+            std::memcpy(op, ip, literals);
+        }
+        op += literals;
+        ip += literals;
+        if (ip == iend) {
+            break; // the last sequence has no match
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !read_length(length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst) || length > static_cast<size_t>(oend - op)) {
+            return false;
+        }
+        const uint8_t* match = op - offset;
+        if (offset >= WILD_SLACK && static_cast<size_t>(oend - op) - length >= WILD_SLACK) {
+            wild_copy(op, match, length);
+            op += length;
+        } else if (offset >= length) {
+            std::memcpy(op, match, length);
+            op += length;
+        } else if (offset >= 8) {
+            // Overlapping, but every 8-byte step reads bytes already written
+            uint8_t* const end = op + length;
+            if (static_cast<size_t>(oend - op) - length >= 8) {
+                for (; op < end; op += 8, match += 8) {
+                    std::memcpy(op, match, 8);
+                }
+                op = end;
+            } else {
+                while (op < end) *op++ = *match++;
+            }
+        } else {
+            while (length--) *op++ = *match++; // short repeats (runs of one byte and the like)
+        }
+    }
+    return ip == iend && op == oend;
+}
+
+bool lz_compress_body(const uint8_t* body, size_t size, std::vector<uint8_t>& out) {
+    size_t saving = size / LZ_MIN_SAVING;
+    if (saving <= LZ_BODY_PREFIX || size > UINT32_MAX) {
+        return false;
+    }
+    size_t start = out.size();
+    size_t capacity = size - saving - LZ_BODY_PREFIX;
+    out.resize(start + LZ_BODY_PREFIX + capacity);
+    uint8_t* prefix = out.data() + start;
+    prefix[0] = static_cast<uint8_t>(size >> 24);
+    prefix[1] = static_cast<uint8_t>(size >> 16);
+    prefix[2] = static_cast<uint8_t>(size >> 8);
+    prefix[3] = static_cast<uint8_t>(size);
+    size_t packed = lz_compress(body, size, prefix + LZ_BODY_PREFIX, capacity);
+    out.resize(packed ? start + LZ_BODY_PREFIX + packed : start);
+    return packed != 0;
+}
+
+bool lz_decompress_body(const uint8_t* body, size_t size, size_t max_size, std::string& out) {
+    if (size < LZ_BODY_PREFIX) {
+        return false;
+    }
+    size_t raw_size = static_cast<size_t>(body[0]) << 24 | static_cast<size_t>(body[1]) << 16 |
+                      static_cast<size_t>(body[2]) << 8 | body[3];
+    if (raw_size > max_size) {
+        return false;
+    }
+    out.resize(raw_size);
+    return lz_decompress(body + LZ_BODY_PREFIX, size - LZ_BODY_PREFIX, reinterpret_cast<uint8_t*>(&out[0]), raw_size);
+}
@@ -14,10 +14,15 @@ size_t send_all(socket_t sockfd, const std::vector<uint8_t>& data) {
         int sent = ::send(sockfd, buf + total_sent, static_cast<int>(len - total_sent), 0);
         if (sent == SOCKET_ERROR) {
             int err = get_last_error();
+#ifndef _WIN32
+            if (err == EINTR) continue;
+#endif
             spdlog::error("send failed: {}", get_error_message(err));
+            break; // Caller sees a short count
         }
         if (sent == 0) {
             spdlog::warn("Connection closed by peer during send.");
+            break;
         }
         total_sent += sent;
     }
@@ -26,23 +31,134 @@ size_t send_all(socket_t sockfd, const std::vector<uint8_t>& data) {
 }
 
 size_t recv_all(socket_t sockfd, std::vector<uint8_t>& data, size_t len) {
-    char* buf = reinterpret_cast<char*>(data.data());
+    return recv_all(sockfd, data.data(), len);
+}
+
+size_t recv_all(socket_t sockfd, uint8_t* data, size_t len) {
+    char* buf = reinterpret_cast<char*>(data);
     size_t total_received = 0;
     while (total_received < len) {
         spdlog::debug("Attempting to recv {} bytes...", len - total_received);
         int received = ::recv(sockfd, buf + total_received, static_cast<int>(len - total_received), 0);
         if (received == SOCKET_ERROR) {
             int err = get_last_error();
+#ifndef _WIN32
+            if (err == EINTR) continue;
+#endif
             spdlog::error("recv failed: {}", get_error_message(err));
+            break; // Caller sees a short count
         }
         if (received == 0) {
             spdlog::info("Connection closed by peer during receive.");
+            break;
         }
         total_received += received;
     }
     return total_received;
 }
 
+int recv_some(socket_t sockfd, uint8_t* buf, size_t len) {
+    while (true) {
+        int received = ::recv(sockfd, reinterpret_cast<char*>(buf), static_cast<int>(len), 0);
+#ifndef _WIN32
+        if (received == SOCKET_ERROR && get_last_error() == EINTR) continue;
+#endif
+        return received;
+    }
+}
+
+bool wait_readable(socket_t sockfd, int timeout_ms) {
+#ifdef _WIN32
+    WSAPOLLFD pfd{};
+    pfd.fd = sockfd;
+    pfd.events = POLLRDNORM;
+    return WSAPoll(&pfd, 1, timeout_ms) > 0;
+#else
+    pollfd pfd{};
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+    while (true) {
+        int ready = ::poll(&pfd, 1, timeout_ms);
+        if (ready == SOCKET_ERROR && errno == EINTR) continue;
+        return ready > 0;
+    }
+#endif
+}
+
+bool set_recv_timeout(socket_t sockfd, int timeout_ms) {
+#ifdef _WIN32
+    DWORD tv = static_cast<DWORD>(timeout_ms);
+#else
+    timeval tv{};
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+#endif
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv)) == SOCKET_ERROR) {
+        spdlog::warn("Failed to set receive timeout: {}", get_error_message(get_last_error()));
+        return false;
+    }
+    return true;
+}
+
+size_t send_all_iov(socket_t sockfd, const std::vector<IoSlice>& slices) {
+    size_t total_len = 0;
+    for (const auto& slice : slices) total_len += slice.len;
+
+    size_t total_sent = 0;
+    size_t index = 0;   // first slice not fully sent
+    size_t offset = 0;  // bytes of slices[index] already sent
+    while (total_sent < total_len) {
+#ifdef _WIN32
+        std::vector<WSABUF> bufs;
+        for (size_t i = index; i < slices.size(); ++i) {
+            size_t skip = (i == index) ? offset : 0;
+            WSABUF b;
+            b.buf = const_cast<char*>(static_cast<const char*>(slices[i].data) + skip);
+            b.len = static_cast<ULONG>(slices[i].len - skip);
+            bufs.push_back(b);
+        }
+        DWORD sent_bytes = 0;
+        if (WSASend(sockfd, bufs.data(), static_cast<DWORD>(bufs.size()), &sent_bytes, 0, NULL, NULL) == SOCKET_ERROR) {
+            spdlog::error("WSASend failed: {}", get_error_message(get_last_error()));
+            break;
+        }
+        size_t sent = sent_bytes;
+#else
+        iovec iov[1024]; // IOV_MAX; on the stack, a gathered write allocates nothing
+        size_t iov_count = 0;
+        for (size_t i = index; i < slices.size() && iov_count < 1024; ++i) {
+            size_t skip = (i == index) ? offset : 0;
+            iov[iov_count++] = {const_cast<char*>(static_cast<const char*>(slices[i].data) + skip), slices[i].len - skip};
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+        ssize_t sent = ::sendmsg(sockfd, &msg, 0);
+        if (sent == SOCKET_ERROR) {
+            int err = get_last_error();
+            if (err == EINTR) continue;
+            spdlog::error("sendmsg failed: {}", get_error_message(err));
+            break;
+        }
+#endif
+        if (sent == 0) {
+            spdlog::warn("Connection closed by peer during send.");
+            break;
+        }
+        total_sent += static_cast<size_t>(sent);
+        // Advance past fully written slices
+        size_t remaining = static_cast<size_t>(sent);
+        while (index < slices.size() && remaining >= slices[index].len - offset) {
+            remaining -= slices[index].len - offset;
+            offset = 0;
+            ++index;
+        }
+        offset += remaining;
+    }
+    spdlog::debug("Gathered send of {} slices, {} bytes.", slices.size(), total_sent);
+    return total_sent;
+}
+
 #ifdef _WIN32
 void initialize_sockets() {
     WSADATA wsaData;
@@ -104,6 +220,10 @@ void close_socket(socket_t sock) {
     closesocket(sock); // Win32
 }
 
+void shutdown_socket(socket_t sock) {
+    shutdown(sock, SD_BOTH);
+}
+
 int get_last_error() {
     return WSAGetLastError();
 }
@@ -173,6 +293,10 @@ void close_socket(socket_t sock) {
     ::close(sock); // POSIX
 }
 
+void shutdown_socket(socket_t sock) {
+    ::shutdown(sock, SHUT_RDWR);
+}
+
 int get_last_error() {
     return errno;
 }
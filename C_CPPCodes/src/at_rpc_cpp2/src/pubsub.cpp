@@ -0,0 +1,213 @@
+// pubsub.cpp
+#include "pubsub.h"
+#include "response_writer.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+
+bool parse_slow_policy(const std::string& name, SlowSubscriberPolicy& policy) {
+    if (name == "conflate") {
+        policy = SlowSubscriberPolicy::Conflate;
+    } else if (name == "drop") {
+        policy = SlowSubscriberPolicy::Drop;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+PushSubscriber::PushSubscriber(size_t max_queued, Writer writer, OnDrop on_drop)
+    : max_queued_(std::max<size_t>(max_queued, 1)), writer_(std::move(writer)), on_drop_(std::move(on_drop)) {
+    sender_ = std::thread(&PushSubscriber::sender_loop, this);
+}
+
+PushSubscriber::~PushSubscriber() {
+    close();
+}
+
+PushSubscriber::Enqueued PushSubscriber::enqueue(uint64_t topic_id, const SharedFrame& frame, SlowSubscriberPolicy policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+        return Enqueued::Dropped;
+    }
+    if (policy == SlowSubscriberPolicy::Conflate) {
+        for (auto& item : queue_) {
+            if (item.topic_id == topic_id) {
+                item.frame = frame; // the older message of this topic is never sent
+                return Enqueued::Conflated;
+            }
+        }
+    }
+    if (queue_.size() >= max_queued_) {
+        // Hopelessly behind: cut it loose. on_drop runs under the lock so that
+        // close() cannot finish (and the connection go away) meanwhile.
+        closed_ = true;
+        queue_.clear();
+        ready_.notify_one();
+        if (on_drop_) {
+            on_drop_();
+        }
+        return Enqueued::Dropped;
+    }
+    queue_.push_back({topic_id, frame});
+    ready_.notify_one();
+    return Enqueued::Queued;
+}
+
+void PushSubscriber::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        queue_.clear();
+    }
+    ready_.notify_one();
+    if (sender_.joinable() && sender_.get_id() != std::this_thread::get_id()) {
+        sender_.join();
+    }
+}
+
+bool PushSubscriber::open() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !closed_;
+}
+
+void PushSubscriber::sender_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        ready_.wait(lock, [this]() { return !queue_.empty() || closed_; });
+        if (closed_) {
+            return;
+        }
+        SharedFrame frame = std::move(queue_.front().frame);
+        queue_.pop_front();
+        lock.unlock();
+        bool ok = writer_(*frame);
+        frame.reset();
+        lock.lock();
+        if (!ok) {
+            closed_ = true;
+            queue_.clear();
+            return;
+        }
+        sent_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void PubSubHub::subscribe(const std::string& topic, const std::shared_ptr<PushSubscriber>& subscriber,
+                          SlowSubscriberPolicy policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = topics_.find(topic);
+    if (it == topics_.end()) {
+        it = topics_.emplace(topic, Topic{next_topic_id_++, 1, {}}).first;
+    }
+    for (auto& sub : it->second.subscriptions) {
+        if (sub.key == subscriber.get()) {
+            sub.policy = policy; // re-subscribing changes the policy
+            return;
+        }
+    }
+    it->second.subscriptions.push_back({subscriber, subscriber.get(), policy});
+}
+
+bool PubSubHub::unsubscribe(const std::string& topic, const PushSubscriber* subscriber) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = topics_.find(topic);
+    if (it == topics_.end()) {
+        return false;
+    }
+    auto& subs = it->second.subscriptions;
+    auto end = std::remove_if(subs.begin(), subs.end(), [subscriber](const Subscription& s) { return s.key == subscriber; });
+    bool removed = end != subs.end();
+    subs.erase(end, subs.end());
+    if (subs.empty()) {
+        topics_.erase(it);
+    }
+    return removed;
+}
+
+size_t PubSubHub::publish(const std::string& topic, const json& data) {
+    // Encoding and queueing happen under the lock, so every subscriber of a
+    // topic sees its messages in seq order even with concurrent publishers;
+    // enqueue() never blocks, so the lock is held only briefly
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++published_;
+    auto it = topics_.find(topic);
+    if (it == topics_.end()) {
+        return 0;
+    }
+    Topic& entry = it->second;
+    uint32_t seq = entry.next_seq++;
+
+    std::string body = json{{"topic", topic}, {"seq", seq}, {"data", data}}.dump();
+    ResponseWriter writer;
+    std::memcpy(writer.binary(body.size()), body.data(), body.size());
+    SharedFrame frame = std::make_shared<const std::vector<uint8_t>>(writer.finish(ATProtocol::FLAG_PUSH, seq));
+
+    size_t reached = 0;
+    auto& subs = entry.subscriptions;
+    for (auto sub = subs.begin(); sub != subs.end();) {
+        std::shared_ptr<PushSubscriber> subscriber = sub->subscriber.lock();
+        PushSubscriber::Enqueued result = subscriber ? subscriber->enqueue(entry.id, frame, sub->policy)
+                                                     : PushSubscriber::Enqueued::Dropped;
+        if (result == PushSubscriber::Enqueued::Dropped) {
+            if (subscriber && sub->policy == SlowSubscriberPolicy::Drop) {
+                ++dropped_;
+                spdlog::warn("Dropped a slow subscriber of '{}'", topic);
+            }
+            sub = subs.erase(sub);
+            continue;
+        }
+        if (result == PushSubscriber::Enqueued::Conflated) {
+            ++conflated_;
+        }
+        ++reached;
+        ++sub;
+    }
+    deliveries_ += reached;
+    if (subs.empty()) {
+        topics_.erase(it);
+    }
+    return reached;
+}
+
+json PubSubHub::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {{"topics", topics_.size()}, {"published", published_}, {"deliveries", deliveries_},
+            {"conflated", conflated_}, {"dropped", dropped_}};
+}
+
+bool is_pubsub_method(std::string_view func) {
+    return func == "subscribe" || func == "unsubscribe" || func == "publish";
+}
+
+bool handle_pubsub_request(const std::string& func, const arena_json& request, PubSubHub& hub,
+                           const std::function<std::shared_ptr<PushSubscriber>()>& subscriber,
+                           ResponseWriter& response) {
+    try {
+        std::string topic = arena_at(request, "topic").get<std::string>();
+        if (topic.empty()) {
+            response.error("Empty topic");
+            return false;
+        }
+        if (func == "subscribe") {
+            std::string policy_name(request.value("policy", "conflate"));
+            SlowSubscriberPolicy policy;
+            if (!parse_slow_policy(policy_name, policy)) {
+                response.error("Unknown policy '" + policy_name + "' (conflate, drop)");
+                return false;
+            }
+            hub.subscribe(topic, subscriber(), policy);
+            response.success(arena_json{{"topic", topic}, {"policy", policy_name}});
+        } else if (func == "unsubscribe") {
+            response.success(arena_json(hub.unsubscribe(topic, subscriber().get())));
+        } else {
+            // Copied out of the arena: queued push frames outlive the request
+            auto data = request.find("data");
+            response.success(arena_json(hub.publish(topic, data != request.end() ? json(*data) : json())));
+        }
+        return true;
+    } catch (const json::exception&) {
+        response.error("Invalid arguments format");
+    }
+    return false;
+}
@@ -0,0 +1,90 @@
+// request_arena.cpp
+#include "request_arena.h"
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+std::atomic<uint64_t> g_chunks{0};
+std::atomic<int64_t> g_bytes{0};
+
+RequestArena& thread_arena() {
+    thread_local RequestArena arena;
+    return arena;
+}
+
+} // namespace
+
+RequestArena::~RequestArena() {
+    for (const Chunk& chunk : chunks_) {
+        g_bytes.fetch_sub(static_cast<int64_t>(chunk.size), std::memory_order_relaxed);
+        ::operator delete(chunk.data);
+    }
+}
+
+bool RequestArena::owns(const void* p) const {
+    const uint8_t* byte = static_cast<const uint8_t*>(p);
+    for (const Chunk& chunk : chunks_) {
+        if (byte >= chunk.data && byte < chunk.data + chunk.size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RequestArena::reset() {
+    if (chunks_.size() > 1) {
+        // Outgrew the first chunk: next time start with one that holds it all
+        size_t total = 0;
+        for (const Chunk& chunk : chunks_) {
+            total += chunk.size;
+            g_bytes.fetch_sub(static_cast<int64_t>(chunk.size), std::memory_order_relaxed);
+            ::operator delete(chunk.data);
+        }
+        chunks_.clear();
+        add_chunk(std::min(total, RETAIN_LIMIT));
+    } else if (!chunks_.empty() && chunks_.front().size > RETAIN_LIMIT) {
+        // One oversized request: do not keep its memory for every later one
+        g_bytes.fetch_sub(static_cast<int64_t>(chunks_.front().size), std::memory_order_relaxed);
+        ::operator delete(chunks_.front().data);
+        chunks_.clear();
+        add_chunk(RETAIN_LIMIT);
+    }
+    if (!chunks_.empty()) {
+        cursor_ = chunks_.front().data;
+        limit_ = cursor_ + chunks_.front().size;
+    }
+    used_ = 0;
+}
+
+void* RequestArena::allocate_slow(size_t size, size_t align) {
+    size_t next = chunks_.empty() ? CHUNK_SIZE : chunks_.back().size * 2;
+    add_chunk(std::max(next, size + align));
+    return allocate(size, align);
+}
+
+void RequestArena::add_chunk(size_t size) {
+    Chunk chunk{static_cast<uint8_t*>(::operator new(size)), size};
+    chunks_.push_back(chunk);
+    cursor_ = chunk.data;
+    limit_ = chunk.data + size;
+    g_chunks.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+json RequestArena::stats() {
+    return {{"chunks", g_chunks.load(std::memory_order_relaxed)}, {"bytes", g_bytes.load(std::memory_order_relaxed)}};
+}
+
+RequestArena::Scope::Scope() : owner_(current_ == nullptr) {
+    if (owner_) {
+        current_ = &thread_arena();
+    }
+}
+
+RequestArena::Scope::~Scope() {
+    if (owner_) {
+        current_->reset();
+        current_ = nullptr;
+    }
+}
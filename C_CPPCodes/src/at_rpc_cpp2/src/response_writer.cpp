@@ -0,0 +1,208 @@
+// response_writer.cpp
+#include "response_writer.h"
+#include "buffer_pool.h"
+#include "crc32.hpp"
+#include "lz_codec.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+ResponseWriter::ResponseWriter(std::vector<uint8_t> buffer) : frame_(std::move(buffer)) {
+    frame_.clear();
+    frame_.resize(ATProtocol::HEADER_SIZE); // patched by finish()
+}
+
+void ResponseWriter::success(double result) {
+    append(R"({"result":)");
+    append_number(result);
+    append(R"(,"status":"success"})");
+}
+
+void ResponseWriter::success(const double* results, size_t count) {
+    append(R"({"result":[)");
+    for (size_t i = 0; i < count; ++i) {
+        if (i) frame_.push_back(',');
+        append_number(results[i]);
+    }
+    append(R"(],"status":"success"})");
+}
+
+void ResponseWriter::success(const json& result) {
+    append(R"({"result":)");
+    append(result.dump());
+    append(R"(,"status":"success"})");
+}
+
+void ResponseWriter::success(const arena_json& result) {
+    append(R"({"result":)");
+    append(result.dump());
+    append(R"(,"status":"success"})");
+}
+
+void ResponseWriter::error(std::string_view message) {
+    append(R"({"message":)");
+    append_string(message);
+    append(R"(,"status":"error"})");
+}
+
+uint8_t* ResponseWriter::binary(size_t size) {
+    size_t offset = frame_.size();
+    reserve(offset + size);
+    frame_.resize(offset + size);
+    return frame_.data() + offset;
+}
+
+void ResponseWriter::to_msgpack() {
+    // The DOM lives in the request arena when one is active, the encoding in a pooled buffer
+    std::vector<uint8_t> packed = BufferPool::instance().acquire(frame_.size());
+    arena_json::to_msgpack(arena_json::parse(body()), packed);
+    frame_.resize(ATProtocol::HEADER_SIZE);
+    frame_.insert(frame_.end(), packed.begin(), packed.end());
+    BufferPool::instance().release(std::move(packed));
+}
+
+bool ResponseWriter::compress(size_t threshold) {
+    size_t body_size = frame_.size() - ATProtocol::HEADER_SIZE;
+    if (body_size < threshold) {
+        return false;
+    }
+    // Compressed into a pooled buffer that replaces the frame; the old one goes back to the pool
+    std::vector<uint8_t> packed = BufferPool::instance().acquire(ATProtocol::HEADER_SIZE + body_size);
+    packed.resize(ATProtocol::HEADER_SIZE);
+    if (!lz_compress_body(frame_.data() + ATProtocol::HEADER_SIZE, body_size, packed)) {
+        BufferPool::instance().release(std::move(packed));
+        return false;
+    }
+    frame_.swap(packed);
+    BufferPool::instance().release(std::move(packed));
+    return true;
+}
+
+std::vector<uint8_t> ResponseWriter::finish(uint16_t flags, uint32_t sequence) {
+    const uint8_t* body_data = frame_.data() + ATProtocol::HEADER_SIZE;
+    size_t body_size = frame_.size() - ATProtocol::HEADER_SIZE;
+
+    ATHeader header{};
+    header.protocol_id = ATProtocol::PROTOCOL_ID;
+    header.flags = flags;
+    header.sequence = sequence;
+    header.body_length = static_cast<uint32_t>(body_size);
+    // A frame to be sealed gets a GCM tag instead (FrameCipher::seal)
+    header.hash_value = flags & ATProtocol::FLAG_SEALED ? 0 : crc32::calculate(body_data, body_size);
+    header.pack_into(frame_.data());
+    return std::move(frame_);
+}
+
+std::string_view ResponseWriter::body() const {
+    return std::string_view(reinterpret_cast<const char*>(frame_.data()) + ATProtocol::HEADER_SIZE,
+                            frame_.size() - ATProtocol::HEADER_SIZE);
+}
+
+void ResponseWriter::append(std::string_view text) {
+    if (frame_.capacity() - frame_.size() < text.size()) {
+        reserve(std::max(frame_.size() + text.size(), frame_.capacity() * 2));
+    }
+    frame_.insert(frame_.end(), text.begin(), text.end());
+}
+
+void ResponseWriter::reserve(size_t size) {
+    if (frame_.capacity() >= size) {
+        return;
+    }
+    std::vector<uint8_t> grown = BufferPool::instance().acquire(size);
+    grown.assign(frame_.begin(), frame_.end());
+    frame_.swap(grown);
+    BufferPool::instance().release(std::move(grown));
+}
+
+// Shortest round-trip digits from std::to_chars, laid out the way nlohmann's
+// dump() does: fixed notation for decimal exponents in (-4, 15], always with a
+// fraction (1 -> 1.0), otherwise d.ddde+XX
+void ResponseWriter::append_number(double value) {
+    if (!std::isfinite(value)) {
+        append("null");
+        return;
+    }
+    char sci[32];
+    auto res = std::to_chars(sci, sci + sizeof(sci), value, std::chars_format::scientific);
+    std::string_view text(sci, static_cast<size_t>(res.ptr - sci));
+
+    char digits[24];
+    size_t k = 0;
+    size_t pos = 0;
+    bool negative = text[0] == '-';
+    if (negative) ++pos;
+    for (; pos < text.size() && text[pos] != 'e'; ++pos) {
+        if (text[pos] != '.') digits[k++] = text[pos];
+    }
+    int exponent = 0;
+    std::from_chars(text.data() + pos + 1 + (text[pos + 1] == '+'), text.data() + text.size(), exponent);
+    int n = exponent + 1; // position of the decimal point relative to the digits
+    int len = static_cast<int>(k);
+
+    char out[48];
+    char* p = out;
+    if (negative) *p++ = '-';
+    if (len <= n && n <= 15) {
+        std::memcpy(p, digits, k);
+        p += k;
+        std::memset(p, '0', static_cast<size_t>(n - len));
+        p += n - len;
+        *p++ = '.';
+        *p++ = '0';
+    } else if (0 < n && n <= 15) {
+        std::memcpy(p, digits, static_cast<size_t>(n));
+        p += n;
+        *p++ = '.';
+        std::memcpy(p, digits + n, static_cast<size_t>(len - n));
+        p += len - n;
+    } else if (-4 < n && n <= 0) {
+        *p++ = '0';
+        *p++ = '.';
+        std::memset(p, '0', static_cast<size_t>(-n));
+        p += -n;
+        std::memcpy(p, digits, k);
+        p += k;
+    } else {
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            std::memcpy(p, digits + 1, k - 1);
+            p += k - 1;
+        }
+        *p++ = 'e';
+        *p++ = exponent < 0 ? '-' : '+';
+        int e = exponent < 0 ? -exponent : exponent;
+        if (e < 10) *p++ = '0';
+        p = std::to_chars(p, out + sizeof(out), e).ptr;
+    }
+    append(std::string_view(out, static_cast<size_t>(p - out)));
+}
+
+// JSON string with dump()'s escaping; UTF-8 passes through unchanged
+void ResponseWriter::append_string(std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    frame_.push_back('"');
+    for (char ch : text) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        switch (c) {
+            case '"':  append(R"(\")"); break;
+            case '\\': append(R"(\\)"); break;
+            case '\b': append(R"(\b)"); break;
+            case '\f': append(R"(\f)"); break;
+            case '\n': append(R"(\n)"); break;
+            case '\r': append(R"(\r)"); break;
+            case '\t': append(R"(\t)"); break;
+            default:
+                if (c < 0x20) {
+                    char escaped[6] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xF]};
+                    append(std::string_view(escaped, sizeof(escaped)));
+                } else {
+                    frame_.push_back(c);
+                }
+        }
+    }
+    frame_.push_back('"');
+}
@@ -0,0 +1,159 @@
+// rpc_capture.cpp
+#include "rpc_capture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <spdlog/spdlog.h>
+
+#include "rpc_metrics.h" // metrics_now_ns()
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+size_t align_up(size_t n) {
+    return (n + CaptureWriter::ALIGNMENT - 1) & ~(CaptureWriter::ALIGNMENT - 1);
+}
+} // namespace
+
+CaptureWriter::~CaptureWriter() {
+    close();
+}
+
+bool CaptureWriter::open(const std::string& path, size_t capacity) {
+    close();
+#ifdef _WIN32
+    spdlog::error("Traffic capture is only supported on POSIX systems");
+    (void)path;
+    (void)capacity;
+    return false;
+#else
+    capacity = std::max(align_up(capacity), sizeof(CaptureFileHeader) + sizeof(CaptureRecordHeader));
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        spdlog::error("Cannot create capture file {}: {}", path, std::strerror(errno));
+        return false;
+    }
+    // ftruncate zero-fills, so an unwritten record length reads as the end marker
+    if (::ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+        spdlog::error("Cannot size capture file {} to {} bytes: {}", path, capacity, std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    void* mapped = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        spdlog::error("Cannot map capture file {}: {}", path, std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    path_ = path;
+    fd_ = fd;
+    capacity_ = capacity;
+    start_ns_ = metrics_now_ns();
+    auto* base = static_cast<uint8_t*>(mapped);
+    CaptureFileHeader header{FILE_MAGIC, FILE_VERSION, static_cast<uint32_t>(ALIGNMENT), 0, 0, start_ns_};
+    std::memcpy(base, &header, sizeof(header));
+    offset_.store(sizeof(header), std::memory_order_relaxed);
+    frames_.store(0, std::memory_order_relaxed);
+    dropped_.store(0, std::memory_order_relaxed);
+    base_.store(base, std::memory_order_release);
+    spdlog::info("Capturing incoming frames to {} ({} MB)", path, capacity / (1024 * 1024));
+    return true;
+#endif
+}
+
+void CaptureWriter::append(uint32_t conn_id, uint64_t arrival_ns, const uint8_t* frame, size_t length) {
+    writers_.fetch_add(1);
+    uint8_t* base = base_.load();
+    if (base == nullptr) {
+        writers_.fetch_sub(1);
+        return;
+    }
+    size_t total = align_up(sizeof(CaptureRecordHeader) + length);
+    size_t offset = offset_.fetch_add(total, std::memory_order_relaxed);
+    if (offset + total > capacity_ || length > UINT32_MAX) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        writers_.fetch_sub(1);
+        return;
+    }
+
+    auto* record = reinterpret_cast<CaptureRecordHeader*>(base + offset);
+    record->ts_ns = arrival_ns > start_ns_ ? arrival_ns - start_ns_ : 0;
+    record->conn_id = conn_id;
+    std::memcpy(base + offset + sizeof(CaptureRecordHeader), frame, length);
+    // Publish: a reader stops at the first zero length
+    std::atomic_thread_fence(std::memory_order_release);
+    record->length = static_cast<uint32_t>(length);
+
+    frames_.fetch_add(1, std::memory_order_relaxed);
+    writers_.fetch_sub(1);
+}
+
+void CaptureWriter::close() {
+#ifndef _WIN32
+    uint8_t* base = base_.exchange(nullptr);
+    if (base == nullptr) {
+        return;
+    }
+    while (writers_.load() > 0) {
+        std::this_thread::yield();
+    }
+    size_t used = std::min(offset_.load(std::memory_order_relaxed), capacity_);
+    reinterpret_cast<CaptureFileHeader*>(base)->data_end = used;
+    ::munmap(base, capacity_);
+    // Keep one zeroed record header as the end marker when there is room
+    size_t keep = std::min(used + sizeof(CaptureRecordHeader), capacity_);
+    if (::ftruncate(fd_, static_cast<off_t>(keep)) != 0) {
+        spdlog::warn("Cannot shrink capture file {}: {}", path_, std::strerror(errno));
+    }
+    ::close(fd_);
+    fd_ = -1;
+    spdlog::info("Capture {} closed: {} frames, {} dropped, {} bytes",
+                 path_, frames(), dropped(), used);
+#endif
+}
+
+bool read_capture(const std::string& path, std::vector<CapturedFrame>& frames) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        spdlog::error("Cannot open capture file {}", path);
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CaptureFileHeader header{};
+    if (data.size() < sizeof(header)) {
+        spdlog::error("{} is not an AT capture file", path);
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != CaptureWriter::FILE_MAGIC || header.version != CaptureWriter::FILE_VERSION ||
+        header.alignment == 0 || (header.alignment & (header.alignment - 1)) != 0) {
+        spdlog::error("{} is not an AT capture file", path);
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    size_t end = header.data_end != 0 ? std::min<size_t>(header.data_end, data.size()) : data.size();
+    while (offset + sizeof(CaptureRecordHeader) <= end) {
+        CaptureRecordHeader record{};
+        std::memcpy(&record, data.data() + offset, sizeof(record));
+        size_t payload = offset + sizeof(CaptureRecordHeader);
+        if (record.length == 0 || payload + record.length > end) {
+            break; // end marker, a record still being written at crash time, or truncation
+        }
+        frames.push_back({record.ts_ns, record.conn_id,
+                          std::vector<uint8_t>(data.begin() + payload, data.begin() + payload + record.length)});
+        offset += (sizeof(CaptureRecordHeader) + record.length + header.alignment - 1) & ~size_t(header.alignment - 1);
+    }
+    // Records are reserved in arrival order, but threads may stamp them slightly out of order
+    std::stable_sort(frames.begin(), frames.end(),
+                     [](const CapturedFrame& a, const CapturedFrame& b) { return a.ts_ns < b.ts_ns; });
+    spdlog::info("Loaded {} frames from {}", frames.size(), path);
+    return true;
+}
@@ -0,0 +1,458 @@
+// rpc_connection.cpp
+#include "rpc_connection.h"
+#include "frame_cipher.h"
+#include "lz_codec.h"
+
+#include <chrono>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+RPCConnection::RPCConnection(const std::string& host, int port)
+    : host_(host), port_(port), sock_(INVALID_SOCKET), connected_(false) {}
+
+RPCConnection::~RPCConnection() {
+    close();
+}
+
+bool RPCConnection::connect() {
+    if (is_connected()) return true;
+    close(); // reap a previous session that ended on its own
+
+    initialize_sockets();
+    sock_ = create_socket();
+    if (sock_ == INVALID_SOCKET) {
+        return false;
+    }
+    if (!connect_socket(sock_, host_, port_)) {
+        spdlog::warn("Failed to connect to {}:{}", host_, port_);
+        close_socket(sock_);
+        sock_ = INVALID_SOCKET;
+        return false;
+    }
+    if (!key_.empty() && !handshake()) {
+        close_socket(sock_);
+        sock_ = INVALID_SOCKET;
+        return false;
+    }
+    connected_.store(true, std::memory_order_release);
+    reader_ = std::thread(&RPCConnection::reader_loop, this);
+    spdlog::info("Connected to {}:{}", host_, port_);
+    return true;
+}
+
+void RPCConnection::enable_encryption(const std::vector<uint8_t>& key) {
+    FrameCipher check(key, FrameCipher::Role::Client); // throws for a bad key or a build without Crypto++
+    key_ = key;
+}
+
+// Salts are exchanged before the reader starts, so a server without the key (or
+// without sealed frames, which ignores the hello) fails connect() rather than
+// every call
+bool RPCConnection::handshake() {
+    static constexpr int HANDSHAKE_TIMEOUT_MS = 5000;
+    cipher_ = std::make_unique<FrameCipher>(key_, FrameCipher::Role::Client);
+    std::vector<uint8_t> hello = cipher_->client_hello();
+    std::vector<uint8_t> reply(ATProtocol::HEADER_SIZE + FrameCipher::SALT_SIZE + FrameCipher::TAG_SIZE);
+    set_recv_timeout(sock_, HANDSHAKE_TIMEOUT_MS);
+    bool ok = send_all(sock_, hello) == hello.size() && recv_all(sock_, reply, reply.size()) == reply.size() &&
+              cipher_->finish_hello(reply.data(), reply.size());
+    set_recv_timeout(sock_, 0);
+    if (!ok) {
+        spdlog::warn("Encryption handshake with {}:{} failed (server without sealed frames, or another key)", host_, port_);
+        cipher_.reset();
+    }
+    return ok;
+}
+
+void RPCConnection::enable_compression(size_t threshold) {
+    compress_threshold_ = threshold;
+}
+
+void RPCConnection::close() {
+    if (connected_.exchange(false)) {
+        // Wakes the reader blocked in recv
+#ifdef _WIN32
+        ::shutdown(sock_, SD_BOTH);
+#else
+        ::shutdown(sock_, SHUT_RDWR);
+#endif
+    }
+    if (reader_.joinable()) {
+        reader_.join();
+    }
+    {
+        // Writers check connected_ under this lock, so the descriptor cannot be reused under them
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        if (sock_ != INVALID_SOCKET) {
+            close_socket(sock_);
+            sock_ = INVALID_SOCKET;
+        }
+    }
+    fail_all("Connection closed");
+}
+
+RPCConnection::PendingCall RPCConnection::call_async(const std::string& func, const std::vector<double>& args) {
+    auto promise = std::make_shared<std::promise<json>>();
+    std::future<json> result = promise->get_future();
+    uint32_t sequence = call_async(func, args, [promise](json&& response, std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(std::move(response));
+        }
+    });
+    return {sequence, std::move(result)};
+}
+
+uint32_t RPCConnection::call_async(const std::string& func, const std::vector<double>& args, Completion on_done) {
+    return request_async(json{{"func", func}, {"args", args}}, std::move(on_done));
+}
+
+uint32_t RPCConnection::request_async(const json& request, Completion on_done) {
+    std::string request_body = request.dump();
+    return submit(ATProtocol::FLAG_REQUEST, reinterpret_cast<const uint8_t*>(request_body.data()), request_body.size(),
+                  std::move(on_done));
+}
+
+json RPCConnection::request(const json& request, int timeout_ms) {
+    auto promise = std::make_shared<std::promise<json>>();
+    std::future<json> future = promise->get_future();
+    uint32_t sequence = request_async(request, [promise](json&& response, std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(std::move(response));
+        }
+    });
+    if (future.wait_for(std::chrono::milliseconds(timeout_ms)) != std::future_status::ready) {
+        cancel(sequence);
+        throw RPCTransportError("Timeout waiting for response (Seq: " + std::to_string(sequence) + ")");
+    }
+    return future.get();
+}
+
+uint32_t RPCConnection::call_bulk_async(const std::vector<uint8_t>& body, Completion on_done) {
+    if (body.size() > MAX_BODY_LENGTH) {
+        // The server would drop the connection over it
+        throw std::invalid_argument("Bulk request of " + std::to_string(body.size()) + " bytes exceeds the " +
+                                    std::to_string(MAX_BODY_LENGTH) + " byte frame limit");
+    }
+    return submit(ATProtocol::FLAG_REQUEST | ATProtocol::FLAG_BINARY, body.data(), body.size(), std::move(on_done));
+}
+
+BulkResult RPCConnection::call_bulk(const std::vector<uint8_t>& body, int timeout_ms) {
+    auto promise = std::make_shared<std::promise<json>>();
+    std::future<json> future = promise->get_future();
+    uint32_t sequence = call_bulk_async(body, [promise](json&& response, std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(std::move(response));
+        }
+    });
+    if (future.wait_for(std::chrono::milliseconds(timeout_ms)) != std::future_status::ready) {
+        cancel(sequence);
+        throw RPCTransportError("Timeout waiting for response (Seq: " + std::to_string(sequence) + ")");
+    }
+    json response = future.get();
+    BulkResult result;
+    if (!response.is_binary() || !decode_bulk_response(response.get_binary().data(), response.get_binary().size(), result)) {
+        throw std::runtime_error("Invalid bulk response format");
+    }
+    return result;
+}
+
+uint32_t RPCConnection::call_typed_async(const std::vector<uint8_t>& body, Completion on_done) {
+    if (body.size() > MAX_BODY_LENGTH) {
+        throw std::invalid_argument("Typed request of " + std::to_string(body.size()) + " bytes exceeds the " +
+                                    std::to_string(MAX_BODY_LENGTH) + " byte frame limit");
+    }
+    return submit(ATProtocol::FLAG_REQUEST | ATProtocol::FLAG_TYPED, body.data(), body.size(), std::move(on_done));
+}
+
+std::vector<uint8_t> RPCConnection::call_typed(const std::vector<uint8_t>& body, int timeout_ms) {
+    auto promise = std::make_shared<std::promise<json>>();
+    std::future<json> future = promise->get_future();
+    uint32_t sequence = call_typed_async(body, [promise](json&& response, std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(std::move(response));
+        }
+    });
+    if (future.wait_for(std::chrono::milliseconds(timeout_ms)) != std::future_status::ready) {
+        cancel(sequence);
+        throw RPCTransportError("Timeout waiting for response (Seq: " + std::to_string(sequence) + ")");
+    }
+    json response = future.get();
+    if (!response.is_binary()) {
+        throw std::runtime_error("Invalid typed response format");
+    }
+    return std::move(response.get_binary());
+}
+
+uint32_t RPCConnection::submit(uint16_t flags, const uint8_t* body, size_t body_size, Completion on_done) {
+    uint32_t sequence = protocol_.get_next_sequence();
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_[sequence] = std::move(on_done);
+    }
+
+    PooledBuffer packed;
+    if (compress_threshold_ > 0) {
+        flags |= ATProtocol::FLAG_ACCEPTS_COMPRESSED;
+        if (body_size >= compress_threshold_) {
+            packed = PooledBuffer(body_size);
+            if (lz_compress_body(body, body_size, *packed)) {
+                flags |= ATProtocol::FLAG_COMPRESSED; // compressed before sealing: ciphertext does not compress
+                body = packed.data();
+                body_size = packed.size();
+            }
+        }
+    }
+    if (!key_.empty()) {
+        flags |= ATProtocol::FLAG_SEALED; // no CRC, room for the tag
+    }
+    // Recycled, with room for the GCM tag: no allocation per request once the pool is warm
+    PooledBuffer request_packet(ATProtocol::HEADER_SIZE + body_size + ATProtocol::SEAL_TAG_SIZE);
+    protocol_.pack_into(*request_packet, flags, body, body_size, sequence);
+    if (batch_max_calls_ > 1) {
+        enqueue_batched(sequence, std::move(request_packet));
+        return sequence;
+    }
+
+    bool sent = false;
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        if (is_connected()) {
+            if (cipher_) {
+                cipher_->seal(*request_packet); // under the write lock: nonces count frames in wire order
+            }
+            sent = send_all(sock_, *request_packet) == request_packet.size();
+            writes_.fetch_add(1, std::memory_order_relaxed);
+            frames_sent_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (!sent) {
+        fail_call(sequence, "Failed to send request to " + host_ + ":" + std::to_string(port_));
+    }
+    return sequence;
+}
+
+void RPCConnection::fail_call(uint32_t sequence, const std::string& reason) {
+    Completion failed;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        auto it = pending_.find(sequence);
+        if (it != pending_.end()) {
+            failed = std::move(it->second);
+            pending_.erase(it);
+        }
+    }
+    if (failed) {
+        failed(json(), std::make_exception_ptr(RPCTransportError(reason)));
+    }
+}
+
+// --- Micro-batching ---
+
+void RPCConnection::enable_batching(std::chrono::microseconds window, size_t max_calls) {
+    std::lock_guard<std::mutex> lock(batch_mutex_);
+    batch_window_ = window;
+    batch_max_calls_ = max_calls;
+    batch_.reserve(max_calls);
+}
+
+void RPCConnection::enqueue_batched(uint32_t sequence, PooledBuffer&& packet) {
+    std::unique_lock<std::mutex> lock(batch_mutex_);
+    bool leader = batch_.empty();
+    batch_.push_back({sequence, std::move(packet)});
+
+    if (batch_.size() >= batch_max_calls_) {
+        flush_batch(lock);
+    } else if (leader) {
+        // The first caller owns the window; a full batch flushed by someone else ends it early
+        uint64_t generation = batch_generation_;
+        batch_cv_.wait_for(lock, batch_window_, [&] { return batch_generation_ != generation; });
+        if (batch_generation_ == generation) {
+            flush_batch(lock);
+        }
+    }
+}
+
+void RPCConnection::flush_batch(std::unique_lock<std::mutex>& lock) {
+    std::vector<BatchedFrame> frames;
+    frames.swap(batch_);
+    batch_.reserve(batch_max_calls_);
+    ++batch_generation_;
+    batch_cv_.notify_all();
+    lock.unlock();
+
+    std::vector<IoSlice> slices;
+    slices.reserve(frames.size());
+    size_t total = 0;
+    bool sent = false;
+    {
+        std::lock_guard<std::mutex> write_lock(write_mutex_);
+        for (auto& frame : frames) {
+            if (cipher_ && is_connected()) {
+                cipher_->seal(*frame.packet); // in write order, as in submit()
+            }
+            slices.push_back({frame.packet.data(), frame.packet.size()});
+            total += frame.packet.size();
+        }
+        if (is_connected()) {
+            sent = send_all_iov(sock_, slices) == total;
+            writes_.fetch_add(1, std::memory_order_relaxed);
+            frames_sent_.fetch_add(frames.size(), std::memory_order_relaxed);
+        }
+    }
+    if (!sent) {
+        for (const auto& frame : frames) {
+            fail_call(frame.sequence, "Failed to send request batch to " + host_ + ":" + std::to_string(port_));
+        }
+    }
+    spdlog::debug("Flushed batch of {} requests ({} bytes)", frames.size(), total);
+}
+
+json RPCConnection::call(const std::string& func, const std::vector<double>& args, int timeout_ms) {
+    PendingCall pending = call_async(func, args);
+    if (pending.result.wait_for(std::chrono::milliseconds(timeout_ms)) != std::future_status::ready) {
+        cancel(pending.sequence);
+        throw RPCTransportError("Timeout waiting for response (Seq: " + std::to_string(pending.sequence) + ")");
+    }
+    return pending.result.get();
+}
+
+bool RPCConnection::cancel(uint32_t sequence) {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    return pending_.erase(sequence) > 0; // an abandoned future reports broken_promise if anyone still waits
+}
+
+size_t RPCConnection::outstanding() const {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    return pending_.size();
+}
+
+void RPCConnection::fail_all(const std::string& reason) {
+    std::unordered_map<uint32_t, Completion> failed;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        failed.swap(pending_);
+    }
+    // Callbacks run outside the lock: they may issue new calls
+    for (auto& entry : failed) {
+        entry.second(json(), std::make_exception_ptr(RPCTransportError(reason)));
+    }
+}
+
+void RPCConnection::set_push_handler(PushHandler handler) {
+    std::lock_guard<std::mutex> lock(push_mutex_);
+    on_push_ = std::move(handler);
+}
+
+void RPCConnection::dispatch_push(uint32_t sequence, std::string_view body) {
+    PushHandler handler;
+    {
+        std::lock_guard<std::mutex> lock(push_mutex_);
+        handler = on_push_; // a copy, so the handler may replace itself
+    }
+    if (!handler) {
+        spdlog::debug("Dropping push {} without a push handler", sequence);
+        return;
+    }
+    try {
+        json push = json::parse(body);
+        handler(push.at("topic").get<std::string>(), sequence, std::move(push.at("data")));
+    } catch (const json::exception& e) {
+        spdlog::error("Invalid push frame {}: {}", sequence, e.what());
+    }
+}
+
+void RPCConnection::reader_loop() {
+    uint8_t header_buffer[ATProtocol::HEADER_SIZE];
+    while (is_connected()) {
+        if (recv_all(sock_, header_buffer, ATProtocol::HEADER_SIZE) != ATProtocol::HEADER_SIZE) {
+            break;
+        }
+        ATHeader header;
+        header.unpack(header_buffer, ATProtocol::HEADER_SIZE);
+        if (header.protocol_id != ATProtocol::PROTOCOL_ID || header.body_length > MAX_BODY_LENGTH) {
+            spdlog::error("Invalid response header from {}:{} (id 0x{:04X}, len {})",
+                          host_, port_, header.protocol_id, header.body_length);
+            break;
+        }
+
+        // Header and body land in one recycled buffer; the body is parsed in place
+        PooledBuffer packet(ATProtocol::HEADER_SIZE + header.body_length);
+        packet->resize(ATProtocol::HEADER_SIZE + header.body_length);
+        std::memcpy(packet.data(), header_buffer, ATProtocol::HEADER_SIZE);
+        if (recv_all(sock_, packet.data() + ATProtocol::HEADER_SIZE, header.body_length) != header.body_length) {
+            break;
+        }
+        size_t size = packet.size();
+        if (cipher_ && !cipher_->open(packet.data(), size)) {
+            spdlog::error("Frame from {}:{} failed to authenticate", host_, port_);
+            break;
+        }
+
+        uint16_t flags;
+        uint32_t sequence;
+        std::string_view body;
+        if (!protocol_.unpack(packet.data(), size, flags, sequence, body)) {
+            break;
+        }
+        std::string inflated;
+        if (flags & ATProtocol::FLAG_COMPRESSED) {
+            if (!lz_decompress_body(reinterpret_cast<const uint8_t*>(body.data()), body.size(), MAX_BODY_LENGTH, inflated)) {
+                spdlog::error("Malformed compressed body from {}:{} (seq {})", host_, port_, sequence);
+                break;
+            }
+            body = inflated;
+        }
+
+        if (flags & ATProtocol::FLAG_PUSH) {
+            // Not an answer: the sequence is the topic's message number
+            dispatch_push(sequence, body);
+            continue;
+        }
+
+        Completion on_done;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            auto it = pending_.find(sequence);
+            if (it == pending_.end()) {
+                spdlog::debug("Dropping response for cancelled or unknown seq {}", sequence);
+                continue;
+            }
+            on_done = std::move(it->second);
+            pending_.erase(it);
+        }
+
+        json response_json;
+        std::exception_ptr error;
+        if ((flags & (ATProtocol::FLAG_BINARY | ATProtocol::FLAG_TYPED)) && !(flags & ATProtocol::FLAG_ERROR)) {
+            on_done(json::binary(std::vector<uint8_t>(body.begin(), body.end())), error);
+            continue;
+        }
+        try {
+            if (flags & ATProtocol::FLAG_MSGPACK) {
+                response_json = json::from_msgpack(body.data(), body.data() + body.size());
+            } else {
+                response_json = json::parse(body);
+            }
+            if (flags & ATProtocol::FLAG_ERROR || response_json.value("status", "") == "error") {
+                std::string msg = response_json.value("message", "Unknown remote error");
+                error = std::make_exception_ptr(std::runtime_error("Remote Error: " + msg));
+            }
+        } catch (const json::exception& e) {
+            spdlog::error("Failed to parse response JSON: {}", e.what());
+            error = std::make_exception_ptr(std::runtime_error("Invalid response format"));
+        }
+        on_done(std::move(response_json), error);
+    }
+
+    connected_.store(false, std::memory_order_release);
+    fail_all("Connection to " + host_ + ":" + std::to_string(port_) + " lost");
+    spdlog::info("Disconnected from {}:{}", host_, port_);
+}
@@ -0,0 +1,226 @@
+// rpc_metrics.cpp
+#include "rpc_metrics.h"
+
+#include <sstream>
+#include <spdlog/spdlog.h>
+
+uint64_t LatencyHistogram::percentile_ns(double q) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+    uint64_t target = static_cast<uint64_t>(q * static_cast<double>(total));
+    if (target >= total) target = total - 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += bucket_count(i);
+        if (seen > target) return bucket_upper_ns(i);
+    }
+    return bucket_upper_ns(BUCKETS - 1);
+}
+
+MethodMetrics* RPCMetrics::find(const std::string& name, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (methods_[i].name == name) return &methods_[i];
+    }
+    return nullptr;
+}
+
+MethodMetrics& RPCMetrics::method(const std::string& name) {
+    // Fast path: slots [0, count) are immutable once published
+    size_t count = method_count_.load(std::memory_order_acquire);
+    if (MethodMetrics* m = find(name, count)) return *m;
+
+    std::lock_guard<std::mutex> lock(register_mutex_);
+    count = method_count_.load(std::memory_order_relaxed);
+    if (MethodMetrics* m = find(name, count)) return *m;
+
+    if (count == MAX_METHODS - 1) {
+        // Reserve the last slot for everything that did not fit
+        methods_[count].name = OVERFLOW_METHOD;
+        method_count_.store(count + 1, std::memory_order_release);
+        spdlog::warn("Metrics method table full, folding '{}' and later methods into '{}'", name, OVERFLOW_METHOD);
+        return methods_[count];
+    }
+    if (count == MAX_METHODS) {
+        return methods_[MAX_METHODS - 1];
+    }
+
+    methods_[count].name = name;
+    method_count_.store(count + 1, std::memory_order_release);
+    return methods_[count];
+}
+
+namespace {
+json histogram_to_json(const LatencyHistogram& h) {
+    uint64_t count = h.count();
+    return {
+        {"count", count},
+        {"avg_ns", count ? h.sum_ns() / count : 0},
+        {"p50_ns", h.percentile_ns(0.50)},
+        {"p90_ns", h.percentile_ns(0.90)},
+        {"p99_ns", h.percentile_ns(0.99)},
+        {"p999_ns", h.percentile_ns(0.999)}
+    };
+}
+
+void histogram_to_prometheus(std::ostringstream& out, const std::string& method,
+                             const char* stage, const LatencyHistogram& h) {
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        cumulative += h.bucket_count(i);
+        out << "at_rpc_latency_seconds_bucket{method=\"" << method << "\",stage=\"" << stage
+            << "\",le=\"" << static_cast<double>(LatencyHistogram::bucket_upper_ns(i)) / 1e9 << "\"} "
+            << cumulative << "\n";
+    }
+    out << "at_rpc_latency_seconds_bucket{method=\"" << method << "\",stage=\"" << stage
+        << "\",le=\"+Inf\"} " << h.count() << "\n";
+    out << "at_rpc_latency_seconds_sum{method=\"" << method << "\",stage=\"" << stage << "\"} "
+        << static_cast<double>(h.sum_ns()) / 1e9 << "\n";
+    out << "at_rpc_latency_seconds_count{method=\"" << method << "\",stage=\"" << stage << "\"} "
+        << h.count() << "\n";
+}
+} // namespace
+
+json RPCMetrics::to_json() const {
+    json methods = json::object();
+    size_t count = method_count_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        const MethodMetrics& m = methods_[i];
+        methods[m.name] = {
+            {"calls", m.calls.load(std::memory_order_relaxed)},
+            {"errors", m.errors.load(std::memory_order_relaxed)},
+            {"bytes_in", m.bytes_in.load(std::memory_order_relaxed)},
+            {"bytes_out", m.bytes_out.load(std::memory_order_relaxed)},
+            {"queue_wait", histogram_to_json(m.queue_wait)},
+            {"handler", histogram_to_json(m.handler)},
+            {"send", histogram_to_json(m.send)}
+        };
+    }
+    return {
+        {"connections", connections.load(std::memory_order_relaxed)},
+        {"connections_total", connections_total.load(std::memory_order_relaxed)},
+        {"queue_depth", queue_depth.load(std::memory_order_relaxed)},
+        {"responses", responses.load(std::memory_order_relaxed)},
+        {"response_writes", response_writes.load(std::memory_order_relaxed)},
+        {"rx_buffer_bytes", rx_buffer_bytes.load(std::memory_order_relaxed)},
+        {"rx_quota_stalls", rx_quota_stalls.load(std::memory_order_relaxed)},
+        {"methods", methods}
+    };
+}
+
+std::string RPCMetrics::to_prometheus() const {
+    std::ostringstream out;
+    size_t count = method_count_.load(std::memory_order_acquire);
+
+    out << "# HELP at_rpc_connections Currently open client connections.\n"
+        << "# TYPE at_rpc_connections gauge\n"
+        << "at_rpc_connections " << connections.load(std::memory_order_relaxed) << "\n"
+        << "# HELP at_rpc_connections_total Accepted client connections.\n"
+        << "# TYPE at_rpc_connections_total counter\n"
+        << "at_rpc_connections_total " << connections_total.load(std::memory_order_relaxed) << "\n"
+        << "# HELP at_rpc_queue_depth Requests received but not yet answered.\n"
+        << "# TYPE at_rpc_queue_depth gauge\n"
+        << "at_rpc_queue_depth " << queue_depth.load(std::memory_order_relaxed) << "\n"
+        << "# HELP at_rpc_responses_total Response frames sent.\n"
+        << "# TYPE at_rpc_responses_total counter\n"
+        << "at_rpc_responses_total " << responses.load(std::memory_order_relaxed) << "\n"
+        << "# HELP at_rpc_response_writes_total Send calls carrying response frames (coalesced).\n"
+        << "# TYPE at_rpc_response_writes_total counter\n"
+        << "at_rpc_response_writes_total " << response_writes.load(std::memory_order_relaxed) << "\n"
+        << "# HELP at_rpc_rx_buffer_bytes Receive buffer memory committed across connections.\n"
+        << "# TYPE at_rpc_rx_buffer_bytes gauge\n"
+        << "at_rpc_rx_buffer_bytes " << rx_buffer_bytes.load(std::memory_order_relaxed) << "\n"
+        << "# HELP at_rpc_rx_quota_stalls_total Reads paused because the global memory quota was exhausted.\n"
+        << "# TYPE at_rpc_rx_quota_stalls_total counter\n"
+        << "at_rpc_rx_quota_stalls_total " << rx_quota_stalls.load(std::memory_order_relaxed) << "\n";
+
+    struct Counter { const char* metric; const char* help; std::atomic<uint64_t> MethodMetrics::*field; };
+    static const Counter counters[] = {
+        {"at_rpc_calls_total", "RPC calls per method.", &MethodMetrics::calls},
+        {"at_rpc_errors_total", "RPC calls answered with an error.", &MethodMetrics::errors},
+        {"at_rpc_bytes_in_total", "Request bytes received, header included.", &MethodMetrics::bytes_in},
+        {"at_rpc_bytes_out_total", "Response bytes sent, header included.", &MethodMetrics::bytes_out},
+    };
+    for (const Counter& c : counters) {
+        out << "# HELP " << c.metric << " " << c.help << "\n"
+            << "# TYPE " << c.metric << " counter\n";
+        for (size_t i = 0; i < count; ++i) {
+            out << c.metric << "{method=\"" << methods_[i].name << "\"} "
+                << (methods_[i].*c.field).load(std::memory_order_relaxed) << "\n";
+        }
+    }
+
+    out << "# HELP at_rpc_latency_seconds Per-stage request latency.\n"
+        << "# TYPE at_rpc_latency_seconds histogram\n";
+    for (size_t i = 0; i < count; ++i) {
+        const MethodMetrics& m = methods_[i];
+        histogram_to_prometheus(out, m.name, "queue_wait", m.queue_wait);
+        histogram_to_prometheus(out, m.name, "handler", m.handler);
+        histogram_to_prometheus(out, m.name, "send", m.send);
+    }
+    return out.str();
+}
+
+// --- Prometheus text exposition over HTTP ---
+
+MetricsHttpExporter::MetricsHttpExporter(const RPCMetrics& metrics, const std::string& host, int port)
+    : metrics_(metrics), host_(host), port_(port), listen_socket_(INVALID_SOCKET), running_(false) {}
+
+MetricsHttpExporter::~MetricsHttpExporter() {
+    stop();
+}
+
+bool MetricsHttpExporter::start() {
+    listen_socket_ = create_socket();
+    if (listen_socket_ == INVALID_SOCKET) {
+        spdlog::error("Failed to create metrics socket.");
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(listen_socket_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    if (!bind_socket(listen_socket_, host_, port_) || ::listen(listen_socket_, 16) == SOCKET_ERROR) {
+        spdlog::error("Failed to listen for metrics on {}:{}", host_, port_);
+        close_socket(listen_socket_);
+        listen_socket_ = INVALID_SOCKET;
+        return false;
+    }
+    running_ = true;
+    thread_ = std::thread(&MetricsHttpExporter::serve_loop, this);
+    spdlog::info("Prometheus metrics available at http://{}:{}/metrics", host_, port_);
+    return true;
+}
+
+void MetricsHttpExporter::stop() {
+    if (!running_.exchange(false)) return;
+    // shutdown() wakes the blocked accept() on POSIX, closing covers Winsock
+#ifdef _WIN32
+    ::shutdown(listen_socket_, SD_BOTH);
+#else
+    ::shutdown(listen_socket_, SHUT_RDWR);
+#endif
+    close_socket(listen_socket_);
+    listen_socket_ = INVALID_SOCKET;
+    if (thread_.joinable()) thread_.join();
+}
+
+void MetricsHttpExporter::serve_loop() {
+    while (running_) {
+        socket_t client = ::accept(listen_socket_, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            if (running_) spdlog::warn("Metrics accept failed: {}", get_error_message(get_last_error()));
+            continue;
+        }
+        // The request line is irrelevant: every path returns the exposition
+        char request[1024];
+        ::recv(client, request, sizeof(request), 0);
+
+        std::string body = metrics_.to_prometheus();
+        std::string head = "HTTP/1.0 200 OK\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n";
+        std::vector<uint8_t> response(head.begin(), head.end());
+        response.insert(response.end(), body.begin(), body.end());
+        send_all(client, response);
+        close_socket(client);
+    }
+}
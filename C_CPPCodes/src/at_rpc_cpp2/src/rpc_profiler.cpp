@@ -0,0 +1,502 @@
+// rpc_profiler.cpp
+#include "rpc_profiler.h"
+#include "response_writer.h"
+#include "rpc_metrics.h" // metrics_now_ns()
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <spdlog/spdlog.h>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define AT_PROFILER_SUPPORTED 1
+#include <cerrno>
+#include <csignal>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <unwind.h>
+#endif
+
+#ifdef AT_PROFILER_SUPPORTED
+namespace {
+
+struct Sample {
+    uint32_t depth;
+    uintptr_t pcs[RPCProfiler::MAX_DEPTH]; // innermost first; callers' are return addresses
+};
+
+// One thread's samples: written by its own signal handler, drained by the collector
+struct ThreadBuffer {
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<int> tid{0}; // 0 until the owning thread has filled it in
+    Sample samples[RPCProfiler::RING_SAMPLES];
+};
+
+// What the handler may touch: atomics and the thread's own plain TLS, nothing
+// that allocates or locks
+std::atomic<bool> g_active{false};
+std::atomic<int> g_in_handler{0};
+std::atomic<ThreadBuffer*> g_buffers{nullptr};
+std::atomic<size_t> g_claimed{0};
+std::atomic<uint64_t> g_dropped{0};
+std::atomic<uint32_t> g_generation{0};
+std::unique_ptr<ThreadBuffer[]> g_buffer_storage;
+
+// The calling thread's ring in the current run. Zero-initialized POD, so no
+// TLS constructor guard; initial-exec keeps the access a plain offset from
+// the thread pointer, no __tls_get_addr, even if this file ends up in a
+// shared library.
+struct ThreadSlot {
+    uint32_t generation; // run that `index` belongs to
+    uint32_t index;
+};
+__attribute__((tls_model("initial-exec"))) thread_local ThreadSlot t_slot;
+
+struct UnwindState {
+    Sample* sample;
+    uintptr_t pc; // where the signal interrupted the thread
+    bool found;
+};
+
+_Unwind_Reason_Code collect_frame(_Unwind_Context* context, void* arg) {
+    UnwindState* state = static_cast<UnwindState*>(arg);
+    int exact = 0; // set for the frame the signal interrupted, whose ip is not a return address
+    uintptr_t ip = _Unwind_GetIPInfo(context, &exact);
+    if (!state->found) {
+        // Skip the handler's own frames and the signal trampoline
+        if (!exact || ip != state->pc) {
+            return _URC_NO_REASON;
+        }
+        state->found = true;
+    }
+    if (ip == 0 || state->sample->depth == RPCProfiler::MAX_DEPTH) {
+        return _URC_END_OF_STACK;
+    }
+    state->sample->pcs[state->sample->depth++] = ip;
+    return _URC_NO_REASON;
+}
+
+void record_sample(const ucontext_t* context) {
+    uint32_t generation = g_generation.load(std::memory_order_acquire);
+    ThreadBuffer* buffers = g_buffers.load(std::memory_order_acquire);
+    if (t_slot.generation != generation) {
+        t_slot.generation = generation;
+        t_slot.index = static_cast<uint32_t>(g_claimed.fetch_add(1, std::memory_order_relaxed));
+        if (t_slot.index < RPCProfiler::MAX_THREADS) {
+            buffers[t_slot.index].tid.store(static_cast<int>(syscall(SYS_gettid)), std::memory_order_release);
+        }
+    }
+    if (t_slot.index >= RPCProfiler::MAX_THREADS) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ThreadBuffer& buffer = buffers[t_slot.index];
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    if (head - buffer.tail.load(std::memory_order_acquire) >= RPCProfiler::RING_SAMPLES) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Sample& sample = buffer.samples[head % RPCProfiler::RING_SAMPLES];
+
+#if defined(__x86_64__)
+    uintptr_t pc = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RIP]);
+#else
+    uintptr_t pc = static_cast<uintptr_t>(context->uc_mcontext.pc);
+#endif
+    sample.depth = 0;
+    UnwindState state{&sample, pc, false};
+    _Unwind_Backtrace(collect_frame, &state);
+    if (!state.found) {
+        // No unwind info where the thread was: keep at least the frame itself
+        sample.pcs[0] = pc;
+        sample.depth = 1;
+    }
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void on_sigprof(int, siginfo_t*, void* context) {
+    int saved_errno = errno;
+    // stop() waits for g_in_handler to drain before freeing the buffers
+    g_in_handler.fetch_add(1);
+    if (g_active.load()) {
+        record_sample(static_cast<const ucontext_t*>(context));
+    }
+    g_in_handler.fetch_sub(1);
+    errno = saved_errno;
+}
+
+_Unwind_Reason_Code count_frame(_Unwind_Context*, void*) {
+    return _URC_NO_REASON;
+}
+
+std::string thread_name(int tid) {
+    std::ifstream comm("/proc/self/task/" + std::to_string(tid) + "/comm");
+    std::string name;
+    std::getline(comm, name);
+    if (name.empty()) {
+        name = "thread-" + std::to_string(tid);
+    }
+    std::replace(name.begin(), name.end(), ';', ':');
+    return name;
+}
+
+std::string demangle(const char* symbol) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(symbol, nullptr, nullptr, &status);
+    std::string name = status == 0 && demangled ? demangled : symbol;
+    std::free(demangled);
+    std::replace(name.begin(), name.end(), ';', ':');
+    return name;
+}
+
+// Function symbols of one ELF file: .symtab when it has one (static functions
+// and lambdas included), else .dynsym
+class ElfSymbols {
+public:
+    bool load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        Elf64_Ehdr header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64 ||
+            header.e_shentsize != sizeof(Elf64_Shdr)) {
+            return false;
+        }
+        relative_ = header.e_type == ET_DYN;
+        std::vector<Elf64_Shdr> sections(header.e_shnum);
+        in.seekg(static_cast<std::streamoff>(header.e_shoff));
+        if (!in.read(reinterpret_cast<char*>(sections.data()), static_cast<std::streamsize>(sections.size() * sizeof(Elf64_Shdr)))) {
+            return false;
+        }
+        const Elf64_Shdr* table = nullptr;
+        for (uint32_t type : {SHT_SYMTAB, SHT_DYNSYM}) {
+            for (const auto& section : sections) {
+                if (!table && section.sh_type == type && section.sh_link < sections.size()) {
+                    table = &section;
+                }
+            }
+        }
+        if (!table) {
+            return false;
+        }
+        const Elf64_Shdr& strings = sections[table->sh_link];
+        names_.resize(strings.sh_size);
+        std::vector<Elf64_Sym> raw(table->sh_size / sizeof(Elf64_Sym));
+        in.seekg(static_cast<std::streamoff>(strings.sh_offset));
+        in.read(names_.data(), static_cast<std::streamsize>(names_.size()));
+        in.seekg(static_cast<std::streamoff>(table->sh_offset));
+        in.read(reinterpret_cast<char*>(raw.data()), static_cast<std::streamsize>(raw.size() * sizeof(Elf64_Sym)));
+        if (!in) {
+            return false;
+        }
+        for (const auto& sym : raw) {
+            unsigned type = ELF64_ST_TYPE(sym.st_info);
+            if ((type == STT_FUNC || type == STT_GNU_IFUNC) && sym.st_shndx != SHN_UNDEF && sym.st_value != 0 &&
+                sym.st_name < names_.size()) {
+                symbols_.push_back({static_cast<uintptr_t>(sym.st_value), static_cast<size_t>(sym.st_size), sym.st_name});
+            }
+        }
+        std::sort(symbols_.begin(), symbols_.end(),
+                  [](const Symbol& a, const Symbol& b) { return a.address < b.address; });
+        return true;
+    }
+
+    // Name of the function holding pc, for a module loaded at `base`
+    const char* find(uintptr_t pc, uintptr_t base) const {
+        uintptr_t address = relative_ ? pc - base : pc;
+        auto it = std::upper_bound(symbols_.begin(), symbols_.end(), address,
+                                   [](uintptr_t a, const Symbol& symbol) { return a < symbol.address; });
+        if (it == symbols_.begin()) {
+            return nullptr;
+        }
+        --it;
+        // Zero-sized symbols (assembly) run up to the next one
+        bool inside = it->size == 0 ? std::next(it) == symbols_.end() || address < std::next(it)->address
+                                    : address < it->address + it->size;
+        return inside ? names_.data() + it->name : nullptr;
+    }
+
+private:
+    struct Symbol {
+        uintptr_t address;
+        size_t size;
+        uint32_t name;
+    };
+    bool relative_ = true; // ET_DYN: symbol addresses are offsets from the load base
+    std::vector<Symbol> symbols_; // by address
+    std::vector<char> names_;
+};
+
+// Names frames as "function", else "module+0xoffset" (for addr2line), else the
+// bare address. Each module's symbols are read once.
+class Symbolizer {
+public:
+    Symbolizer() {
+        // The executable is listed first, with an empty name; dladdr would
+        // report it as argv[0], which need not be a path from here
+        dl_iterate_phdr(
+            [](dl_phdr_info* info, size_t, void* arg) {
+                uintptr_t start = UINTPTR_MAX;
+                for (int i = 0; i < info->dlpi_phnum; ++i) {
+                    if (info->dlpi_phdr[i].p_type == PT_LOAD) {
+                        start = std::min<uintptr_t>(start, info->dlpi_addr + info->dlpi_phdr[i].p_vaddr);
+                    }
+                }
+                *static_cast<uintptr_t*>(arg) = start & ~uintptr_t(getpagesize() - 1);
+                return 1;
+            },
+            &executable_base_);
+    }
+
+    const std::string& name(uintptr_t pc) {
+        auto it = cache_.find(pc);
+        if (it != cache_.end()) {
+            return it->second;
+        }
+        return cache_.emplace(pc, lookup(pc)).first->second;
+    }
+
+private:
+    std::string lookup(uintptr_t pc) {
+        char buffer[64];
+        Dl_info info;
+        if (!dladdr(reinterpret_cast<void*>(pc), &info) || !info.dli_fbase) {
+            snprintf(buffer, sizeof(buffer), "0x%zx", static_cast<size_t>(pc));
+            return buffer;
+        }
+        uintptr_t base = reinterpret_cast<uintptr_t>(info.dli_fbase);
+        std::string path = base == executable_base_ ? "/proc/self/exe" : (info.dli_fname ? info.dli_fname : "");
+        auto module = modules_.find(path);
+        if (module == modules_.end()) {
+            module = modules_.emplace(path, ElfSymbols()).first;
+            module->second.load(path);
+        }
+        if (const char* symbol = module->second.find(pc, base)) {
+            return demangle(symbol);
+        }
+        if (info.dli_sname) {
+            return demangle(info.dli_sname);
+        }
+        std::string file = info.dli_fname ? info.dli_fname : "";
+        snprintf(buffer, sizeof(buffer), "+0x%zx", static_cast<size_t>(pc - base));
+        return file.substr(file.find_last_of('/') + 1) + buffer;
+    }
+
+    uintptr_t executable_base_ = 0;
+    std::unordered_map<uintptr_t, std::string> cache_;
+    std::map<std::string, ElfSymbols> modules_;
+};
+
+} // namespace
+#endif // AT_PROFILER_SUPPORTED
+
+RPCProfiler& RPCProfiler::instance() {
+    static RPCProfiler profiler;
+    return profiler;
+}
+
+bool RPCProfiler::available() {
+#ifdef AT_PROFILER_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+void RPCProfiler::start(unsigned hz) {
+    if (!available()) {
+        throw std::runtime_error("The sampling profiler needs Linux on x86-64 or AArch64");
+    }
+    if (hz == 0 || hz > MAX_HZ) {
+        throw std::invalid_argument("Profiler rate must be 1.." + std::to_string(MAX_HZ) + " Hz");
+    }
+#ifdef AT_PROFILER_SUPPORTED
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        throw std::runtime_error("The profiler is already running");
+    }
+    // Installed once and left in place: a SIGPROF still pending after stop()
+    // must not meet the default action, which ends the process
+    struct sigaction current {};
+    sigaction(SIGPROF, nullptr, &current);
+    if ((current.sa_flags & SA_SIGINFO) ? current.sa_sigaction != on_sigprof
+                                        : current.sa_handler != SIG_DFL && current.sa_handler != SIG_IGN) {
+        throw std::runtime_error("SIGPROF is already handled by another profiler");
+    }
+    if (!(current.sa_flags & SA_SIGINFO)) {
+        struct sigaction action {};
+        action.sa_sigaction = on_sigprof;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, nullptr) != 0) {
+            throw std::runtime_error(std::string("Cannot install the SIGPROF handler: ") + std::strerror(errno));
+        }
+    }
+
+    // The unwinder sets itself up (and may allocate) on first use: not in a handler
+    _Unwind_Backtrace(count_frame, nullptr);
+
+    g_buffer_storage.reset(new ThreadBuffer[MAX_THREADS]);
+    g_buffers.store(g_buffer_storage.get(), std::memory_order_release);
+    g_claimed.store(0, std::memory_order_relaxed);
+    g_dropped.store(0, std::memory_order_relaxed);
+    g_generation.fetch_add(1, std::memory_order_release);
+    counts_.clear();
+    thread_names_.clear();
+    slot_names_.assign(MAX_THREADS, -1);
+    samples_ = 0;
+    collect_stop_ = false;
+    collector_ = std::thread(&RPCProfiler::collect_loop, this);
+
+    started_ns_ = metrics_now_ns();
+    g_active.store(true);
+    itimerval timer{};
+    timer.it_interval.tv_usec = static_cast<suseconds_t>(1000000 / hz);
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    running_ = true;
+    spdlog::info("Profiler sampling at {} Hz", hz);
+#endif
+}
+
+json RPCProfiler::stop(const std::string& path) {
+#ifdef AT_PROFILER_SUPPORTED
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+        throw std::runtime_error("The profiler is not running");
+    }
+    itimerval timer{};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    g_active.store(false);
+    while (g_in_handler.load() != 0) {
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> collect_lock(collect_mutex_);
+        collect_stop_ = true;
+    }
+    collect_cv_.notify_one();
+    collector_.join();
+    drain();
+    g_buffers.store(nullptr, std::memory_order_release);
+    g_buffer_storage.reset();
+    running_ = false;
+    double seconds = static_cast<double>(metrics_now_ns() - started_ns_) / 1e9;
+    uint64_t dropped = g_dropped.load(std::memory_order_relaxed);
+
+    // Name every frame once, then merge stacks that differ only in offsets
+    // within the same functions
+    Symbolizer symbolizer;
+    std::map<std::string, uint64_t> folded;
+    for (const auto& [key, count] : counts_) {
+        std::string line = thread_names_[key[0]];
+        for (size_t i = key.size() - 1; i >= 1; --i) {
+            // Return addresses point past the call; name the call itself
+            line += ';';
+            line += symbolizer.name(i == 1 ? key[i] : key[i] - 1);
+        }
+        folded[line] += count;
+    }
+    std::vector<std::pair<std::string, uint64_t>> lines(folded.begin(), folded.end());
+    std::sort(lines.begin(), lines.end(),
+              [](const auto& a, const auto& b) { return a.second > b.second; });
+    size_t threads = thread_names_.size();
+    uint64_t samples = samples_;
+    counts_.clear();
+
+    std::ofstream out(path, std::ios::trunc);
+    for (const auto& [line, count] : lines) {
+        out << line << ' ' << count << '\n';
+    }
+    if (!out) {
+        throw std::runtime_error("Cannot write the profile to " + path);
+    }
+    spdlog::info("Wrote {} stacks ({} samples over {:.1f} s) to {}", lines.size(), samples, seconds, path);
+    return {{"path", path}, {"samples", samples}, {"dropped", dropped}, {"stacks", lines.size()},
+            {"threads", threads}, {"seconds", seconds}};
+#else
+    (void)path;
+    throw std::runtime_error("The profiler is not running");
+#endif
+}
+
+void RPCProfiler::collect_loop() {
+    std::unique_lock<std::mutex> lock(collect_mutex_);
+    while (!collect_cv_.wait_for(lock, std::chrono::milliseconds(COLLECT_INTERVAL_MS),
+                                 [this]() { return collect_stop_; })) {
+        drain();
+    }
+}
+
+void RPCProfiler::drain() {
+#ifdef AT_PROFILER_SUPPORTED
+    ThreadBuffer* buffers = g_buffers.load(std::memory_order_acquire);
+    size_t claimed = std::min(g_claimed.load(std::memory_order_relaxed), MAX_THREADS);
+    std::vector<uintptr_t> key;
+    for (size_t slot = 0; slot < claimed; ++slot) {
+        ThreadBuffer& buffer = buffers[slot];
+        int tid = buffer.tid.load(std::memory_order_acquire);
+        if (tid == 0) {
+            continue;
+        }
+        uint64_t tail = buffer.tail.load(std::memory_order_relaxed);
+        uint64_t head = buffer.head.load(std::memory_order_acquire);
+        if (tail == head) {
+            continue;
+        }
+        if (slot_names_[slot] < 0) {
+            // Read while the thread is still around to have a name
+            slot_names_[slot] = static_cast<int>(thread_names_.size());
+            thread_names_.push_back(thread_name(tid));
+        }
+        for (; tail < head; ++tail) {
+            const Sample& sample = buffer.samples[tail % RING_SAMPLES];
+            key.assign(1, static_cast<uintptr_t>(slot_names_[slot]));
+            key.insert(key.end(), sample.pcs, sample.pcs + sample.depth);
+            ++counts_[key];
+            ++samples_;
+        }
+        buffer.tail.store(head, std::memory_order_release);
+    }
+#endif
+}
+
+bool is_profile_method(std::string_view func) {
+    return func == RPCProfiler::START_METHOD || func == RPCProfiler::STOP_METHOD;
+}
+
+bool handle_profile_request(const std::string& func, const InlineArgs& args, const std::string& output_path,
+                            ResponseWriter& response) {
+    if (output_path.empty()) {
+        response.error("Profiling is not enabled on this server");
+        return false;
+    }
+    RPCProfiler& profiler = RPCProfiler::instance();
+    try {
+        if (func == RPCProfiler::START_METHOD) {
+            double rate = args.empty() ? RPCProfiler::DEFAULT_HZ : args[0];
+            unsigned hz = rate >= 1 && rate <= RPCProfiler::MAX_HZ ? static_cast<unsigned>(rate) : 0;
+            profiler.start(hz);
+            response.success(json{{"hz", hz}});
+        } else {
+            response.success(profiler.stop(output_path));
+        }
+        return true;
+    } catch (const std::exception& e) {
+        spdlog::warn("{} failed: {}", func, e.what());
+        response.error(e.what());
+        return false;
+    }
+}
@@ -0,0 +1,63 @@
+// rpc_quota.cpp
+#include "rpc_quota.h"
+#include <algorithm>
+
+void ByteBudget::set_limit(size_t limit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limit_ = limit;
+    released_.notify_all();
+}
+
+uint64_t ByteBudget::begin_frame() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t ticket = next_ticket_++;
+    frames_.push_back(ticket);
+    return ticket;
+}
+
+void ByteBudget::end_frame(uint64_t ticket) {
+    if (ticket == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::lower_bound(frames_.begin(), frames_.end(), ticket);
+        if (it != frames_.end() && *it == ticket) {
+            frames_.erase(it);
+        }
+    }
+    released_.notify_all(); // the next oldest frame may now proceed
+}
+
+bool ByteBudget::acquire(size_t n, uint64_t ticket, std::chrono::milliseconds timeout, bool* waited) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto granted = [&] {
+        return limit_ == 0 || used_ + n <= limit_ || (ticket != 0 && !frames_.empty() && frames_.front() == ticket);
+    };
+    if (waited) *waited = false;
+    if (!granted()) {
+        if (waited) *waited = true;
+        if (!released_.wait_for(lock, timeout, granted)) {
+            return false;
+        }
+    }
+    used_ += n;
+    return true;
+}
+
+void ByteBudget::release(size_t n) {
+    if (n == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_ = n > used_ ? 0 : used_ - n;
+    }
+    released_.notify_all();
+}
+
+size_t ByteBudget::used() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_;
+}
+
+size_t ByteBudget::limit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_;
+}
@@ -0,0 +1,143 @@
+// rpc_scheduler.cpp
+#include "rpc_scheduler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <stdexcept>
+
+FairScheduler::FairScheduler(size_t workers, size_t quantum, size_t max_outstanding, WorkerInit init)
+    : init_(std::move(init)), quantum_(std::max<size_t>(quantum, 1)), max_outstanding_(std::max<size_t>(max_outstanding, 1)) {
+    workers = std::max<size_t>(workers, 1);
+    threads_.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        threads_.emplace_back(&FairScheduler::worker_loop, this, i);
+    }
+}
+
+FairScheduler::~FairScheduler() {
+    stop();
+}
+
+void FairScheduler::set_weight(const std::string& flow, uint32_t weight) {
+    if (weight == 0) {
+        throw std::invalid_argument("Scheduler weight must be at least 1");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    weights_[flow] = weight;
+}
+
+bool FairScheduler::submit(const std::string& flow_name, size_t cost, Job job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_) {
+        return false;
+    }
+    auto& slot = flows_[flow_name];
+    if (!slot) {
+        slot = std::make_unique<Flow>();
+        slot->name = flow_name;
+        auto weight = weights_.find(flow_name);
+        if (weight != weights_.end()) {
+            slot->weight = weight->second;
+        }
+    }
+    Flow& flow = *slot;
+    if (flow.outstanding >= max_outstanding_) {
+        throttled_.fetch_add(1, std::memory_order_relaxed);
+        ++flow.waiters;
+        flow.space.wait(lock, [&]() { return flow.outstanding < max_outstanding_ || stopping_; });
+        --flow.waiters;
+        if (stopping_) {
+            return false;
+        }
+    }
+    ++flow.outstanding;
+    flow.queue.push_back({cost, std::move(job)});
+    ++queued_;
+    if (!flow.active) {
+        flow.active = true;
+        active_.push_back(&flow);
+    }
+    lock.unlock();
+    work_.notify_one();
+    return true;
+}
+
+void FairScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (auto& entry : flows_) {
+            entry.second->space.notify_all();
+        }
+    }
+    work_.notify_all();
+    // A second caller (e.g. the destructor racing stop()) waits for the joins
+    std::lock_guard<std::mutex> lock(join_mutex_);
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+size_t FairScheduler::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+void FairScheduler::worker_loop(size_t index) {
+    if (init_) {
+        init_(index);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_.wait(lock, [this]() { return !active_.empty() || stopping_; });
+        if (active_.empty()) {
+            return; // stopping and drained
+        }
+        // DRR: the flow at the front gets its quantum once per visit and starts
+        // jobs while its credit covers the next one; otherwise the visit ends
+        // and the credit waits for the next round
+        Flow* flow = active_.front();
+        if (!flow->granted) {
+            flow->deficit += quantum_ * flow->weight;
+            flow->granted = true;
+        }
+        Task& head = flow->queue.front();
+        if (flow->deficit < head.cost) {
+            flow->granted = false;
+            active_.splice(active_.end(), active_, active_.begin());
+            continue;
+        }
+        flow->deficit -= head.cost;
+        Job job = std::move(head.job);
+        flow->queue.pop_front();
+        --queued_;
+        if (flow->queue.empty()) {
+            // An idle flow keeps no credit, or it could burst after a pause
+            flow->deficit = 0;
+            flow->granted = false;
+            flow->active = false;
+            active_.pop_front();
+        }
+        lock.unlock();
+        try {
+            job();
+        } catch (const std::exception& e) {
+            spdlog::error("Scheduled job failed: {}", e.what());
+        } catch (...) {
+            spdlog::critical("Scheduled job failed with an unknown exception");
+        }
+        job = nullptr; // release what the job captured before taking the lock
+        lock.lock();
+        finish(*flow);
+    }
+}
+
+void FairScheduler::finish(Flow& flow) {
+    --flow.outstanding;
+    if (flow.outstanding == 0 && !flow.active && flow.waiters == 0) {
+        flows_.erase(flow.name);
+        return;
+    }
+    flow.space.notify_one();
+}
@@ -1,7 +1,31 @@
 // rpc_server.cpp
 #include "at_protocol.h"
+#include "buffer_pool.h"
+#include "bulk_ops.h"
+#include "cpu_affinity.h"
+#include "expr_eval.h"
+#include "fast_request.h"
+#include "frame_cipher.h"
+#include "lz_codec.h"
 #include "network_utils.h" // Includes socket setup/cleanup
+#include "pubsub.h"
+#include "request_arena.h"
+#include "response_writer.h"
+#include "rpc_capture.h"
+#include "rpc_metrics.h"
+#include "rpc_profiler.h"
+#include "rpc_quota.h"
+#include "rpc_scheduler.h"
+#include "rpc_trace.h"
+#include "typed_call.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <sstream>
 #include <nlohmann/json.hpp>
@@ -10,13 +34,135 @@ using json = nlohmann::json;
 
 class RPCServer {
 public:
+    // Reserved method answering with the metrics snapshot as JSON
+    static constexpr const char* STATS_METHOD = "__stats";
+    // Reserved method writing the trace rings to the configured dump file
+    static constexpr const char* TRACE_DUMP_METHOD = "__trace_dump";
+    // Formula over variables, compiled once and cached (see expr_eval.h)
+    static constexpr const char* EVAL_METHOD = "eval";
+    // Push frames a subscribed connection may have queued before it counts as
+    // slow (conflated or dropped, per its subscription policy; see pubsub.h)
+    static constexpr size_t PUSH_QUEUE_FRAMES = 1024;
+
     RPCServer(const std::string& host, int port)
-        : host_(host), port_(port), server_socket_(INVALID_SOCKET), running_(false) {
-        AT_Protocol_ = std::make_unique<ATProtocol>();
+        : host_(host), port_(port), server_socket_(INVALID_SOCKET), running_(false) {}
+
+    // Serve Prometheus text exposition on host:port; call before start(). 0 disables it.
+    void enable_metrics_http(int port, const std::string& host = "127.0.0.1") {
+        metrics_port_ = port;
+        metrics_host_ = host;
+    }
+
+    const RPCMetrics& metrics() const { return metrics_; }
+
+    // Push `data` to every connection subscribed to `topic` (the same as a
+    // client's "publish" request). Returns how many subscribers took it.
+    size_t publish(const std::string& topic, const json& data) { return pubsub_.publish(topic, data); }
+
+    // Typed methods (FLAG_TYPED, see typed_call.h); fill before start(), e.g.
+    // with a generated <service>::register_service(server.typed_methods(), impl)
+    TypedRegistry& typed_methods() { return typed_methods_; }
+
+    // Record every incoming frame with its arrival time into an mmap'ed capture
+    // file of `capacity` bytes (frames beyond that are dropped); call before
+    // start(). Re-drive it with: at_rpc_replay --input <path> --speed 1
+    void enable_capture(const std::string& path, size_t capacity = 256 * 1024 * 1024) {
+        capture_path_ = path;
+        capture_capacity_ = capacity;
+    }
+
+    // Responses ready on one connection are gathered into a single writev. They are
+    // flushed once no more pipelined input is waiting, or earlier when max_bytes are
+    // queued or the oldest has waited max_delay. max_bytes = 0 writes each response
+    // on its own (the old behaviour).
+    void set_write_coalescing(size_t max_bytes, std::chrono::microseconds max_delay) {
+        coalesce_max_bytes_ = max_bytes;
+        coalesce_max_delay_ns_ = static_cast<uint64_t>(max_delay.count()) * 1000;
+    }
+
+    // Bound receive buffer memory: one connection may hold at most per_connection
+    // bytes (which also caps the frame size), all connections together at most
+    // global bytes (0 = unlimited; the oldest partial frame may overshoot it, see
+    // ByteBudget). A reader that would exceed the global quota pauses for up to
+    // max_wait, then its connection is dropped. Call before start().
+    void set_memory_quotas(size_t per_connection, size_t global,
+                           std::chrono::milliseconds max_wait = std::chrono::milliseconds(5000)) {
+        conn_quota_ = std::max<size_t>(per_connection, 1024);
+        rx_budget_.set_limit(global);
+        quota_wait_ = max_wait;
+    }
+
+    // Run requests on a shared pool of `workers` threads instead of on each
+    // connection's own thread, ordered by deficit round-robin across clients (see
+    // rpc_scheduler.h). A client is one connection ("conn:<id>"), or with
+    // per_peer_address every connection from one IP address. A client may have
+    // max_outstanding requests queued or running; its connection stops reading
+    // beyond that. quantum is the frame bytes a client of weight 1 may start per
+    // round. Call before start().
+    void enable_fair_scheduling(size_t workers, bool per_peer_address = false, size_t max_outstanding = 64,
+                                size_t quantum = 1024) {
+        scheduler_workers_ = std::max<size_t>(workers, 1);
+        scheduler_quantum_ = quantum;
+        scheduler_max_outstanding_ = max_outstanding;
+        flow_per_peer_ = per_peer_address;
+    }
+
+    // Scheduling weight of a client ("conn:<id>" or an IP address), default 1.
+    // Call before start().
+    void set_client_weight(const std::string& client, uint32_t weight) {
+        if (weight == 0) {
+            throw std::invalid_argument("Scheduler weight must be at least 1");
+        }
+        client_weights_.emplace_back(client, weight);
+    }
+
+    // Pin connection threads, and fair-scheduling workers, to CPUs round-robin
+    // over `cpus`: "auto" for every CPU this process may use, or a list such as
+    // "0-7,16-23". On multi-node machines each pinned thread also prefers its
+    // NUMA node for new memory, so the receive buffer and response pool a
+    // connection's thread allocates live next to the core serving it, and that
+    // core runs the connection from read to write. Call before start(); throws
+    // std::invalid_argument on a bad list.
+    void set_cpu_affinity(const std::string& cpus) {
+        topology_ = CpuTopology::detect();
+        pinned_cpus_ = select_cpus(topology_, cpus);
+    }
+
+    // Seal every frame with AES-256-GCM under this 32-byte key (see
+    // frame_cipher.h): each connection must open with the handshake, plaintext
+    // clients are dropped. Call before start(); std::runtime_error when built
+    // without Crypto++.
+    void enable_encryption(const std::vector<uint8_t>& key) {
+        FrameCipher check(key, FrameCipher::Role::Server); // throws for a bad key or a build without Crypto++
+        key_ = key;
+    }
+
+    // LZ-compress responses of at least `threshold` bytes (see lz_codec.h),
+    // for clients whose requests carry FLAG_ACCEPTS_COMPRESSED; 0 = never.
+    // Compressed requests are taken either way. Call before start().
+    void set_compression(size_t threshold) {
+        compress_threshold_ = threshold;
+    }
+
+    // Record per-request trace spans; __trace_dump (and stop()) write them to dump_path.
+    // Convert the dump with: at_rpc_demo trace2chrome --input <dump> --output trace.json
+    void enable_tracing(const std::string& dump_path) {
+        trace_dump_path_ = dump_path;
+        RPCTracer::instance().set_enabled(true);
+    }
+
+    // Allow __profile_start / __profile_stop (see rpc_profiler.h); stop writes
+    // collapsed stacks to output_path, e.g. for flamegraph.pl. Call before start().
+    void enable_profiling(const std::string& output_path) {
+        profile_output_path_ = output_path;
     }
 
     bool start() {
         initialize_sockets();
+#ifndef _WIN32
+        // A client vanishing mid-write (or a dropped subscriber) must not kill the server
+        signal(SIGPIPE, SIG_IGN);
+#endif
 
         server_socket_ = create_socket();
         if (server_socket_ == INVALID_SOCKET) {
@@ -42,6 +188,34 @@ public:
         spdlog::info("RPC Server listening on {}:{}", host_, port_);
         running_ = true;
 
+        if (!capture_path_.empty() && !capture_.open(capture_path_, capture_capacity_)) {
+            spdlog::warn("Continuing without traffic capture.");
+        }
+
+        if (!pinned_cpus_.empty()) {
+            spdlog::info("CPU topology: {}; pinning threads to cpus {}", topology_.describe(),
+                         format_cpu_list(pinned_cpus_));
+        }
+        if (scheduler_workers_ > 0) {
+            FairScheduler::WorkerInit init;
+            if (!pinned_cpus_.empty()) {
+                init = [this](size_t worker) { pin_thread(worker); };
+            }
+            scheduler_ = std::make_unique<FairScheduler>(scheduler_workers_, scheduler_quantum_,
+                                                         scheduler_max_outstanding_, std::move(init));
+            for (const auto& weight : client_weights_) {
+                scheduler_->set_weight(weight.first, weight.second);
+            }
+        }
+
+        if (metrics_port_ > 0) {
+            metrics_exporter_ = std::make_unique<MetricsHttpExporter>(metrics_, metrics_host_, metrics_port_);
+            if (!metrics_exporter_->start()) {
+                spdlog::warn("Continuing without the metrics endpoint.");
+                metrics_exporter_.reset();
+            }
+        }
+
         while (running_) {
             sockaddr_in client_addr{};
             socklen_t client_addr_len = sizeof(client_addr);
@@ -53,11 +227,21 @@ public:
                 }
                 continue; // Continue loop even on accept failure, unless shutting down
             }
+            uint32_t conn_id = next_conn_id_.fetch_add(1, std::memory_order_relaxed);
+            RPCTracer::instance().record(TraceStage::Accept, conn_id, 0);
             spdlog::info("Accepted connection");
+            std::string client = "conn:" + std::to_string(conn_id);
+            char peer[INET_ADDRSTRLEN] = {};
+            if (flow_per_peer_ && inet_ntop(AF_INET, &client_addr.sin_addr, peer, sizeof(peer))) {
+                client = peer;
+            }
 
             // Handle each client in a separate thread
-            std::thread([this, client_socket]() {
-                handle_client(client_socket);
+            std::thread([this, client_socket, conn_id, client]() {
+                if (!pinned_cpus_.empty()) {
+                    pin_thread(conn_id - 1); // before handle_client allocates the connection's buffers
+                }
+                handle_client(client_socket, conn_id, client);
                 close_socket(client_socket);
                 spdlog::info("Client disconnected");
             }).detach(); // Detach thread to allow independent execution
@@ -79,6 +263,23 @@ public:
              close_socket(server_socket_);
              server_socket_ = INVALID_SOCKET;
         }
+        if (metrics_exporter_) {
+            metrics_exporter_->stop();
+        }
+        if (scheduler_) {
+            scheduler_->stop(); // runs what is queued; later frames are refused
+        }
+        if (!trace_dump_path_.empty()) {
+            RPCTracer::instance().dump(trace_dump_path_);
+        }
+        if (RPCProfiler::instance().running()) {
+            try {
+                RPCProfiler::instance().stop(profile_output_path_); // keep what a forgotten run sampled
+            } catch (const std::exception& e) {
+                spdlog::warn("Profiler: {}", e.what());
+            }
+        }
+        capture_.close();
         spdlog::info("RPC Server stopped.");
     }
 
@@ -93,9 +294,294 @@ private:
     int port_;
     socket_t server_socket_;
     std::atomic<bool> running_;
-    std::unique_ptr<ATProtocol> AT_Protocol_;
 
-    double perform_calculation(const std::string& func, const std::vector<double>& args) {
+    RPCMetrics metrics_;
+    int metrics_port_ = 0;
+    std::string metrics_host_ = "127.0.0.1";
+    std::unique_ptr<MetricsHttpExporter> metrics_exporter_;
+    std::string trace_dump_path_;
+    std::string profile_output_path_;
+    std::atomic<uint32_t> next_conn_id_{1};
+    std::string capture_path_;
+    size_t capture_capacity_ = 0;
+    CaptureWriter capture_;
+    ExprPlanCache expr_plans_;
+    PubSubHub pubsub_;
+    TypedRegistry typed_methods_;
+    std::unique_ptr<FairScheduler> scheduler_; // created by start() when enable_fair_scheduling was called
+    size_t scheduler_workers_ = 0;
+    size_t scheduler_quantum_ = 1024;
+    size_t scheduler_max_outstanding_ = 64;
+    bool flow_per_peer_ = false;
+    std::vector<std::pair<std::string, uint32_t>> client_weights_;
+    CpuTopology topology_;
+    std::vector<int> pinned_cpus_; // empty: threads float
+    std::vector<uint8_t> key_;     // sealed frames when set (see enable_encryption)
+    size_t compress_threshold_ = 0; // see set_compression
+
+    static constexpr uint32_t MAX_BODY_LENGTH = 10 * 1024 * 1024;
+    static constexpr size_t RECV_CHUNK = 64 * 1024;
+    static constexpr size_t RECV_INITIAL = 4 * 1024;
+
+    // Memory quotas (see set_memory_quotas)
+    size_t conn_quota_ = ATProtocol::HEADER_SIZE + MAX_BODY_LENGTH;
+    ByteBudget rx_budget_{256 * 1024 * 1024};
+    std::chrono::milliseconds quota_wait_{5000};
+
+    // Write coalescing limits (see set_write_coalescing)
+    size_t coalesce_max_bytes_ = 64 * 1024;
+    uint64_t coalesce_max_delay_ns_ = 200 * 1000;
+
+    // A packed response waiting for the connection's next gathered write
+    struct PendingResponse {
+        uint32_t sequence;
+        uint16_t flags;
+        std::vector<uint8_t> packet;
+        MethodMetrics* method;
+        uint64_t t_encode;
+    };
+
+    // Per-connection state, owned by the connection's thread. With fair
+    // scheduling, workers process frames and flush responses (the tx side)
+    // under tx_mutex while the connection's thread keeps reading.
+    struct Connection {
+        socket_t socket;
+        uint32_t id;
+        ATProtocol protocol;            // unpack() keeps header state, so one per connection
+        std::vector<uint8_t> rx;        // bytes [rx_begin, rx_end) are received but not yet consumed
+        size_t rx_begin = 0;
+        size_t rx_end = 0;
+        uint64_t last_read_ns = 0;
+        uint64_t frame_first_ns = 0;    // arrival of the first byte of the frame at rx_begin
+        uint64_t rx_ticket = 0;         // ByteBudget frame ticket while the buffer holds a partial frame
+        std::vector<PendingResponse> tx;
+        size_t tx_bytes = 0;
+        uint64_t tx_oldest_ns = 0;
+        std::vector<IoSlice> tx_slices; // flush_responses() scratch, kept for its capacity
+
+        std::string client;             // scheduler flow
+        std::mutex tx_mutex;
+        std::mutex jobs_mutex;
+        std::condition_variable jobs_done;
+        size_t jobs = 0;                // frames handed to the scheduler and not finished
+        std::atomic<bool> failed{false}; // a worker dropped the connection
+        std::mutex send_mutex;          // responses and push frames go out whole, one writer at a time
+        std::shared_ptr<PushSubscriber> subscriber; // created by the first subscribe
+        std::unique_ptr<FrameCipher> cipher; // sealed connections: opens on this thread, seals under send_mutex
+        bool accepts_compressed = false; // set by its first request with FLAG_ACCEPTS_COMPRESSED
+
+        Connection(socket_t s, uint32_t conn_id, std::string client_name)
+            : socket(s), id(conn_id), client(std::move(client_name)) {}
+    };
+
+    // Pin the calling thread to the slot-th CPU of pinned_cpus_ (and its node)
+    void pin_thread(size_t slot) {
+        int cpu = pinned_cpus_[slot % pinned_cpus_.size()];
+        int node = topology_.nodes().size() > 1 ? topology_.node_of(cpu) : -1;
+        if (!pin_current_thread(cpu, node)) {
+            spdlog::warn("Could not pin thread to cpu {}", cpu);
+        }
+    }
+
+    // Gauge bookkeeping that has to survive every break/continue in handle_client
+    struct GaugeGuard {
+        std::atomic<int64_t>& gauge;
+        explicit GaugeGuard(std::atomic<int64_t>& g) : gauge(g) { gauge.fetch_add(1, std::memory_order_relaxed); }
+        ~GaugeGuard() { gauge.fetch_sub(1, std::memory_order_relaxed); }
+    };
+
+    // Bytes the next read may take: up to the buffer size (so a fresh connection
+    // starts small and the buffer doubles only when traffic fills it), at most
+    // one chunk, and never more than the connection quota allows
+    size_t rx_want(const Connection& conn) const {
+        size_t step = std::min(RECV_CHUNK, std::max(RECV_INITIAL, conn.rx.size()));
+        return std::min(step, conn_quota_ - (conn.rx_end - conn.rx_begin));
+    }
+
+    // Buffer growth (charged to the global quota) the next read_more() needs
+    size_t rx_growth_needed(const Connection& conn) const {
+        size_t needed = (conn.rx_end - conn.rx_begin) + rx_want(conn);
+        return needed > conn.rx.size() ? needed - conn.rx.size() : 0;
+    }
+
+    // Read whatever the socket has (blocking until at least one byte). Buffer memory
+    // is committed as bytes arrive, not when a header announces a large body, and
+    // is charged to the global quota; while that is exhausted the read waits, so
+    // TCP flow control pushes back on the client. Returns false on close/error or
+    // when the quota stays exhausted for quota_wait_.
+    bool read_more(Connection& conn) {
+        if (conn.rx_begin == conn.rx_end) {
+            conn.rx_begin = conn.rx_end = 0;
+            rx_budget_.end_frame(conn.rx_ticket);
+            conn.rx_ticket = 0;
+            // Idle between frames: give back what a large frame made us commit
+            if (conn.rx.size() > RECV_CHUNK) {
+                release_rx(conn.rx.size() - RECV_CHUNK);
+                std::vector<uint8_t> chunk = BufferPool::instance().acquire(RECV_CHUNK);
+                chunk.resize(RECV_CHUNK);
+                chunk.swap(conn.rx);
+                BufferPool::instance().release(std::move(chunk)); // the next large frame picks it up
+            }
+        }
+        size_t want = rx_want(conn);
+        if (conn.rx.size() - conn.rx_end < want && conn.rx_begin > 0) {
+            std::memmove(conn.rx.data(), conn.rx.data() + conn.rx_begin, conn.rx_end - conn.rx_begin);
+            conn.rx_end -= conn.rx_begin;
+            conn.rx_begin = 0;
+        }
+        if (conn.rx.size() - conn.rx_end < want) {
+            // Geometric growth keeps copies linear, capped by the connection quota
+            size_t target = std::max(conn.rx_end + want, std::min(conn.rx.size() * 2, conn_quota_));
+            size_t growth = target - conn.rx.size();
+            // Only commit memory for bytes that are actually on their way
+            if (!wait_readable(conn.socket, -1)) {
+                return false;
+            }
+            if (conn.rx_ticket == 0) {
+                conn.rx_ticket = rx_budget_.begin_frame();
+            }
+            bool waited = false;
+            bool acquired = rx_budget_.acquire(growth, conn.rx_ticket, quota_wait_, &waited);
+            if (waited) {
+                metrics_.rx_quota_stalls.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (!acquired) {
+                spdlog::warn("Connection {}: receive memory quota exhausted ({} of {} bytes in use). Disconnecting.",
+                             conn.id, rx_budget_.used(), rx_budget_.limit());
+                return false;
+            }
+            metrics_.rx_buffer_bytes.fetch_add(static_cast<int64_t>(growth), std::memory_order_relaxed);
+            std::vector<uint8_t> grown = BufferPool::instance().acquire(target);
+            grown.assign(conn.rx.begin(), conn.rx.begin() + conn.rx_end);
+            grown.resize(target);
+            grown.swap(conn.rx);
+            BufferPool::instance().release(std::move(grown));
+        }
+        bool starts_frame = conn.rx_begin == conn.rx_end;
+        int received = recv_some(conn.socket, conn.rx.data() + conn.rx_end, want);
+        if (received <= 0) {
+            return false;
+        }
+        conn.last_read_ns = metrics_now_ns();
+        if (starts_frame) {
+            conn.frame_first_ns = conn.last_read_ns;
+        }
+        conn.rx_end += static_cast<size_t>(received);
+        return true;
+    }
+
+    void release_rx(size_t bytes) {
+        rx_budget_.release(bytes);
+        metrics_.rx_buffer_bytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+    }
+
+    // True when a whole frame is buffered at rx_begin; sets `bad` on a corrupt header
+    bool has_frame(const Connection& conn, ATHeader& header, bool& bad) const {
+        size_t available = conn.rx_end - conn.rx_begin;
+        if (available < ATProtocol::HEADER_SIZE) {
+            return false;
+        }
+        header.unpack(conn.rx.data() + conn.rx_begin, ATProtocol::HEADER_SIZE);
+        if (header.protocol_id != ATProtocol::PROTOCOL_ID || header.body_length > MAX_BODY_LENGTH) {
+            spdlog::error("Invalid request header (id 0x{:04X}, len {}). Disconnecting client.",
+                          header.protocol_id, header.body_length);
+            bad = true;
+            return false;
+        }
+        if (ATProtocol::HEADER_SIZE + header.body_length > conn_quota_) {
+            spdlog::error("Frame of {} bytes exceeds the connection quota of {} bytes. Disconnecting client.",
+                          ATProtocol::HEADER_SIZE + header.body_length, conn_quota_);
+            bad = true;
+            return false;
+        }
+        return available >= ATProtocol::HEADER_SIZE + header.body_length;
+    }
+
+    // Buffer for the next response frame, recycled through the buffer pool;
+    // flush_responses() hands it back once sent
+    static std::vector<uint8_t> take_tx_buffer() {
+        return BufferPool::instance().acquire(0);
+    }
+
+    // Seal a response written in place and queue it for the next flush
+    void queue_response(Connection& conn, uint32_t sequence, uint16_t flags,
+                        ResponseWriter& response, MethodMetrics& method_metrics) {
+        uint64_t t_encode = metrics_now_ns();
+        if (flags & ATProtocol::FLAG_MSGPACK) {
+            response.to_msgpack(); // answered in the request's encoding
+        }
+        if (conn.accepts_compressed && compress_threshold_ > 0 && response.compress(compress_threshold_)) {
+            flags |= ATProtocol::FLAG_COMPRESSED;
+        }
+        if (conn.cipher) {
+            flags |= ATProtocol::FLAG_SEALED; // no CRC: flush_responses seals it
+        }
+        PendingResponse pending{sequence, flags, response.finish(flags, sequence), &method_metrics, t_encode};
+        RPCTracer::instance().record(TraceStage::Encode, conn.id, sequence);
+        if (conn.tx.empty()) {
+            conn.tx_oldest_ns = t_encode;
+        }
+        conn.tx_bytes += pending.packet.size();
+        conn.tx.push_back(std::move(pending));
+    }
+
+    bool flush_due(const Connection& conn) const {
+        return !conn.tx.empty() &&
+               (conn.tx_bytes >= coalesce_max_bytes_ || metrics_now_ns() - conn.tx_oldest_ns >= coalesce_max_delay_ns_);
+    }
+
+    // Send every queued response with one gathered write and account them.
+    // Returns false when the connection should be dropped.
+    bool flush_responses(Connection& conn) {
+        if (conn.tx.empty()) {
+            return true;
+        }
+        std::vector<IoSlice>& slices = conn.tx_slices;
+        slices.clear();
+        size_t sent;
+        {
+            std::lock_guard<std::mutex> lock(conn.send_mutex);
+            for (auto& pending : conn.tx) {
+                if (conn.cipher) {
+                    // Sealed under the send lock: nonces count frames in wire order, push frames included
+                    conn.cipher->seal(pending.packet);
+                    conn.tx_bytes += FrameCipher::TAG_SIZE;
+                }
+                slices.push_back({pending.packet.data(), pending.packet.size()});
+            }
+            sent = send_all_iov(conn.socket, slices);
+        }
+        uint64_t t_sent = metrics_now_ns();
+
+        size_t accounted = 0;
+        for (const auto& pending : conn.tx) {
+            size_t bytes = std::min(pending.packet.size(), sent - accounted);
+            accounted += bytes;
+            RPCTracer::instance().record(TraceStage::SendComplete, conn.id, pending.sequence, t_sent);
+            pending.method->send.record(t_sent - pending.t_encode);
+            pending.method->bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+            if (pending.flags & ATProtocol::FLAG_ERROR) {
+                pending.method->errors.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        metrics_.response_writes.fetch_add(1, std::memory_order_relaxed);
+        metrics_.responses.fetch_add(conn.tx.size(), std::memory_order_relaxed);
+        metrics_.queue_depth.fetch_sub(static_cast<int64_t>(conn.tx.size()), std::memory_order_relaxed);
+        spdlog::debug("Flushed {} responses ({} bytes) in one write", conn.tx.size(), conn.tx_bytes);
+
+        bool ok = sent == conn.tx_bytes;
+        for (auto& pending : conn.tx) {
+            BufferPool::instance().release(std::move(pending.packet));
+        }
+        conn.tx.clear();
+        conn.tx_bytes = 0;
+        if (!ok) {
+            spdlog::error("Failed to send response packets. Disconnecting.");
+        }
+        return ok;
+    }
+
+    double perform_calculation(const std::string& func, const InlineArgs& args) {
         if (func == "add") {
             if (args.size() != 2) throw std::invalid_argument("add requires 2 arguments");
             return args[0] + args[1];
@@ -114,144 +600,458 @@ private:
         }
     }
 
-    void handle_client(socket_t client_socket) {
+    // Reactor loop of one connection: handle every complete frame already buffered
+    // (pipelined clients send several), and flush the responses together once no
+    // more input is waiting, or earlier when the size / latency budget is spent.
+    void handle_client(socket_t client_socket, uint32_t conn_id, const std::string& client) {
+    GaugeGuard connection_gauge(metrics_.connections);
+    metrics_.connections_total.fetch_add(1, std::memory_order_relaxed);
+    auto conn_ptr = std::make_shared<Connection>(client_socket, conn_id, client); // scheduled frames share it
+    Connection& conn = *conn_ptr;
+    if (!key_.empty()) {
+        conn.cipher = std::make_unique<FrameCipher>(key_, FrameCipher::Role::Server);
+    }
     try {
-        while (true) { // Keep handling requests on the same connection
-            // 1. Receive Header
-            std::vector<uint8_t> header_buffer(ATProtocol::HEADER_SIZE);
-            if (recv_all(client_socket, header_buffer, ATProtocol::HEADER_SIZE) != ATProtocol::HEADER_SIZE) {
-                spdlog::info("Client disconnected or error receiving header.");
-                break; // Client disconnected or error
+        bool open = true;
+        while (open) {
+            ATHeader header;
+            bool bad_frame = false;
+            while (open && has_frame(conn, header, bad_frame)) {
+                size_t frame_size = ATProtocol::HEADER_SIZE + header.body_length;
+                uint8_t* frame = conn.rx.data() + conn.rx_begin;
+                size_t plain_size = frame_size; // without the GCM tag once a sealed frame is opened
+                bool handshake = false;
+                if (conn.cipher) {
+                    open = open_frame(conn, frame, plain_size, handshake);
+                    if (!open || handshake) {
+                        conn.rx_begin += frame_size;
+                        continue;
+                    }
+                }
+                if (capture_.is_open()) {
+                    // Decrypted, so the capture replays against a plaintext server
+                    capture_.append(conn.id, conn.last_read_ns, frame, plain_size);
+                }
+                if (scheduler_) {
+                    open = schedule_frame(conn_ptr, frame, plain_size);
+                } else {
+                    open = process_frame(conn, conn.protocol, frame, plain_size, conn.frame_first_ns, conn.last_read_ns);
+                }
+                conn.rx_begin += frame_size;
+                // Bytes left over belong to a frame that was already arriving
+                conn.frame_first_ns = conn.last_read_ns;
+                if (open && !scheduler_ && flush_due(conn)) {
+                    open = flush_responses(conn);
+                }
+            }
+            if (!open || bad_frame) {
+                break;
+            }
+            if (scheduler_) {
+                // Workers answer; this thread only reads
+                if (!read_more(conn)) {
+                    spdlog::info("Client disconnected or error receiving data.");
+                    break;
+                }
+                continue;
+            }
+            // More pipelined input already waiting: keep gathering responses, unless
+            // reading it could block on the memory quota with answers still queued
+            if (!conn.tx.empty() && coalesce_max_bytes_ > 0 && rx_growth_needed(conn) == 0 &&
+                wait_readable(conn.socket, 0)) {
+                if (!read_more(conn)) {
+                    spdlog::info("Client disconnected or error receiving data.");
+                    break;
+                }
+                continue;
+            }
+            if (!flush_responses(conn)) {
+                break;
             }
+            if (!read_more(conn)) {
+                spdlog::info("Client disconnected or error receiving data.");
+                break;
+            }
+        }
+        if (scheduler_) {
+            wait_for_jobs(conn);
+        }
+        flush_responses(conn); // Answers already computed still go out (or are accounted as failed)
+    } catch (const std::exception& e) {
+        spdlog::error("Unhandled std::exception in handle_client: {}", e.what());
+    } catch (...) {
+         spdlog::critical("Unhandled unknown exception type in handle_client!");
+    }
+    if (scheduler_) {
+        wait_for_jobs(conn); // they write to the socket the accepting thread is about to close
+    }
+    if (conn.subscriber) {
+        shutdown_socket(conn.socket); // a push blocked on a client that stopped reading fails now
+        conn.subscriber->close();
+    }
+    rx_budget_.end_frame(conn.rx_ticket);
+    release_rx(conn.rx.size());
+    BufferPool::instance().release(std::move(conn.rx));
+    // The accepting thread closes the socket once handle_client returns
+    spdlog::info("Client connection closed.");
+    }
 
-            // 2. Parse Header to get body length
-            ATHeader temp_header;
-            std::memcpy(&temp_header, header_buffer.data(), ATProtocol::HEADER_SIZE);
+    // Sealed connections: the first frame must be the client's hello, answered
+    // at once (`handshake` set); every later one is decrypted in place. Runs on
+    // the connection's thread, in arrival order. Returns false when the
+    // connection should be dropped.
+    bool open_frame(Connection& conn, uint8_t* frame, size_t& size, bool& handshake) {
+        if (!conn.cipher->established()) {
+            handshake = true;
+            std::vector<uint8_t> reply;
+            if (!conn.cipher->accept_hello(frame, size, reply)) {
+                spdlog::error("Connection {} did not start with an encryption handshake. Disconnecting.", conn.id);
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(conn.send_mutex);
+            return send_all(conn.socket, reply) == reply.size();
+        }
+        if (!conn.cipher->open(frame, size)) {
+            spdlog::error("Connection {}: frame failed to authenticate. Disconnecting.", conn.id);
+            return false;
+        }
+        return true;
+    }
 
-            uint32_t body_len = temp_header.body_length;
+    // Hand a frame to the fair scheduler. The frame is copied (into a pooled buffer), as the receive
+    // buffer moves on; the worker runs process_frame and flushes the response
+    // under tx_mutex. Blocks while the client is at its outstanding limit.
+    // Returns false once the connection has failed or the server is stopping.
+    bool schedule_frame(const std::shared_ptr<Connection>& conn, const uint8_t* frame, size_t frame_size) {
+        if (conn->failed.load(std::memory_order_acquire)) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(conn->jobs_mutex);
+            ++conn->jobs;
+        }
+        std::vector<uint8_t> copy = BufferPool::instance().acquire(frame_size);
+        copy.assign(frame, frame + frame_size);
+        uint64_t t_first_byte = conn->frame_first_ns;
+        uint64_t t_frame = conn->last_read_ns;
+        bool queued = scheduler_->submit(conn->client, frame_size,
+            [this, conn, copy = std::move(copy), t_first_byte, t_frame]() mutable {
+                run_scheduled_frame(*conn, copy, t_first_byte, t_frame);
+                BufferPool::instance().release(std::move(copy));
+            });
+        if (!queued) {
+            job_done(*conn);
+        }
+        return queued;
+    }
 
-            // 3. Receive Body
-            std::vector<uint8_t> body_buffer(body_len);
-            if (recv_all(client_socket, body_buffer, body_len) != body_len) {
-                spdlog::error("Error receiving body data.");
-                break;
+    void run_scheduled_frame(Connection& conn, const std::vector<uint8_t>& frame, uint64_t t_first_byte, uint64_t t_frame) {
+        ATProtocol protocol; // unpack() keeps header state, so workers do not share one
+        {
+            std::lock_guard<std::mutex> lock(conn.tx_mutex);
+            if (!conn.failed.load(std::memory_order_acquire)) {
+                bool ok = process_frame(conn, protocol, frame.data(), frame.size(), t_first_byte, t_frame) &&
+                          flush_responses(conn);
+                if (!ok && !conn.failed.exchange(true)) {
+                    shutdown_socket(conn.socket); // wakes the connection's thread out of recv
+                }
             }
+        }
+        job_done(conn);
+    }
 
-            // 4. Combine Header and Body for unpacking
-            // 注意：AT_Protocol_->unpack 似乎可以直接处理分开的 header 和 body，
-            // 或者需要组合后的 full_packet。请根据你的 unpack 实现调整。
-            // 如果 unpack 需要完整包，则保留下面代码；否则可以直接用 header_buffer 和 body_buffer。
-            std::vector<uint8_t> full_packet;
-            full_packet.insert(full_packet.end(), header_buffer.begin(), header_buffer.end());
-            full_packet.insert(full_packet.end(), body_buffer.begin(), body_buffer.end());
-
-            // 5. Unpack Request
-            uint16_t flags;
-            uint32_t sequence;
-            std::string request_body_str;
-            // --- 关键修改 1: 增加 unpack 错误处理 ---
-            try {
-                 AT_Protocol_->unpack(full_packet, flags, sequence, request_body_str);
-            } catch (const std::exception& e) {
-                 spdlog::error("AT_Protocol_->unpack failed: {}. Disconnecting client.", e.what());
-                 // 如果 unpack 失败，通常意味着协议错误，很难恢复，断开连接比较安全
-                 break;
-            }
-            // --- 结束修改 1 ---
+    // The connection's push side, created on its first subscribe. Callers hold
+    // the connection (its thread, or a worker under tx_mutex).
+    std::shared_ptr<PushSubscriber> push_subscriber(Connection& conn) {
+        if (!conn.subscriber) {
+            Connection* c = &conn; // outlives the subscriber: handle_client closes it first
+            conn.subscriber = std::make_shared<PushSubscriber>(PUSH_QUEUE_FRAMES,
+                [c](const std::vector<uint8_t>& frame) {
+                    std::lock_guard<std::mutex> lock(c->send_mutex);
+                    if (c->cipher) {
+                        std::vector<uint8_t> sealed = c->cipher->seal_copy(frame); // the frame is shared
+                        return send_all(c->socket, sealed) == sealed.size();
+                    }
+                    return send_all(c->socket, frame) == frame.size();
+                },
+                [c]() {
+                    spdlog::warn("Connection {} is too slow for its subscriptions. Disconnecting.", c->id);
+                    shutdown_socket(c->socket);
+                });
+        }
+        return conn.subscriber;
+    }
+
+    void job_done(Connection& conn) {
+        std::lock_guard<std::mutex> lock(conn.jobs_mutex);
+        if (--conn.jobs == 0) {
+            conn.jobs_done.notify_all();
+        }
+    }
+
+    void wait_for_jobs(Connection& conn) {
+        std::unique_lock<std::mutex> lock(conn.jobs_mutex);
+        conn.jobs_done.wait(lock, [&conn]() { return conn.jobs == 0; });
+    }
 
-            if (!(flags & ATProtocol::FLAG_REQUEST)) {
-                spdlog::warn("Received non-request packet (Seq: {}, Flags: 0x{:04X}). Ignoring.", sequence, flags);
-                continue; // Expecting a request
+    // Decode and execute one request frame, queueing its response. Returns false
+    // when the connection should be dropped.
+    bool process_frame(Connection& conn, ATProtocol& protocol, const uint8_t* frame, size_t frame_size,
+                       uint64_t t_first_byte, uint64_t t_frame) {
+        uint32_t conn_id = conn.id;
+        uint64_t frame_bytes = frame_size;
+        // The request DOM and handler scratch live in this thread's arena, freed in one reset on return
+        RequestArena::Scope arena_scope;
+        RequestArena& arena = *RequestArena::current();
+
+        // 1. Unpack Request
+        uint16_t flags;
+        uint32_t sequence;
+        std::string_view request_body_str; // points into the receive buffer
+        // --- 关键修改 1: 增加 unpack 错误处理 ---
+        try {
+             if (!protocol.unpack(frame, frame_size, flags, sequence, request_body_str)) {
+                 return false;
+             }
+        } catch (const std::exception& e) {
+             spdlog::error("ATProtocol::unpack failed: {}. Disconnecting client.", e.what());
+             // 如果 unpack 失败，通常意味着协议错误，很难恢复，断开连接比较安全
+             return false;
+        }
+        // --- 结束修改 1 ---
+        // Expanded here, so every path below sees the plain body; frame_bytes stays what came over the wire
+        std::string inflated;
+        if (flags & ATProtocol::FLAG_COMPRESSED) {
+            if (!lz_decompress_body(reinterpret_cast<const uint8_t*>(request_body_str.data()), request_body_str.size(),
+                                    conn_quota_ - ATProtocol::HEADER_SIZE, inflated)) {
+                spdlog::error("Malformed compressed body (Seq: {}). Disconnecting client.", sequence);
+                return false;
             }
+            request_body_str = inflated;
+        }
+        if (flags & ATProtocol::FLAG_ACCEPTS_COMPRESSED) {
+            conn.accepts_compressed = true;
+        }
+        RPCTracer& tracer = RPCTracer::instance();
+        tracer.record(TraceStage::FirstByte, conn_id, sequence, t_first_byte);
+        tracer.record(TraceStage::FrameComplete, conn_id, sequence, t_frame);
+
+        if (!(flags & ATProtocol::FLAG_REQUEST)) {
+            spdlog::warn("Received non-request packet (Seq: {}, Flags: 0x{:04X}). Ignoring.", sequence, flags);
+            return true; // Expecting a request
+        }
+        // In flight until its response is flushed
+        metrics_.queue_depth.fetch_add(1, std::memory_order_relaxed);
+
+        if (flags & ATProtocol::FLAG_BINARY) {
+            process_bulk(conn, sequence, request_body_str, frame_bytes, t_frame);
+            return true;
+        }
+        if (flags & ATProtocol::FLAG_TYPED) {
+            process_typed(conn, sequence, request_body_str, frame_bytes, t_frame);
+            return true;
+        }
 
-            json request_json;
+        // A MessagePack body becomes the JSON text the path below expects; the
+        // response is re-encoded on the way out (queue_response)
+        uint16_t reply_encoding = flags & ATProtocol::FLAG_MSGPACK;
+        std::string transcoded;
+        if (reply_encoding) {
+            const uint8_t* packed = reinterpret_cast<const uint8_t*>(request_body_str.data());
             try {
-                request_json = json::parse(request_body_str);
+                transcoded = json::from_msgpack(packed, packed + request_body_str.size()).dump();
             } catch (const json::exception& e) {
-                spdlog::error("JSON parse error in request (Seq: {}): {}", sequence, e.what());
-                // Send error response
-                json error_response = {{"status", "error"}, {"message", "Invalid JSON in request"}};
-                std::string response_body = error_response.dump();
-                auto response_packet = AT_Protocol_->pack(ATProtocol::FLAG_ERROR, response_body, sequence);
-                spdlog::debug("Sending JSON parse error response ({} bytes)", response_packet.size()); // 添加日志
-                if (send_all(client_socket, response_packet) != response_packet.size()) {
-                     spdlog::error("Failed to send JSON parse error response packet (Seq: {}). Disconnecting.", sequence);
-                     break; // Assume connection issue
-                }
-                continue;
+                spdlog::error("MessagePack decode error in request (Seq: {}): {}", sequence, e.what());
             }
+            request_body_str = transcoded; // empty on failure, answered as invalid below
+        }
 
-            std::string func_name = request_json.value("func", "");
-            std::vector<double> args_vec;
+        // Fast path for the usual {"func": ..., "args": [...]} body; the DOM is only
+        // built for bodies it declines (including every malformed one)
+        FastRequest request;
+        bool fast = parse_fast_request(request_body_str, request);
+        arena_json& request_json = arena.make<arena_json>(); // dropped with the arena, not walked node by node
+        try {
+            if (!fast) request_json = arena_json::parse(request_body_str);
+        } catch (const json::exception& e) {
+            spdlog::error("JSON parse error in request (Seq: {}): {}", sequence, e.what());
+            // Send error response
+            MethodMetrics& invalid_metrics = metrics_.method("__invalid");
+            invalid_metrics.calls.fetch_add(1, std::memory_order_relaxed);
+            invalid_metrics.bytes_in.fetch_add(frame_bytes, std::memory_order_relaxed);
+            ResponseWriter error_response(take_tx_buffer());
+            error_response.error("Invalid JSON in request");
+            spdlog::debug("Sending JSON parse error response (Seq: {})", sequence); // 添加日志
+            queue_response(conn, sequence, ATProtocol::FLAG_ERROR | reply_encoding, error_response, invalid_metrics);
+            return true;
+        }
+
+        tracer.record(TraceStage::Decode, conn_id, sequence);
+        std::string func_name = fast ? std::string(request.func) : std::string(request_json.value("func", ""));
+        MethodMetrics& method_metrics = metrics_.method(func_name);
+        method_metrics.calls.fetch_add(1, std::memory_order_relaxed);
+        method_metrics.bytes_in.fetch_add(frame_bytes, std::memory_order_relaxed);
+
+        // eval and pub/sub carry their own fields and read them from the DOM themselves
+        if (!fast && func_name != EVAL_METHOD && !is_pubsub_method(func_name)) {
             try {
                 // 使用 is_array 检查更安全
-                if (!request_json.contains("args") || !request_json.at("args").is_array()) {
-                     throw json::type_error::create(302, "type must be array, but is " + std::string(request_json.at("args").type_name()), &request_json);
+                const arena_json& args = arena_at(request_json, "args");
+                if (!args.is_array()) {
+                     throw json::type_error::create(302, "type must be array, but is " + std::string(args.type_name()), &request_json);
                 }
-                for (const auto& arg : request_json.at("args")) {
+                request.args.clear(); // the fast parser may have filled some before declining
+                for (const auto& arg : args) {
                     // 检查类型更安全
                     if (!arg.is_number()) {
                          throw json::type_error::create(302, "array element type must be number", &arg);
                     }
-                    args_vec.push_back(arg.get<double>());
+                    request.args.push_back(arg.get<double>());
                 }
             } catch (const json::exception& e) {
                 spdlog::error("Error parsing arguments from JSON (Seq: {}): {}", sequence, e.what());
-                json error_response = {{"status", "error"}, {"message", "Invalid arguments format"}};
-                std::string response_body = error_response.dump();
-                auto response_packet = AT_Protocol_->pack(ATProtocol::FLAG_ERROR, response_body, sequence);
-                spdlog::debug("Sending argument parse error response ({} bytes)", response_packet.size()); // 添加日志
-                if (send_all(client_socket, response_packet) != response_packet.size()) {
-                     spdlog::error("Failed to send argument parse error response packet (Seq: {}). Disconnecting.", sequence);
-                     break; // Assume connection issue
-                }
-                continue;
+                ResponseWriter error_response(take_tx_buffer());
+                error_response.error("Invalid arguments format");
+                spdlog::debug("Sending argument parse error response (Seq: {})", sequence); // 添加日志
+                queue_response(conn, sequence, ATProtocol::FLAG_ERROR | reply_encoding, error_response, method_metrics);
+                return true;
             }
+        }
 
-            // 6. Perform Calculation and Prepare Response
-            // --- 关键修改 2: 明确初始化 response_json ---
-            json response_json = {{"status", "error"}, {"message", "Unknown error"}}; // 默认错误响应
-            uint16_t response_flags = ATProtocol::FLAG_ERROR; // 默认错误标志
-            try {
-                double result = perform_calculation(func_name, args_vec);
-                response_json = {{"status", "success"}, {"result", result}}; // 成功则覆盖
-                response_flags = ATProtocol::FLAG_RESPONSE; // 成功标志
-                spdlog::debug("Calculation successful for '{}', result: {}", func_name, result); // 添加成功日志
-            } catch (const std::exception& e) {
-                spdlog::error("Calculation error for '{}' (Seq: {}): {}", func_name, sequence, e.what());
-                response_json = {{"status", "error"}, {"message", std::string(e.what())}}; // 使用异常信息
-                // response_flags 保持 ATProtocol::FLAG_ERROR
-            } catch (...) { // 捕获所有其他异常
-                spdlog::critical("Unknown exception type caught during calculation for '{}' (Seq: {})!", func_name, sequence);
-                response_json = {{"status", "error"}, {"message", "Critical internal server error"}};
-                // response_flags 保持 ATProtocol::FLAG_ERROR
+        // 2. Perform Calculation and write the response straight into its frame
+        // --- 关键修改 2: 每个分支都写出响应 ---
+        ResponseWriter response(take_tx_buffer());
+        uint16_t response_flags = ATProtocol::FLAG_ERROR; // 默认错误标志
+        // Thread-per-connection: the "queue" is the decode/parse time between frame and handler
+        tracer.record(TraceStage::Enqueue, conn_id, sequence);
+        uint64_t t_handler = metrics_now_ns();
+        tracer.record(TraceStage::HandlerStart, conn_id, sequence, t_handler);
+        method_metrics.queue_wait.record(t_handler - t_frame);
+        if (func_name == STATS_METHOD) {
+            json stats = metrics_.to_json();
+            stats["expr_plans"] = {{"cached", expr_plans_.size()}, {"hits", expr_plans_.hits()}, {"misses", expr_plans_.misses()}};
+            stats["pubsub"] = pubsub_.stats();
+            stats["buffers"] = BufferPool::instance().stats();
+            stats["arena"] = RequestArena::stats();
+            if (scheduler_) {
+                stats["scheduler"] = {{"workers", scheduler_->workers()}, {"queued", scheduler_->queued()},
+                                      {"throttled", scheduler_->throttled()}};
             }
-            // --- 结束修改 2 ---
-
-            // 7. Pack and Send Response
-            std::string response_body = response_json.dump();
-            // response_flags 已在上面根据情况设置
-            auto response_packet = AT_Protocol_->pack(response_flags, response_body, sequence);
-
-            // --- 关键修改 3: 增强 send_all 调用的日志 ---
-            spdlog::debug("Preparing to send response (Seq: {}, Status: {}, Size: {} bytes): {}", sequence, response_json.value("status", "unknown"), response_packet.size(), response_json.dump());
-            size_t send_success = send_all(client_socket, response_packet);
-            if (send_success != response_packet.size()) {
-                spdlog::error("Failed to send response packet (Seq: {}, Status: {}). Disconnecting.", sequence, response_json.value("status", "unknown"));
-                break; // Assume connection issue
+            response.success(stats);
+            response_flags = ATProtocol::FLAG_RESPONSE;
+        } else if (func_name == TRACE_DUMP_METHOD) {
+            long long written = trace_dump_path_.empty() ? -1 : tracer.dump(trace_dump_path_);
+            if (written >= 0) {
+                response.success(json{{"path", trace_dump_path_}, {"events", written}});
+                response_flags = ATProtocol::FLAG_RESPONSE;
             } else {
-                spdlog::info("Successfully processed and sent response for request '{}' with seq {} -> {}", func_name, sequence, response_json.dump());
+                response.error("Tracing is not enabled or dump failed");
+            }
+        } else if (is_profile_method(func_name)) {
+            if (handle_profile_request(func_name, request.args, profile_output_path_, response)) {
+                response_flags = ATProtocol::FLAG_RESPONSE;
+            }
+        } else if (func_name == EVAL_METHOD) {
+            // A body the fast parser took has nothing but "args", so no expression
+            if (fast) {
+                response.error("eval needs \"expr\" or \"program\"");
+            } else if (handle_eval_request(request_json, expr_plans_, response)) {
+                response_flags = ATProtocol::FLAG_RESPONSE;
             }
-            // --- 结束修改 3 ---
+        } else if (is_pubsub_method(func_name)) {
+            if (fast) {
+                response.error(func_name + " needs \"topic\"");
+            } else if (handle_pubsub_request(func_name, request_json, pubsub_,
+                                             [this, &conn]() { return push_subscriber(conn); }, response)) {
+                response_flags = ATProtocol::FLAG_RESPONSE;
+            }
+        } else {
+        try {
+            double result = perform_calculation(func_name, request.args);
+            response.success(result);
+            response_flags = ATProtocol::FLAG_RESPONSE; // 成功标志
+            spdlog::debug("Calculation successful for '{}', result: {}", func_name, result); // 添加成功日志
+        } catch (const std::exception& e) {
+            spdlog::error("Calculation error for '{}' (Seq: {}): {}", func_name, sequence, e.what());
+            response.error(e.what()); // 使用异常信息
+            // response_flags 保持 ATProtocol::FLAG_ERROR
+        } catch (...) { // 捕获所有其他异常
+            spdlog::critical("Unknown exception type caught during calculation for '{}' (Seq: {})!", func_name, sequence);
+            response.error("Critical internal server error");
+            // response_flags 保持 ATProtocol::FLAG_ERROR
         }
-    } catch (const std::exception& e) {
-        spdlog::error("Unhandled std::exception in handle_client: {}", e.what());
-    } catch (...) {
-         spdlog::critical("Unhandled unknown exception type in handle_client!");
+        }
+        uint64_t t_handler_end = metrics_now_ns();
+        tracer.record(TraceStage::HandlerEnd, conn_id, sequence, t_handler_end);
+        method_metrics.handler.record(t_handler_end - t_handler);
+        // --- 结束修改 2 ---
+
+        // 3. Seal and queue the response; handle_client flushes it
+        spdlog::info("Processed request '{}' with seq {} -> {}", func_name, sequence, response.body());
+        queue_response(conn, sequence, response_flags | reply_encoding, response, method_metrics);
+        return true;
     }
-    // Close the client socket when done or on error
-    closesocket(client_socket); // Don't forget to close the socket
-    spdlog::info("Client connection closed.");
+
+    // Array-valued request (FLAG_BINARY, see bulk_ops.h): the kernels read the
+    // arrays in place from the receive buffer and write into the response frame
+    void process_bulk(Connection& conn, uint32_t sequence, std::string_view body, uint64_t frame_bytes, uint64_t t_frame) {
+        RPCTracer& tracer = RPCTracer::instance();
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(body.data());
+        tracer.record(TraceStage::Decode, conn.id, sequence);
+        MethodMetrics& method_metrics = metrics_.method(bulk_method_name(data, body.size()));
+        method_metrics.calls.fetch_add(1, std::memory_order_relaxed);
+        method_metrics.bytes_in.fetch_add(frame_bytes, std::memory_order_relaxed);
+
+        tracer.record(TraceStage::Enqueue, conn.id, sequence);
+        uint64_t t_handler = metrics_now_ns();
+        tracer.record(TraceStage::HandlerStart, conn.id, sequence, t_handler);
+        method_metrics.queue_wait.record(t_handler - t_frame);
+
+        ResponseWriter response(take_tx_buffer());
+        std::string error;
+        uint16_t response_flags = ATProtocol::FLAG_RESPONSE | ATProtocol::FLAG_BINARY;
+        if (!execute_bulk(data, body.size(), response, error)) {
+            spdlog::error("Bulk request error (Seq: {}): {}", sequence, error);
+            response.error(error);
+            response_flags = ATProtocol::FLAG_ERROR;
+        }
+        uint64_t t_handler_end = metrics_now_ns();
+        tracer.record(TraceStage::HandlerEnd, conn.id, sequence, t_handler_end);
+        method_metrics.handler.record(t_handler_end - t_handler);
+
+        spdlog::info("Processed bulk request with seq {} ({} bytes in, {} bytes out)", sequence, body.size(), response.body().size());
+        queue_response(conn, sequence, response_flags, response, method_metrics);
+    }
+
+    // Typed request (FLAG_TYPED, see typed_call.h): generated code decodes the
+    // arguments straight from the receive buffer, no JSON either way
+    void process_typed(Connection& conn, uint32_t sequence, std::string_view body, uint64_t frame_bytes, uint64_t t_frame) {
+        RPCTracer& tracer = RPCTracer::instance();
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(body.data());
+        tracer.record(TraceStage::Decode, conn.id, sequence);
+        MethodMetrics& method_metrics = metrics_.method(typed_methods_.method_name(data, body.size()));
+        method_metrics.calls.fetch_add(1, std::memory_order_relaxed);
+        method_metrics.bytes_in.fetch_add(frame_bytes, std::memory_order_relaxed);
+
+        tracer.record(TraceStage::Enqueue, conn.id, sequence);
+        uint64_t t_handler = metrics_now_ns();
+        tracer.record(TraceStage::HandlerStart, conn.id, sequence, t_handler);
+        method_metrics.queue_wait.record(t_handler - t_frame);
+
+        ResponseWriter response(take_tx_buffer());
+        std::string error;
+        uint16_t response_flags = ATProtocol::FLAG_RESPONSE | ATProtocol::FLAG_TYPED;
+        if (!typed_methods_.execute(data, body.size(), response, error)) {
+            spdlog::error("Typed request error (Seq: {}): {}", sequence, error);
+            response.error(error);
+            response_flags = ATProtocol::FLAG_ERROR;
+        }
+        uint64_t t_handler_end = metrics_now_ns();
+        tracer.record(TraceStage::HandlerEnd, conn.id, sequence, t_handler_end);
+        method_metrics.handler.record(t_handler_end - t_handler);
+
+        spdlog::info("Processed typed request with seq {} ({} bytes in, {} bytes out)", sequence, body.size(), response.body().size());
+        queue_response(conn, sequence, response_flags, response, method_metrics);
     }
 };
 
@@ -0,0 +1,189 @@
+// rpc_trace.cpp
+#include "rpc_trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <spdlog/spdlog.h>
+
+const char* trace_stage_name(TraceStage stage) {
+    switch (stage) {
+        case TraceStage::Accept:        return "accept";
+        case TraceStage::FirstByte:     return "first_byte";
+        case TraceStage::FrameComplete: return "frame_complete";
+        case TraceStage::Decode:        return "decode";
+        case TraceStage::Enqueue:       return "enqueue";
+        case TraceStage::HandlerStart:  return "handler_start";
+        case TraceStage::HandlerEnd:    return "handler_end";
+        case TraceStage::Encode:        return "encode";
+        case TraceStage::SendComplete:  return "send_complete";
+        default:                        return "unknown";
+    }
+}
+
+void TraceRing::snapshot(std::vector<TraceEvent>& out) const {
+    uint64_t end = head_.load(std::memory_order_acquire);
+    uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+    size_t first = out.size();
+    for (uint64_t i = begin; i < end; ++i) {
+        out.push_back(events_[i & (CAPACITY - 1)]);
+    }
+    // Anything the writer lapped while we were copying is unreliable
+    uint64_t now = head_.load(std::memory_order_acquire);
+    if (now > CAPACITY && now - CAPACITY > begin) {
+        size_t torn = static_cast<size_t>(std::min<uint64_t>(now - CAPACITY - begin, end - begin));
+        out.erase(out.begin() + first, out.begin() + first + torn);
+    }
+}
+
+RPCTracer& RPCTracer::instance() {
+    static RPCTracer tracer;
+    return tracer;
+}
+
+// Returns the ring to the tracer when its thread exits
+struct TraceRingHandle {
+    TraceRing* ring = nullptr;
+    ~TraceRingHandle() {
+        if (ring) RPCTracer::instance().release_ring(ring);
+    }
+};
+
+TraceRing& RPCTracer::local_ring() {
+    thread_local TraceRingHandle handle;
+    if (!handle.ring) {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        if (!free_rings_.empty()) {
+            handle.ring = free_rings_.back();
+            free_rings_.pop_back();
+        } else {
+            rings_.push_back(std::make_unique<TraceRing>());
+            handle.ring = rings_.back().get();
+        }
+    }
+    return *handle.ring;
+}
+
+void RPCTracer::release_ring(TraceRing* ring) {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    free_rings_.push_back(ring);
+}
+
+uint32_t RPCTracer::thread_id() {
+    static std::atomic<uint32_t> next_id{1};
+    thread_local uint32_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+long long RPCTracer::dump(const std::string& path) {
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (const auto& ring : rings_) ring->snapshot(events);
+    }
+    std::sort(events.begin(), events.end(),
+              [](const TraceEvent& a, const TraceEvent& b) { return a.ts_ns < b.ts_ns; });
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        spdlog::error("Cannot open trace dump file {}", path);
+        return -1;
+    }
+    uint32_t file_header[4] = {FILE_MAGIC, FILE_VERSION, static_cast<uint32_t>(sizeof(TraceEvent)),
+                               static_cast<uint32_t>(events.size())};
+    out.write(reinterpret_cast<const char*>(file_header), sizeof(file_header));
+    out.write(reinterpret_cast<const char*>(events.data()),
+              static_cast<std::streamsize>(events.size() * sizeof(TraceEvent)));
+    if (!out) {
+        spdlog::error("Failed writing trace dump {}", path);
+        return -1;
+    }
+    spdlog::info("Wrote {} trace events to {}", events.size(), path);
+    return static_cast<long long>(events.size());
+}
+
+namespace {
+// Name of the span that ends at the given stage (empty: no span)
+const char* span_ending_at(TraceStage stage) {
+    switch (stage) {
+        case TraceStage::FrameComplete: return "recv";
+        case TraceStage::Decode:        return "decode";
+        case TraceStage::Enqueue:       return "enqueue";
+        case TraceStage::HandlerStart:  return "queue";
+        case TraceStage::HandlerEnd:    return "handler";
+        case TraceStage::Encode:        return "encode";
+        case TraceStage::SendComplete:  return "send";
+        default:                        return "";
+    }
+}
+} // namespace
+
+bool trace_dump_to_chrome(const std::string& dump_path, const std::string& json_path) {
+    std::ifstream in(dump_path, std::ios::binary);
+    if (!in) {
+        spdlog::error("Cannot open trace dump {}", dump_path);
+        return false;
+    }
+    uint32_t file_header[4] = {0, 0, 0, 0};
+    in.read(reinterpret_cast<char*>(file_header), sizeof(file_header));
+    if (!in || file_header[0] != RPCTracer::FILE_MAGIC || file_header[2] != sizeof(TraceEvent)) {
+        spdlog::error("{} is not an AT trace dump", dump_path);
+        return false;
+    }
+    std::vector<TraceEvent> events(file_header[3]);
+    in.read(reinterpret_cast<char*>(events.data()),
+            static_cast<std::streamsize>(events.size() * sizeof(TraceEvent)));
+    if (!in) {
+        spdlog::error("Trace dump {} is truncated", dump_path);
+        return false;
+    }
+
+    // Group per request; sequence 0 carries connection-level events
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<TraceEvent>> requests;
+    uint64_t base_ns = events.empty() ? 0 : events.front().ts_ns;
+    for (const auto& ev : events) {
+        base_ns = std::min(base_ns, ev.ts_ns);
+        requests[{ev.conn_id, ev.sequence}].push_back(ev);
+    }
+
+    auto to_us = [base_ns](uint64_t ts) { return static_cast<double>(ts - base_ns) / 1000.0; };
+    json trace_events = json::array();
+    for (auto& [key, evs] : requests) {
+        std::sort(evs.begin(), evs.end(),
+                  [](const TraceEvent& a, const TraceEvent& b) { return a.ts_ns < b.ts_ns; });
+        json args = {{"conn", key.first}, {"seq", key.second}};
+        for (size_t i = 0; i < evs.size(); ++i) {
+            auto stage = static_cast<TraceStage>(evs[i].stage);
+            if (stage == TraceStage::Accept) {
+                trace_events.push_back({{"name", "accept"}, {"ph", "i"}, {"s", "t"}, {"pid", 1},
+                                        {"tid", evs[i].thread_id}, {"ts", to_us(evs[i].ts_ns)}, {"args", args}});
+                continue;
+            }
+            const char* span = span_ending_at(stage);
+            if (i == 0 || span[0] == '\0') continue;
+            trace_events.push_back({{"name", span}, {"cat", "rpc"}, {"ph", "X"}, {"pid", 1},
+                                    {"tid", evs[i].thread_id}, {"ts", to_us(evs[i - 1].ts_ns)},
+                                    {"dur", to_us(evs[i].ts_ns) - to_us(evs[i - 1].ts_ns)}, {"args", args}});
+        }
+        // Whole request on a per-connection lane, so queueing across threads stays visible
+        if (key.second != 0 && evs.size() > 1) {
+            trace_events.push_back({{"name", "request"}, {"cat", "rpc"}, {"ph", "X"}, {"pid", 2},
+                                    {"tid", key.first}, {"ts", to_us(evs.front().ts_ns)},
+                                    {"dur", to_us(evs.back().ts_ns) - to_us(evs.front().ts_ns)}, {"args", args}});
+        }
+    }
+
+    json root = {
+        {"traceEvents", trace_events},
+        {"displayTimeUnit", "ns"},
+        {"metadata", {{"source", dump_path}, {"events", events.size()}}}
+    };
+    std::ofstream out(json_path, std::ios::trunc);
+    if (!out) {
+        spdlog::error("Cannot open {} for writing", json_path);
+        return false;
+    }
+    out << root.dump();
+    spdlog::info("Converted {} events ({} requests) to {}", events.size(), requests.size(), json_path);
+    return static_cast<bool>(out);
+}
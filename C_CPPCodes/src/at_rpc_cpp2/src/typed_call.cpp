@@ -0,0 +1,92 @@
+// typed_call.cpp
+#include "typed_call.h"
+#include "response_writer.h"
+#include <stdexcept>
+
+uint8_t* TypedWriter::reserve(size_t size) {
+    if (response_ != nullptr) {
+        return response_->binary(size);
+    }
+    size_t offset = vector_->size();
+    vector_->resize(offset + size);
+    return vector_->data() + offset;
+}
+
+void TypedWriter::write_string(std::string_view text) {
+    write_u32(static_cast<uint32_t>(text.size()));
+    if (!text.empty()) {
+        std::memcpy(reserve(text.size()), text.data(), text.size());
+    }
+}
+
+bool TypedReader::read_bool(bool& value) {
+    uint8_t byte;
+    if (!get(byte) || byte > 1) {
+        return false;
+    }
+    value = byte != 0;
+    return true;
+}
+
+bool TypedReader::read_string(std::string& text) {
+    uint32_t length;
+    if (!read_u32(length) || length > remaining()) {
+        return false;
+    }
+    text.assign(reinterpret_cast<const char*>(data_ + pos_), length);
+    pos_ += length;
+    return true;
+}
+
+void TypedRegistry::add(uint32_t method_id, const std::string& name, Handler handler) {
+    auto it = methods_.find(method_id);
+    if (it != methods_.end()) {
+        throw std::logic_error("Typed method '" + name + "' collides with '" + it->second.name + "' (id " +
+                               std::to_string(method_id) + ")");
+    }
+    methods_.emplace(method_id, Method{name, "typed." + name, std::move(handler)});
+}
+
+const TypedRegistry::Method* TypedRegistry::find(const uint8_t* body, size_t size) const {
+    TypedCallHeader header;
+    if (size < sizeof(header)) {
+        return nullptr;
+    }
+    std::memcpy(&header, body, sizeof(header));
+    auto it = methods_.find(header.method_id);
+    return it == methods_.end() ? nullptr : &it->second;
+}
+
+const std::string& TypedRegistry::method_name(const uint8_t* body, size_t size) const {
+    static const std::string unknown = "typed.unknown";
+    const Method* method = find(body, size);
+    return method ? method->metric_name : unknown;
+}
+
+bool TypedRegistry::execute(const uint8_t* body, size_t size, ResponseWriter& response, std::string& error) const {
+    if (size < sizeof(TypedCallHeader)) {
+        error = "Typed request too short";
+        return false;
+    }
+    const Method* method = find(body, size);
+    if (method == nullptr) {
+        TypedCallHeader header;
+        std::memcpy(&header, body, sizeof(header));
+        error = "Unknown typed method id " + std::to_string(header.method_id);
+        return false;
+    }
+    TypedReader args(body + sizeof(TypedCallHeader), size - sizeof(TypedCallHeader));
+    TypedWriter result(response);
+    try {
+        // Generated handlers decode everything first and only write the result
+        // once the method returned, so a failure leaves the response empty
+        if (!method->handler(args, result)) {
+            error = "Malformed arguments for '" + method->name + "'";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+        return false;
+    }
+    return true;
+}
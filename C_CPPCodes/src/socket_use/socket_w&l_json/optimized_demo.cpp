@@ -14,6 +14,7 @@
 #include <vector>
 #include <memory>
 #include <atomic>
+#include <csignal>
 
 // 全局变量用于控制程序退出
 std::atomic<bool> g_running{true};
@@ -301,17 +302,35 @@ void signalHandler(int signal) {
     g_running.store(false);
 }
 
-int main() {
-    std::cout << "=== 优化的Socket通讯演示程序 ===" << std::endl;
-    std::cout << "版本: 2.0 - 使用类封装优化" << std::endl;
-    std::cout << "作者: cch" << std::endl;
-    std::cout << "日期: 2024-12-08" << std::endl;
-    
+// 非交互的服务器模式：一直运行到收到 SIGINT / SIGTERM，供脚本和压测工具（at_rpc_bench）启动
+int runServerOnly() {
+    OptimizedServer server("127.0.0.1", 6006);
+    if (!server.start()) {
+        std::cerr << "服务器启动失败！" << std::endl;
+        return 1;
+    }
+    while (g_running.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    server.stop();
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
     // 设置信号处理
     #ifdef __linux__
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
     #endif
+
+    if (argc > 1 && std::string(argv[1]) == "server") {
+        return runServerOnly();
+    }
+
+    std::cout << "=== 优化的Socket通讯演示程序 ===" << std::endl;
+    std::cout << "版本: 2.0 - 使用类封装优化" << std::endl;
+    std::cout << "作者: cch" << std::endl;
+    std::cout << "日期: 2024-12-08" << std::endl;
     
     while (g_running.load()) {
         std::cout << "\n请选择演示模式:" << std::endl;
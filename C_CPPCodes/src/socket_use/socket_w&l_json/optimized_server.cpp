@@ -218,14 +218,13 @@ void OptimizedServer::handleClient(std::unique_ptr<ClientInfo> client) {
     const int bufferSize = 1024;
     char buffer[bufferSize];
     
-    // 添加到客户端列表
+    // 添加到客户端列表；先取出自己的指针，clients.back() 可能已是其他线程刚加入的客户端
+    ClientInfo* clientRef = client.get();
     {
         std::lock_guard<std::mutex> lock(clientsMutex);
         clients.push_back(std::move(client));
     }
     
-    auto& clientRef = clients.back();
-    
     while (clientRef->isConnected.load() && running.load()) {
         memset(buffer, 0, bufferSize);
         int bytesReceived = recv(clientRef->socket, buffer, bufferSize - 1, 0);
@@ -260,7 +259,14 @@ void OptimizedServer::handleClient(std::unique_ptr<ClientInfo> client) {
         }
     }
     
-    // 移除客户端
+    // 关闭连接并移除客户端（stop() 已关闭的不再重复关闭）
+    if (clientRef->isConnected.exchange(false)) {
+        #ifdef __linux__
+        close(clientRef->socket);
+        #elif _WIN32
+        closesocket(clientRef->socket);
+        #endif
+    }
     removeClient(clientRef->clientId);
 }
 